@@ -0,0 +1,818 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BENCH_HAS_DEVNULL
+#endif
+
+#include "assembler.h"
+#include "loader.h"
+#include "perf.h"
+#include "vm.h"
+
+#define DEFAULT_REPEAT 5
+#define MAX_SOURCE 8192
+#define ASSEMBLER_LINES 20000
+#define VM_CREATE_COUNT 500
+
+typedef enum {
+    BENCH_MICRO,
+    BENCH_MACRO,
+} BenchCategory;
+
+typedef struct {
+    const char* name;
+    BenchCategory category;
+    const char* source;  // Guest program, prefixed with ".equ N, <n>"
+    int n;
+    int (*check)(VM* vm);  // Returns 0 if the guest computed the right result
+    bool quiet;            // Guest writes to stdout, silence it while timing
+    const VMConfig* config;  // NULL for the default VM
+} GuestBench;
+
+typedef struct {
+    const char* name;
+    const char* category;
+    const char* unit;
+    unsigned long long ops;
+    double min_ns;
+    double median_ns;
+    bool has_mips;
+
+    // Hardware counters, summed over runs and averaged by summarize()
+    uint64_t counters[PERF_COUNTER_COUNT];
+} BenchResult;
+
+// NULL when counters are disabled or none is available
+static PerfCounters* perf;
+
+static const char DISPATCH_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "loop:\n"
+    "    nop\n"
+    "    nop\n"
+    "    nop\n"
+    "    nop\n"
+    "    nop\n"
+    "    nop\n"
+    "    nop\n"
+    "    nop\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+static const char ARITH_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "    mov ax, 1\n"
+    "    mov bx, 3\n"
+    "loop:\n"
+    "    add ax, bx\n"
+    "    sub ax, 1\n"
+    "    mul ax, 3\n"
+    "    xor ax, bx\n"
+    "    and ax, 0xFFFF\n"
+    "    or ax, 1\n"
+    "    div ax, 2\n"
+    "    inc ax\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+static const char MEMORY_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "    mov bx, 0x2000\n"
+    "loop:\n"
+    "    mov [bx], cx\n"
+    "    mov [bx+1], cx\n"
+    "    mov ax, [bx]\n"
+    "    mov dx, [bx+1]\n"
+    "    mov [bx+2], ax\n"
+    "    mov si, [bx+2]\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+static const char CALL_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "loop:\n"
+    "    call leaf\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n"
+    "leaf:\n"
+    "    ret\n";
+
+static const char BRANCH_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "    mov ax, 0\n"
+    "loop:\n"
+    "    xor ax, 1\n"
+    "    cmp ax, 0\n"
+    "    jz even\n"
+    "    inc dx\n"
+    "    jmp next\n"
+    "even:\n"
+    "    inc si\n"
+    "next:\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+// BRANCH_SOURCE with the flag-free branches: CJMP for the test, LOOP for
+// the counter
+static const char LOOP_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "    mov ax, 0\n"
+    "loop:\n"
+    "    xor ax, 1\n"
+    "    cjmp eq, ax, 0, even\n"
+    "    inc dx\n"
+    "    jmp next\n"
+    "even:\n"
+    "    inc si\n"
+    "next:\n"
+    "    loop cx, loop\n"
+    "    halt\n";
+
+static const char IO_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "loop:\n"
+    "    preg cx\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+// Count primes below N
+static const char SIEVE_SOURCE[] =
+    ".equ flags, 0x2000\n"
+    "start:\n"
+    "    mov ax, 0\n"
+    "    mov si, 2\n"
+    "outer:\n"
+    "    cmp si, N\n"
+    "    jge done\n"
+    "    mov dx, [flags + si]\n"
+    "    cmp dx, 0\n"
+    "    jnz next\n"
+    "    inc ax\n"
+    "    mov di, si\n"
+    "    mul di, si\n"
+    "inner:\n"
+    "    cmp di, N\n"
+    "    jge next\n"
+    "    mov [flags + di], 1\n"
+    "    add di, si\n"
+    "    jmp inner\n"
+    "next:\n"
+    "    inc si\n"
+    "    jmp outer\n"
+    "done:\n"
+    "    halt\n";
+
+// Naive recursive Fibonacci of N
+static const char FIB_SOURCE[] =
+    "start:\n"
+    "    mov ax, N\n"
+    "    call fib\n"
+    "    halt\n"
+    "fib:\n"
+    "    cmp ax, 2\n"
+    "    jl fib_base\n"
+    "    push ax\n"
+    "    dec ax\n"
+    "    call fib\n"
+    "    pop bx\n"
+    "    push ax\n"
+    "    mov ax, bx\n"
+    "    sub ax, 2\n"
+    "    call fib\n"
+    "    pop bx\n"
+    "    add ax, bx\n"
+    "    ret\n"
+    "fib_base:\n"
+    "    ret\n";
+
+// Copy a packed zero-terminated string N times, a byte at a time
+static const char STRCPY_SOURCE[] =
+    ".data 0x2000\n"
+    "src: .string \"The quick brown fox jumps over the lazy dog, "
+    "then naps in the sun for a while.\"\n"
+    ".text\n"
+    ".equ dst, 0x3000\n"
+    "start:\n"
+    "    mov cx, N\n"
+    "outer:\n"
+    "    mov si, src\n"
+    "    mul si, 4\n"
+    "    mov di, dst\n"
+    "    mul di, 4\n"
+    "copy:\n"
+    "    ldb ax, [si]\n"
+    "    stb [di], ax\n"
+    "    inc si\n"
+    "    inc di\n"
+    "    cmp ax, 0\n"
+    "    jnz copy\n"
+    "    dec cx\n"
+    "    jnz outer\n"
+    "    halt\n";
+
+// Allocate, touch and free blocks of two size classes
+static const char ALLOC_SOURCE[] =
+    "start:\n"
+    "    mov cx, N\n"
+    "loop:\n"
+    "    alloc ax, 4\n"
+    "    alloc bx, 24\n"
+    "    mov [ax], cx\n"
+    "    mov [bx + 23], cx\n"
+    "    free ax\n"
+    "    free bx\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+// Random reads over 64 MiB of guest memory, from a linear congruential
+// generator, to expose TLB misses
+static const char GATHER_SOURCE[] =
+    ".equ MASK, 0xFFFFFF\n"
+    "start:\n"
+    "    mov cx, N\n"
+    "    mov bx, 12345\n"
+    "loop:\n"
+    "    mul bx, 1103515245\n"
+    "    add bx, 12345\n"
+    "    mov si, bx\n"
+    "    and si, MASK\n"
+    "    add ax, [si]\n"
+    "    dec cx\n"
+    "    jnz loop\n"
+    "    halt\n";
+
+static const VMConfig GATHER_CONFIG = {1 << 24, false, 0, CALL_STACK_DEPTH};
+static const VMConfig GATHER_HUGE_CONFIG = {1 << 24, true, 0,
+                                            CALL_STACK_DEPTH};
+
+// C = A * B for N x N matrices with A[k] = k & 7 and B[k] = (3 * k) & 7
+static const char MATMUL_SOURCE[] =
+    ".equ A, 0x2000\n"
+    ".equ B, 0x3000\n"
+    ".equ C, 0x4000\n"
+    ".equ LIMIT, 0x1F00\n"
+    "start:\n"
+    "    mov si, 0\n"
+    "    mov cx, N\n"
+    "    mul cx, N\n"
+    "    mov [LIMIT], cx\n"
+    "init:\n"
+    "    mov ax, si\n"
+    "    and ax, 7\n"
+    "    mov [A + si], ax\n"
+    "    mov ax, si\n"
+    "    mul ax, 3\n"
+    "    and ax, 7\n"
+    "    mov [B + si], ax\n"
+    "    inc si\n"
+    "    cmp si, cx\n"
+    "    jl init\n"
+    "    mov si, 0\n"  // si = i * N, the start of row i
+    "iloop:\n"
+    "    mov di, 0\n"
+    "jloop:\n"
+    "    mov dx, 0\n"
+    "    mov cx, 0\n"
+    "    mov bx, di\n"  // bx = k * N + j walks column j of B
+    "kloop:\n"
+    "    mov ax, [A + si + cx]\n"
+    "    mul ax, [B + bx]\n"
+    "    add dx, ax\n"
+    "    add bx, N\n"
+    "    inc cx\n"
+    "    cmp cx, N\n"
+    "    jl kloop\n"
+    "    mov [C + si + di], dx\n"
+    "    inc di\n"
+    "    cmp di, N\n"
+    "    jl jloop\n"
+    "    add si, N\n"
+    "    cmp si, [LIMIT]\n"
+    "    jl iloop\n"
+    "    halt\n";
+
+static int check_none(VM* vm) {
+    (void)vm;
+    return 0;
+}
+
+static int check_sieve(VM* vm) {
+    return vm->cpu.registers[R_AX] == 1028 ? 0 : -1;  // Primes below 8192
+}
+
+static int check_fib(VM* vm) {
+    return vm->cpu.registers[R_AX] == 17711 ? 0 : -1;  // fib(22)
+}
+
+static int check_strcpy(VM* vm) {
+    const char* src = (const char*)memory_bytes(&vm->memory) + 0x2000 * 4;
+    const char* dst = (const char*)memory_bytes(&vm->memory) + 0x3000 * 4;
+    return strcmp(src, dst) == 0 && strlen(src) > 0 ? 0 : -1;
+}
+
+static int check_matmul(VM* vm) {
+    const int n = 24;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            int sum = 0;
+            for (int k = 0; k < n; k++) {
+                sum += ((i * n + k) & 7) * ((3 * (k * n + j)) & 7);
+            }
+            if ((int)vm->memory.data[0x4000 + i * n + j] != sum) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static const GuestBench GUEST_BENCHES[] = {
+    {"dispatch", BENCH_MICRO, DISPATCH_SOURCE, 200000, check_none, false, NULL},
+    {"arith", BENCH_MICRO, ARITH_SOURCE, 200000, check_none, false, NULL},
+    {"memory", BENCH_MICRO, MEMORY_SOURCE, 200000, check_none, false, NULL},
+    {"call_ret", BENCH_MICRO, CALL_SOURCE, 300000, check_none, false, NULL},
+    {"branch", BENCH_MICRO, BRANCH_SOURCE, 200000, check_none, false, NULL},
+    {"loop_cjmp", BENCH_MICRO, LOOP_SOURCE, 200000, check_none, false, NULL},
+    {"io", BENCH_MICRO, IO_SOURCE, 50000, check_none, true, NULL},
+    {"alloc", BENCH_MICRO, ALLOC_SOURCE, 200000, check_none, false, NULL},
+    {"sieve", BENCH_MACRO, SIEVE_SOURCE, 8192, check_sieve, false, NULL},
+    {"fib", BENCH_MACRO, FIB_SOURCE, 22, check_fib, false, NULL},
+    {"strcpy", BENCH_MACRO, STRCPY_SOURCE, 5000, check_strcpy, false, NULL},
+    {"matmul", BENCH_MACRO, MATMUL_SOURCE, 24, check_matmul, false, NULL},
+    {"gather", BENCH_MACRO, GATHER_SOURCE, 500000, check_none, false,
+     &GATHER_CONFIG},
+    {"gather_huge", BENCH_MACRO, GATHER_SOURCE, 500000, check_none, false,
+     &GATHER_HUGE_CONFIG},
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double measure_begin(void) {
+    if (perf) {
+        perf_counters_start(perf);
+    }
+    return now_ns();
+}
+
+static double measure_end(double start, BenchResult* result) {
+    double elapsed = now_ns() - start;
+    if (perf) {
+        perf_counters_stop(perf);
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            result->counters[i] += perf->values[i];
+        }
+    }
+    return elapsed;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void summarize(double* samples, int count, BenchResult* result) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    result->min_ns = samples[0];
+    result->median_ns = samples[count / 2];
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        result->counters[i] /= (uint64_t)count;
+    }
+}
+
+// Redirect stdout to /dev/null while a chatty guest runs
+static int silence_stdout(void) {
+#ifdef BENCH_HAS_DEVNULL
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (saved < 0 || devnull < 0) {
+        return -1;
+    }
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+    return saved;
+#else
+    return -1;
+#endif
+}
+
+static void restore_stdout(int saved) {
+#ifdef BENCH_HAS_DEVNULL
+    if (saved >= 0) {
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+#else
+    (void)saved;
+#endif
+}
+
+static unsigned long long count_instructions(VM* vm) {
+    unsigned long long count = 0;
+    while (vm->cpu.ip >= 0 && vm->cpu.ip < vm->program_size) {
+        if (vm_step(vm) != VM_SUCCESS) {
+            return 0;
+        }
+        count++;
+    }
+    return count;
+}
+
+static int run_guest_bench(const GuestBench* bench, int repeat,
+                           BenchResult* result) {
+    memset(result, 0, sizeof(*result));
+    char source[MAX_SOURCE];
+    snprintf(source, sizeof(source), ".equ N, %d\n%s", bench->n,
+             bench->source);
+
+    Program* program = assemble_from_string(source);
+    if (!program) {
+        fprintf(stderr, "[ANVIL] Error: Failed to assemble benchmark '%s'!\n",
+                bench->name);
+        return -1;
+    }
+
+    result->name = bench->name;
+    result->category = bench->category == BENCH_MICRO ? "micro" : "macro";
+    result->unit = "instruction";
+    result->has_mips = true;
+
+    // Count retired instructions once, untimed, with single stepping
+    int saved = bench->quiet ? silence_stdout() : -1;
+    VMConfig config = bench->config ? *bench->config : vm_default_config();
+    VM* vm = load_program_with_config(program, &config);
+    result->ops = vm ? count_instructions(vm) : 0;
+    int status = vm && result->ops > 0 ? bench->check(vm) : -1;
+    vm_destroy(vm);
+
+    double* samples = malloc(sizeof(double) * repeat);
+    for (int r = 0; status == 0 && samples && r < repeat; r++) {
+        vm = load_program_with_config(program, &config);
+        if (!vm) {
+            status = -1;
+            break;
+        }
+
+        double start = measure_begin();
+        VMError err = vm_run(vm);
+        samples[r] = measure_end(start, result);
+
+        if (err != VM_SUCCESS || bench->check(vm) != 0) {
+            status = -1;
+        }
+        vm_destroy(vm);
+    }
+    restore_stdout(saved);
+
+    if (status == 0 && samples) {
+        summarize(samples, repeat, result);
+    } else {
+        fprintf(stderr, "[ANVIL] Error: Benchmark '%s' produced a wrong "
+                        "result!\n",
+                bench->name);
+        status = -1;
+    }
+
+    free(samples);
+    program_destroy(program);
+    return status;
+}
+
+static char* build_assembler_source(int lines, size_t* length) {
+    size_t capacity = (size_t)lines * 32;
+    char* source = malloc(capacity);
+    if (!source) {
+        return NULL;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < lines; i++) {
+        switch (i % 8) {
+            case 0:
+                len += snprintf(source + len, capacity - len, "l%d:\n", i);
+                break;
+            case 1:
+                len += snprintf(source + len, capacity - len,
+                                "    mov ax, %d\n", i);
+                break;
+            case 2:
+                len += snprintf(source + len, capacity - len,
+                                "    add ax, bx\n");
+                break;
+            case 3:
+                len += snprintf(source + len, capacity - len,
+                                "    mov [bx+%d], ax\n", i & 0xFF);
+                break;
+            case 4:
+                len += snprintf(source + len, capacity - len,
+                                "    cmp ax, cx ; compare\n");
+                break;
+            case 5:
+                len += snprintf(source + len, capacity - len, "    jnz l%d\n",
+                                i - 5);
+                break;
+            case 6:
+                len += snprintf(source + len, capacity - len,
+                                "    call l%d\n",
+                                i + 10 < lines ? (i + 10) & ~7 : 0);
+                break;
+            default:
+                len += snprintf(source + len, capacity - len, "    nop\n");
+                break;
+        }
+    }
+    len += snprintf(source + len, capacity - len, "l%d:\n    halt\n", lines);
+
+    *length = len;
+    return source;
+}
+
+static int run_assembler_bench(int repeat, BenchResult* result) {
+    memset(result, 0, sizeof(*result));
+    size_t length;
+    char* source = build_assembler_source(ASSEMBLER_LINES, &length);
+    double* samples = malloc(sizeof(double) * repeat);
+    if (!source || !samples) {
+        free(source);
+        free(samples);
+        return -1;
+    }
+
+    int status = 0;
+    for (int r = 0; r < repeat; r++) {
+        double start = measure_begin();
+        Program* program = assemble_from_string(source);
+        samples[r] = measure_end(start, result);
+
+        if (!program) {
+            status = -1;
+            break;
+        }
+        program_destroy(program);
+    }
+
+    if (status == 0) {
+        result->name = "assemble";
+        result->category = "micro";
+        result->unit = "line";
+        result->ops = ASSEMBLER_LINES + 2;
+        result->has_mips = false;
+        summarize(samples, repeat, result);
+    }
+
+    free(samples);
+    free(source);
+    return status;
+}
+
+static int run_vm_create_bench(int repeat, bool init_only,
+                               BenchResult* result) {
+    memset(result, 0, sizeof(*result));
+    Instruction halt = {0};
+    halt.opcode = OP_HALT;
+
+    double* samples = malloc(sizeof(double) * repeat);
+    VM* reused = malloc(sizeof(VM));
+    if (!samples || !reused) {
+        free(samples);
+        free(reused);
+        return -1;
+    }
+
+    int status = 0;
+    for (int r = 0; r < repeat && status == 0; r++) {
+        double start = measure_begin();
+        for (int i = 0; i < VM_CREATE_COUNT; i++) {
+            if (init_only) {
+                if (vm_init(reused, &halt, 1, NULL, 0) != VM_SUCCESS) {
+                    status = -1;
+                    break;
+                }
+                vm_release(reused);
+            } else {
+                VM* vm = vm_create(&halt, 1, NULL, 0);
+                if (!vm) {
+                    status = -1;
+                    break;
+                }
+                vm_destroy(vm);
+            }
+        }
+        samples[r] = measure_end(start, result);
+    }
+
+    if (status == 0) {
+        result->name = init_only ? "vm_init" : "vm_create";
+        result->category = "micro";
+        result->unit = init_only ? "init" : "create";
+        result->ops = VM_CREATE_COUNT;
+        result->has_mips = false;
+        summarize(samples, repeat, result);
+    }
+
+    free(reused);
+    free(samples);
+    return status;
+}
+
+static bool selected(const char* name, int argc, char** filters) {
+    if (argc == 0) {
+        return true;
+    }
+    for (int i = 0; i < argc; i++) {
+        if (strstr(name, filters[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_rate(const BenchResult* r, PerfCounterId id, double scale,
+                       int width, int precision) {
+    if (perf_counter_available(perf, id)) {
+        printf(" %*.*f", width, precision,
+               scale * (double)r->counters[id] / (double)r->ops);
+    } else {
+        printf(" %*s", width, "n/a");
+    }
+}
+
+static void print_text(const BenchResult* results, int count) {
+    printf("%-12s %-6s %12s %14s %12s %10s\n", "benchmark", "kind", "ops",
+           "median ns", "ns/op", "MIPS");
+    for (int i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        double ns_per_op = r->median_ns / (double)r->ops;
+        printf("%-12s %-6s %12llu %14.0f %12.2f", r->name, r->category,
+               r->ops, r->median_ns, ns_per_op);
+        if (r->has_mips) {
+            printf(" %10.1f", 1e3 / ns_per_op);
+        }
+        printf("\n");
+    }
+
+    if (!perf) {
+        printf("\nHardware counters unavailable\n");
+        return;
+    }
+
+    // Per-run averages; rates are per benchmark op
+    printf("\n%-12s %10s %8s %14s %14s %14s\n", "benchmark", "cycles/op",
+           "IPC", "br-miss/kop", "L1d-miss/kop", "L1i-miss/kop");
+    for (int i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        printf("%-12s", r->name);
+        print_rate(r, PERF_CYCLES, 1.0, 10, 2);
+        if (perf_counter_available(perf, PERF_CYCLES) &&
+            perf_counter_available(perf, PERF_INSTRUCTIONS) &&
+            r->counters[PERF_CYCLES] > 0) {
+            printf(" %8.2f", (double)r->counters[PERF_INSTRUCTIONS] /
+                                 (double)r->counters[PERF_CYCLES]);
+        } else {
+            printf(" %8s", "n/a");
+        }
+        print_rate(r, PERF_BRANCH_MISSES, 1e3, 14, 3);
+        print_rate(r, PERF_L1D_MISSES, 1e3, 14, 3);
+        print_rate(r, PERF_L1I_MISSES, 1e3, 14, 3);
+        printf("\n");
+    }
+}
+
+static void print_json(const BenchResult* results, int count, int repeat) {
+    printf("{\"suite\":\"anvil\",\"repeat\":%d,\"benchmarks\":[", repeat);
+    for (int i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        double ns_per_op = r->median_ns / (double)r->ops;
+        printf("%s{\"name\":\"%s\",\"category\":\"%s\",\"unit\":\"%s\","
+               "\"ops\":%llu,\"min_ns\":%.0f,\"median_ns\":%.0f,"
+               "\"ns_per_op\":%.4f",
+               i ? "," : "", r->name, r->category, r->unit, r->ops, r->min_ns,
+               r->median_ns, ns_per_op);
+        if (r->has_mips) {
+            printf(",\"mips\":%.2f", 1e3 / ns_per_op);
+        }
+
+        printf(",\"counters\":{");
+        bool first = true;
+        for (int c = 0; perf && c < PERF_COUNTER_COUNT; c++) {
+            if (perf_counter_available(perf, (PerfCounterId)c)) {
+                printf("%s\"%s\":%llu", first ? "" : ",",
+                       perf_counter_name((PerfCounterId)c),
+                       (unsigned long long)r->counters[c]);
+                first = false;
+            }
+        }
+        printf("}}");
+    }
+    printf("]}\n");
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    bool counters = true;
+    int repeat = DEFAULT_REPEAT;
+    char** filters = malloc(sizeof(char*) * argc);
+    int num_filters = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--no-counters") == 0) {
+            counters = false;
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1) {
+                repeat = 1;
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [--json] [--repeat N] [--no-counters] "
+                   "[name filter...]\n",
+                   argv[0]);
+            free(filters);
+            return 0;
+        } else {
+            filters[num_filters++] = argv[i];
+        }
+    }
+
+    PerfCounters counter_state;
+    if (counters && perf_counters_open(&counter_state)) {
+        perf = &counter_state;
+    }
+
+    int num_guest = (int)(sizeof(GUEST_BENCHES) / sizeof(GUEST_BENCHES[0]));
+    BenchResult* results = calloc(num_guest + 3, sizeof(BenchResult));
+    int count = 0;
+    int failures = 0;
+
+    for (int i = 0; i < num_guest; i++) {
+        if (selected(GUEST_BENCHES[i].name, num_filters, filters)) {
+            if (run_guest_bench(&GUEST_BENCHES[i], repeat, &results[count]) ==
+                0) {
+                count++;
+            } else {
+                failures++;
+            }
+        }
+    }
+
+    if (selected("assemble", num_filters, filters)) {
+        if (run_assembler_bench(repeat, &results[count]) == 0) {
+            count++;
+        } else {
+            failures++;
+        }
+    }
+    if (selected("vm_create", num_filters, filters)) {
+        if (run_vm_create_bench(repeat, false, &results[count]) == 0) {
+            count++;
+        } else {
+            failures++;
+        }
+    }
+    if (selected("vm_init", num_filters, filters)) {
+        if (run_vm_create_bench(repeat, true, &results[count]) == 0) {
+            count++;
+        } else {
+            failures++;
+        }
+    }
+
+    if (json) {
+        print_json(results, count, repeat);
+    } else {
+        print_text(results, count);
+    }
+
+    if (perf) {
+        perf_counters_close(perf);
+    }
+    free(results);
+    free(filters);
+    return failures > 0 ? 1 : 0;
+}
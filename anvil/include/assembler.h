@@ -4,14 +4,27 @@
 #include <stdbool.h>
 
 #include "parser.h"
+#include "symtab.h"
 
 #define INITIAL_CAPACITY 16
+#define DATA_START 0x1000
+
+typedef enum {
+    SECTION_TEXT,
+    SECTION_DATA,
+} Section;
 
 typedef struct {
-    char* name;
-    int address;
+    const char* name;  // Interned in Program.symbols; NULL if anonymous
+    int address;       // -1 until placed
 } Label;
 
+// A data word whose value is a symbol, patched by program_finalize
+typedef struct {
+    int index;
+    int symbol;
+} DataFixup;
+
 typedef struct {
     Instruction* instructions;
     int capacity;
@@ -22,12 +35,37 @@ typedef struct {
     int label_size;
 
     int* label_addresses;
+
+    SymbolTable symbols;
+
+    // Initialized data image, loaded at guest address data_base
+    uint32_t* data;
+    int data_capacity;
+    int data_size;
+    uint32_t data_base;
+
+    DataFixup* data_fixups;
+    int data_fixup_capacity;
+    int data_fixup_size;
+
+    Section section;  // Section that parse_line currently emits into
 } Program;
 
 Program* program_create();
 void program_destroy(Program* program);
 bool add_instruction(Program* program, Instruction instruction);
 bool add_label(Program* program, const char* name);
+// Anonymous labels for generated code. new_label returns an unplaced label
+// that jumps can already refer to, or -1 on allocation failure;
+// place_label binds it to the next instruction added.
+int new_label(Program* program);
+void place_label(Program* program, int label);
+bool add_constant(Program* program, const char* name, int value);
+bool add_data_label(Program* program, const char* name);
+
+// Append words to the data image, returning the guest address of the first
+// word or -1 on failure
+int add_data(Program* program, const uint32_t* words, int count);
 bool parse_line(Parser* parser, Program* program);
 
 // Resolve label references and prepare the program for execution
@@ -0,0 +1,64 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assembler.h"
+
+#define CACHE_MAGIC 0x43564E41u  // "ANVC"
+#define CACHE_VERSION 1
+
+// Content-addressed cache of finalized programs, so a front end that sees
+// the same source again can go straight to load_program. A key is the
+// source text together with a tag naming the front end, its version and
+// every option that changes the generated code; the hash only picks a
+// bucket, and a hit compares the whole key.
+//
+// Past `capacity` entries the least recently used one that nobody holds is
+// dropped. With a directory, programs are also stored there as images that
+// later processes read back. The cache may be shared between threads.
+typedef struct ProgramCache ProgramCache;
+
+typedef struct CacheEntry {
+    Program* program;  // Shared by every holder: do not modify
+
+    // Owned by the cache, under its lock
+    uint64_t hash;
+    char* key;  // The tag, a NUL, then the source
+    size_t key_length;
+    int holders;
+    struct CacheEntry* chain;  // Next in the same bucket
+    struct CacheEntry* newer;
+    struct CacheEntry* older;
+} CacheEntry;
+
+typedef struct {
+    uint64_t hits;       // Found in memory
+    uint64_t disk_hits;  // Read back from the directory
+    uint64_t misses;
+    uint64_t evictions;
+} CacheStats;
+
+// `directory`, if not NULL, must already exist
+ProgramCache* program_cache_create(int capacity, const char* directory);
+void program_cache_destroy(ProgramCache* cache);
+
+// The entry for the key, or NULL on a miss. The caller holds the entry, so
+// it stays valid until passed to program_cache_release.
+CacheEntry* program_cache_get(ProgramCache* cache, const char* tag,
+                              const char* source, size_t length);
+
+// Adds a finalized program, which the cache takes over, and returns its
+// entry held as by program_cache_get. If another thread added the same key
+// first, that entry is returned and `program` destroyed. Returns NULL if out
+// of memory, leaving `program` to the caller.
+CacheEntry* program_cache_put(ProgramCache* cache, const char* tag,
+                              const char* source, size_t length,
+                              Program* program);
+
+void program_cache_release(ProgramCache* cache, CacheEntry* entry);
+
+void program_cache_stats(ProgramCache* cache, CacheStats* stats);
+
+#endif  // CACHE_H_
@@ -0,0 +1,23 @@
+#ifndef DISASSEMBLER_H_
+#define DISASSEMBLER_H_
+
+#include <stddef.h>
+
+#include "assembler.h"
+
+// Textual assembly of a Program, for viewers and debugging. Code generators
+// build Programs directly, so text is only produced when asked for. The
+// output of program_disassemble assembles back into an equivalent program;
+// anonymous labels are written as __L<index>.
+
+// Formats one instruction, e.g. "cjmp lt, ax, [bx + 4], __L3", the way
+// snprintf does: the result is truncated to `size` and the full length is
+// returned
+int format_instruction(const Program* program, const Instruction* instr,
+                       char* buffer, size_t size);
+
+// The whole program, data image included, in a heap-allocated string that
+// the caller frees. NULL on allocation failure.
+char* program_disassemble(const Program* program);
+
+#endif  // DISASSEMBLER_H_
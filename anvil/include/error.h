@@ -18,6 +18,8 @@ typedef enum {
     VM_ERROR_INVALID_REGISTER,
     VM_ERROR_PROGRAM_COUNTER_OUT_OF_BOUNDS,
     VM_ERROR_MEMORY_ALREADY_INITIALIZED,
+    VM_ERROR_INVALID_HEAP_ADDRESS,
+    VM_ERROR_STEP_LIMIT,
     VM_ERROR_UNKNOWN
 } VMError;
 
@@ -0,0 +1,33 @@
+#ifndef FAULT_H_
+#define FAULT_H_
+
+// Turns hardware faults on guarded guest memory into VM errors. A run loop
+// arms a FaultContext around execution; if a load or store lands in the
+// guard region of that context's memory, the SIGSEGV/SIGBUS handler jumps
+// back to the sigsetjmp in the run loop. Faults anywhere else keep the
+// process's previous disposition.
+
+#include "memory.h"
+
+#ifdef ANVIL_GUARD_MEMORY
+
+#include <setjmp.h>
+
+typedef struct FaultContext {
+    sigjmp_buf env;
+    const Memory* memory;
+    int address;  // Faulting guest address, valid after the jump
+    struct FaultContext* previous;
+} FaultContext;
+
+// Install the handlers once per process. Returns false if that failed, in
+// which case guarded execution must not be used.
+bool fault_handler_install(void);
+
+// Arm/disarm a context for the calling thread. Contexts nest.
+void fault_enter(FaultContext* fault, const Memory* memory);
+void fault_leave(FaultContext* fault);
+
+#endif  // ANVIL_GUARD_MEMORY
+
+#endif  // FAULT_H_
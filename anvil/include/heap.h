@@ -0,0 +1,50 @@
+#ifndef HEAP_H_
+#define HEAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "error.h"
+#include "memory.h"
+
+// Host-side allocator behind ALLOC/FREE/REALLOC. It hands out blocks of a
+// region of guest memory in power-of-two size classes of 2, 4, 8, ... words.
+// Each class has a free list threaded through the freed blocks themselves
+// and is refilled from a bump pointer. Blocks are not coalesced.
+//
+// Which blocks are allocated, and their classes, is tracked host-side, so
+// bad or repeated FREEs are detected and guest writes to freed blocks can
+// not make the allocator hand out memory outside the heap.
+
+#define HEAP_GRANULE 2  // Words; the smallest block and the block alignment
+#define HEAP_CLASS_COUNT 32
+
+typedef struct {
+    uint32_t base;  // First word of the heap region
+    uint32_t end;   // One past the last word
+    uint32_t top;   // Bump pointer, everything above is untouched
+    uint32_t free_lists[HEAP_CLASS_COUNT];  // 0 when empty
+    uint8_t* blocks;        // State of the block starting at each granule
+    uint32_t live_blocks;   // Allocated and not yet freed
+} Heap;
+
+// A zero-sized heap is valid; every allocation from it fails
+VMError heap_init(Heap* heap, uint32_t base, uint32_t size);
+void heap_destroy(Heap* heap);
+
+// Allocation stores 0, never a heap address, if the heap is exhausted.
+// Blocks are not cleared.
+VMError heap_alloc(Heap* heap, Memory* memory, uint32_t size,
+                   uint32_t* address);
+// Freeing 0 does nothing; anything else that is not an allocated block is an
+// error
+VMError heap_free(Heap* heap, Memory* memory, uint32_t address);
+// Like C realloc: 0 allocates, the contents are kept up to the smaller size,
+// and on exhaustion 0 is stored and the old block stays allocated
+VMError heap_realloc(Heap* heap, Memory* memory, uint32_t address,
+                     uint32_t size, uint32_t* new_address);
+
+// Capacity in words of the allocated block at `address`, or 0
+uint32_t heap_block_size(const Heap* heap, uint32_t address);
+
+#endif  // HEAP_H_
@@ -2,6 +2,7 @@
 #define INSTRUCTIONS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     OP_HALT,
@@ -30,14 +31,56 @@ typedef enum {
     OP_RET,
     OP_NOP,
     OP_OUT,
-    OP_PREG
+    OP_PREG,
+    OP_LDB,  // Byte and halfword loads/stores take byte addresses
+    OP_LDH,
+    OP_STB,
+    OP_STH,
+    OP_ALLOC,
+    OP_FREE,
+    OP_REALLOC,
+    OP_ENTER,
+    OP_LEAVE,
+    OP_LOOP,  // Decrement a register, branch if it is not zero
+    OP_CJMP,  // Compare two operands and branch, without touching the flags
+    OP_MOD,   // Signed remainder, with the sign of the dividend
+    OP_SHL,   // Shifts take the count mod 32; SHR shifts in zeros
+    OP_SHR,
+    OP_POW,  // Integer power; a negative exponent truncates like DIV
+    OP_COUNT
 } OpCode;
 
+// CJMP conditions, comparing its first two operands as signed ints
+typedef enum {
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_LE,
+    COND_GT,
+    COND_GE,
+    COND_COUNT
+} Condition;
+
+// Address computation shapes. The interpreter dispatches on the mode so each
+// shape only does the arithmetic it needs; ADDR_GENERIC handles any ref and
+// is what zero-initialized refs get.
+typedef enum {
+    ADDR_GENERIC,
+    ADDR_ABSOLUTE,          // [disp]
+    ADDR_BASE_DISP,         // [base + disp]
+    ADDR_INDEX_DISP,        // [index*scale + disp]
+    ADDR_BASE_INDEX_DISP,   // [base + index*scale + disp]
+    ADDR_MODE_COUNT,
+    ADDR_UNRESOLVED = 0xFF  // `symbol` still has to be added to the offset
+} AddressMode;
+
 typedef struct {
-    int base_reg;
-    int index_reg;
-    int scale;
-    int offset;
+    int8_t base_reg;   // R_NONE if absent
+    int8_t index_reg;  // R_NONE if absent
+    uint8_t scale;     // 1, 2, 4 or 8; ignored without an index
+    int32_t offset;
+    uint8_t mode;      // AddressMode
+    int32_t symbol;    // Displacement symbol while mode is ADDR_UNRESOLVED
 } MemoryRef;
 
 typedef enum {
@@ -45,6 +88,7 @@ typedef enum {
     OPERAND_IMMEDIATE,
     OPERAND_MEMORY,
     OPERAND_LABEL,
+    OPERAND_SYMBOL,  // Unresolved name, rewritten by program_finalize
 } OperandType;
 
 typedef struct {
@@ -52,18 +96,24 @@ typedef struct {
     union {
         int reg;
         int imm;
-        int mem;
         MemoryRef mem_ref;
         int label;
+        int symbol;
     } value;
 } Operand;
 
+#define MAX_OPERANDS 3
+
 typedef struct {
     OpCode opcode;
-    Operand operands[2];
+    Operand operands[MAX_OPERANDS];
     int num_operands;
+    uint8_t cond;  // Condition, for CJMP
 } Instruction;
 
 bool has_signed_overflow(int a, int b, int result);
 
+// Pick the address mode matching the registers present in `mem_ref`
+void memory_ref_classify(MemoryRef* mem_ref);
+
 #endif  // INSTRUCTIONS_H_
@@ -11,6 +11,7 @@
 
 VMError io_init(VM* vm);
 VMError io_handle(VM* vm, uint32_t address, uint32_t value);
+// Strings are packed bytes addressed by byte (see memory.h)
 VMError vm_print_string(VM* vm, uint32_t address, uint32_t length);
 VMError vm_print_reg_value(VM* vm, uint32_t format, uint32_t reg);
 VMError vm_read_string(VM* vm, uint32_t address, uint32_t max_length);
@@ -0,0 +1,19 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include "assembler.h"
+#include "vm.h"
+
+// Copy the program's initialized data image into guest memory in one block
+VMError load_program_data(VM* vm, const Program* program);
+
+// Create a VM running a finalized program, with its data already loaded.
+// Programs that pass the verifier run on the check-free interpreter.
+VM* load_program(Program* program);
+VM* load_program_with_config(Program* program, const VMConfig* config);
+
+// Run `program` on a VM that already ran something else, as load_program
+// would on a fresh one but without allocating (see vm_reset)
+VMError reload_program(VM* vm, Program* program);
+
+#endif  // LOADER_H_
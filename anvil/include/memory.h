@@ -1,20 +1,78 @@
 #ifndef MEMORY_H_
 #define MEMORY_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "error.h"
 #include "instructions.h"
 
+// Sizes are in words. Each VM picks its own size; MEMORY_SIZE is the
+// default. The maximum keeps every byte address a non-negative int32.
 #define MEMORY_SIZE (1 << 16)
+#define MEMORY_MAX_SIZE (1u << 29)
+#define MEMORY_PAGE_SIZE 1024            // Sizes are rounded up to 4 KiB
+#define MEMORY_HUGE_PAGE_SIZE (1 << 19)  // 2 MiB
 
+// Guest memory can be reserved with PROT_NONE guard regions on both sides,
+// large enough that any address formed from 32-bit int arithmetic lands in
+// the mapping. Out-of-range accesses then fault (see fault.h) instead of
+// being checked. Needs mmap and a 64-bit address space.
+#if !defined(ANVIL_NO_GUARD_MEMORY) && \
+    (defined(__unix__) || defined(__APPLE__)) && UINTPTR_MAX > 0xFFFFFFFFu
+#define ANVIL_GUARD_MEMORY
+#define MEMORY_GUARD_SIZE ((size_t)1 << 33)  // 2^31 words of 4 bytes
+#endif
+
+// Memory is an array of `size` words, but it can also be viewed as
+// 4 * `size` bytes: byte address 4 * w + k is byte k of word w in host byte
+// order, so on little-endian hosts it holds bits 8k..8k+7 of the word.
 typedef struct {
-    uint32_t data[MEMORY_SIZE];
+    uint32_t* data;
+    uint32_t size;     // Words
+    bool guarded;      // `reservation` has guard regions around `data`
+    bool huge_pages;   // Backed by explicitly reserved huge pages
+
+    // Whole mapping, including any guard regions; NULL for heap memory
+    void* reservation;
+    size_t reservation_size;
 } Memory;
 
-VMError init_memory(Memory* memory);
+// Allocates `size` words of zeroed guest memory, rounded up to whole pages.
+// Memory is guarded when the platform allows it and mapped with mmap where
+// available, falling back to the heap otherwise. With `huge_pages`, memories
+// of at least a huge page are backed by huge pages: explicitly reserved ones
+// if the size is a multiple of MEMORY_HUGE_PAGE_SIZE and the system has them
+// (MAP_HUGETLB), transparent ones (MADV_HUGEPAGE) otherwise.
+VMError init_memory(Memory* memory, uint32_t size, bool huge_pages);
+void free_memory(Memory* memory);
+bool memory_is_guarded(const Memory* memory);
+
+// If `host_address` lies in the memory's reservation, store the guest word
+// address it corresponds to and return true
+bool memory_translate_fault(const Memory* memory, const void* host_address,
+                            int* guest_address);
+
 VMError read_memory(Memory* memory, uint32_t address, uint32_t* value);
 VMError write_memory(Memory* memory, uint32_t address, uint32_t value);
+// Byte view of the same memory
+static inline uint8_t* memory_bytes(const Memory* memory) {
+    return (uint8_t*)memory->data;
+}
+
+static inline uint32_t memory_byte_size(const Memory* memory) {
+    return memory->size * (uint32_t)sizeof(uint32_t);
+}
+
+// The `length` bytes at byte `address`, or NULL if they are not all in range
+uint8_t* memory_byte_range(const Memory* memory, uint32_t address,
+                           uint32_t length);
+VMError read_memory_byte(Memory* memory, uint32_t address, uint8_t* value);
+VMError write_memory_byte(Memory* memory, uint32_t address, uint8_t value);
+
+VMError load_memory(Memory* memory, uint32_t address, const uint32_t* data,
+                    uint32_t size);
 VMError write_memory_ref(Memory* memory, MemoryRef mem_ref, uint32_t value);
 VMError clear_memory(Memory* memory);
 VMError memcopy(Memory* dest, Memory* src, uint32_t size);
@@ -8,11 +8,13 @@
 #endif
 #include <string.h>
 
+#include "symtab.h"
 #include "vm.h"
 
 typedef struct {
     const char* str;
     size_t pos;
+    SymbolTable* symbols;  // Names in operands are interned here, if set
 } Parser;
 
 void parser_init(Parser* parser, const char* str);
@@ -21,9 +23,21 @@ bool is_end_of_line(Parser* parser);
 char* parse_token(Parser* parser);
 bool expect_char(Parser* parser, char expected);
 bool parse_register(const char* token, Register* reg);
+const char* get_register_name(Register reg);
+int parse_escape(char c);
 bool parse_immediate(const char* token, int* imm);
-bool parse_memory_reference(const char* token, MemoryRef* mem_ref);
+bool parse_string_literal(Parser* parser, char** str, size_t* length);
+bool is_identifier(const char* token);
+// [base + index*scale + disp]; any part may be omitted and the index may be
+// written scale*index. With `symbols`, the displacement may include a name
+// that program_finalize resolves.
+bool parse_memory_reference(const char* token, MemoryRef* mem_ref,
+                            SymbolTable* symbols);
 bool parse_operand(Parser* parser, Operand* operand);
 OpCode get_opcode(const char* token);
+const char* get_opcode_name(OpCode opcode);
+// eq/ne/lt/le/gt/ge, or the jump suffixes z/nz/l/le/g/ge
+bool parse_condition(const char* token, Condition* cond);
+const char* get_condition_name(Condition cond);
 
 #endif  // PARSER_H_
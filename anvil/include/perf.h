@@ -0,0 +1,39 @@
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware performance counters for the host thread, backed by Linux
+// perf_event_open. Each counter is opened independently, so a machine (or
+// container) that lacks one event still reports the others; on other
+// platforms, or when perf is restricted, every counter is unavailable.
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_L1I_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounterId;
+
+typedef struct {
+    int fds[PERF_COUNTER_COUNT];  // -1 when the counter is unavailable
+    uint64_t values[PERF_COUNTER_COUNT];
+} PerfCounters;
+
+// Returns true if at least one counter could be opened
+bool perf_counters_open(PerfCounters* counters);
+void perf_counters_close(PerfCounters* counters);
+
+// Reset and enable all available counters
+void perf_counters_start(PerfCounters* counters);
+
+// Disable the counters and store their values, scaled for multiplexing
+void perf_counters_stop(PerfCounters* counters);
+
+bool perf_counter_available(const PerfCounters* counters, PerfCounterId id);
+const char* perf_counter_name(PerfCounterId id);
+
+#endif  // PERF_H_
@@ -0,0 +1,75 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+// Execution profiler. Only available when the library is built with
+// ANVIL_PROFILE (CMake option ANVIL_PROFILING); otherwise vm_run carries no
+// instrumentation at all.
+#ifdef ANVIL_PROFILE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "perf.h"
+#include "vm.h"
+
+#define PROFILER_TOP_INSTRUCTIONS 20
+
+typedef enum {
+    PROF_CLASS_DATA,    // mov, lea
+    PROF_CLASS_ARITH,   // add, sub, mul, div, inc, dec, and, or, xor, cmp
+    PROF_CLASS_BRANCH,  // jmp and conditional jumps
+    PROF_CLASS_STACK,   // push, pop
+    PROF_CLASS_CALL,    // call, ret
+    PROF_CLASS_IO,      // out, preg
+    PROF_CLASS_OTHER,   // halt, nop
+    PROF_CLASS_COUNT
+} OpClass;
+
+typedef struct Profiler {
+    uint64_t total_instructions;
+    uint64_t opcode_counts[OP_COUNT];
+    uint64_t class_counts[PROF_CLASS_COUNT];
+    uint64_t class_cycles[PROF_CLASS_COUNT];  // rdtsc ticks, ns without TSC
+
+    // Indexed by instruction index
+    int program_size;
+    uint64_t* ip_counts;
+    uint64_t* branch_taken;
+    uint64_t* branch_not_taken;
+
+    // Host hardware counters accumulated over instrumented runs, so they
+    // include the profiler's own bookkeeping
+    bool perf_enabled;
+    PerfCounters perf;
+    uint64_t perf_totals[PERF_COUNTER_COUNT];
+} Profiler;
+
+Profiler* profiler_create(int program_size);
+void profiler_destroy(Profiler* profiler);
+void profiler_reset(Profiler* profiler);
+
+// Count host cycles, instructions, branch misses and L1 misses across
+// vm_run. Returns false if no counter is available on this machine.
+bool profiler_enable_perf(Profiler* profiler);
+
+// Attach a profiler to a VM; vm_run then records into it. Pass NULL to
+// detach. The profiler must cover at least the VM's program size.
+VMError vm_attach_profiler(VM* vm, Profiler* profiler);
+
+// vm_run brackets a run of an attached profiler with these, so that the
+// hardware counters cover it, and executes each instruction through
+// profiler_execute, which counts it and the host cycles it took
+void profiler_begin_run(Profiler* profiler);
+void profiler_end_run(Profiler* profiler);
+VMError profiler_execute(Profiler* profiler, VM* vm,
+                         const Instruction* instr);
+
+OpClass get_opcode_class(OpCode opcode);
+const char* get_opcode_class_name(OpClass op_class);
+
+void profiler_dump_text(const Profiler* profiler, FILE* out);
+void profiler_dump_json(const Profiler* profiler, FILE* out);
+
+#endif  // ANVIL_PROFILE
+
+#endif  // PROFILER_H_
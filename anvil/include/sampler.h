@@ -0,0 +1,90 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+// Call-stack sampling profiler. Unlike the flat profiler it is always built,
+// so that production VMs can sample: attaching one is a runtime choice, and a
+// VM without one pays a single pointer test per vm_run.
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "assembler.h"
+#include "vm.h"
+
+#define SAMPLER_ROOT 0
+#define SAMPLER_UNKNOWN_FRAME -1
+#define SAMPLER_MAX_DEPTH 1024
+
+// One node per distinct call path. The shadow stack is a chain of nodes, so
+// taking a sample is a single counter increment on the current node.
+typedef struct {
+    int parent;
+    int label;  // Index into Program.labels, or SAMPLER_UNKNOWN_FRAME
+    uint64_t samples;
+
+    // Most recently entered child, checked before the hash table
+    int last_child;
+} CallNode;
+
+typedef struct Sampler {
+    const Program* program;
+
+    CallNode* nodes;
+    int node_count;
+    int node_capacity;
+
+    int* slots;  // Open-addressing table keyed by (parent, label)
+    int slot_capacity;
+
+    int current;  // Node for the innermost active frame
+    int depth;
+    int max_depth;
+
+    int interval;  // Instructions between samples, 0 for timer-only
+    int countdown;
+    volatile sig_atomic_t timer_pending;
+
+    uint64_t total_samples;
+    int overflow;  // Active calls past max_depth, folded into the caller
+} Sampler;
+
+// Sample every `interval` retired instructions (0 to rely on the timer)
+Sampler* sampler_create(const Program* program, int interval);
+void sampler_destroy(Sampler* sampler);
+void sampler_reset(Sampler* sampler);
+
+VMError vm_attach_sampler(VM* vm, Sampler* sampler);
+
+// Additionally sample on a CPU-time timer (SIGPROF). Only one sampler can own
+// the timer at a time.
+bool sampler_start_timer(Sampler* sampler, int interval_us);
+void sampler_stop_timer(Sampler* sampler);
+
+// Track CALL/RET on the shadow stack and take a sample when one is due
+void sampler_enter(Sampler* sampler, int label);
+void sampler_take_sample(Sampler* sampler);
+
+static inline void sampler_step(Sampler* sampler, const Instruction* instr) {
+    if (instr->opcode == OP_CALL) {
+        sampler_enter(sampler, instr->operands[0].type == OPERAND_LABEL
+                                   ? instr->operands[0].value.label
+                                   : SAMPLER_UNKNOWN_FRAME);
+    } else if (instr->opcode == OP_RET) {
+        if (sampler->overflow > 0) {
+            sampler->overflow--;
+        } else if (sampler->depth > 0) {
+            sampler->current = sampler->nodes[sampler->current].parent;
+            sampler->depth--;
+        }
+    }
+
+    if (--sampler->countdown == 0 || sampler->timer_pending) {
+        sampler_take_sample(sampler);
+    }
+}
+
+// Write "frame;frame;frame count" lines for flamegraph.pl / inferno
+void sampler_write_collapsed(const Sampler* sampler, FILE* out);
+
+#endif  // SAMPLER_H_
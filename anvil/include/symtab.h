@@ -0,0 +1,58 @@
+#ifndef SYMTAB_H_
+#define SYMTAB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYMTAB_INITIAL_SLOTS 64
+#define SYMTAB_CHUNK_SIZE 4096
+
+typedef enum {
+    SYM_UNDEFINED,  // Referenced but not defined (yet)
+    SYM_LABEL,      // Code label, value is the index into Program.labels
+    SYM_CONSTANT,   // .equ constant, value is the constant itself
+    SYM_DATA,       // Data label, value is the guest word address; byte
+                    // operands and OUT get its byte address instead
+} SymbolKind;
+
+typedef struct {
+    const char* name;  // Interned, owned by the table's string pool
+    size_t length;
+    uint32_t hash;
+    SymbolKind kind;
+    int value;
+} Symbol;
+
+typedef struct StringChunk {
+    struct StringChunk* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} StringChunk;
+
+// Symbols are stored densely and addressed by id; the open-addressing slot
+// table (linear probing, power-of-two size) maps names to ids. Names are
+// interned into chunked storage so their addresses stay stable on growth.
+typedef struct {
+    Symbol* symbols;
+    int size;
+    int capacity;
+
+    int* slots;  // Symbol id per slot, -1 when empty
+    int slot_capacity;
+
+    StringChunk* strings;
+} SymbolTable;
+
+bool symtab_init(SymbolTable* table);
+void symtab_free(SymbolTable* table);
+
+// Return the id of the symbol called `name`, or -1 if it does not exist
+int symtab_find(const SymbolTable* table, const char* name, size_t length);
+
+// Return the id of the symbol called `name`, creating an SYM_UNDEFINED entry
+// if needed. Returns -1 on allocation failure.
+int symtab_intern(SymbolTable* table, const char* name, size_t length);
+
+#endif  // SYMTAB_H_
@@ -0,0 +1,95 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+// Binary execution tracing. Like the sampler it is always built, so a live
+// job can have a ring attached while a latency spike is chased; a VM
+// without one pays a single pointer test per vm_run.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+#define TRACE_MAGIC 0x54564E41u  // "ANVT"
+#define TRACE_VERSION 1
+#define TRACE_NO_ADDRESS 0xFFFFFFFFu
+#define TRACE_CACHE_LINE 64
+
+typedef enum {
+    TRACE_BRANCH = 1 << 0,  // Conditional branch
+    TRACE_TAKEN = 1 << 1,   // Branch taken (only with TRACE_BRANCH)
+    TRACE_MEMORY = 1 << 2,  // `address` is valid
+    TRACE_ERROR = 1 << 3,   // Instruction raised a VMError
+} TraceFlag;
+
+typedef struct {
+    uint32_t ip;
+    uint32_t address;  // Guest memory address touched, or TRACE_NO_ADDRESS
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+} TraceEvent;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint32_t reserved;
+} TraceFileHeader;
+
+// Single-producer single-consumer ring. The VM thread appends events and
+// another thread may drain concurrently; a full ring drops new events rather
+// than ever blocking the VM.
+typedef struct TraceBuffer {
+    _Alignas(TRACE_CACHE_LINE) _Atomic uint64_t head;  // Written by the VM
+    uint64_t cached_tail;
+    _Atomic uint64_t dropped;  // Read by trace_dropped from any thread
+
+    _Alignas(TRACE_CACHE_LINE) _Atomic uint64_t tail;  // Written by drain
+
+    _Alignas(TRACE_CACHE_LINE) uint32_t mask;
+    TraceEvent* events;
+} TraceBuffer;
+
+// Capacity is rounded up to a power of two
+TraceBuffer* trace_create(uint32_t capacity);
+void trace_destroy(TraceBuffer* trace);
+
+VMError vm_attach_trace(VM* vm, TraceBuffer* trace);
+
+static inline void trace_record(TraceBuffer* trace, const TraceEvent* event) {
+    uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    if (head - trace->cached_tail > trace->mask) {
+        trace->cached_tail =
+            atomic_load_explicit(&trace->tail, memory_order_acquire);
+        if (head - trace->cached_tail > trace->mask) {
+            atomic_fetch_add_explicit(&trace->dropped, 1,
+                                      memory_order_relaxed);
+            return;
+        }
+    }
+
+    trace->events[head & trace->mask] = *event;
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+// Build the event for `instr` before it executes; trace_finish_event fills
+// in the outcome afterwards
+void trace_begin_event(VM* vm, const Instruction* instr, TraceEvent* event);
+void trace_finish_event(VM* vm, VMError err, TraceEvent* event);
+
+// Copy up to `max` pending events into `out`, oldest first
+size_t trace_drain(TraceBuffer* trace, TraceEvent* out, size_t max);
+
+// Events lost because the ring was full
+uint64_t trace_dropped(const TraceBuffer* trace);
+
+// Trace files are a TraceFileHeader followed by raw TraceEvents
+bool trace_write_header(FILE* out);
+size_t trace_drain_to_file(TraceBuffer* trace, FILE* out);
+bool trace_read_header(FILE* in);
+
+#endif  // TRACE_H_
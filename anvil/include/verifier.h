@@ -0,0 +1,35 @@
+#ifndef VERIFIER_H_
+#define VERIFIER_H_
+
+#include "vm.h"
+
+// Load-time bytecode verification. A program that passes has valid opcodes,
+// operand counts and operand types for every instruction, register indices
+// in range, label indices that resolve to instructions, and in-bounds
+// absolute memory addresses. vm_run executes such programs on an interpreter
+// with those checks compiled out.
+
+typedef struct {
+    VMError error;        // VM_SUCCESS if the program verified
+    int ip;               // Offending instruction, -1 for the label table
+    const char* message;  // Static description of the failure
+} VerifyResult;
+
+// The checks of verify_program that hold for any program the assembler
+// finalizes: known opcodes and CJMP conditions, at most MAX_OPERANDS
+// operands, and every operand slot of a known type naming a register or
+// label that exists. The checked interpreter relies on these alone.
+VerifyResult verify_operands(const Instruction* program, int program_size,
+                             int num_labels);
+
+// Absolute addresses are checked against a guest memory of `memory_size`
+// words
+VerifyResult verify_program(const Instruction* program, int program_size,
+                            const int* label_addresses, int num_labels,
+                            uint32_t memory_size);
+
+// Verify the VM's program and, on success, switch vm_run to the verified
+// interpreter. The program must not be modified afterwards.
+VMError vm_verify(VM* vm);
+
+#endif  // VERIFIER_H_
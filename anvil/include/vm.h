@@ -6,11 +6,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "heap.h"
 #include "instructions.h"
 #include "memory.h"
 
-#define STACK_START (MEMORY_SIZE - 1)
-#define STACK_SIZE 4096
+#define STACK_SIZE 4096  // Words, growing down from the top of memory
+#define CALL_STACK_DEPTH 4096
+#define VM_MIN_MEMORY_SIZE (2 * STACK_SIZE)
 
 typedef enum {
     R_NONE = 0,
@@ -34,26 +36,71 @@ typedef enum {
     FL_CF = 1 << 3,  // Carry Flag
 } Flag;
 
+// The stack pointer is registers[R_SP]
 typedef struct {
     int registers[R_COUNT];
     uint32_t flags;
     int ip;  // Instruction Pointer
-    int sp;  // Stack Pointer
 } CPU;
 
 typedef struct {
     CPU cpu;
     Memory memory;
+    Heap heap;  // ALLOC/FREE/REALLOC, directly below the stack
+
+    // Return addresses live apart from guest memory, so CALL/RET never
+    // touch the data stack and guest stores cannot corrupt them
+    int* call_stack;
+    int call_depth;
+    int call_capacity;
+
     Instruction* program;
     int program_size;
     char* labels;
     int* label_addresses;
     int num_labels;
+    bool verified;  // Set by vm_verify; selects the check-free interpreter
+    FILE* output;   // Where OUT and PREG write; vm_init sets stdout
+    // Instructions one vm_run may execute before it stops with
+    // VM_ERROR_STEP_LIMIT; 0, as vm_init sets it, for no limit
+    uint64_t step_limit;
+    struct Sampler* sampler;
+    struct TraceBuffer* trace;
+#ifdef ANVIL_PROFILE
+    struct Profiler* profiler;
+#endif
 } VM;
 
+// Per-VM settings chosen at creation
+typedef struct {
+    uint32_t memory_size;  // Guest memory in words, see init_memory
+    bool huge_pages;       // Back large guest memories with huge pages
+    uint32_t heap_size;    // Words for the guest heap, may be 0
+    uint32_t call_depth;   // Nested CALLs allowed, at least 1
+} VMConfig;
+
+// MEMORY_SIZE words on ordinary pages, a quarter of them heap, and
+// CALL_STACK_DEPTH nested calls
+VMConfig vm_default_config(void);
+
+// SP starts at the top word and PUSH stores below it, down to and including
+// vm_stack_limit()
+static inline int vm_stack_start(const VM* vm) {
+    return (int)vm->memory.size - 1;
+}
+
+static inline int vm_stack_limit(const VM* vm) {
+    return vm_stack_start(vm) - STACK_SIZE;
+}
+
 VMError execute_instruction(VM* vm, Instruction instr);
+// Only valid for programs accepted by vm_verify
+VMError execute_verified(VM* vm, const Instruction* instr);
+// Verified and running on guarded memory inside an armed FaultContext
+VMError execute_guarded(VM* vm, const Instruction* instr);
 
 int get_operand_value(VM* vm, Operand operand);
+int get_effective_address(VM* vm, MemoryRef mem_ref);
 VMError set_operand_value(VM* vm, Operand operand, int value);
 
 int find_label_address(VM* vm, int label_index);
@@ -61,11 +108,24 @@ int find_label_address(VM* vm, int label_index);
 VMError update_flags(VM* vm, int result, int operand1, int operand2,
                      OpCode operation);
 
-// Core VM functions
+// Core VM functions. The plain variants use vm_default_config().
 VMError vm_init(VM* vm, Instruction* program, int program_size,
                 int* label_addresses, int num_labels);
+VMError vm_init_with_config(VM* vm, Instruction* program, int program_size,
+                            int* label_addresses, int num_labels,
+                            const VMConfig* config);
 VM* vm_create(Instruction* program, int program_size, int* label_addresses,
               int num_labels);
+VM* vm_create_with_config(Instruction* program, int program_size,
+                          int* label_addresses, int num_labels,
+                          const VMConfig* config);
+// Start over on another program, reusing the memory, heap and call stack
+// vm_init allocated: memory is cleared, the heap emptied and the registers
+// reset as if the VM were new. The output stream and step limit are kept.
+VMError vm_reset(VM* vm, Instruction* program, int program_size,
+                 int* label_addresses, int num_labels);
+// Release what vm_init allocated without freeing the VM itself
+void vm_release(VM* vm);
 void vm_destroy(VM* vm);
 VMError vm_run(VM* vm);
 VMError vm_step(VM* vm);
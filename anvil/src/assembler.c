@@ -1,5 +1,26 @@
 #include "assembler.h"
 
+#include "io.h"
+
+static bool define_symbol(Program* program, const char* name, SymbolKind kind,
+                          int value) {
+    int id = symtab_intern(&program->symbols, name, strlen(name));
+    if (id < 0) {
+        return false;
+    }
+
+    Symbol* sym = &program->symbols.symbols[id];
+    if (sym->kind != SYM_UNDEFINED) {
+        fprintf(stderr, "[ANVIL] Error: Symbol '%s' is already defined!\n",
+                name);
+        return false;
+    }
+
+    sym->kind = kind;
+    sym->value = value;
+    return true;
+}
+
 Program* program_create() {
     Program* program = malloc(sizeof(Program));
     if (!program) {
@@ -31,14 +52,37 @@ Program* program_create() {
         return NULL;
     }
 
+    if (!symtab_init(&program->symbols)) {
+        free(program->label_addresses);
+        free(program->labels);
+        free(program->instructions);
+        free(program);
+        return NULL;
+    }
+
+    program->data = NULL;
+    program->data_capacity = 0;
+    program->data_size = 0;
+    program->data_base = DATA_START;
+    program->data_fixups = NULL;
+    program->data_fixup_capacity = 0;
+    program->data_fixup_size = 0;
+    program->section = SECTION_TEXT;
+
+    if (!add_constant(program, "IO_STDIN", (int)IO_STDIN) ||
+        !add_constant(program, "IO_STDOUT", (int)IO_STDOUT)) {
+        program_destroy(program);
+        return NULL;
+    }
+
     return program;
 }
 
 void program_destroy(Program* program) {
     if (program) {
-        for (int i = 0; i < program->label_size; i++) {
-            free(program->labels[i].name);
-        }
+        symtab_free(&program->symbols);
+        free(program->data);
+        free(program->data_fixups);
         free(program->labels);
         free(program->instructions);
         free(program->label_addresses);
@@ -62,7 +106,7 @@ bool add_instruction(Program* program, Instruction instruction) {
     return true;
 }
 
-bool add_label(Program* program, const char* name) {
+static bool reserve_label(Program* program) {
     if (program->label_size >= program->label_capacity) {
         int new_capacity = program->label_capacity * 2;
         Label* new_labels =
@@ -73,13 +117,244 @@ bool add_label(Program* program, const char* name) {
         program->labels = new_labels;
         program->label_capacity = new_capacity;
     }
+    return true;
+}
 
-    program->labels[program->label_size].name = strdup(name);
+bool add_label(Program* program, const char* name) {
+    if (!reserve_label(program)) {
+        return false;
+    }
+
+    if (!define_symbol(program, name, SYM_LABEL, program->label_size)) {
+        return false;
+    }
+
+    int id = symtab_find(&program->symbols, name, strlen(name));
+    program->labels[program->label_size].name =
+        program->symbols.symbols[id].name;
     program->labels[program->label_size].address = program->size;
     program->label_size++;
     return true;
 }
 
+int new_label(Program* program) {
+    if (!reserve_label(program)) {
+        return -1;
+    }
+
+    program->labels[program->label_size].name = NULL;
+    program->labels[program->label_size].address = -1;
+    return program->label_size++;
+}
+
+void place_label(Program* program, int label) {
+    program->labels[label].address = program->size;
+}
+
+bool add_constant(Program* program, const char* name, int value) {
+    return define_symbol(program, name, SYM_CONSTANT, value);
+}
+
+bool add_data_label(Program* program, const char* name) {
+    return define_symbol(program, name, SYM_DATA,
+                         (int)program->data_base + program->data_size);
+}
+
+int add_data(Program* program, const uint32_t* words, int count) {
+    if (program->data_size + count > program->data_capacity) {
+        int new_capacity = program->data_capacity > 0 ? program->data_capacity
+                                                      : INITIAL_CAPACITY;
+        while (new_capacity < program->data_size + count) {
+            new_capacity *= 2;
+        }
+        uint32_t* new_data =
+            realloc(program->data, sizeof(uint32_t) * new_capacity);
+        if (!new_data) {
+            return -1;
+        }
+        program->data = new_data;
+        program->data_capacity = new_capacity;
+    }
+
+    int address = (int)program->data_base + program->data_size;
+    if (words) {
+        memcpy(program->data + program->data_size, words,
+               sizeof(uint32_t) * count);
+    } else {
+        memset(program->data + program->data_size, 0,
+               sizeof(uint32_t) * count);
+    }
+    program->data_size += count;
+    return address;
+}
+
+static bool add_data_fixup(Program* program, int index, int symbol) {
+    if (program->data_fixup_size >= program->data_fixup_capacity) {
+        int new_capacity = program->data_fixup_capacity > 0
+                               ? program->data_fixup_capacity * 2
+                               : INITIAL_CAPACITY;
+        DataFixup* new_fixups =
+            realloc(program->data_fixups, sizeof(DataFixup) * new_capacity);
+        if (!new_fixups) {
+            return false;
+        }
+        program->data_fixups = new_fixups;
+        program->data_fixup_capacity = new_capacity;
+    }
+
+    program->data_fixups[program->data_fixup_size].index = index;
+    program->data_fixups[program->data_fixup_size].symbol = symbol;
+    program->data_fixup_size++;
+    return true;
+}
+
+static bool parse_word_directive(Parser* parser, Program* program) {
+    do {
+        char* token = parse_token(parser);
+        if (!token) {
+            fprintf(stderr, "[ANVIL] Error: Missing value in .word!\n");
+            return false;
+        }
+
+        int value = 0;
+        int symbol = -1;
+        if (!parse_immediate(token, &value)) {
+            if (!is_identifier(token)) {
+                fprintf(stderr, "[ANVIL] Error: Invalid .word value '%s'!\n",
+                        token);
+                free(token);
+                return false;
+            }
+            symbol = symtab_intern(&program->symbols, token, strlen(token));
+        }
+        free(token);
+
+        uint32_t word = (uint32_t)value;
+        if (add_data(program, &word, 1) < 0) {
+            return false;
+        }
+        if (symbol >= 0 &&
+            !add_data_fixup(program, program->data_size - 1, symbol)) {
+            return false;
+        }
+    } while (expect_char(parser, ','));
+
+    return true;
+}
+
+static bool parse_string_directive(Parser* parser, Program* program) {
+    char* str;
+    size_t length;
+    if (!parse_string_literal(parser, &str, &length)) {
+        fprintf(stderr, "[ANVIL] Error: Malformed string in .string!\n");
+        return false;
+    }
+
+    // Packed four characters per word in the memory's byte order, followed by
+    // a terminating zero byte and zero padding up to a word boundary
+    size_t num_words = (length + sizeof(uint32_t)) / sizeof(uint32_t);
+    uint32_t* words = calloc(num_words, sizeof(uint32_t));
+    if (!words) {
+        free(str);
+        return false;
+    }
+    memcpy(words, str, length);
+
+    bool ok = add_data(program, words, (int)num_words) >= 0;
+    free(words);
+    free(str);
+    return ok;
+}
+
+static bool parse_directive(Parser* parser, Program* program,
+                            const char* directive) {
+    if (strcasecmp(directive, ".text") == 0) {
+        program->section = SECTION_TEXT;
+        return true;
+    }
+
+    if (strcasecmp(directive, ".data") == 0) {
+        char* token = parse_token(parser);
+        if (token) {
+            int address;
+            bool ok = parse_immediate(token, &address) && address >= 0;
+            free(token);
+            if (!ok || program->data_size > 0) {
+                fprintf(stderr,
+                        "[ANVIL] Error: .data address must be a constant "
+                        "given before any data!\n");
+                return false;
+            }
+            program->data_base = (uint32_t)address;
+        }
+        program->section = SECTION_DATA;
+        return true;
+    }
+
+    if (strcasecmp(directive, ".word") == 0 ||
+        strcasecmp(directive, ".string") == 0 ||
+        strcasecmp(directive, ".space") == 0) {
+        if (program->section != SECTION_DATA) {
+            fprintf(stderr, "[ANVIL] Error: %s outside of .data!\n",
+                    directive);
+            return false;
+        }
+
+        if (strcasecmp(directive, ".word") == 0) {
+            return parse_word_directive(parser, program);
+        }
+        if (strcasecmp(directive, ".string") == 0) {
+            return parse_string_directive(parser, program);
+        }
+
+        char* token = parse_token(parser);
+        int count;
+        bool ok = token && parse_immediate(token, &count) && count >= 0;
+        free(token);
+        if (!ok) {
+            fprintf(stderr, "[ANVIL] Error: Malformed .space!\n");
+            return false;
+        }
+        return add_data(program, NULL, count) >= 0;
+    }
+
+    if (strcasecmp(directive, ".equ") == 0) {
+        char* name = parse_token(parser);
+        if (!name) {
+            fprintf(stderr, "[ANVIL] Error: Missing name in .equ!\n");
+            return false;
+        }
+
+        char* token = NULL;
+        int value;
+        bool ok = is_identifier(name) && expect_char(parser, ',') &&
+                  (token = parse_token(parser)) != NULL;
+        if (ok && !parse_immediate(token, &value)) {
+            // Allow constants to be defined in terms of earlier constants
+            int id = symtab_find(&program->symbols, token, strlen(token));
+            ok = id >= 0 &&
+                 program->symbols.symbols[id].kind == SYM_CONSTANT;
+            if (ok) {
+                value = program->symbols.symbols[id].value;
+            }
+        }
+
+        if (!ok) {
+            fprintf(stderr, "[ANVIL] Error: Malformed .equ for '%s'!\n",
+                    name);
+        } else {
+            ok = add_constant(program, name, value);
+        }
+
+        free(token);
+        free(name);
+        return ok;
+    }
+
+    fprintf(stderr, "[ANVIL] Error: Unknown directive '%s'!\n", directive);
+    return false;
+}
+
 bool parse_line(Parser* parser, Program* program) {
     skip_whitespace(parser);
 
@@ -87,7 +362,6 @@ bool parse_line(Parser* parser, Program* program) {
         return true;
     }
 
-    const char* start = parser->str + parser->pos;
     char* token = parse_token(parser);
     if (!token) {
         return false;
@@ -98,7 +372,10 @@ bool parse_line(Parser* parser, Program* program) {
 
     if (parser->str[parser->pos] == ':') {
         parser->pos++;
-        if (!add_label(program, token)) {
+        bool ok = program->section == SECTION_DATA
+                      ? add_data_label(program, token)
+                      : add_label(program, token);
+        if (!ok) {
             free(token);
             return false;
         }
@@ -117,24 +394,62 @@ bool parse_line(Parser* parser, Program* program) {
         parser->pos = saved_pos;
     }
 
-    OpCode opcode = get_opcode(token);
-    free(token);
+    if (token[0] == '.') {
+        bool ok = parse_directive(parser, program, token);
+        free(token);
+        return ok;
+    }
 
-    if (opcode == -1) {
+    if (program->section == SECTION_DATA) {
+        fprintf(stderr, "[ANVIL] Error: Instruction '%s' inside .data!\n",
+                token);
+        free(token);
         return false;
     }
 
-    Instruction instr;
+    OpCode opcode = get_opcode(token);
+    if ((int)opcode == -1) {
+        fprintf(stderr, "[ANVIL] Error: Unknown instruction '%s'!\n", token);
+        free(token);
+        return false;
+    }
+    free(token);
+
+    Instruction instr = {0};
     instr.opcode = opcode;
     instr.num_operands = 0;
 
+    if (opcode == OP_CJMP) {
+        // The condition comes first: cjmp lt, ax, 10, label
+        skip_whitespace(parser);
+        token = parse_token(parser);
+        Condition cond;
+        if (!token || !parse_condition(token, &cond)) {
+            fprintf(stderr, "[ANVIL] Error: Invalid condition '%s' for "
+                            "'cjmp'!\n",
+                    token ? token : "");
+            free(token);
+            return false;
+        }
+        free(token);
+        instr.cond = (uint8_t)cond;
+        skip_whitespace(parser);
+        expect_char(parser, ',');
+    }
+
     if (opcode == OP_RET || opcode == OP_HALT) {
         instr.num_operands = 0;
     } else {
-        while (instr.num_operands < 2) {
-            if (!parse_operand(parser, &instr.operands[instr.num_operands])) {
+        while (instr.num_operands < MAX_OPERANDS) {
+            skip_whitespace(parser);
+            if (is_end_of_line(parser)) {
                 break;
             }
+            if (!parse_operand(parser, &instr.operands[instr.num_operands])) {
+                fprintf(stderr, "[ANVIL] Error: Invalid operand %d for '%s'!\n",
+                        instr.num_operands + 1, get_opcode_name(opcode));
+                return false;
+            }
             instr.num_operands++;
         }
     }
@@ -142,14 +457,125 @@ bool parse_line(Parser* parser, Program* program) {
     return add_instruction(program, instr);
 }
 
+// Whether operand `index` of `opcode` is the address of packed bytes: the
+// memory operand of a byte or halfword access, or the string OUT prints.
+// Data labels there stand for the byte address of their first word.
+static bool takes_byte_address(OpCode opcode, int index) {
+    switch (opcode) {
+        case OP_LDB:
+        case OP_LDH:
+            return index == 1;
+        case OP_STB:
+        case OP_STH:
+        case OP_OUT:
+            return index == 0;
+        default:
+            return false;
+    }
+}
+
+static bool resolve_memory_ref(Program* program, MemoryRef* mem_ref,
+                               bool bytes) {
+    const Symbol* sym = &program->symbols.symbols[mem_ref->symbol];
+    switch (sym->kind) {
+        case SYM_CONSTANT:
+            mem_ref->offset += sym->value;
+            mem_ref->symbol = -1;
+            memory_ref_classify(mem_ref);
+            return true;
+        case SYM_DATA:
+            mem_ref->offset += bytes ? sym->value * 4 : sym->value;
+            mem_ref->symbol = -1;
+            memory_ref_classify(mem_ref);
+            return true;
+        case SYM_LABEL:
+            fprintf(stderr,
+                    "[ANVIL] Error: Code label '%s' used as a memory "
+                    "address!\n",
+                    sym->name);
+            return false;
+        default:
+            fprintf(stderr, "[ANVIL] Error: Undefined symbol '%s'!\n",
+                    sym->name);
+            return false;
+    }
+}
+
+static bool resolve_operand(Program* program, OpCode opcode, int index,
+                            Operand* operand) {
+    // OUT's memory operand holds the string's address rather than being it
+    bool bytes = takes_byte_address(opcode, index);
+    if (operand->type == OPERAND_MEMORY &&
+        operand->value.mem_ref.mode == ADDR_UNRESOLVED) {
+        return resolve_memory_ref(program, &operand->value.mem_ref,
+                                  bytes && opcode != OP_OUT);
+    }
+    if (operand->type != OPERAND_SYMBOL) {
+        return true;
+    }
+
+    const Symbol* sym = &program->symbols.symbols[operand->value.symbol];
+    switch (sym->kind) {
+        case SYM_LABEL:
+            operand->type = OPERAND_LABEL;
+            operand->value.label = sym->value;
+            return true;
+        case SYM_CONSTANT:
+            operand->type = OPERAND_IMMEDIATE;
+            operand->value.imm = sym->value;
+            return true;
+        case SYM_DATA:
+            operand->type = OPERAND_IMMEDIATE;
+            operand->value.imm = bytes ? sym->value * 4 : sym->value;
+            return true;
+        default:
+            fprintf(stderr, "[ANVIL] Error: Undefined symbol '%s'!\n",
+                    sym->name);
+            return false;
+    }
+}
+
 bool program_finalize(Program* program) {
-    program->label_addresses =
-        realloc(program->label_addresses, sizeof(int) * program->label_size);
-    if (!program->label_addresses) {
+    for (int i = 0; i < program->size; i++) {
+        Instruction* instr = &program->instructions[i];
+        for (int j = 0; j < instr->num_operands; j++) {
+            if (!resolve_operand(program, (OpCode)instr->opcode, j,
+                                 &instr->operands[j])) {
+                return false;
+            }
+        }
+    }
+
+    for (int i = 0; i < program->data_fixup_size; i++) {
+        const DataFixup* fixup = &program->data_fixups[i];
+        const Symbol* sym = &program->symbols.symbols[fixup->symbol];
+        if (sym->kind == SYM_UNDEFINED) {
+            fprintf(stderr, "[ANVIL] Error: Undefined symbol '%s'!\n",
+                    sym->name);
+            return false;
+        }
+
+        // Code labels in data (e.g. jump tables) hold instruction addresses
+        program->data[fixup->index] =
+            sym->kind == SYM_LABEL
+                ? (uint32_t)program->labels[sym->value].address
+                : (uint32_t)sym->value;
+    }
+
+    int* label_addresses =
+        realloc(program->label_addresses,
+                sizeof(int) * (program->label_size > 0 ? program->label_size
+                                                       : 1));
+    if (!label_addresses) {
         return false;
     }
+    program->label_addresses = label_addresses;
 
     for (int i = 0; i < program->label_size; i++) {
+        if (program->labels[i].address < 0) {
+            fprintf(stderr, "[ANVIL] Error: Label %d is never placed!\n", i);
+            return false;
+        }
         program->label_addresses[i] = program->labels[i].address;
     }
 
@@ -165,6 +591,7 @@ Program* assemble_from_string(const char* source) {
 
     Parser parser;
     parser_init(&parser, source);
+    parser.symbols = &program->symbols;
 
     while (parser.str[parser.pos] != '\0') {
         if (!parse_line(&parser, program)) {
@@ -172,8 +599,9 @@ Program* assemble_from_string(const char* source) {
             return NULL;
         }
 
+        // Skip any trailing comment, then the newline itself
         while (parser.str[parser.pos] != '\0' &&
-               parser.str[parser.pos] == '\n') {
+               parser.str[parser.pos] != '\n') {
             parser.pos++;
         }
 
@@ -0,0 +1,448 @@
+#include "cache.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "verifier.h"
+
+// An image is only read back by the same build of ANVIL: instructions are
+// stored as they are in memory, so any change to their layout or to the
+// opcode numbering makes older images miss
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t instruction_size;
+    uint32_t opcode_count;
+    uint64_t key_length;
+    int32_t size;
+    int32_t label_size;
+    int32_t data_size;
+    uint32_t data_base;
+} CacheFileHeader;
+
+struct ProgramCache {
+    pthread_mutex_t lock;
+    CacheEntry** buckets;
+    uint32_t mask;
+    CacheEntry* newest;
+    CacheEntry* oldest;
+    int count;
+    int capacity;
+    char* directory;  // NULL for a memory-only cache
+    CacheStats stats;
+};
+
+typedef struct {
+    uint64_t hash;
+    const char* tag;
+    size_t tag_length;
+    const char* source;
+    size_t length;
+} CacheKey;
+
+// FNV-1a over the tag, its terminating NUL and the source
+static uint64_t hash_bytes(uint64_t hash, const char* bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static CacheKey make_key(const char* tag, const char* source, size_t length) {
+    CacheKey key = {0, tag, strlen(tag), source, length};
+    key.hash = hash_bytes(0xcbf29ce484222325ull, tag, key.tag_length + 1);
+    key.hash = hash_bytes(key.hash, source, length);
+    return key;
+}
+
+static size_t key_size(const CacheKey* key) {
+    return key->tag_length + 1 + key->length;
+}
+
+// Whether `bytes` spells out the whole key
+static bool key_equals(const CacheKey* key, const char* bytes, size_t size) {
+    return size == key_size(key) &&
+           memcmp(bytes, key->tag, key->tag_length + 1) == 0 &&
+           memcmp(bytes + key->tag_length + 1, key->source, key->length) == 0;
+}
+
+ProgramCache* program_cache_create(int capacity, const char* directory) {
+    struct stat info;
+    if (capacity <= 0 ||
+        (directory &&
+         (stat(directory, &info) != 0 || !S_ISDIR(info.st_mode)))) {
+        return NULL;
+    }
+
+    ProgramCache* cache = calloc(1, sizeof(ProgramCache));
+    if (!cache) {
+        return NULL;
+    }
+
+    uint32_t buckets = 16;
+    while (buckets < (uint32_t)capacity) {
+        buckets *= 2;
+    }
+    cache->buckets = calloc(buckets, sizeof(CacheEntry*));
+    cache->directory = directory ? strdup(directory) : NULL;
+    if (!cache->buckets || (directory && !cache->directory) ||
+        pthread_mutex_init(&cache->lock, NULL) != 0) {
+        free(cache->buckets);
+        free(cache->directory);
+        free(cache);
+        return NULL;
+    }
+    cache->mask = buckets - 1;
+    cache->capacity = capacity;
+    return cache;
+}
+
+static void entry_free(CacheEntry* entry) {
+    program_destroy(entry->program);
+    free(entry->key);
+    free(entry);
+}
+
+void program_cache_destroy(ProgramCache* cache) {
+    if (!cache) {
+        return;
+    }
+
+    CacheEntry* entry = cache->newest;
+    while (entry) {
+        CacheEntry* older = entry->older;
+        entry_free(entry);
+        entry = older;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache->directory);
+    free(cache);
+}
+
+// The helpers below run with the lock held
+
+static CacheEntry* find(const ProgramCache* cache, const CacheKey* key) {
+    for (CacheEntry* entry = cache->buckets[key->hash & cache->mask]; entry;
+         entry = entry->chain) {
+        if (entry->hash == key->hash &&
+            key_equals(key, entry->key, entry->key_length)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void unlink_entry(ProgramCache* cache, CacheEntry* entry) {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void push_newest(ProgramCache* cache, CacheEntry* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+// Marks a found entry as just used and held once more
+static CacheEntry* hold(ProgramCache* cache, CacheEntry* entry) {
+    unlink_entry(cache, entry);
+    push_newest(cache, entry);
+    entry->holders++;
+    return entry;
+}
+
+// Drops the least recently used entries nobody holds until the cache is
+// back within capacity; held ones wait for their release
+static void evict(ProgramCache* cache) {
+    CacheEntry* entry = cache->oldest;
+    while (entry && cache->count > cache->capacity) {
+        CacheEntry* newer = entry->newer;
+        if (entry->holders == 0) {
+            CacheEntry** link = &cache->buckets[entry->hash & cache->mask];
+            while (*link != entry) {
+                link = &(*link)->chain;
+            }
+            *link = entry->chain;
+            unlink_entry(cache, entry);
+            cache->count--;
+            cache->stats.evictions++;
+            entry_free(entry);
+        }
+        entry = newer;
+    }
+}
+
+// Adds a held entry for `program`. If the key is already present, that entry
+// is held and returned instead and `program` destroyed, with `*added` false.
+static CacheEntry* add_entry(ProgramCache* cache, const CacheKey* key,
+                             Program* program, bool* added) {
+    CacheEntry* entry = malloc(sizeof(CacheEntry));
+    char* bytes = malloc(key_size(key));
+    if (!entry || !bytes) {
+        free(entry);
+        free(bytes);
+        return NULL;
+    }
+    memcpy(bytes, key->tag, key->tag_length + 1);
+    memcpy(bytes + key->tag_length + 1, key->source, key->length);
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry* existing = find(cache, key);
+    if (existing) {
+        hold(cache, existing);
+        pthread_mutex_unlock(&cache->lock);
+        free(entry);
+        free(bytes);
+        program_destroy(program);
+        *added = false;
+        return existing;
+    }
+
+    entry->program = program;
+    entry->hash = key->hash;
+    entry->key = bytes;
+    entry->key_length = key_size(key);
+    entry->holders = 1;
+    entry->chain = cache->buckets[key->hash & cache->mask];
+    cache->buckets[key->hash & cache->mask] = entry;
+    push_newest(cache, entry);
+    cache->count++;
+    evict(cache);
+    pthread_mutex_unlock(&cache->lock);
+    *added = true;
+    return entry;
+}
+
+// Images
+
+static char* image_path(const ProgramCache* cache, uint64_t hash,
+                        bool temporary) {
+    size_t size = strlen(cache->directory) + 32;
+    char* path = malloc(size);
+    if (path) {
+        snprintf(path, size,
+                 temporary ? "%s/.%016" PRIx64 ".XXXXXX"
+                           : "%s/%016" PRIx64 ".anvc",
+                 cache->directory, hash);
+    }
+    return path;
+}
+
+// Writes under a temporary name and renames, so that readers, including
+// other processes sharing the directory, never see half an image
+static void write_image(const ProgramCache* cache, const CacheEntry* entry) {
+    const Program* program = entry->program;
+    char* path = image_path(cache, entry->hash, false);
+    char* temporary = image_path(cache, entry->hash, true);
+    int fd = path && temporary ? mkstemp(temporary) : -1;
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!file) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(temporary);
+        }
+        free(path);
+        free(temporary);
+        return;
+    }
+
+    CacheFileHeader header = {CACHE_MAGIC,
+                              CACHE_VERSION,
+                              sizeof(Instruction),
+                              OP_COUNT,
+                              entry->key_length,
+                              program->size,
+                              program->label_size,
+                              program->data_size,
+                              program->data_base};
+    bool ok =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(entry->key, 1, entry->key_length, file) == entry->key_length &&
+        fwrite(program->instructions, sizeof(Instruction),
+               (size_t)program->size, file) == (size_t)program->size &&
+        fwrite(program->label_addresses, sizeof(int),
+               (size_t)program->label_size,
+               file) == (size_t)program->label_size &&
+        (program->data_size == 0 ||
+         fwrite(program->data, sizeof(uint32_t), (size_t)program->data_size,
+                file) == (size_t)program->data_size);
+    if (fclose(file) != 0 || !ok || rename(temporary, path) != 0) {
+        unlink(temporary);
+    }
+    free(path);
+    free(temporary);
+}
+
+// Fills a fresh program from the rest of an image whose header checked out
+static bool read_program(FILE* file, const CacheFileHeader* header,
+                         Program* program) {
+    size_t size = (size_t)header->size;
+    size_t labels = (size_t)header->label_size;
+    size_t data = (size_t)header->data_size;
+
+    Instruction* instructions =
+        realloc(program->instructions, sizeof(Instruction) * size);
+    if (!instructions) {
+        return false;
+    }
+    program->instructions = instructions;
+    program->capacity = header->size;
+
+    Label* label_array =
+        realloc(program->labels, sizeof(Label) * (labels > 0 ? labels : 1));
+    if (!label_array) {
+        return false;
+    }
+    program->labels = label_array;
+    program->label_capacity = labels > 0 ? header->label_size : 1;
+
+    int* addresses = realloc(program->label_addresses,
+                             sizeof(int) * (labels > 0 ? labels : 1));
+    if (!addresses) {
+        return false;
+    }
+    program->label_addresses = addresses;
+
+    if (data > 0 && !(program->data = malloc(sizeof(uint32_t) * data))) {
+        return false;
+    }
+    program->data_capacity = header->data_size;
+
+    if (fread(instructions, sizeof(Instruction), size, file) != size ||
+        fread(addresses, sizeof(int), labels, file) != labels ||
+        (data > 0 &&
+         fread(program->data, sizeof(uint32_t), data, file) != data) ||
+        verify_operands(instructions, header->size, header->label_size)
+                .error != VM_SUCCESS) {
+        return false;
+    }
+
+    program->size = header->size;
+    program->label_size = header->label_size;
+    program->data_size = header->data_size;
+    program->data_base = header->data_base;
+    for (size_t i = 0; i < labels; i++) {
+        program->labels[i].name = NULL;
+        program->labels[i].address = addresses[i];
+    }
+    return true;
+}
+
+// The program stored for the key, or NULL. Beyond its sizes, an image must
+// hold only what the assembler could have produced: known opcodes, and
+// operands naming registers and labels that exist, so that even a program
+// the loader fails to verify is safe on the checked interpreter.
+static Program* read_image(const ProgramCache* cache, const CacheKey* key) {
+    char* path = image_path(cache, key->hash, false);
+    FILE* file = path ? fopen(path, "rb") : NULL;
+    free(path);
+    if (!file) {
+        return NULL;
+    }
+
+    CacheFileHeader header;
+    struct stat info;
+    char* bytes = NULL;
+    bool valid =
+        fread(&header, sizeof(header), 1, file) == 1 &&
+        fstat(fileno(file), &info) == 0 && header.magic == CACHE_MAGIC &&
+        header.version == CACHE_VERSION &&
+        header.instruction_size == sizeof(Instruction) &&
+        header.opcode_count == OP_COUNT &&
+        header.key_length == key_size(key) && header.size > 0 &&
+        header.label_size >= 0 && header.data_size >= 0 &&
+        (uint64_t)info.st_size ==
+            sizeof(header) + header.key_length +
+                sizeof(Instruction) * (uint64_t)header.size +
+                sizeof(int) * (uint64_t)header.label_size +
+                sizeof(uint32_t) * (uint64_t)header.data_size &&
+        (bytes = malloc(key_size(key))) &&
+        fread(bytes, 1, key_size(key), file) == key_size(key) &&
+        key_equals(key, bytes, key_size(key));
+
+    Program* program = valid ? program_create() : NULL;
+    if (program && !read_program(file, &header, program)) {
+        program_destroy(program);
+        program = NULL;
+    }
+    free(bytes);
+    fclose(file);
+    return program;
+}
+
+CacheEntry* program_cache_get(ProgramCache* cache, const char* tag,
+                              const char* source, size_t length) {
+    CacheKey key = make_key(tag, source, length);
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry* entry = find(cache, &key);
+    if (entry) {
+        hold(cache, entry);
+        cache->stats.hits++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (entry) {
+        return entry;
+    }
+
+    // Read outside the lock; a racing reader or put just finds the entry
+    // already added
+    Program* program = cache->directory ? read_image(cache, &key) : NULL;
+    bool added;
+    if (program && !(entry = add_entry(cache, &key, program, &added))) {
+        program_destroy(program);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (entry) {
+        cache->stats.disk_hits++;
+    } else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+CacheEntry* program_cache_put(ProgramCache* cache, const char* tag,
+                              const char* source, size_t length,
+                              Program* program) {
+    CacheKey key = make_key(tag, source, length);
+    bool added;
+    CacheEntry* entry = add_entry(cache, &key, program, &added);
+    if (entry && added && cache->directory) {
+        write_image(cache, entry);
+    }
+    return entry;
+}
+
+void program_cache_release(ProgramCache* cache, CacheEntry* entry) {
+    pthread_mutex_lock(&cache->lock);
+    entry->holders--;
+    evict(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void program_cache_stats(ProgramCache* cache, CacheStats* stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
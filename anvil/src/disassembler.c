@@ -0,0 +1,232 @@
+#include "disassembler.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORDS_PER_LINE 8
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} TextBuffer;
+
+static void append(TextBuffer* text, const char* format, ...) {
+    if (text->failed) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(text->data + text->length,
+                           text->capacity - text->length, format, args);
+    va_end(args);
+    if (needed < 0) {
+        text->failed = true;
+        return;
+    }
+
+    if (text->length + (size_t)needed >= text->capacity) {
+        size_t capacity = text->capacity * 2;
+        while (text->length + (size_t)needed >= capacity) {
+            capacity *= 2;
+        }
+        char* data = realloc(text->data, capacity);
+        if (!data) {
+            text->failed = true;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+
+        va_start(args, format);
+        vsnprintf(text->data + text->length, text->capacity - text->length,
+                  format, args);
+        va_end(args);
+    }
+    text->length += (size_t)needed;
+}
+
+// snprintf that appends at `*length`, which keeps counting past `size`
+static void put(char* buffer, size_t size, int* length, const char* format,
+                ...) {
+    size_t offset = (size_t)*length;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(offset < size ? buffer + offset : NULL,
+                      offset < size ? size - offset : 0, format, args);
+    va_end(args);
+    if (n > 0) {
+        *length += n;
+    }
+}
+
+static void put_label(const Program* program, int label, char* buffer,
+                      size_t size, int* length) {
+    if (label >= 0 && label < program->label_size &&
+        program->labels[label].name) {
+        put(buffer, size, length, "%s", program->labels[label].name);
+    } else {
+        put(buffer, size, length, "__L%d", label);
+    }
+}
+
+static void put_memory_ref(const Program* program, const MemoryRef* mem_ref,
+                           char* buffer, size_t size, int* length) {
+    bool empty = true;
+    put(buffer, size, length, "[");
+    if (mem_ref->base_reg != R_NONE) {
+        put(buffer, size, length, "%s",
+            get_register_name((Register)mem_ref->base_reg));
+        empty = false;
+    }
+    if (mem_ref->index_reg != R_NONE) {
+        put(buffer, size, length, "%s%s*%d", empty ? "" : " + ",
+            get_register_name((Register)mem_ref->index_reg), mem_ref->scale);
+        empty = false;
+    }
+    if (mem_ref->mode == ADDR_UNRESOLVED && mem_ref->symbol >= 0) {
+        put(buffer, size, length, "%s%s", empty ? "" : " + ",
+            program->symbols.symbols[mem_ref->symbol].name);
+        empty = false;
+    }
+    if (empty) {
+        put(buffer, size, length, "%d", mem_ref->offset);
+    } else if (mem_ref->offset > 0) {
+        put(buffer, size, length, " + %d", mem_ref->offset);
+    } else if (mem_ref->offset < 0) {
+        put(buffer, size, length, " - %u", 0u - (uint32_t)mem_ref->offset);
+    }
+    put(buffer, size, length, "]");
+}
+
+static void put_operand(const Program* program, const Operand* operand,
+                        char* buffer, size_t size, int* length) {
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            put(buffer, size, length, "%s",
+                get_register_name((Register)operand->value.reg));
+            break;
+        case OPERAND_IMMEDIATE:
+            put(buffer, size, length, "%d", operand->value.imm);
+            break;
+        case OPERAND_MEMORY:
+            put_memory_ref(program, &operand->value.mem_ref, buffer, size,
+                           length);
+            break;
+        case OPERAND_LABEL:
+            put_label(program, operand->value.label, buffer, size, length);
+            break;
+        case OPERAND_SYMBOL:
+            put(buffer, size, length, "%s",
+                program->symbols.symbols[operand->value.symbol].name);
+            break;
+        default:
+            put(buffer, size, length, "?");
+            break;
+    }
+}
+
+int format_instruction(const Program* program, const Instruction* instr,
+                       char* buffer, size_t size) {
+    int length = 0;
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+
+    put(buffer, size, &length, "%s", get_opcode_name(instr->opcode));
+    for (int i = 0; i < instr->num_operands; i++) {
+        put(buffer, size, &length, i == 0 ? " " : ", ");
+        if (i == 0 && instr->opcode == OP_CJMP) {
+            put(buffer, size, &length, "%s, ",
+                get_condition_name((Condition)instr->cond));
+        }
+        put_operand(program, &instr->operands[i], buffer, size, &length);
+    }
+    return length;
+}
+
+static void append_labels_at(const Program* program, const int* order,
+                             const int* first, int address,
+                             TextBuffer* text) {
+    for (int i = first[address]; i < first[address + 1]; i++) {
+        char name[64];
+        int length = 0;
+        put_label(program, order[i], name, sizeof(name), &length);
+        append(text, "%s:\n", name);
+    }
+}
+
+char* program_disassemble(const Program* program) {
+    TextBuffer text = {malloc(256), 0, 256, false};
+    if (!text.data) {
+        return NULL;
+    }
+    text.data[0] = '\0';
+
+    if (program->data_size > 0) {
+        append(&text, ".data 0x%x\n", program->data_base);
+        for (int i = 0; i < program->data_size; i++) {
+            append(&text, "%s%u", i % WORDS_PER_LINE == 0 ? "    .word " : ", ",
+                   program->data[i]);
+            if (i % WORDS_PER_LINE == WORDS_PER_LINE - 1 ||
+                i == program->data_size - 1) {
+                append(&text, "\n");
+            }
+        }
+        append(&text, ".text\n");
+    }
+
+    // Bucket the placed labels by address, in label order
+    int* first = calloc((size_t)program->size + 2, sizeof(int));
+    int* order = malloc(sizeof(int) * (program->label_size + 1));
+    if (!first || !order) {
+        free(first);
+        free(order);
+        free(text.data);
+        return NULL;
+    }
+    for (int i = 0; i < program->label_size; i++) {
+        int address = program->labels[i].address;
+        if (address >= 0 && address <= program->size) {
+            first[address + 1]++;
+        }
+    }
+    for (int a = 0; a <= program->size; a++) {
+        first[a + 1] += first[a];
+    }
+    int* next = calloc((size_t)program->size + 1, sizeof(int));
+    if (!next) {
+        free(first);
+        free(order);
+        free(text.data);
+        return NULL;
+    }
+    for (int i = 0; i < program->label_size; i++) {
+        int address = program->labels[i].address;
+        if (address >= 0 && address <= program->size) {
+            order[first[address] + next[address]++] = i;
+        }
+    }
+    free(next);
+
+    char line[256];
+    for (int ip = 0; ip < program->size; ip++) {
+        append_labels_at(program, order, first, ip, &text);
+        format_instruction(program, &program->instructions[ip], line,
+                           sizeof(line));
+        append(&text, "    %s\n", line);
+    }
+    append_labels_at(program, order, first, program->size, &text);
+
+    free(first);
+    free(order);
+    if (text.failed) {
+        free(text.data);
+        return NULL;
+    }
+    return text.data;
+}
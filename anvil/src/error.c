@@ -41,6 +41,12 @@ int handle_error(VMError err) {
         case VM_ERROR_MEMORY_ALREADY_INITIALIZED:
             fprintf(stderr, "[ANVIL] Error: Memory already initialized!\n");
             break;
+        case VM_ERROR_INVALID_HEAP_ADDRESS:
+            fprintf(stderr, "[ANVIL] Error: Invalid heap address!\n");
+            break;
+        case VM_ERROR_STEP_LIMIT:
+            fprintf(stderr, "[ANVIL] Error: Step limit reached!\n");
+            break;
         default:
             fprintf(stderr, "[ANVIL] Error: Unknown error occurred!\n");
     }
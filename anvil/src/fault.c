@@ -0,0 +1,65 @@
+#include "fault.h"
+
+#ifdef ANVIL_GUARD_MEMORY
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+static _Thread_local FaultContext* current_fault;
+
+static struct sigaction previous_segv;
+static struct sigaction previous_bus;
+static pthread_once_t install_once = PTHREAD_ONCE_INIT;
+static bool installed;
+
+static void fault_handler(int sig, siginfo_t* info, void* ucontext) {
+    FaultContext* fault = current_fault;
+    if (fault && memory_translate_fault(fault->memory, info->si_addr,
+                                        &fault->address)) {
+        current_fault = fault->previous;
+        siglongjmp(fault->env, 1);
+    }
+
+    // Not a guest access: hand the fault to whoever had it before
+    const struct sigaction* previous =
+        sig == SIGBUS ? &previous_bus : &previous_segv;
+    if ((previous->sa_flags & SA_SIGINFO) && previous->sa_sigaction) {
+        previous->sa_sigaction(sig, info, ucontext);
+        return;
+    }
+    if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN) {
+        previous->sa_handler(sig);
+        return;
+    }
+
+    // Restore the default action; returning re-executes the access
+    signal(sig, SIG_DFL);
+}
+
+static void install_handlers(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = fault_handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+
+    installed = sigaction(SIGSEGV, &action, &previous_segv) == 0 &&
+                sigaction(SIGBUS, &action, &previous_bus) == 0;
+}
+
+bool fault_handler_install(void) {
+    pthread_once(&install_once, install_handlers);
+    return installed;
+}
+
+void fault_enter(FaultContext* fault, const Memory* memory) {
+    fault->memory = memory;
+    fault->address = 0;
+    fault->previous = current_fault;
+    current_fault = fault;
+}
+
+void fault_leave(FaultContext* fault) { current_fault = fault->previous; }
+
+#endif  // ANVIL_GUARD_MEMORY
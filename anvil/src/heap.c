@@ -0,0 +1,155 @@
+#include "heap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Per-granule block state: 0 if no block starts there, otherwise the size
+// class plus one, with BLOCK_FREE set while the block is on a free list
+#define BLOCK_FREE 0x80
+
+static uint32_t class_size(int size_class) {
+    return (uint32_t)HEAP_GRANULE << size_class;
+}
+
+static int size_class_of(uint32_t size) {
+    int size_class = 0;
+    while (class_size(size_class) < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+// The block state of `address`, or 0 if it is not a granule in use
+static uint8_t block_state(const Heap* heap, uint32_t address) {
+    if (address < heap->base || address >= heap->top ||
+        (address - heap->base) % HEAP_GRANULE != 0) {
+        return 0;
+    }
+    return heap->blocks[(address - heap->base) / HEAP_GRANULE];
+}
+
+static void set_block_state(Heap* heap, uint32_t address, uint8_t state) {
+    heap->blocks[(address - heap->base) / HEAP_GRANULE] = state;
+}
+
+VMError heap_init(Heap* heap, uint32_t base, uint32_t size) {
+    if (!heap || (base == 0 && size > 0)) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+
+    size -= size % HEAP_GRANULE;
+    heap->base = base;
+    heap->end = base + size;
+    heap->top = base;
+    heap->live_blocks = 0;
+    for (int i = 0; i < HEAP_CLASS_COUNT; i++) {
+        heap->free_lists[i] = 0;
+    }
+
+    heap->blocks = NULL;
+    if (size > 0) {
+        heap->blocks = calloc(size / HEAP_GRANULE, sizeof(uint8_t));
+        if (!heap->blocks) {
+            return VM_ERROR_MEMORY_INIT;
+        }
+    }
+    return VM_SUCCESS;
+}
+
+void heap_destroy(Heap* heap) {
+    if (heap) {
+        free(heap->blocks);
+        heap->blocks = NULL;
+        heap->base = heap->end = heap->top = 0;
+    }
+}
+
+VMError heap_alloc(Heap* heap, Memory* memory, uint32_t size,
+                   uint32_t* address) {
+    *address = 0;
+    if (size > heap->end - heap->base) {
+        return VM_SUCCESS;
+    }
+
+    int size_class = size_class_of(size);
+    uint8_t allocated = (uint8_t)(size_class + 1);
+
+    // The links live in guest memory. One the guest overwrote may still
+    // name a free block of the class, such as the block itself; the head is
+    // checked again before it is taken, and a list that fails is dropped.
+    uint32_t block = heap->free_lists[size_class];
+    if (block != 0 &&
+        (block_state(heap, block) != (allocated | BLOCK_FREE) ||
+         memory->data[block] == block)) {
+        heap->free_lists[size_class] = block = 0;
+    }
+    if (block != 0) {
+        uint32_t next = memory->data[block];
+        if (next != 0 && block_state(heap, next) != (allocated | BLOCK_FREE)) {
+            next = 0;
+        }
+        heap->free_lists[size_class] = next;
+    } else {
+        if (class_size(size_class) > heap->end - heap->top) {
+            return VM_SUCCESS;
+        }
+        block = heap->top;
+        heap->top += class_size(size_class);
+    }
+
+    set_block_state(heap, block, allocated);
+    heap->live_blocks++;
+    *address = block;
+    return VM_SUCCESS;
+}
+
+VMError heap_free(Heap* heap, Memory* memory, uint32_t address) {
+    if (address == 0) {
+        return VM_SUCCESS;
+    }
+
+    uint8_t state = block_state(heap, address);
+    if (state == 0 || (state & BLOCK_FREE)) {
+        return VM_ERROR_INVALID_HEAP_ADDRESS;
+    }
+
+    int size_class = state - 1;
+    memory->data[address] = heap->free_lists[size_class];
+    heap->free_lists[size_class] = address;
+    set_block_state(heap, address, state | BLOCK_FREE);
+    heap->live_blocks--;
+    return VM_SUCCESS;
+}
+
+VMError heap_realloc(Heap* heap, Memory* memory, uint32_t address,
+                     uint32_t size, uint32_t* new_address) {
+    if (address == 0) {
+        return heap_alloc(heap, memory, size, new_address);
+    }
+
+    uint32_t capacity = heap_block_size(heap, address);
+    if (capacity == 0) {
+        *new_address = 0;
+        return VM_ERROR_INVALID_HEAP_ADDRESS;
+    }
+    if (size <= capacity) {
+        *new_address = address;
+        return VM_SUCCESS;
+    }
+
+    VMError err = heap_alloc(heap, memory, size, new_address);
+    if (err != VM_SUCCESS || *new_address == 0) {
+        return err;
+    }
+    memcpy(&memory->data[*new_address], &memory->data[address],
+           sizeof(uint32_t) * capacity);
+    return heap_free(heap, memory, address);
+}
+
+uint32_t heap_block_size(const Heap* heap, uint32_t address) {
+    uint8_t state = block_state(heap, address);
+    if (state == 0 || (state & BLOCK_FREE)) {
+        return 0;
+    }
+    return class_size(state - 1);
+}
@@ -8,59 +8,300 @@
 #endif
 #endif
 
-VMError execute_instruction(VM* vm, Instruction instr) {
+#if defined(__GNUC__) || defined(__clang__)
+#define ALWAYS_INLINE __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE
+#endif
+
+// The interpreter is instantiated three times: `checked` re-validates
+// everything the verifier can prove statically, while the verified variant
+// trusts the program and keeps only the checks that depend on runtime values
+// (computed memory addresses, the stack, return addresses, division by
+// zero). The guarded variant additionally drops the address checks and
+// relies on guard pages to fault on out-of-range accesses.
+
+static inline ALWAYS_INLINE bool valid_address_registers(
+    const MemoryRef* mem_ref) {
+    return mem_ref->base_reg >= 0 && mem_ref->base_reg < R_COUNT &&
+           mem_ref->index_reg >= 0 && mem_ref->index_reg < R_COUNT;
+}
+
+// Wrapping 32-bit arithmetic, so the result always falls inside the guard
+// regions of guarded memory
+static inline ALWAYS_INLINE int address_of(VM* vm, const MemoryRef* mem_ref) {
+    const int* registers = vm->cpu.registers;
+    uint32_t address = (uint32_t)mem_ref->offset;
+
+    switch (mem_ref->mode) {
+        case ADDR_ABSOLUTE:
+            break;
+        case ADDR_BASE_DISP:
+            address += (uint32_t)registers[mem_ref->base_reg];
+            break;
+        case ADDR_INDEX_DISP:
+            address +=
+                (uint32_t)registers[mem_ref->index_reg] * mem_ref->scale;
+            break;
+        case ADDR_BASE_INDEX_DISP:
+            address += (uint32_t)registers[mem_ref->base_reg] +
+                       (uint32_t)registers[mem_ref->index_reg] * mem_ref->scale;
+            break;
+        default:
+            if (mem_ref->base_reg != R_NONE) {
+                address += (uint32_t)registers[mem_ref->base_reg];
+            }
+            if (mem_ref->index_reg != R_NONE) {
+                address +=
+                    (uint32_t)registers[mem_ref->index_reg] * mem_ref->scale;
+            }
+            break;
+    }
+
+    return (int32_t)address;
+}
+
+// Compute the address of a memory operand, valid below `limit` (in words, or
+// in bytes for the narrow accesses). Returns false if the access must be
+// rejected; guarded memory instead faults on a bad address.
+static inline ALWAYS_INLINE bool resolve_address(VM* vm,
+                                                 const MemoryRef* mem_ref,
+                                                 const bool checked,
+                                                 const bool guarded,
+                                                 const uint32_t limit,
+                                                 int* address) {
+    if (checked && !valid_address_registers(mem_ref)) {
+        *address = 0;
+        return false;
+    }
+
+    *address = address_of(vm, mem_ref);
+    if (guarded || (!checked && mem_ref->mode == ADDR_ABSOLUTE)) {
+        return true;
+    }
+    return (uint32_t)*address < limit;
+}
+
+static inline ALWAYS_INLINE int operand_value(VM* vm, const Operand* operand,
+                                              const bool checked,
+                                              const bool guarded) {
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            if (checked &&
+                (operand->value.reg < 0 || operand->value.reg >= R_COUNT)) {
+                fprintf(stderr, "[ANVIL] Error: Invalid register index %d\n",
+                        operand->value.reg);
+                return 0;
+            }
+            return vm->cpu.registers[operand->value.reg];
+        case OPERAND_IMMEDIATE:
+            return operand->value.imm;
+        case OPERAND_MEMORY: {
+            int address;
+            if (!resolve_address(vm, &operand->value.mem_ref, checked, guarded,
+                                 vm->memory.size, &address)) {
+                fprintf(stderr, "[ANVIL] Error: Invalid memory address %d\n",
+                        address);
+                return 0;
+            }
+
+            return vm->memory.data[address];
+        }
+        case OPERAND_LABEL:
+            if (checked) {
+                return find_label_address(vm, operand->value.label);
+            }
+            return vm->label_addresses[operand->value.label];
+        default:
+            fprintf(stderr, "[ANVIL] Error: Invalid operand type!\n");
+            return 0;
+    }
+}
+
+static inline ALWAYS_INLINE VMError store_operand(VM* vm,
+                                                  const Operand* operand,
+                                                  int value,
+                                                  const bool checked,
+                                                  const bool guarded) {
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            if (checked &&
+                (operand->value.reg < 0 || operand->value.reg >= R_COUNT)) {
+                fprintf(stderr, "[ANVIL] Error: Invalid register index %d\n",
+                        operand->value.reg);
+                return VM_ERROR_INVALID_REGISTER;
+            }
+            vm->cpu.registers[operand->value.reg] = value;
+            return VM_SUCCESS;
+        case OPERAND_MEMORY: {
+            int address;
+            if (!resolve_address(vm, &operand->value.mem_ref, checked, guarded,
+                                 vm->memory.size, &address)) {
+                fprintf(stderr, "[ANVIL] Error: Invalid memory address %d\n",
+                        address);
+                return VM_ERROR_MEMORY_ACCESS;
+            }
+
+            vm->memory.data[address] = value;
+            return VM_SUCCESS;
+        }
+        default:
+            fprintf(stderr,
+                    "[ANVIL] Error: Cannot set value for this operand type!\n");
+            return VM_ERROR_INVALID_OPERAND;
+    }
+}
+
+// PUSH stores below SP and POP reads at SP. SP is an ordinary register, so
+// both check it against the whole stack.
+static inline ALWAYS_INLINE bool stack_has_room(VM* vm, int sp,
+                                                int64_t words) {
+    return sp <= vm_stack_start(vm) &&
+           (int64_t)sp - words >= vm_stack_limit(vm);
+}
+
+static inline ALWAYS_INLINE bool stack_has_data(VM* vm, int sp,
+                                                int64_t words) {
+    return sp >= vm_stack_limit(vm) &&
+           (int64_t)sp + words <= vm_stack_start(vm);
+}
+
+static inline ALWAYS_INLINE int label_target(VM* vm, int label_index,
+                                             const bool checked) {
+    if (checked) {
+        return find_label_address(vm, label_index);
+    }
+    return vm->label_addresses[label_index];
+}
+
+// LDB/LDH zero-extend the byte or halfword at a byte address into a register
+static inline ALWAYS_INLINE VMError load_narrow(VM* vm,
+                                                const Instruction* instr,
+                                                const int width,
+                                                const bool checked,
+                                                const bool guarded) {
+    if (checked && (instr->operands[0].type != OPERAND_REGISTER ||
+                    instr->operands[1].type != OPERAND_MEMORY)) {
+        fprintf(stderr, "[ANVIL] Error: Invalid operand type for %s!\n",
+                width == 1 ? "LDB" : "LDH");
+        return VM_ERROR_INVALID_OPERAND;
+    }
+
+    int address;
+    if (!resolve_address(vm, &instr->operands[1].value.mem_ref, checked,
+                         guarded, memory_byte_size(&vm->memory) - width + 1,
+                         &address)) {
+        fprintf(stderr, "[ANVIL] Error: Invalid byte address %d\n", address);
+        return VM_ERROR_MEMORY_ACCESS;
+    }
+
+    const uint8_t* bytes = memory_bytes(&vm->memory) + address;
+    uint32_t value = bytes[0];
+    if (width == 2) {
+        uint16_t half;
+        memcpy(&half, bytes, sizeof(half));
+        value = half;
+    }
+    return store_operand(vm, &instr->operands[0], (int)value, checked,
+                         guarded);
+}
+
+// STB/STH store the low byte or halfword of a register or immediate
+static inline ALWAYS_INLINE VMError store_narrow(VM* vm,
+                                                 const Instruction* instr,
+                                                 const int width,
+                                                 const bool checked,
+                                                 const bool guarded) {
+    if (checked && (instr->operands[0].type != OPERAND_MEMORY ||
+                    (instr->operands[1].type != OPERAND_REGISTER &&
+                     instr->operands[1].type != OPERAND_IMMEDIATE))) {
+        fprintf(stderr, "[ANVIL] Error: Invalid operand type for %s!\n",
+                width == 1 ? "STB" : "STH");
+        return VM_ERROR_INVALID_OPERAND;
+    }
+
+    int address;
+    if (!resolve_address(vm, &instr->operands[0].value.mem_ref, checked,
+                         guarded, memory_byte_size(&vm->memory) - width + 1,
+                         &address)) {
+        fprintf(stderr, "[ANVIL] Error: Invalid byte address %d\n", address);
+        return VM_ERROR_MEMORY_ACCESS;
+    }
+
+    uint32_t value =
+        (uint32_t)operand_value(vm, &instr->operands[1], checked, guarded);
+    uint8_t* bytes = memory_bytes(&vm->memory) + address;
+    if (width == 1) {
+        bytes[0] = (uint8_t)value;
+    } else {
+        uint16_t half = (uint16_t)value;
+        memcpy(bytes, &half, sizeof(half));
+    }
+    return VM_SUCCESS;
+}
+
+// Square and multiply, wrapping like MUL: O(log exponent) steps in place of a
+// guest loop. A negative exponent truncates toward zero like DIV, so only
+// bases 1 and -1 give a nonzero result.
+static inline ALWAYS_INLINE int integer_power(int base, int exponent) {
+    if (exponent < 0) {
+        if (base == 1 || base == -1) {
+            return (exponent & 1) ? base : 1;
+        }
+        return 0;
+    }
+
+    uint32_t result = 1;
+    uint32_t factor = (uint32_t)base;
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result *= factor;
+        }
+        factor *= factor;
+        exponent >>= 1;
+    }
+    return (int)result;
+}
+
+static inline ALWAYS_INLINE VMError execute(VM* vm, const Instruction* instr,
+                                            const bool checked,
+                                            const bool guarded) {
     VMError err = VM_SUCCESS;
     int value;
     int val1, val2, result;
-    int addr, target_addr, return_addr;
-
-    val1 = get_operand_value(vm, instr.operands[0]);
-    if (instr.num_operands > 1) val2 = get_operand_value(vm, instr.operands[1]);
+    int addr, target_addr, sp;
+
+    // MOV never reads its destination, LEA must not access memory at all and
+    // the narrow loads and stores address memory in bytes
+    const OpCode opcode = instr->opcode;
+    val1 = val2 = 0;
+    if (opcode != OP_MOV && opcode != OP_LEA && opcode != OP_LDB &&
+        opcode != OP_LDH && opcode != OP_STB && opcode != OP_STH) {
+        val1 = operand_value(vm, &instr->operands[0], checked, guarded);
+        if (instr->num_operands > 1)
+            val2 = operand_value(vm, &instr->operands[1], checked, guarded);
+    }
 
-    switch (instr.opcode) {
+    switch (instr->opcode) {
         case OP_HALT:
             vm->cpu.ip = -1;  // Stop execution
             break;
 
         case OP_MOV:
-            value = get_operand_value(vm, instr.operands[1]);
-            if (instr.operands[0].type == OPERAND_REGISTER) {
-                vm->cpu.registers[instr.operands[0].value.reg] = value;
-            } else if (instr.operands[0].type == OPERAND_MEMORY) {
-                MemoryRef mem_ref = instr.operands[0].value.mem_ref;
-                uint32_t effective_address = 0;
-
-                if (mem_ref.base_reg >= R_NONE) {
-                    if (mem_ref.base_reg >= R_NONE &&
-                        mem_ref.base_reg < R_COUNT) {
-                        effective_address +=
-                            vm->cpu.registers[mem_ref.base_reg];
-                    } else {
-                        err = VM_ERROR_INVALID_REGISTER;
-                        fprintf(stderr,
-                                "[ANVIL] Error: Invalid base register in MOV "
-                                "destination!\n");
-                        return err;
-                    }
-                }
-
-                effective_address += mem_ref.offset;
-
-                err = write_memory(&vm->memory, effective_address, value);
-                if (err != VM_SUCCESS) {
-                    fprintf(stderr,
-                            "[ANVIL] Error: Failed to write to memory at 0x%x. "
-                            "Error "
-                            "code: %d\n",
-                            effective_address, err);
-                    return err;
-                }
-            } else {
+            value = operand_value(vm, &instr->operands[1], checked, guarded);
+            if (checked && instr->operands[0].type != OPERAND_REGISTER &&
+                instr->operands[0].type != OPERAND_MEMORY) {
                 err = VM_ERROR_INVALID_OPERAND;
                 fprintf(stderr,
                         "[ANVIL] Error: Invalid destination for MOV!\n");
                 return err;
             }
+
+            err = store_operand(vm, &instr->operands[0], value, checked,
+                                guarded);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
             vm->cpu.ip++;
             break;
 
@@ -74,7 +315,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 + val2;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -97,7 +339,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 - val2;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -120,7 +363,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 * val2;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -133,31 +377,85 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             vm->cpu.ip++;
             break;
 
+        // Signed and truncating toward zero. INT_MIN / -1 wraps to INT_MIN
+        // with remainder 0 instead of trapping the host.
         case OP_DIV:
+        case OP_MOD:
             if (val2 == 0) {
                 err = VM_ERROR_DIVIDE_BY_ZERO;
                 fprintf(stderr, "[ANVIL] Error: Division by zero!\n");
                 return err;
             }
 
+            if (val2 == -1) {
+                result = opcode == OP_DIV ? (int)(0u - (uint32_t)val1) : 0;
+            } else {
 #ifdef USE_ASM
-            asm volatile(
-                "mov %[val1], %%eax\n\t"
-                "xor %%edx, %%edx\n\t"
-                "div %[val2]\n\t"
-                "mov %%eax, %[result]"
-                : [result] "=r"(result)
-                : [val1] "r"(val1), [val2] "r"(val2)
-                : "eax", "edx");
+                int quotient, remainder;
+                asm volatile(
+                    "cltd\n\t"
+                    "idivl %[val2]"
+                    : "=a"(quotient), "=&d"(remainder)
+                    : "a"(val1), [val2] "r"(val2));
+                result = opcode == OP_DIV ? quotient : remainder;
+#else
+                result = opcode == OP_DIV ? val1 / val2 : val1 % val2;
+#endif
+            }
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+
+            err = update_flags(vm, result, val1, val2, opcode);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+
+            vm->cpu.ip++;
+            break;
+
+        case OP_SHL:
+        case OP_SHR:
+#ifdef USE_ASM
+            if (opcode == OP_SHL) {
+                asm volatile("shll %%cl, %[result]"
+                             : [result] "=r"(result)
+                             : "0"(val1), "c"(val2));
+            } else {
+                asm volatile("shrl %%cl, %[result]"
+                             : [result] "=r"(result)
+                             : "0"(val1), "c"(val2));
+            }
 #else
-            result = val1 / val2;
+            result = opcode == OP_SHL
+                         ? (int)((uint32_t)val1 << (val2 & 31))
+                         : (int)((uint32_t)val1 >> (val2 & 31));
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+
+            err = update_flags(vm, result, val1, val2, opcode);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+
+            vm->cpu.ip++;
+            break;
+
+        case OP_POW:
+            result = integer_power(val1, val2);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
 
-            err = update_flags(vm, result, val1, val2, OP_DIV);
+            err = update_flags(vm, result, val1, val2, OP_POW);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -175,7 +473,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 + 1;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -199,7 +498,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 - 1;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -222,7 +522,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 & val2;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -245,7 +546,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 | val2;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -268,7 +570,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
 #else
             result = val1 ^ val2;
 #endif
-            err = set_operand_value(vm, instr.operands[0], result);
+            err = store_operand(vm, &instr->operands[0], result, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -320,13 +623,14 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             break;
 
         case OP_JMP:
-            vm->cpu.ip = find_label_address(vm, instr.operands[0].value.label);
+            vm->cpu.ip =
+                label_target(vm, instr->operands[0].value.label, checked);
             break;
 
         case OP_JZ:
             if (vm->cpu.flags & FL_ZF)
                 vm->cpu.ip =
-                    find_label_address(vm, instr.operands[0].value.label);
+                    label_target(vm, instr->operands[0].value.label, checked);
             else
                 vm->cpu.ip++;
             break;
@@ -334,7 +638,7 @@ VMError execute_instruction(VM* vm, Instruction instr) {
         case OP_JNZ:
             if (!(vm->cpu.flags & FL_ZF))
                 vm->cpu.ip =
-                    find_label_address(vm, instr.operands[0].value.label);
+                    label_target(vm, instr->operands[0].value.label, checked);
             else
                 vm->cpu.ip++;
             break;
@@ -343,7 +647,7 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             if (!(vm->cpu.flags & FL_ZF) && ((vm->cpu.flags & FL_SF) == 0) ==
                                                 ((vm->cpu.flags & FL_OF) == 0))
                 vm->cpu.ip =
-                    find_label_address(vm, instr.operands[0].value.label);
+                    label_target(vm, instr->operands[0].value.label, checked);
             else
                 vm->cpu.ip++;
             break;
@@ -352,16 +656,76 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             if (((vm->cpu.flags & FL_SF) == 0) !=
                 ((vm->cpu.flags & FL_OF) == 0))
                 vm->cpu.ip =
-                    find_label_address(vm, instr.operands[0].value.label);
+                    label_target(vm, instr->operands[0].value.label, checked);
+            else
+                vm->cpu.ip++;
+            break;
+
+        // LOOP and CJMP decide the branch without computing the flags
+        case OP_LOOP:
+            if (checked && (instr->operands[0].type != OPERAND_REGISTER ||
+                            instr->operands[1].type != OPERAND_LABEL)) {
+                err = VM_ERROR_INVALID_OPERAND;
+                fprintf(stderr,
+                        "[ANVIL] Error: Invalid operand type for LOOP!\n");
+                return err;
+            }
+            value = (int)((uint32_t)val1 - 1);
+            vm->cpu.registers[instr->operands[0].value.reg] = value;
+            if (value != 0)
+                vm->cpu.ip =
+                    label_target(vm, instr->operands[1].value.label, checked);
             else
                 vm->cpu.ip++;
             break;
 
+        case OP_CJMP: {
+            if (checked && instr->operands[2].type != OPERAND_LABEL) {
+                err = VM_ERROR_INVALID_OPERAND;
+                fprintf(stderr,
+                        "[ANVIL] Error: Invalid operand type for CJMP!\n");
+                return err;
+            }
+            bool taken;
+            switch (instr->cond) {
+                case COND_EQ:
+                    taken = val1 == val2;
+                    break;
+                case COND_NE:
+                    taken = val1 != val2;
+                    break;
+                case COND_LT:
+                    taken = val1 < val2;
+                    break;
+                case COND_LE:
+                    taken = val1 <= val2;
+                    break;
+                case COND_GT:
+                    taken = val1 > val2;
+                    break;
+                case COND_GE:
+                    taken = val1 >= val2;
+                    break;
+                default:
+                    err = VM_ERROR_INVALID_INSTRUCTION;
+                    fprintf(stderr,
+                            "[ANVIL] Error: Unknown CJMP condition %d\n",
+                            instr->cond);
+                    return err;
+            }
+            if (taken)
+                vm->cpu.ip =
+                    label_target(vm, instr->operands[2].value.label, checked);
+            else
+                vm->cpu.ip++;
+            break;
+        }
+
         case OP_JGE:
             if (((vm->cpu.flags & FL_SF) == 0) ==
                 ((vm->cpu.flags & FL_OF) == 0))
                 vm->cpu.ip =
-                    find_label_address(vm, instr.operands[0].value.label);
+                    label_target(vm, instr->operands[0].value.label, checked);
             else
                 vm->cpu.ip++;
             break;
@@ -370,7 +734,7 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             if ((vm->cpu.flags & FL_ZF) || ((vm->cpu.flags & FL_SF) == 0) !=
                                                ((vm->cpu.flags & FL_OF) == 0))
                 vm->cpu.ip =
-                    find_label_address(vm, instr.operands[0].value.label);
+                    label_target(vm, instr->operands[0].value.label, checked);
             else
                 vm->cpu.ip++;
             break;
@@ -378,12 +742,19 @@ VMError execute_instruction(VM* vm, Instruction instr) {
         case OP_LEA:
             addr = 0;
 
-            if (instr.operands[1].type == OPERAND_MEMORY)
-                addr = instr.operands[1].value.mem;
-            else if (instr.operands[1].type == OPERAND_IMMEDIATE)
-                addr = instr.operands[1].value.imm;
-            else if (instr.operands[1].type == OPERAND_REGISTER)
-                addr = vm->cpu.registers[instr.operands[1].value.reg];
+            if (instr->operands[1].type == OPERAND_MEMORY) {
+                const MemoryRef* mem_ref = &instr->operands[1].value.mem_ref;
+                if (checked && !valid_address_registers(mem_ref)) {
+                    err = VM_ERROR_INVALID_REGISTER;
+                    fprintf(stderr,
+                            "[ANVIL] Error: Invalid register in LEA source!\n");
+                    return err;
+                }
+                addr = address_of(vm, mem_ref);
+            } else if (instr->operands[1].type == OPERAND_IMMEDIATE)
+                addr = instr->operands[1].value.imm;
+            else if (instr->operands[1].type == OPERAND_REGISTER)
+                addr = vm->cpu.registers[instr->operands[1].value.reg];
             else {
                 err = VM_ERROR_INVALID_OPERAND;
                 fprintf(stderr,
@@ -391,7 +762,8 @@ VMError execute_instruction(VM* vm, Instruction instr) {
                 return err;
             }
 
-            err = set_operand_value(vm, instr.operands[0], addr);
+            err = store_operand(vm, &instr->operands[0], addr, checked,
+                                guarded);
             if (err != VM_SUCCESS) {
                 return err;
             }
@@ -400,19 +772,22 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             break;
 
         case OP_PUSH:
-            if (vm->cpu.sp <= (STACK_START - STACK_SIZE)) {
+            sp = vm->cpu.registers[R_SP];
+            if (!stack_has_room(vm, sp, 1)) {
                 err = VM_ERROR_STACK_OVERFLOW;
                 fprintf(stderr,
                         "[ANVIL] Error: Stack overflow at instruction %d\n",
                         vm->cpu.ip);
                 return err;
             }
-            vm->memory.data[--vm->cpu.sp] = val1;
+            vm->memory.data[--sp] = val1;
+            vm->cpu.registers[R_SP] = sp;
             vm->cpu.ip++;
             break;
 
         case OP_POP:
-            if (vm->cpu.sp >= vm->cpu.registers[R_BP]) {
+            sp = vm->cpu.registers[R_SP];
+            if (!stack_has_data(vm, sp, 1)) {
                 err = VM_ERROR_STACK_UNDERFLOW;
                 fprintf(stderr,
                         "[ANVIL] Error: Stack underflow at instruction %d\n",
@@ -420,16 +795,18 @@ VMError execute_instruction(VM* vm, Instruction instr) {
                 return err;
             }
 
-            if (instr.operands[0].type != OPERAND_REGISTER &&
-                instr.operands[0].type != OPERAND_MEMORY) {
+            if (checked && instr->operands[0].type != OPERAND_REGISTER &&
+                instr->operands[0].type != OPERAND_MEMORY) {
                 err = VM_ERROR_INVALID_OPERAND;
                 fprintf(stderr,
                         "[ANVIL] Error: Invalid destination for POP!\n");
                 return err;
             }
 
-            err = set_operand_value(vm, instr.operands[0],
-                                    vm->memory.data[vm->cpu.sp++]);
+            // SP moves first, so `pop sp` keeps the popped value
+            vm->cpu.registers[R_SP] = sp + 1;
+            err = store_operand(vm, &instr->operands[0], vm->memory.data[sp],
+                                checked, guarded);
             if (err != VM_SUCCESS) {
                 fprintf(stderr,
                         "[ANVIL] Error: Failed to set operand value!\n");
@@ -439,18 +816,52 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             vm->cpu.ip++;
             break;
 
+        // ENTER n: push BP, point BP at it and reserve n words of locals
+        case OP_ENTER:
+            value = instr->num_operands > 0 ? val1 : 0;
+            sp = vm->cpu.registers[R_SP];
+            if (value < 0 || !stack_has_room(vm, sp, 1 + (int64_t)value)) {
+                err = VM_ERROR_STACK_OVERFLOW;
+                fprintf(stderr,
+                        "[ANVIL] Error: Stack overflow on ENTER at %d\n",
+                        vm->cpu.ip);
+                return err;
+            }
+            vm->memory.data[--sp] = vm->cpu.registers[R_BP];
+            vm->cpu.registers[R_BP] = sp;
+            vm->cpu.registers[R_SP] = sp - value;
+            vm->cpu.ip++;
+            break;
+
+        // LEAVE: drop the locals and restore the caller's BP
+        case OP_LEAVE:
+            sp = vm->cpu.registers[R_BP];
+            if (!stack_has_data(vm, sp, 1)) {
+                err = VM_ERROR_STACK_UNDERFLOW;
+                fprintf(stderr,
+                        "[ANVIL] Error: Stack underflow on LEAVE at %d\n",
+                        vm->cpu.ip);
+                return err;
+            }
+            vm->cpu.registers[R_BP] = vm->memory.data[sp];
+            vm->cpu.registers[R_SP] = sp + 1;
+            vm->cpu.ip++;
+            break;
+
         case OP_CALL:
-            if (vm->cpu.sp <= (STACK_START - STACK_SIZE)) {
+            if (vm->call_depth >= vm->call_capacity) {
                 err = VM_ERROR_STACK_OVERFLOW;
                 fprintf(
                     stderr,
-                    "[ANVIL] Error: Stack overflow on CALL instruction at %d\n",
+                    "[ANVIL] Error: Call stack overflow on CALL at %d\n",
                     vm->cpu.ip);
                 return err;
             }
 
-            target_addr = find_label_address(vm, instr.operands[0].value.label);
-            if (target_addr < 0 || target_addr >= vm->program_size) {
+            target_addr =
+                label_target(vm, instr->operands[0].value.label, checked);
+            if (checked &&
+                (target_addr < 0 || target_addr >= vm->program_size)) {
                 err = VM_ERROR_INVALID_INSTRUCTION;
                 fprintf(stderr,
                         "[ANVIL] Error: Invalid CALL target address %d\n",
@@ -458,29 +869,23 @@ VMError execute_instruction(VM* vm, Instruction instr) {
                 return err;
             }
 
-            vm->memory.data[--vm->cpu.sp] = vm->cpu.ip + 1;
+            vm->call_stack[vm->call_depth++] = vm->cpu.ip + 1;
             vm->cpu.ip = target_addr;
             break;
 
+        // Return addresses were pushed by CALL and cannot be modified, so
+        // they need no validation
         case OP_RET:
-            if (vm->cpu.sp >= vm->cpu.registers[R_BP]) {
+            if (vm->call_depth == 0) {
                 err = VM_ERROR_STACK_UNDERFLOW;
                 fprintf(
                     stderr,
-                    "[ANVIL] Error: Stack underflow on RET instruction at %d\n",
+                    "[ANVIL] Error: Call stack underflow on RET at %d\n",
                     vm->cpu.ip);
                 return err;
             }
 
-            return_addr = vm->memory.data[vm->cpu.sp++];
-            if (return_addr < 0 || return_addr >= vm->program_size) {
-                err = VM_ERROR_INVALID_INSTRUCTION;
-                fprintf(stderr, "[ANVIL] Error: Invalid return address %d\n",
-                        return_addr);
-                return err;
-            }
-
-            vm->cpu.ip = return_addr;
+            vm->cpu.ip = vm->call_stack[--vm->call_depth];
             break;
 
         case OP_NOP:
@@ -488,22 +893,24 @@ VMError execute_instruction(VM* vm, Instruction instr) {
             break;
 
         case OP_OUT:
-            if (instr.operands[0].type != OPERAND_REGISTER &&
-                instr.operands[0].type != OPERAND_MEMORY) {
+            if (checked && instr->operands[0].type != OPERAND_REGISTER &&
+                instr->operands[0].type != OPERAND_IMMEDIATE &&
+                instr->operands[0].type != OPERAND_MEMORY) {
                 err = VM_ERROR_INVALID_OPERAND;
                 fprintf(stderr,
                         "[ANVIL] Error: Invalid operand type for OUT!\n");
                 return err;
             }
 
-            value = get_operand_value(vm, instr.operands[0]);
+            value = operand_value(vm, &instr->operands[0], checked, guarded);
             int format_or_length = 0;
-            if (instr.num_operands > 1) {
-                if (instr.operands[1].type == OPERAND_IMMEDIATE) {
-                    format_or_length = get_operand_value(vm, instr.operands[1]);
-                } else if (instr.operands[1].type == OPERAND_REGISTER) {
+            if (instr->num_operands > 1) {
+                if (instr->operands[1].type == OPERAND_IMMEDIATE) {
+                    format_or_length = operand_value(
+                        vm, &instr->operands[1], checked, guarded);
+                } else if (instr->operands[1].type == OPERAND_REGISTER) {
                     format_or_length =
-                        vm->cpu.registers[instr.operands[1].value.reg];
+                        vm->cpu.registers[instr->operands[1].value.reg];
                 } else {
                     err = VM_ERROR_INVALID_OPERAND;
                     fprintf(stderr,
@@ -512,17 +919,19 @@ VMError execute_instruction(VM* vm, Instruction instr) {
                 }
             }
 
-            if (instr.operands[0].type == OPERAND_REGISTER) {
-                if (instr.num_operands >= 1) {
-                    vm_print_string(
-                        vm, vm->cpu.registers[instr.operands[0].value.reg],
+            // Strings are packed bytes; the operand holds their byte address
+            if (instr->operands[0].type == OPERAND_REGISTER) {
+                if (instr->num_operands >= 1) {
+                    err = vm_print_string(
+                        vm, vm->cpu.registers[instr->operands[0].value.reg],
                         format_or_length);
                 }
-            } else if (instr.operands[0].type == OPERAND_MEMORY) {
-                if (instr.num_operands >= 1) {
-                    vm_print_string(
-                        vm, vm->memory.data[instr.operands[0].value.mem],
-                        format_or_length);
+            } else if (instr->operands[0].type == OPERAND_IMMEDIATE) {
+                err = vm_print_string(vm, value, format_or_length);
+            } else if (instr->operands[0].type == OPERAND_MEMORY) {
+                if (instr->num_operands >= 1) {
+                    // The word loaded from memory is the string address
+                    err = vm_print_string(vm, value, format_or_length);
                 }
             } else {
                 err = VM_ERROR_INVALID_OPERAND;
@@ -530,93 +939,148 @@ VMError execute_instruction(VM* vm, Instruction instr) {
                         "[ANVIL] Error: Invalid operand type for OUT!\n");
                 return err;
             }
+            if (err != VM_SUCCESS) {
+                fprintf(stderr,
+                        "[ANVIL] Error: String out of range for OUT!\n");
+                return err;
+            }
 
             vm->cpu.ip++;
             break;
 
         case OP_PREG:
-            if (instr.operands[0].type != OPERAND_REGISTER) {
+            if (checked && instr->operands[0].type != OPERAND_REGISTER) {
                 err = VM_ERROR_INVALID_OPERAND;
                 fprintf(stderr,
                         "[ANVIL] Error: Invalid operand type for PREG!\n");
                 return err;
             }
-            uint32_t format = (instr.num_operands > 1)
-                                  ? get_operand_value(vm, instr.operands[1])
+            uint32_t format = (instr->num_operands > 1)
+                                  ? operand_value(vm, &instr->operands[1],
+                                                  checked, guarded)
                                   : 0;
-            vm_print_reg_value(vm, format, instr.operands[0].value.reg);
+            vm_print_reg_value(vm, format, instr->operands[0].value.reg);
+            vm->cpu.ip++;
+            break;
+
+        case OP_LDB:
+        case OP_LDH:
+            err = load_narrow(vm, instr, instr->opcode == OP_LDB ? 1 : 2,
+                              checked, guarded);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+            vm->cpu.ip++;
+            break;
+
+        case OP_STB:
+        case OP_STH:
+            err = store_narrow(vm, instr, instr->opcode == OP_STB ? 1 : 2,
+                               checked, guarded);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+            vm->cpu.ip++;
+            break;
+
+        // The heap checks every address itself, on all interpreter variants
+        case OP_ALLOC:
+        case OP_REALLOC: {
+            if (checked && instr->operands[0].type != OPERAND_REGISTER) {
+                err = VM_ERROR_INVALID_OPERAND;
+                fprintf(stderr, "[ANVIL] Error: Invalid operand type for %s!\n",
+                        opcode == OP_ALLOC ? "ALLOC" : "REALLOC");
+                return err;
+            }
+
+            uint32_t block;
+            if (opcode == OP_ALLOC) {
+                err = heap_alloc(&vm->heap, &vm->memory, (uint32_t)val2,
+                                 &block);
+            } else {
+                err = heap_realloc(&vm->heap, &vm->memory, (uint32_t)val1,
+                                   (uint32_t)val2, &block);
+            }
+            if (err != VM_SUCCESS && opcode == OP_ALLOC) {
+                fprintf(stderr,
+                        "[ANVIL] Error: ALLOC of %u words failed!\n",
+                        (uint32_t)val2);
+                return err;
+            }
+            if (err != VM_SUCCESS) {
+                fprintf(stderr,
+                        "[ANVIL] Error: REALLOC of %d, which is not an "
+                        "allocated block!\n",
+                        val1);
+                return err;
+            }
+
+            err = store_operand(vm, &instr->operands[0], (int)block, checked,
+                                guarded);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+            vm->cpu.ip++;
+            break;
+        }
+
+        case OP_FREE:
+            err = heap_free(&vm->heap, &vm->memory, (uint32_t)val1);
+            if (err != VM_SUCCESS) {
+                fprintf(stderr,
+                        "[ANVIL] Error: FREE of %d, which is not an "
+                        "allocated block!\n",
+                        val1);
+                return err;
+            }
             vm->cpu.ip++;
             break;
         default:
             err = VM_ERROR_INVALID_INSTRUCTION;
-            fprintf(stderr, "[ANVIL] Error: Unknown opcode %d\n", instr.opcode);
+            fprintf(stderr, "[ANVIL] Error: Unknown opcode %d\n",
+                    instr->opcode);
             return err;
     }
     return err;
 }
 
-int get_operand_value(VM* vm, Operand operand) {
-    switch (operand.type) {
-        case OPERAND_REGISTER:
-            return vm->cpu.registers[operand.value.reg];
-        case OPERAND_IMMEDIATE:
-            return operand.value.imm;
-        case OPERAND_MEMORY:
-            int effective_address = 0;
-            if (operand.value.mem_ref.base_reg != R_NONE) {
-                effective_address +=
-                    vm->cpu.registers[operand.value.mem_ref.base_reg];
-            }
+VMError execute_instruction(VM* vm, Instruction instr) {
+    return execute(vm, &instr, true, false);
+}
 
-            if (operand.value.mem_ref.index_reg != R_NONE) {
-                effective_address +=
-                    vm->cpu.registers[operand.value.mem_ref.index_reg] *
-                    operand.value.mem_ref.scale;
-            }
+VMError execute_verified(VM* vm, const Instruction* instr) {
+    return execute(vm, instr, false, false);
+}
 
-            effective_address += operand.value.mem_ref.offset;
+VMError execute_guarded(VM* vm, const Instruction* instr) {
+    return execute(vm, instr, false, true);
+}
 
-            if (effective_address < 0 || effective_address >= MEMORY_SIZE) {
-                fprintf(stderr, "[ANVIL] Error: Invalid memory address %d\n",
-                        effective_address);
-                return 0;
-            }
+int get_operand_value(VM* vm, Operand operand) {
+    return operand_value(vm, &operand, true, false);
+}
 
-            return vm->memory.data[effective_address];
-        case OPERAND_LABEL:
-            return vm->label_addresses[operand.value.label];
-        default:
-            fprintf(stderr, "[ANVIL] Error: Invalid operand type!\n");
-            return 0;
-    }
+int get_effective_address(VM* vm, MemoryRef mem_ref) {
+    return address_of(vm, &mem_ref);
 }
 
 VMError set_operand_value(VM* vm, Operand operand, int value) {
-    VMError err = VM_SUCCESS;
+    return store_operand(vm, &operand, value, true, false);
+}
 
-    switch (operand.type) {
-        case OPERAND_REGISTER:
-            if (operand.value.reg < 0 || operand.value.reg >= R_COUNT) {
-                fprintf(stderr, "[ANVIL] Error: Invalid register index %d\n",
-                        operand.value.reg);
-                err = VM_ERROR_INVALID_REGISTER;
-            }
-            vm->cpu.registers[operand.value.reg] = value;
-            break;
-        case OPERAND_MEMORY:
-            if (operand.value.mem < 0 || operand.value.mem >= MEMORY_SIZE) {
-                fprintf(stderr, "[ANVIL] Error: Invalid memory address %d\n",
-                        operand.value.mem);
-                err = VM_ERROR_MEMORY_ACCESS;
-            }
-            vm->memory.data[operand.value.mem] = value;
-            break;
-        default:
-            fprintf(stderr,
-                    "[ANVIL] Error: Cannot set value for this operand type!\n");
-            err = VM_ERROR_INVALID_OPERAND;
+void memory_ref_classify(MemoryRef* mem_ref) {
+    bool has_base = mem_ref->base_reg != R_NONE;
+    bool has_index = mem_ref->index_reg != R_NONE;
+
+    if (has_base && has_index) {
+        mem_ref->mode = ADDR_BASE_INDEX_DISP;
+    } else if (has_base) {
+        mem_ref->mode = ADDR_BASE_DISP;
+    } else if (has_index) {
+        mem_ref->mode = ADDR_INDEX_DISP;
+    } else {
+        mem_ref->mode = ADDR_ABSOLUTE;
     }
-    return err;
 }
 
 int find_label_address(VM* vm, int label_index) {
@@ -669,9 +1133,13 @@ VMError update_flags(VM* vm, int result, int operand1, int operand2,
             break;
 
         case OP_DIV:
+        case OP_MOD:
         case OP_AND:
         case OP_OR:
         case OP_XOR:
+        case OP_SHL:
+        case OP_SHR:
+        case OP_POW:
             // No flags to update for logical operations
             if (result == 0) vm->cpu.flags |= FL_ZF;
 
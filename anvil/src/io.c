@@ -1,5 +1,10 @@
 #include "io.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define USE_POSIX_IO
+#endif
+
 #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
     defined(_M_IX86)
 #define USE_ASM
@@ -20,13 +25,14 @@ VMError io_init(VM* vm) {
 VMError io_handle(VM* vm, uint32_t address, uint32_t value) {
     VMError err = VM_SUCCESS;
     switch (address) {
-        case IO_STDIN:
+        case IO_STDIN: {
             uint32_t c = getchar();
             err = write_memory(&vm->memory, value, c);
             return err;
+        }
         case IO_STDOUT:
-            putchar((char)value);
-            fflush(stdout);
+            fputc((char)value, vm->output);
+            fflush(vm->output);
             err = VM_SUCCESS;
             break;
         default:
@@ -37,20 +43,32 @@ VMError io_handle(VM* vm, uint32_t address, uint32_t value) {
 }
 
 VMError vm_print_string(VM* vm, uint32_t address, uint32_t length) {
-    VMError err = VM_SUCCESS;
-    if (address >= MEMORY_SIZE || address + length >= MEMORY_SIZE) {
+    const uint8_t* bytes = memory_byte_range(&vm->memory, address, length);
+    if (!bytes) {
         return VM_ERROR_MEMORY_ACCESS;
     }
-    for (uint32_t i = 0; i < length; i++) {
-        uint32_t value;
-        err = read_memory(&vm->memory, address + i, &value);
-        if (err != VM_SUCCESS) {
-            return err;
+
+    // Guest strings are packed, so the bytes go out as they are. Flush first
+    // to keep them ordered with output written through stdio.
+    fflush(vm->output);
+#ifdef USE_POSIX_IO
+    if (vm->output == stdout) {
+        while (length > 0) {
+            ssize_t written = write(STDOUT_FILENO, bytes, length);
+            if (written < 0) {
+                return VM_ERROR_UNKNOWN;
+            }
+            bytes += written;
+            length -= (uint32_t)written;
         }
-        printf("%c", (char)value);
+        return VM_SUCCESS;
     }
-    fflush(stdout);
-    return err;
+#endif
+    if (fwrite(bytes, 1, length, vm->output) != length) {
+        return VM_ERROR_UNKNOWN;
+    }
+    fflush(vm->output);
+    return VM_SUCCESS;
 }
 
 VMError vm_print_reg_value(VM* vm, uint32_t format, uint32_t reg) {
@@ -62,47 +80,45 @@ VMError vm_print_reg_value(VM* vm, uint32_t format, uint32_t reg) {
 
     switch (format) {
         case 1:
-            printf("0x%x", value);
+            fprintf(vm->output, "0x%x", value);
             break;
         case 2:
-            printf("0b");
+            fputs("0b", vm->output);
             for (int i = 31; i >= 0; i--) {
-                putchar((value & (1 << i)) ? '1' : '0');
+                fputc((value & (1u << i)) ? '1' : '0', vm->output);
             }
             break;
         default:
-            printf("%d", value);
+            fprintf(vm->output, "%d", value);
     }
 
-    printf("\n");
-    fflush(stdout);
+    fputc('\n', vm->output);
+    fflush(vm->output);
 
     return VM_SUCCESS;
 }
 
+// Reads a line straight into guest memory as a packed, null-terminated
+// string of at most `max_length` bytes including the terminator. Goes
+// through stdio rather than read() since IO_STDIN also reads from stdin.
 VMError vm_read_string(VM* vm, uint32_t address, uint32_t max_length) {
-    char buffer[1024];
-    if (max_length > 1023) {
-        max_length = 1023;
+    if (max_length > INT32_MAX) {
+        max_length = INT32_MAX;
+    }
+    char* buffer =
+        (char*)memory_byte_range(&vm->memory, address, max_length);
+    if (!buffer || max_length == 0) {
+        return VM_ERROR_MEMORY_ACCESS;
     }
 
-    if (!fgets(buffer, max_length, stdin)) {
+    if (!fgets(buffer, (int)max_length, stdin)) {
+        buffer[0] = '\0';
         return VM_ERROR_UNKNOWN;
     }
 
     size_t len = strlen(buffer);
-
     if (len > 0 && buffer[len - 1] == '\n') {
         buffer[--len] = '\0';
     }
-
-    for (uint32_t i = 0; i < len; i++) {
-        VMError err = write_memory(&vm->memory, address + i, buffer[i]);
-        if (err != VM_SUCCESS) {
-            return err;
-        }
-    }
-
-    // Null-terminate the string
-    return write_memory(&vm->memory, address + len, 0);
+    return VM_SUCCESS;
 }
@@ -0,0 +1,65 @@
+#include "loader.h"
+
+#include "verifier.h"
+
+VMError load_program_data(VM* vm, const Program* program) {
+    if (!vm || !program) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+
+    VMError err = load_memory(&vm->memory, program->data_base, program->data,
+                              (uint32_t)program->data_size);
+    if (err != VM_SUCCESS) {
+        fprintf(stderr,
+                "[ANVIL] Error: Data image at 0x%x (%d words) does not fit "
+                "in guest memory!\n",
+                program->data_base, program->data_size);
+    }
+    return err;
+}
+
+VM* load_program(Program* program) {
+    VMConfig config = vm_default_config();
+    return load_program_with_config(program, &config);
+}
+
+VM* load_program_with_config(Program* program, const VMConfig* config) {
+    if (!program) {
+        return NULL;
+    }
+
+    VM* vm = vm_create_with_config(program->instructions, program->size,
+                                   program->label_addresses,
+                                   program->label_size, config);
+    if (!vm) {
+        return NULL;
+    }
+
+    VMError err = load_program_data(vm, program);
+    if (err != VM_SUCCESS) {
+        vm_destroy(vm);
+        handle_error(err);
+        return NULL;
+    }
+
+    // A program that fails verification still runs, fully checked, and
+    // reports the problem when (and if) the bad instruction executes
+    vm_verify(vm);
+    return vm;
+}
+
+VMError reload_program(VM* vm, Program* program) {
+    if (!vm || !program) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+
+    VMError err = vm_reset(vm, program->instructions, program->size,
+                           program->label_addresses, program->label_size);
+    if (err == VM_SUCCESS) {
+        err = load_program_data(vm, program);
+    }
+    if (err == VM_SUCCESS) {
+        vm_verify(vm);
+    }
+    return err;
+}
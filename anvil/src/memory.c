@@ -1,5 +1,13 @@
 #include "memory.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define USE_MMAP
+#endif
+
 #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
     defined(_M_IX86)
 #ifndef _MSC_VER
@@ -12,59 +20,222 @@ void memcopy_(uint32_t* dest, uint32_t* src, uint32_t size);
 void memclear_(uint32_t* data, uint32_t size);
 #endif
 
-VMError init_memory(Memory* memory) {
-    VMError err = VM_SUCCESS;
-    if (memory == NULL) {
-        err = VM_ERROR_MEMORY_INIT;
+#ifdef USE_MMAP
+// Map `size` bytes of zeroed read/write memory, over `address` if it is not
+// NULL. Explicit huge pages need a pool reserved by the administrator, so
+// transparent huge pages are the fallback.
+static void* map_data(void* address, size_t size, bool huge_pages,
+                      bool* huge) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | (address ? MAP_FIXED : 0);
+    *huge = false;
+
+#ifdef MAP_HUGETLB
+    if (huge_pages && size % (MEMORY_HUGE_PAGE_SIZE * sizeof(uint32_t)) == 0) {
+        void* data = mmap(address, size, PROT_READ | PROT_WRITE,
+                          flags | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            *huge = true;
+            return data;
+        }
     }
-    for (uint32_t i = 0; i < MEMORY_SIZE; i++) {
-        memory->data[i] = 0;
+#endif
+
+    void* data = mmap(address, size, PROT_READ | PROT_WRITE,
+                      flags | MAP_NORESERVE, -1, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
     }
-    return err;
+#ifdef MADV_HUGEPAGE
+    if (huge_pages && size >= MEMORY_HUGE_PAGE_SIZE * sizeof(uint32_t)) {
+        madvise(data, size, MADV_HUGEPAGE);
+    }
+#endif
+    (void)huge_pages;
+    return data;
+}
+#endif
+
+#ifdef ANVIL_GUARD_MEMORY
+// Reserve guard + memory + guard as PROT_NONE and map the middle. Huge pages
+// need the memory aligned to a huge page, so reserve that much slack.
+static bool init_guarded_memory(Memory* memory, bool huge_pages) {
+    size_t size = sizeof(uint32_t) * memory->size;
+    size_t align = huge_pages ? MEMORY_HUGE_PAGE_SIZE * sizeof(uint32_t) : 0;
+    size_t reservation_size =
+        MEMORY_GUARD_SIZE + align + size + MEMORY_GUARD_SIZE;
+
+    void* reservation =
+        mmap(NULL, reservation_size, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED) {
+        return false;
+    }
+
+    uintptr_t data = (uintptr_t)reservation + MEMORY_GUARD_SIZE;
+    if (align > 0) {
+        data = (data + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    if (!map_data((void*)data, size, huge_pages, &memory->huge_pages)) {
+        munmap(reservation, reservation_size);
+        return false;
+    }
+
+    memory->data = (uint32_t*)data;
+    memory->guarded = true;
+    memory->reservation = reservation;
+    memory->reservation_size = reservation_size;
+    return true;
+}
+#endif
+
+VMError init_memory(Memory* memory, uint32_t size, bool huge_pages) {
+    if (memory == NULL || size == 0 || size > MEMORY_MAX_SIZE) {
+        return VM_ERROR_MEMORY_INIT;
+    }
+
+    memory->data = NULL;
+    memory->size = (size + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1u);
+    memory->guarded = false;
+    memory->huge_pages = false;
+    memory->reservation = NULL;
+    memory->reservation_size = 0;
+#ifdef ANVIL_GUARD_MEMORY
+    if (init_guarded_memory(memory, huge_pages)) {
+        return VM_SUCCESS;
+    }
+#endif
+
+#ifdef USE_MMAP
+    size_t bytes = sizeof(uint32_t) * memory->size;
+    void* data = map_data(NULL, bytes, huge_pages, &memory->huge_pages);
+    if (data) {
+        memory->data = data;
+        memory->reservation = data;
+        memory->reservation_size = bytes;
+        return VM_SUCCESS;
+    }
+#endif
+
+    (void)huge_pages;
+    memory->data = calloc(memory->size, sizeof(uint32_t));
+    if (!memory->data) {
+        return VM_ERROR_MEMORY_INIT;
+    }
+    return VM_SUCCESS;
+}
+
+void free_memory(Memory* memory) {
+    if (!memory) {
+        return;
+    }
+#ifdef USE_MMAP
+    if (memory->reservation) {
+        munmap(memory->reservation, memory->reservation_size);
+    } else {
+        free(memory->data);
+    }
+#else
+    free(memory->data);
+#endif
+    memory->data = NULL;
+    memory->size = 0;
+    memory->guarded = false;
+    memory->huge_pages = false;
+    memory->reservation = NULL;
+    memory->reservation_size = 0;
+}
+
+bool memory_is_guarded(const Memory* memory) { return memory->guarded; }
+
+bool memory_translate_fault(const Memory* memory, const void* host_address,
+                            int* guest_address) {
+    if (!memory->guarded) {
+        return false;
+    }
+
+    uintptr_t address = (uintptr_t)host_address;
+    uintptr_t start = (uintptr_t)memory->reservation;
+    if (address < start || address - start >= memory->reservation_size) {
+        return false;
+    }
+
+    intptr_t offset = (intptr_t)(address - (uintptr_t)memory->data);
+    *guest_address = (int)(offset / (intptr_t)sizeof(uint32_t));
+    return true;
 }
 
 VMError read_memory(Memory* memory, uint32_t address, uint32_t* value) {
-    VMError err = VM_SUCCESS;
-    if (address >= MEMORY_SIZE) {
-        err = VM_ERROR_MEMORY_ACCESS;
+    if (address >= memory->size) {
+        return VM_ERROR_MEMORY_ACCESS;
     }
     *value = memory->data[address];
-    return err;
+    return VM_SUCCESS;
 }
 
 VMError write_memory(Memory* memory, uint32_t address, uint32_t value) {
-    VMError err = VM_SUCCESS;
-    if (address >= MEMORY_SIZE) {
-        err = VM_ERROR_MEMORY_ACCESS;
+    if (address >= memory->size) {
+        return VM_ERROR_MEMORY_ACCESS;
     }
     memory->data[address] = value;
-    return err;
+    return VM_SUCCESS;
 }
 
-VMError write_memory_ref(Memory* memory, MemoryRef mem_ref, uint32_t value) {
-    VMError err = VM_SUCCESS;
-    if (mem_ref.base_reg >= MEMORY_SIZE || mem_ref.index_reg >= MEMORY_SIZE) {
-        err = VM_ERROR_MEMORY_ACCESS;
+uint8_t* memory_byte_range(const Memory* memory, uint32_t address,
+                           uint32_t length) {
+    uint32_t byte_size = memory_byte_size(memory);
+    if (address > byte_size || length > byte_size - address) {
+        return NULL;
+    }
+    return memory_bytes(memory) + address;
+}
+
+VMError read_memory_byte(Memory* memory, uint32_t address, uint8_t* value) {
+    if (address >= memory_byte_size(memory)) {
+        return VM_ERROR_MEMORY_ACCESS;
     }
-    uint32_t effective_address =
-        mem_ref.base_reg + (mem_ref.index_reg * mem_ref.scale) + mem_ref.offset;
-    if (effective_address >= MEMORY_SIZE) {
-        err = VM_ERROR_MEMORY_ACCESS;
+    *value = memory_bytes(memory)[address];
+    return VM_SUCCESS;
+}
+
+VMError write_memory_byte(Memory* memory, uint32_t address, uint8_t value) {
+    if (address >= memory_byte_size(memory)) {
+        return VM_ERROR_MEMORY_ACCESS;
     }
-    memory->data[effective_address] = value;
-    return err;
+    memory_bytes(memory)[address] = value;
+    return VM_SUCCESS;
+}
+
+VMError load_memory(Memory* memory, uint32_t address, const uint32_t* data,
+                    uint32_t size) {
+    if (address > memory->size || size > memory->size - address) {
+        return VM_ERROR_MEMORY_ACCESS;
+    }
+    if (size > 0) {
+        memcpy(&memory->data[address], data, sizeof(uint32_t) * size);
+    }
+    return VM_SUCCESS;
+}
+
+// Memory has no register file, so only absolute references (no base or
+// index register) can be written here; register-relative references go
+// through set_operand_value
+VMError write_memory_ref(Memory* memory, MemoryRef mem_ref, uint32_t value) {
+    if (mem_ref.base_reg != 0 || mem_ref.index_reg != 0) {
+        return VM_ERROR_INVALID_OPERAND;
+    }
+    return write_memory(memory, (uint32_t)mem_ref.offset, value);
 }
 
 VMError clear_memory(Memory* memory) {
     VMError err = VM_SUCCESS;
 #ifdef USE_ASM
-    memclear_(memory->data, MEMORY_SIZE);
+    memclear_(memory->data, memory->size);
     return err;
 #else
     if (memory == NULL) {
         err = VM_ERROR_MEMORY_INIT;
     }
-    for (uint32_t i = 0; i < MEMORY_SIZE; i++) {
+    for (uint32_t i = 0; i < memory->size; i++) {
         memory->data[i] = 0;
     }
     return err;
@@ -77,8 +248,8 @@ VMError memcopy(Memory* dest, Memory* src, uint32_t size) {
     memcopy_(dest->data, src->data, size);
     return err;
 #else
-    if (size > MEMORY_SIZE) {
-        err = VM_ERROR_MEMORY_ACCESS;
+    if (size > dest->size || size > src->size) {
+        return VM_ERROR_MEMORY_ACCESS;
     }
     for (uint32_t i = 0; i < size; i++) {
         dest->data[i] = src->data[i];
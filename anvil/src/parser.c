@@ -3,10 +3,13 @@
 void parser_init(Parser* parser, const char* str) {
     parser->str = str;
     parser->pos = 0;
+    parser->symbols = NULL;
 }
 
 void skip_whitespace(Parser* parser) {
+    // Newlines terminate statements, so never skip past them here
     while (parser->str[parser->pos] != '\0' &&
+           parser->str[parser->pos] != '\n' &&
            isspace(parser->str[parser->pos])) {
         parser->pos++;
     }
@@ -39,6 +42,17 @@ char* parse_token(Parser* parser) {
         } else {
             parser->pos++;
         }
+    } else if (parser->str[parser->pos] == '[') {
+        // Memory references may contain spaces, e.g. [bx + si*4]
+        while (parser->str[parser->pos] != '\0' &&
+               parser->str[parser->pos] != '\n' &&
+               parser->str[parser->pos] != ']') {
+            parser->pos++;
+        }
+        if (parser->str[parser->pos] != ']') {
+            return NULL;
+        }
+        parser->pos++;
     } else {
         while (parser->str[parser->pos] != '\0' &&
                !isspace(parser->str[parser->pos]) &&
@@ -105,32 +119,48 @@ bool parse_register(const char* token, Register* reg) {
     return true;
 }
 
+const char* get_register_name(Register reg) {
+    static const char* names[R_COUNT] = {
+        [R_AX] = "ax", [R_BX] = "bx", [R_CX] = "cx", [R_DX] = "dx",
+        [R_SP] = "sp", [R_BP] = "bp", [R_SI] = "si", [R_DI] = "di",
+        [R_IP] = "ip",
+    };
+    if ((int)reg < 0 || reg >= R_COUNT || !names[reg]) {
+        return "??";
+    }
+    return names[reg];
+}
+
+int parse_escape(char c) {
+    switch (c) {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'r':
+            return '\r';
+        case '0':
+            return '\0';
+        case '\\':
+            return '\\';
+        case '\'':
+            return '\'';
+        case '"':
+            return '"';
+        default:
+            return -1;
+    }
+}
+
 bool parse_immediate(const char* token, int* imm) {
     if (strlen(token) >= 3 && token[0] == '\'' &&
         token[strlen(token) - 1] == '\'') {
-        if (token[1] == '\\' && strlen(token) > 4) {
-            switch (token[2]) {
-                case 'n':
-                    *imm = '\n';
-                    break;
-                case 't':
-                    *imm = '\t';
-                    break;
-                case 'r':
-                    *imm = '\r';
-                    break;
-                case '0':
-                    *imm = '\0';
-                    break;
-                case '\\':
-                    *imm = '\\';
-                    break;
-                case '\'':
-                    *imm = '\'';
-                    break;
-                default:
-                    return false;
+        if (token[1] == '\\' && strlen(token) == 4) {
+            int c = parse_escape(token[2]);
+            if (c < 0) {
+                return false;
             }
+            *imm = c;
         } else if (strlen(token) == 3) {
             *imm = (int)token[1];
         } else {
@@ -150,75 +180,176 @@ bool parse_immediate(const char* token, int* imm) {
     return *endptr == '\0';
 }
 
-bool parse_memory_reference(const char* token, MemoryRef* mem_ref) {
-    if (token[0] != '[' || token[strlen(token) - 1] != ']') {
+bool parse_string_literal(Parser* parser, char** str, size_t* length) {
+    skip_whitespace(parser);
+    if (parser->str[parser->pos] != '"') {
         return false;
     }
+    parser->pos++;
 
-    char content[256];
-    strncpy(content, token + 1, strlen(token) - 2);
-    content[strlen(token) - 2] = '\0';
-
-    char* plus = strchr(content, '+');
-    char* minus = strchr(content, '-');
-
-    if (plus) {
-        *plus = '\0';
-        Register reg;
-        if (!parse_register(content, &reg)) {
+    // The unescaped string is never longer than its source text
+    size_t start = parser->pos;
+    size_t end = start;
+    while (parser->str[end] != '"') {
+        if (parser->str[end] == '\0' || parser->str[end] == '\n') {
             return false;
         }
+        if (parser->str[end] == '\\' && parser->str[end + 1] != '\0') {
+            end++;
+        }
+        end++;
+    }
 
-        int offset;
-        if (!parse_immediate(plus + 1, &offset)) {
-            return false;
+    char* out = malloc(end - start + 1);
+    if (!out) {
+        return false;
+    }
+
+    size_t n = 0;
+    for (size_t i = start; i < end; i++) {
+        if (parser->str[i] == '\\') {
+            int c = parse_escape(parser->str[++i]);
+            if (c < 0) {
+                free(out);
+                return false;
+            }
+            out[n++] = (char)c;
+        } else {
+            out[n++] = parser->str[i];
         }
+    }
+    out[n] = '\0';
 
-        mem_ref->base_reg = reg;
-        mem_ref->index_reg = R_NONE;
-        mem_ref->scale = 0;
-        mem_ref->offset = offset;
+    parser->pos = end + 1;
+    *str = out;
+    *length = n;
+    return true;
+}
 
-        return true;
-    } else if (minus) {
-        *minus = '\0';
-        Register reg;
-        if (!parse_register(content, &reg)) {
+bool is_identifier(const char* token) {
+    if (!isalpha((unsigned char)token[0]) && token[0] != '_' &&
+        token[0] != '.') {
+        return false;
+    }
+    for (size_t i = 1; token[i] != '\0'; i++) {
+        if (!isalnum((unsigned char)token[i]) && token[i] != '_' &&
+            token[i] != '.') {
             return false;
         }
+    }
+    return true;
+}
 
-        int offset;
-        if (!parse_immediate(minus + 1, &offset)) {
+// A scaled index term, reg*scale or scale*reg
+static bool parse_scaled_register(char* term, Register* reg, int* scale) {
+    char* star = strchr(term, '*');
+    *star = '\0';
+    const char* factor = star + 1;
+    if (!parse_register(term, reg)) {
+        // Also accept scale*reg
+        if (!parse_register(factor, reg)) {
             return false;
         }
+        factor = term;
+    }
 
-        mem_ref->base_reg = reg;
-        mem_ref->index_reg = R_NONE;
-        mem_ref->scale = 0;
-        mem_ref->offset = -offset;
+    return parse_immediate(factor, scale) &&
+           (*scale == 1 || *scale == 2 || *scale == 4 || *scale == 8);
+}
+
+bool parse_memory_reference(const char* token, MemoryRef* mem_ref,
+                            SymbolTable* symbols) {
+    size_t token_length = strlen(token);
+    if (token_length < 3 || token[0] != '[' ||
+        token[token_length - 1] != ']') {
+        return false;
+    }
+
+    // Copy the contents without whitespace
+    char content[256];
+    size_t length = 0;
+    for (size_t i = 1; i < token_length - 1; i++) {
+        if (isspace((unsigned char)token[i])) {
+            continue;
+        }
+        if (length + 1 >= sizeof(content)) {
+            return false;
+        }
+        content[length++] = token[i];
+    }
+    content[length] = '\0';
+
+    mem_ref->base_reg = R_NONE;
+    mem_ref->index_reg = R_NONE;
+    mem_ref->scale = 0;
+    mem_ref->offset = 0;
+    mem_ref->mode = ADDR_GENERIC;
+    mem_ref->symbol = -1;
+
+    char* term = content;
+    bool negative = false;
+    while (*term != '\0') {
+        char* end = term;
+        while (*end != '\0' && *end != '+' &&
+               (*end != '-' || end == term)) {
+            end++;
+        }
+        char next = *end;
+        *end = '\0';
 
-        return true;
-    } else {
         Register reg;
-        if (parse_register(content, &reg)) {
-            mem_ref->base_reg = reg;
-            mem_ref->index_reg = R_NONE;
-            mem_ref->scale = 0;
-            mem_ref->offset = 0;
-            return true;
+        int scale;
+        int imm;
+        if (*term == '\0') {
+            return false;
+        } else if (strchr(term, '*')) {
+            if (negative || !parse_scaled_register(term, &reg, &scale) ||
+                mem_ref->index_reg != R_NONE) {
+                return false;
+            }
+            mem_ref->index_reg = reg;
+            mem_ref->scale = scale;
+        } else if (parse_register(term, &reg)) {
+            // The first plain register is the base, a second one the index
+            if (negative) {
+                return false;
+            }
+            if (mem_ref->base_reg == R_NONE) {
+                mem_ref->base_reg = reg;
+            } else if (mem_ref->index_reg == R_NONE) {
+                mem_ref->index_reg = reg;
+                mem_ref->scale = 1;
+            } else {
+                return false;
+            }
+        } else if (parse_immediate(term, &imm)) {
+            mem_ref->offset += negative ? -imm : imm;
+        } else if (symbols && is_identifier(term) && !negative &&
+                   mem_ref->symbol < 0) {
+            mem_ref->symbol = symtab_intern(symbols, term, strlen(term));
+            if (mem_ref->symbol < 0) {
+                return false;
+            }
+        } else {
+            return false;
         }
 
-        int offset;
-        if (parse_immediate(content, &offset)) {
-            mem_ref->base_reg = R_NONE;
-            mem_ref->index_reg = R_NONE;
-            mem_ref->scale = 0;
-            mem_ref->offset = offset;
-            return true;
+        if (next == '\0') {
+            break;
+        }
+        negative = next == '-';
+        term = end + 1;
+        if (*term == '\0') {
+            return false;  // Trailing operator
         }
     }
 
-    return false;
+    if (mem_ref->symbol >= 0) {
+        mem_ref->mode = ADDR_UNRESOLVED;  // Classified by program_finalize
+    } else {
+        memory_ref_classify(mem_ref);
+    }
+    return true;
 }
 
 bool parse_operand(Parser* parser, Operand* operand) {
@@ -243,15 +374,22 @@ bool parse_operand(Parser* parser, Operand* operand) {
         success = true;
     } else if (token[0] == '[') {
         MemoryRef mem_ref;
-        if (parse_memory_reference(token, &mem_ref)) {
+        if (parse_memory_reference(token, &mem_ref, parser->symbols)) {
             operand->type = OPERAND_MEMORY;
             operand->value.mem_ref = mem_ref;
             success = true;
         }
-    } else {
-        if (parse_immediate(token, &imm)) {
-            operand->type = OPERAND_IMMEDIATE;
-            operand->value.imm = imm;
+    } else if (parse_immediate(token, &imm)) {
+        operand->type = OPERAND_IMMEDIATE;
+        operand->value.imm = imm;
+        success = true;
+    } else if (parser->symbols && is_identifier(token)) {
+        // Labels and constants may be defined later in the source, so only
+        // intern the name here and let program_finalize resolve it
+        int symbol = symtab_intern(parser->symbols, token, strlen(token));
+        if (symbol >= 0) {
+            operand->type = OPERAND_SYMBOL;
+            operand->value.symbol = symbol;
             success = true;
         }
     }
@@ -293,6 +431,73 @@ OpCode get_opcode(const char* token) {
     if (strcasecmp(token, "nop") == 0) return OP_NOP;
     if (strcasecmp(token, "out") == 0) return OP_OUT;
     if (strcasecmp(token, "preg") == 0) return OP_PREG;
+    if (strcasecmp(token, "ldb") == 0) return OP_LDB;
+    if (strcasecmp(token, "ldh") == 0) return OP_LDH;
+    if (strcasecmp(token, "stb") == 0) return OP_STB;
+    if (strcasecmp(token, "sth") == 0) return OP_STH;
+    if (strcasecmp(token, "alloc") == 0) return OP_ALLOC;
+    if (strcasecmp(token, "free") == 0) return OP_FREE;
+    if (strcasecmp(token, "realloc") == 0) return OP_REALLOC;
+    if (strcasecmp(token, "enter") == 0) return OP_ENTER;
+    if (strcasecmp(token, "leave") == 0) return OP_LEAVE;
+    if (strcasecmp(token, "loop") == 0) return OP_LOOP;
+    if (strcasecmp(token, "cjmp") == 0) return OP_CJMP;
+    if (strcasecmp(token, "mod") == 0) return OP_MOD;
+    if (strcasecmp(token, "shl") == 0) return OP_SHL;
+    if (strcasecmp(token, "shr") == 0) return OP_SHR;
+    if (strcasecmp(token, "pow") == 0) return OP_POW;
 
     return -1;  // Invalid opcode
 }
+
+const char* get_opcode_name(OpCode opcode) {
+    static const char* names[OP_COUNT] = {
+        [OP_HALT] = "halt", [OP_MOV] = "mov",   [OP_ADD] = "add",
+        [OP_SUB] = "sub",   [OP_MUL] = "mul",   [OP_DIV] = "div",
+        [OP_INC] = "inc",   [OP_DEC] = "dec",   [OP_AND] = "and",
+        [OP_OR] = "or",     [OP_XOR] = "xor",   [OP_CMP] = "cmp",
+        [OP_JMP] = "jmp",   [OP_JZ] = "jz",     [OP_JNZ] = "jnz",
+        [OP_JG] = "jg",     [OP_JL] = "jl",     [OP_JGE] = "jge",
+        [OP_JLE] = "jle",   [OP_LEA] = "lea",   [OP_PUSH] = "push",
+        [OP_POP] = "pop",   [OP_CALL] = "call", [OP_RET] = "ret",
+        [OP_NOP] = "nop",   [OP_OUT] = "out",   [OP_PREG] = "preg",
+        [OP_LDB] = "ldb",   [OP_LDH] = "ldh",   [OP_STB] = "stb",
+        [OP_STH] = "sth",   [OP_ALLOC] = "alloc",
+        [OP_FREE] = "free", [OP_REALLOC] = "realloc",
+        [OP_ENTER] = "enter", [OP_LEAVE] = "leave", [OP_LOOP] = "loop",
+        [OP_CJMP] = "cjmp", [OP_MOD] = "mod",   [OP_SHL] = "shl",
+        [OP_SHR] = "shr",   [OP_POW] = "pow",
+    };
+
+    if ((int)opcode < 0 || opcode >= OP_COUNT || !names[opcode]) {
+        return "???";
+    }
+    return names[opcode];
+}
+
+bool parse_condition(const char* token, Condition* cond) {
+    static const struct {
+        const char* name;
+        Condition cond;
+    } names[] = {
+        {"eq", COND_EQ}, {"z", COND_EQ},  {"ne", COND_NE}, {"nz", COND_NE},
+        {"lt", COND_LT}, {"l", COND_LT},  {"le", COND_LE}, {"gt", COND_GT},
+        {"g", COND_GT},  {"ge", COND_GE},
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(token, names[i].name) == 0) {
+            *cond = names[i].cond;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* get_condition_name(Condition cond) {
+    static const char* names[COND_COUNT] = {"eq", "ne", "lt", "le", "gt", "ge"};
+    if ((int)cond < 0 || cond >= COND_COUNT) {
+        return "???";
+    }
+    return names[cond];
+}
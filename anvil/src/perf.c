@@ -0,0 +1,139 @@
+#include "perf.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} PERF_EVENTS[PERF_COUNTER_COUNT] = {
+    [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                         PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    [PERF_L1I_MISSES] = {PERF_TYPE_HW_CACHE,
+                         PERF_COUNT_HW_CACHE_L1I |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+// Layout of read() with PERF_FORMAT_TOTAL_TIME_ENABLED | _RUNNING
+typedef struct {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+} PerfReading;
+
+static int open_event(PerfCounterId id) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_EVENTS[id].type;
+    attr.config = PERF_EVENTS[id].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;  // Allowed with perf_event_paranoid <= 2
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool perf_counters_open(PerfCounters* counters) {
+    bool any = false;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counters->fds[i] = open_event((PerfCounterId)i);
+        counters->values[i] = 0;
+        any |= counters->fds[i] >= 0;
+    }
+    return any;
+}
+
+void perf_counters_close(PerfCounters* counters) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+            counters->fds[i] = -1;
+        }
+    }
+}
+
+void perf_counters_start(PerfCounters* counters) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perf_counters_stop(PerfCounters* counters) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counters->values[i] = 0;
+        if (counters->fds[i] < 0) {
+            continue;
+        }
+
+        PerfReading reading;
+        if (read(counters->fds[i], &reading, sizeof(reading)) !=
+            sizeof(reading)) {
+            continue;
+        }
+
+        // The kernel multiplexes when there are more events than hardware
+        // counters; extrapolate from the fraction of time we were scheduled
+        if (reading.time_running > 0 &&
+            reading.time_running < reading.time_enabled) {
+            reading.value = (uint64_t)((double)reading.value *
+                                       (double)reading.time_enabled /
+                                       (double)reading.time_running);
+        }
+        counters->values[i] = reading.value;
+    }
+}
+
+#else
+
+bool perf_counters_open(PerfCounters* counters) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counters->fds[i] = -1;
+        counters->values[i] = 0;
+    }
+    return false;
+}
+
+void perf_counters_close(PerfCounters* counters) { (void)counters; }
+
+void perf_counters_start(PerfCounters* counters) { (void)counters; }
+
+void perf_counters_stop(PerfCounters* counters) { (void)counters; }
+
+#endif  // __linux__
+
+bool perf_counter_available(const PerfCounters* counters, PerfCounterId id) {
+    return counters->fds[id] >= 0;
+}
+
+const char* perf_counter_name(PerfCounterId id) {
+    static const char* names[PERF_COUNTER_COUNT] = {
+        "cycles", "instructions", "branch_misses", "l1d_misses", "l1i_misses",
+    };
+    if ((int)id < 0 || id >= PERF_COUNTER_COUNT) {
+        return "???";
+    }
+    return names[id];
+}
@@ -0,0 +1,361 @@
+#include "profiler.h"
+
+#include "parser.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_cycles() __rdtsc()
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define read_cycles() __rdtsc()
+#else
+#include <time.h>
+static uint64_t read_cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+Profiler* profiler_create(int program_size) {
+    if (program_size <= 0) {
+        return NULL;
+    }
+
+    Profiler* profiler = calloc(1, sizeof(Profiler));
+    if (!profiler) {
+        return NULL;
+    }
+
+    profiler->program_size = program_size;
+    profiler->ip_counts = calloc(program_size, sizeof(uint64_t));
+    profiler->branch_taken = calloc(program_size, sizeof(uint64_t));
+    profiler->branch_not_taken = calloc(program_size, sizeof(uint64_t));
+    if (!profiler->ip_counts || !profiler->branch_taken ||
+        !profiler->branch_not_taken) {
+        profiler_destroy(profiler);
+        return NULL;
+    }
+
+    return profiler;
+}
+
+void profiler_destroy(Profiler* profiler) {
+    if (profiler) {
+        if (profiler->perf_enabled) {
+            perf_counters_close(&profiler->perf);
+        }
+        free(profiler->ip_counts);
+        free(profiler->branch_taken);
+        free(profiler->branch_not_taken);
+        free(profiler);
+    }
+}
+
+void profiler_reset(Profiler* profiler) {
+    profiler->total_instructions = 0;
+    memset(profiler->opcode_counts, 0, sizeof(profiler->opcode_counts));
+    memset(profiler->class_counts, 0, sizeof(profiler->class_counts));
+    memset(profiler->class_cycles, 0, sizeof(profiler->class_cycles));
+    memset(profiler->ip_counts, 0, sizeof(uint64_t) * profiler->program_size);
+    memset(profiler->branch_taken, 0,
+           sizeof(uint64_t) * profiler->program_size);
+    memset(profiler->branch_not_taken, 0,
+           sizeof(uint64_t) * profiler->program_size);
+    memset(profiler->perf_totals, 0, sizeof(profiler->perf_totals));
+}
+
+bool profiler_enable_perf(Profiler* profiler) {
+    if (profiler->perf_enabled) {
+        return true;
+    }
+    if (!perf_counters_open(&profiler->perf)) {
+        perf_counters_close(&profiler->perf);
+        return false;
+    }
+    profiler->perf_enabled = true;
+    return true;
+}
+
+VMError vm_attach_profiler(VM* vm, Profiler* profiler) {
+    if (!vm || (profiler && profiler->program_size < vm->program_size)) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+    vm->profiler = profiler;
+    return VM_SUCCESS;
+}
+
+void profiler_begin_run(Profiler* profiler) {
+    if (profiler->perf_enabled) {
+        perf_counters_start(&profiler->perf);
+    }
+}
+
+void profiler_end_run(Profiler* profiler) {
+    if (profiler->perf_enabled) {
+        perf_counters_stop(&profiler->perf);
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            profiler->perf_totals[i] += profiler->perf.values[i];
+        }
+    }
+}
+
+static bool is_conditional_branch(OpCode opcode) {
+    return (opcode >= OP_JZ && opcode <= OP_JLE) || opcode == OP_LOOP ||
+           opcode == OP_CJMP;
+}
+
+VMError profiler_execute(Profiler* profiler, VM* vm,
+                         const Instruction* instr) {
+    int ip = vm->cpu.ip;
+    uint64_t start = read_cycles();
+    VMError err = execute_instruction(vm, *instr);
+    uint64_t cycles = read_cycles() - start;
+
+    OpClass op_class = get_opcode_class(instr->opcode);
+    profiler->total_instructions++;
+    profiler->ip_counts[ip]++;
+    if ((int)instr->opcode >= 0 && instr->opcode < OP_COUNT) {
+        profiler->opcode_counts[instr->opcode]++;
+    }
+    profiler->class_counts[op_class]++;
+    profiler->class_cycles[op_class] += cycles;
+
+    if (is_conditional_branch(instr->opcode)) {
+        if (vm->cpu.ip != ip + 1) {
+            profiler->branch_taken[ip]++;
+        } else {
+            profiler->branch_not_taken[ip]++;
+        }
+    }
+    return err;
+}
+
+OpClass get_opcode_class(OpCode opcode) {
+    switch (opcode) {
+        case OP_MOV:
+        case OP_LEA:
+        case OP_LDB:
+        case OP_LDH:
+        case OP_STB:
+        case OP_STH:
+            return PROF_CLASS_DATA;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_INC:
+        case OP_DEC:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_SHL:
+        case OP_SHR:
+        case OP_POW:
+        case OP_CMP:
+            return PROF_CLASS_ARITH;
+        case OP_JMP:
+        case OP_JZ:
+        case OP_JNZ:
+        case OP_JG:
+        case OP_JL:
+        case OP_JGE:
+        case OP_JLE:
+        case OP_LOOP:
+        case OP_CJMP:
+            return PROF_CLASS_BRANCH;
+        case OP_PUSH:
+        case OP_POP:
+        case OP_ENTER:
+        case OP_LEAVE:
+            return PROF_CLASS_STACK;
+        case OP_CALL:
+        case OP_RET:
+            return PROF_CLASS_CALL;
+        case OP_OUT:
+        case OP_PREG:
+            return PROF_CLASS_IO;
+        default:
+            return PROF_CLASS_OTHER;
+    }
+}
+
+const char* get_opcode_class_name(OpClass op_class) {
+    static const char* names[PROF_CLASS_COUNT] = {
+        "data", "arith", "branch", "stack", "call", "io", "other",
+    };
+    if ((int)op_class < 0 || op_class >= PROF_CLASS_COUNT) {
+        return "???";
+    }
+    return names[op_class];
+}
+
+typedef struct {
+    int ip;
+    uint64_t count;
+} IpCount;
+
+static int compare_ip_counts(const void* a, const void* b) {
+    const IpCount* x = a;
+    const IpCount* y = b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->ip - y->ip;
+}
+
+// Instruction indices sorted by execution count, hottest first
+static int hot_instructions(const Profiler* profiler, IpCount** out) {
+    IpCount* hot = malloc(sizeof(IpCount) * profiler->program_size);
+    if (!hot) {
+        *out = NULL;
+        return 0;
+    }
+
+    int n = 0;
+    for (int ip = 0; ip < profiler->program_size; ip++) {
+        if (profiler->ip_counts[ip] > 0) {
+            hot[n].ip = ip;
+            hot[n].count = profiler->ip_counts[ip];
+            n++;
+        }
+    }
+    qsort(hot, n, sizeof(IpCount), compare_ip_counts);
+
+    *out = hot;
+    return n;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total > 0 ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+void profiler_dump_text(const Profiler* profiler, FILE* out) {
+    uint64_t total = profiler->total_instructions;
+    fprintf(out, "[ANVIL] Profile: %llu instructions retired\n",
+            (unsigned long long)total);
+
+    fprintf(out, "\nOpcodes:\n");
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (profiler->opcode_counts[op] > 0) {
+            fprintf(out, "  %-6s %12llu  %6.2f%%\n",
+                    get_opcode_name((OpCode)op),
+                    (unsigned long long)profiler->opcode_counts[op],
+                    percent(profiler->opcode_counts[op], total));
+        }
+    }
+
+    fprintf(out, "\nOpcode classes:\n");
+    for (int c = 0; c < PROF_CLASS_COUNT; c++) {
+        if (profiler->class_counts[c] > 0) {
+            fprintf(out, "  %-6s %12llu  %14llu cycles  %8.1f cycles/op\n",
+                    get_opcode_class_name((OpClass)c),
+                    (unsigned long long)profiler->class_counts[c],
+                    (unsigned long long)profiler->class_cycles[c],
+                    (double)profiler->class_cycles[c] /
+                        (double)profiler->class_counts[c]);
+        }
+    }
+
+    IpCount* hot;
+    int n = hot_instructions(profiler, &hot);
+    fprintf(out, "\nHottest instructions:\n");
+    for (int i = 0; i < n && i < PROFILER_TOP_INSTRUCTIONS; i++) {
+        fprintf(out, "  ip %-6d %12llu  %6.2f%%\n", hot[i].ip,
+                (unsigned long long)hot[i].count,
+                percent(hot[i].count, total));
+    }
+    free(hot);
+
+    fprintf(out, "\nBranches:\n");
+    for (int ip = 0; ip < profiler->program_size; ip++) {
+        uint64_t taken = profiler->branch_taken[ip];
+        uint64_t not_taken = profiler->branch_not_taken[ip];
+        if (taken + not_taken > 0) {
+            fprintf(out, "  ip %-6d taken %12llu  not taken %12llu  %6.2f%%\n",
+                    ip, (unsigned long long)taken,
+                    (unsigned long long)not_taken,
+                    percent(taken, taken + not_taken));
+        }
+    }
+
+    if (profiler->perf_enabled) {
+        fprintf(out, "\nHardware counters:\n");
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            if (!perf_counter_available(&profiler->perf, (PerfCounterId)i)) {
+                fprintf(out, "  %-14s %14s\n",
+                        perf_counter_name((PerfCounterId)i), "n/a");
+                continue;
+            }
+            fprintf(out, "  %-14s %14llu  %8.2f per guest op\n",
+                    perf_counter_name((PerfCounterId)i),
+                    (unsigned long long)profiler->perf_totals[i],
+                    total > 0 ? (double)profiler->perf_totals[i] / (double)total
+                              : 0.0);
+        }
+    }
+}
+
+void profiler_dump_json(const Profiler* profiler, FILE* out) {
+    fprintf(out, "{\"total_instructions\":%llu",
+            (unsigned long long)profiler->total_instructions);
+
+    fprintf(out, ",\"opcodes\":{");
+    bool first = true;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (profiler->opcode_counts[op] > 0) {
+            fprintf(out, "%s\"%s\":%llu", first ? "" : ",",
+                    get_opcode_name((OpCode)op),
+                    (unsigned long long)profiler->opcode_counts[op]);
+            first = false;
+        }
+    }
+
+    fprintf(out, "},\"classes\":{");
+    first = true;
+    for (int c = 0; c < PROF_CLASS_COUNT; c++) {
+        if (profiler->class_counts[c] > 0) {
+            fprintf(out, "%s\"%s\":{\"count\":%llu,\"cycles\":%llu}",
+                    first ? "" : ",", get_opcode_class_name((OpClass)c),
+                    (unsigned long long)profiler->class_counts[c],
+                    (unsigned long long)profiler->class_cycles[c]);
+            first = false;
+        }
+    }
+
+    fprintf(out, "},\"instructions\":[");
+    first = true;
+    for (int ip = 0; ip < profiler->program_size; ip++) {
+        if (profiler->ip_counts[ip] > 0) {
+            fprintf(out, "%s{\"ip\":%d,\"count\":%llu}", first ? "" : ",", ip,
+                    (unsigned long long)profiler->ip_counts[ip]);
+            first = false;
+        }
+    }
+
+    fprintf(out, "],\"branches\":[");
+    first = true;
+    for (int ip = 0; ip < profiler->program_size; ip++) {
+        uint64_t taken = profiler->branch_taken[ip];
+        uint64_t not_taken = profiler->branch_not_taken[ip];
+        if (taken + not_taken > 0) {
+            fprintf(out, "%s{\"ip\":%d,\"taken\":%llu,\"not_taken\":%llu}",
+                    first ? "" : ",", ip, (unsigned long long)taken,
+                    (unsigned long long)not_taken);
+            first = false;
+        }
+    }
+
+    fprintf(out, "],\"counters\":{");
+    first = true;
+    for (int i = 0; profiler->perf_enabled && i < PERF_COUNTER_COUNT; i++) {
+        if (perf_counter_available(&profiler->perf, (PerfCounterId)i)) {
+            fprintf(out, "%s\"%s\":%llu", first ? "" : ",",
+                    perf_counter_name((PerfCounterId)i),
+                    (unsigned long long)profiler->perf_totals[i]);
+            first = false;
+        }
+    }
+    fprintf(out, "}}\n");
+}
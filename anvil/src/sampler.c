@@ -0,0 +1,278 @@
+#include "sampler.h"
+
+#include <limits.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>
+#define SAMPLER_HAS_TIMER
+#endif
+
+#define SAMPLER_INITIAL_NODES 64
+
+static uint32_t hash_frame(int parent, int label) {
+    uint32_t hash = (uint32_t)parent * 0x9E3779B1u;
+    hash ^= (uint32_t)label + 0x7F4A7C15u + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static bool grow_slots(Sampler* sampler) {
+    int new_capacity = sampler->slot_capacity * 2;
+    int* new_slots = malloc(sizeof(int) * new_capacity);
+    if (!new_slots) {
+        return false;
+    }
+    memset(new_slots, 0xFF, sizeof(int) * new_capacity);
+
+    int mask = new_capacity - 1;
+    for (int id = 1; id < sampler->node_count; id++) {
+        const CallNode* node = &sampler->nodes[id];
+        int slot = (int)(hash_frame(node->parent, node->label) & mask);
+        while (new_slots[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+        new_slots[slot] = id;
+    }
+
+    free(sampler->slots);
+    sampler->slots = new_slots;
+    sampler->slot_capacity = new_capacity;
+    return true;
+}
+
+// Find or create the node for calling `label` from `parent`. Returns -1 when
+// out of memory.
+static int child_node(Sampler* sampler, int parent, int label) {
+    int mask = sampler->slot_capacity - 1;
+    int slot = (int)(hash_frame(parent, label) & mask);
+    while (sampler->slots[slot] != -1) {
+        const CallNode* node = &sampler->nodes[sampler->slots[slot]];
+        if (node->parent == parent && node->label == label) {
+            return sampler->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if ((sampler->node_count + 1) * 2 > sampler->slot_capacity) {
+        if (!grow_slots(sampler)) {
+            return -1;
+        }
+        return child_node(sampler, parent, label);
+    }
+
+    if (sampler->node_count >= sampler->node_capacity) {
+        int new_capacity = sampler->node_capacity * 2;
+        CallNode* new_nodes =
+            realloc(sampler->nodes, sizeof(CallNode) * new_capacity);
+        if (!new_nodes) {
+            return -1;
+        }
+        sampler->nodes = new_nodes;
+        sampler->node_capacity = new_capacity;
+    }
+
+    int id = sampler->node_count++;
+    sampler->nodes[id].parent = parent;
+    sampler->nodes[id].label = label;
+    sampler->nodes[id].samples = 0;
+    sampler->nodes[id].last_child = -1;
+    sampler->slots[slot] = id;
+    return id;
+}
+
+Sampler* sampler_create(const Program* program, int interval) {
+    if (!program || interval < 0) {
+        return NULL;
+    }
+
+    Sampler* sampler = calloc(1, sizeof(Sampler));
+    if (!sampler) {
+        return NULL;
+    }
+
+    sampler->program = program;
+    sampler->nodes = malloc(sizeof(CallNode) * SAMPLER_INITIAL_NODES);
+    sampler->slots = malloc(sizeof(int) * SAMPLER_INITIAL_NODES * 2);
+    if (!sampler->nodes || !sampler->slots) {
+        sampler_destroy(sampler);
+        return NULL;
+    }
+    sampler->node_capacity = SAMPLER_INITIAL_NODES;
+    sampler->slot_capacity = SAMPLER_INITIAL_NODES * 2;
+    sampler->interval = interval;
+    sampler->max_depth = SAMPLER_MAX_DEPTH;
+
+    sampler_reset(sampler);
+    return sampler;
+}
+
+void sampler_destroy(Sampler* sampler) {
+    if (sampler) {
+        sampler_stop_timer(sampler);
+        free(sampler->nodes);
+        free(sampler->slots);
+        free(sampler);
+    }
+}
+
+void sampler_reset(Sampler* sampler) {
+    memset(sampler->slots, 0xFF, sizeof(int) * sampler->slot_capacity);
+
+    // The root node stands for code executed outside of any CALL
+    sampler->nodes[SAMPLER_ROOT].parent = -1;
+    sampler->nodes[SAMPLER_ROOT].label = SAMPLER_UNKNOWN_FRAME;
+    sampler->nodes[SAMPLER_ROOT].samples = 0;
+    sampler->nodes[SAMPLER_ROOT].last_child = -1;
+    sampler->node_count = 1;
+
+    sampler->current = SAMPLER_ROOT;
+    sampler->depth = 0;
+    sampler->overflow = 0;
+    sampler->countdown = sampler->interval > 0 ? sampler->interval : INT_MAX;
+    sampler->timer_pending = 0;
+    sampler->total_samples = 0;
+}
+
+VMError vm_attach_sampler(VM* vm, Sampler* sampler) {
+    if (!vm) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+    vm->sampler = sampler;
+    return VM_SUCCESS;
+}
+
+void sampler_enter(Sampler* sampler, int label) {
+    if (sampler->depth >= sampler->max_depth) {
+        sampler->overflow++;
+        return;
+    }
+
+    CallNode* node = &sampler->nodes[sampler->current];
+    int child = node->last_child;
+    if (child < 0 || sampler->nodes[child].label != label) {
+        child = child_node(sampler, sampler->current, label);
+        if (child < 0) {
+            // Out of memory: attribute the callee to its caller
+            sampler->overflow++;
+            return;
+        }
+        sampler->nodes[sampler->current].last_child = child;
+    }
+
+    sampler->current = child;
+    sampler->depth++;
+}
+
+void sampler_take_sample(Sampler* sampler) {
+    sampler->nodes[sampler->current].samples++;
+    sampler->total_samples++;
+    sampler->countdown = sampler->interval > 0 ? sampler->interval : INT_MAX;
+    sampler->timer_pending = 0;
+}
+
+#ifdef SAMPLER_HAS_TIMER
+static volatile sig_atomic_t* timer_flag = NULL;
+
+static void handle_sigprof(int sig) {
+    (void)sig;
+    volatile sig_atomic_t* flag = timer_flag;
+    if (flag) {
+        *flag = 1;
+    }
+}
+#endif
+
+bool sampler_start_timer(Sampler* sampler, int interval_us) {
+#ifdef SAMPLER_HAS_TIMER
+    if (interval_us <= 0 ||
+        (timer_flag && timer_flag != &sampler->timer_pending)) {
+        return false;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_sigprof;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGPROF, &action, NULL) != 0) {
+        return false;
+    }
+
+    timer_flag = &sampler->timer_pending;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval_us / 1000000;
+    timer.it_interval.tv_usec = interval_us % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        timer_flag = NULL;
+        return false;
+    }
+    return true;
+#else
+    (void)sampler;
+    (void)interval_us;
+    return false;
+#endif
+}
+
+void sampler_stop_timer(Sampler* sampler) {
+#ifdef SAMPLER_HAS_TIMER
+    if (timer_flag != &sampler->timer_pending) {
+        return;
+    }
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    timer_flag = NULL;
+#else
+    (void)sampler;
+#endif
+}
+
+static const char* frame_name(const Sampler* sampler, int label) {
+    if (label >= 0 && label < sampler->program->label_size &&
+        sampler->program->labels[label].name) {
+        return sampler->program->labels[label].name;
+    }
+    return "[unknown]";
+}
+
+static const char* root_name(const Sampler* sampler) {
+    // Name the top-level frame after the entry label, if there is one
+    for (int i = 0; i < sampler->program->label_size; i++) {
+        if (sampler->program->labels[i].address == 0 &&
+            sampler->program->labels[i].name) {
+            return sampler->program->labels[i].name;
+        }
+    }
+    return "[root]";
+}
+
+void sampler_write_collapsed(const Sampler* sampler, FILE* out) {
+    int* path = malloc(sizeof(int) * (sampler->max_depth + 1));
+    if (!path) {
+        return;
+    }
+
+    for (int id = 0; id < sampler->node_count; id++) {
+        if (sampler->nodes[id].samples == 0) {
+            continue;
+        }
+
+        int depth = 0;
+        for (int n = id; n != SAMPLER_ROOT; n = sampler->nodes[n].parent) {
+            path[depth++] = n;
+        }
+
+        fputs(root_name(sampler), out);
+        while (depth > 0) {
+            fprintf(out, ";%s",
+                    frame_name(sampler, sampler->nodes[path[--depth]].label));
+        }
+        fprintf(out, " %llu\n",
+                (unsigned long long)sampler->nodes[id].samples);
+    }
+
+    free(path);
+}
@@ -0,0 +1,159 @@
+#include "symtab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t hash_name(const char* name, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static const char* intern_string(SymbolTable* table, const char* name,
+                                 size_t length) {
+    StringChunk* chunk = table->strings;
+    if (!chunk || chunk->capacity - chunk->used < length + 1) {
+        size_t capacity = SYMTAB_CHUNK_SIZE;
+        if (capacity < length + 1) {
+            capacity = length + 1;
+        }
+
+        chunk = malloc(sizeof(StringChunk) + capacity);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = table->strings;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        table->strings = chunk;
+    }
+
+    char* str = chunk->data + chunk->used;
+    memcpy(str, name, length);
+    str[length] = '\0';
+    chunk->used += length + 1;
+    return str;
+}
+
+static bool grow_slots(SymbolTable* table) {
+    int new_capacity = table->slot_capacity * 2;
+    int* new_slots = malloc(sizeof(int) * new_capacity);
+    if (!new_slots) {
+        return false;
+    }
+    memset(new_slots, 0xFF, sizeof(int) * new_capacity);
+
+    int mask = new_capacity - 1;
+    for (int id = 0; id < table->size; id++) {
+        int slot = (int)(table->symbols[id].hash & (uint32_t)mask);
+        while (new_slots[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+        new_slots[slot] = id;
+    }
+
+    free(table->slots);
+    table->slots = new_slots;
+    table->slot_capacity = new_capacity;
+    return true;
+}
+
+bool symtab_init(SymbolTable* table) {
+    table->symbols = malloc(sizeof(Symbol) * SYMTAB_INITIAL_SLOTS / 2);
+    if (!table->symbols) {
+        return false;
+    }
+    table->size = 0;
+    table->capacity = SYMTAB_INITIAL_SLOTS / 2;
+
+    table->slots = malloc(sizeof(int) * SYMTAB_INITIAL_SLOTS);
+    if (!table->slots) {
+        free(table->symbols);
+        return false;
+    }
+    memset(table->slots, 0xFF, sizeof(int) * SYMTAB_INITIAL_SLOTS);
+    table->slot_capacity = SYMTAB_INITIAL_SLOTS;
+
+    table->strings = NULL;
+    return true;
+}
+
+void symtab_free(SymbolTable* table) {
+    StringChunk* chunk = table->strings;
+    while (chunk) {
+        StringChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(table->slots);
+    free(table->symbols);
+    table->strings = NULL;
+    table->slots = NULL;
+    table->symbols = NULL;
+    table->size = 0;
+}
+
+static int probe(const SymbolTable* table, const char* name, size_t length,
+                 uint32_t hash) {
+    int mask = table->slot_capacity - 1;
+    int slot = (int)(hash & (uint32_t)mask);
+    while (table->slots[slot] != -1) {
+        const Symbol* sym = &table->symbols[table->slots[slot]];
+        if (sym->hash == hash && sym->length == length &&
+            memcmp(sym->name, name, length) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+int symtab_find(const SymbolTable* table, const char* name, size_t length) {
+    int slot = probe(table, name, length, hash_name(name, length));
+    return table->slots[slot];
+}
+
+int symtab_intern(SymbolTable* table, const char* name, size_t length) {
+    uint32_t hash = hash_name(name, length);
+    int slot = probe(table, name, length, hash);
+    if (table->slots[slot] != -1) {
+        return table->slots[slot];
+    }
+
+    // Keep the load factor at or below 1/2 so probe sequences stay short
+    if ((table->size + 1) * 2 > table->slot_capacity) {
+        if (!grow_slots(table)) {
+            return -1;
+        }
+        slot = probe(table, name, length, hash);
+    }
+
+    if (table->size >= table->capacity) {
+        int new_capacity = table->capacity * 2;
+        Symbol* new_symbols =
+            realloc(table->symbols, sizeof(Symbol) * new_capacity);
+        if (!new_symbols) {
+            return -1;
+        }
+        table->symbols = new_symbols;
+        table->capacity = new_capacity;
+    }
+
+    const char* str = intern_string(table, name, length);
+    if (!str) {
+        return -1;
+    }
+
+    int id = table->size++;
+    table->symbols[id].name = str;
+    table->symbols[id].length = length;
+    table->symbols[id].hash = hash;
+    table->symbols[id].kind = SYM_UNDEFINED;
+    table->symbols[id].value = 0;
+    table->slots[slot] = id;
+    return id;
+}
@@ -0,0 +1,149 @@
+#include "trace.h"
+
+#define TRACE_DRAIN_BATCH 1024
+
+TraceBuffer* trace_create(uint32_t capacity) {
+    if (capacity == 0 || capacity > (1u << 31)) {
+        return NULL;
+    }
+
+    uint32_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    TraceBuffer* trace = aligned_alloc(TRACE_CACHE_LINE, sizeof(TraceBuffer));
+    if (!trace) {
+        return NULL;
+    }
+
+    trace->events = malloc(sizeof(TraceEvent) * size);
+    if (!trace->events) {
+        free(trace);
+        return NULL;
+    }
+
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->tail, 0);
+    trace->cached_tail = 0;
+    atomic_init(&trace->dropped, 0);
+    trace->mask = size - 1;
+    return trace;
+}
+
+void trace_destroy(TraceBuffer* trace) {
+    if (trace) {
+        free(trace->events);
+        free(trace);
+    }
+}
+
+VMError vm_attach_trace(VM* vm, TraceBuffer* trace) {
+    if (!vm) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+    vm->trace = trace;
+    return VM_SUCCESS;
+}
+
+void trace_begin_event(VM* vm, const Instruction* instr, TraceEvent* event) {
+    event->ip = (uint32_t)vm->cpu.ip;
+    event->address = TRACE_NO_ADDRESS;
+    event->opcode = (uint8_t)instr->opcode;
+    event->flags = 0;
+    event->reserved = 0;
+
+    switch (instr->opcode) {
+        case OP_PUSH:
+        case OP_ENTER:
+            event->address = (uint32_t)(vm->cpu.registers[R_SP] - 1);
+            break;
+        case OP_POP:
+            event->address = (uint32_t)vm->cpu.registers[R_SP];
+            break;
+        case OP_LEAVE:
+            event->address = (uint32_t)vm->cpu.registers[R_BP];
+            break;
+        case OP_JZ:
+        case OP_JNZ:
+        case OP_JG:
+        case OP_JL:
+        case OP_JGE:
+        case OP_JLE:
+        case OP_LOOP:
+        case OP_CJMP:
+            event->flags |= TRACE_BRANCH;
+            break;
+        default:
+            // Report the first memory operand, which is the one that is
+            // written for two-operand instructions
+            for (int i = 0; i < instr->num_operands; i++) {
+                if (instr->operands[i].type == OPERAND_MEMORY) {
+                    event->address = (uint32_t)get_effective_address(
+                        vm, instr->operands[i].value.mem_ref);
+                    break;
+                }
+            }
+            break;
+    }
+
+    if (event->address != TRACE_NO_ADDRESS) {
+        event->flags |= TRACE_MEMORY;
+    }
+}
+
+void trace_finish_event(VM* vm, VMError err, TraceEvent* event) {
+    if ((event->flags & TRACE_BRANCH) &&
+        (uint32_t)vm->cpu.ip != event->ip + 1) {
+        event->flags |= TRACE_TAKEN;
+    }
+    if (err != VM_SUCCESS) {
+        event->flags |= TRACE_ERROR;
+    }
+}
+
+size_t trace_drain(TraceBuffer* trace, TraceEvent* out, size_t max) {
+    uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+
+    size_t count = (size_t)(head - tail);
+    if (count > max) {
+        count = max;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = trace->events[(tail + i) & trace->mask];
+    }
+
+    atomic_store_explicit(&trace->tail, tail + count, memory_order_release);
+    return count;
+}
+
+uint64_t trace_dropped(const TraceBuffer* trace) {
+    return atomic_load_explicit(&trace->dropped, memory_order_relaxed);
+}
+
+bool trace_write_header(FILE* out) {
+    TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceEvent),
+                              0};
+    return fwrite(&header, sizeof(header), 1, out) == 1;
+}
+
+size_t trace_drain_to_file(TraceBuffer* trace, FILE* out) {
+    TraceEvent batch[TRACE_DRAIN_BATCH];
+    size_t total = 0;
+    size_t count;
+    while ((count = trace_drain(trace, batch, TRACE_DRAIN_BATCH)) > 0) {
+        total += fwrite(batch, sizeof(TraceEvent), count, out);
+    }
+    return total;
+}
+
+bool trace_read_header(FILE* in) {
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1) {
+        return false;
+    }
+    return header.magic == TRACE_MAGIC && header.version == TRACE_VERSION &&
+           header.event_size == sizeof(TraceEvent);
+}
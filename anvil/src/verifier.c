@@ -0,0 +1,232 @@
+#include "verifier.h"
+
+#define R (1 << OPERAND_REGISTER)
+#define I (1 << OPERAND_IMMEDIATE)
+#define M (1 << OPERAND_MEMORY)
+#define L (1 << OPERAND_LABEL)
+
+typedef struct {
+    int min_operands;
+    int max_operands;
+    int allowed[MAX_OPERANDS];  // Bitmask of OperandType per operand slot
+} OperandRule;
+
+static const OperandRule OPERAND_RULES[OP_COUNT] = {
+    [OP_HALT] = {0, 0, {0, 0}},
+    [OP_MOV] = {2, 2, {R | M, R | I | M | L}},
+    [OP_ADD] = {2, 2, {R | M, R | I | M}},
+    [OP_SUB] = {2, 2, {R | M, R | I | M}},
+    [OP_MUL] = {2, 2, {R | M, R | I | M}},
+    [OP_DIV] = {2, 2, {R | M, R | I | M}},
+    [OP_INC] = {1, 1, {R | M, 0}},
+    [OP_DEC] = {1, 1, {R | M, 0}},
+    [OP_AND] = {2, 2, {R | M, R | I | M}},
+    [OP_OR] = {2, 2, {R | M, R | I | M}},
+    [OP_XOR] = {2, 2, {R | M, R | I | M}},
+    [OP_CMP] = {2, 2, {R | I | M, R | I | M}},
+    [OP_JMP] = {1, 1, {L, 0}},
+    [OP_JZ] = {1, 1, {L, 0}},
+    [OP_JNZ] = {1, 1, {L, 0}},
+    [OP_JG] = {1, 1, {L, 0}},
+    [OP_JL] = {1, 1, {L, 0}},
+    [OP_JGE] = {1, 1, {L, 0}},
+    [OP_JLE] = {1, 1, {L, 0}},
+    [OP_LEA] = {2, 2, {R | M, R | I | M}},
+    [OP_PUSH] = {1, 1, {R | I | M | L, 0}},
+    [OP_POP] = {1, 1, {R | M, 0}},
+    [OP_CALL] = {1, 1, {L, 0}},
+    [OP_RET] = {0, 0, {0, 0}},
+    [OP_NOP] = {0, 0, {0, 0}},
+    [OP_OUT] = {1, 2, {R | I | M, R | I}},
+    [OP_PREG] = {1, 2, {R, R | I | M}},
+    [OP_LDB] = {2, 2, {R, M}},
+    [OP_LDH] = {2, 2, {R, M}},
+    [OP_STB] = {2, 2, {M, R | I}},
+    [OP_STH] = {2, 2, {M, R | I}},
+    [OP_ALLOC] = {2, 2, {R, R | I | M}},
+    [OP_FREE] = {1, 1, {R | I | M, 0}},
+    [OP_REALLOC] = {2, 2, {R, R | I | M}},
+    [OP_ENTER] = {0, 1, {I, 0}},
+    [OP_LEAVE] = {0, 0, {0, 0}},
+    [OP_LOOP] = {2, 2, {R, L}},
+    [OP_CJMP] = {3, 3, {R | I | M, R | I | M, L}},
+    [OP_MOD] = {2, 2, {R | M, R | I | M}},
+    [OP_SHL] = {2, 2, {R | M, R | I | M}},
+    [OP_SHR] = {2, 2, {R | M, R | I | M}},
+    [OP_POW] = {2, 2, {R | M, R | I | M}},
+};
+
+#undef R
+#undef I
+#undef M
+#undef L
+
+static VerifyResult fail(VMError error, int ip, const char* message) {
+    VerifyResult result = {error, ip, message};
+    return result;
+}
+
+static bool valid_register(int reg) { return reg >= 0 && reg < R_COUNT; }
+
+// Number of valid start addresses for the opcode's memory accesses
+static uint32_t memory_limit(OpCode opcode, uint32_t memory_size) {
+    switch (opcode) {
+        case OP_LDB:
+        case OP_STB:
+            return memory_size * 4;
+        case OP_LDH:
+        case OP_STH:
+            return memory_size * 4 - 1;
+        default:
+            return memory_size;
+    }
+}
+
+// Every slot is checked, used or not, since the interpreter reads both
+static VerifyResult verify_operand(const Operand* operand, int ip,
+                                   int num_labels) {
+    switch (operand->type) {
+        case OPERAND_REGISTER:
+            if (!valid_register(operand->value.reg)) {
+                return fail(VM_ERROR_INVALID_REGISTER, ip,
+                            "register index out of range");
+            }
+            break;
+        case OPERAND_IMMEDIATE:
+            break;
+        case OPERAND_MEMORY: {
+            MemoryRef mem_ref = operand->value.mem_ref;
+            if (!valid_register(mem_ref.base_reg) ||
+                !valid_register(mem_ref.index_reg)) {
+                return fail(VM_ERROR_INVALID_REGISTER, ip,
+                            "memory operand register out of range");
+            }
+            // Specialized modes only read the registers their shape names
+            MemoryRef classified = mem_ref;
+            memory_ref_classify(&classified);
+            if (mem_ref.mode != ADDR_GENERIC &&
+                mem_ref.mode != classified.mode) {
+                return fail(VM_ERROR_INVALID_OPERAND, ip,
+                            "memory operand has an invalid address mode");
+            }
+            break;
+        }
+        case OPERAND_LABEL:
+            if (operand->value.label < 0 ||
+                operand->value.label >= num_labels) {
+                return fail(VM_ERROR_INVALID_LABEL, ip,
+                            "label index out of range");
+            }
+            break;
+        default:
+            return fail(VM_ERROR_INVALID_OPERAND, ip,
+                        "unresolved or unknown operand type");
+    }
+    return fail(VM_SUCCESS, ip, NULL);
+}
+
+VerifyResult verify_operands(const Instruction* program, int program_size,
+                             int num_labels) {
+    for (int ip = 0; ip < program_size; ip++) {
+        const Instruction* instr = &program[ip];
+        if ((int)instr->opcode < 0 || instr->opcode >= OP_COUNT) {
+            return fail(VM_ERROR_INVALID_INSTRUCTION, ip, "unknown opcode");
+        }
+        if (instr->num_operands < 0 || instr->num_operands > MAX_OPERANDS) {
+            return fail(VM_ERROR_INVALID_OPERAND, ip,
+                        "wrong number of operands");
+        }
+        if (instr->opcode == OP_CJMP && instr->cond >= COND_COUNT) {
+            return fail(VM_ERROR_INVALID_INSTRUCTION, ip,
+                        "unknown CJMP condition");
+        }
+
+        for (int i = 0; i < MAX_OPERANDS; i++) {
+            VerifyResult result =
+                verify_operand(&instr->operands[i], ip, num_labels);
+            if (result.error != VM_SUCCESS) {
+                return result;
+            }
+        }
+    }
+    return fail(VM_SUCCESS, -1, NULL);
+}
+
+VerifyResult verify_program(const Instruction* program, int program_size,
+                            const int* label_addresses, int num_labels,
+                            uint32_t memory_size) {
+    if (!program || program_size <= 0 || num_labels < 0 ||
+        (num_labels > 0 && !label_addresses)) {
+        return fail(VM_ERROR_INVALID_ARGUMENT, -1, "no program");
+    }
+
+    // Jumping to program_size is a clean exit, so it is a valid target
+    for (int i = 0; i < num_labels; i++) {
+        if (label_addresses[i] < 0 || label_addresses[i] > program_size) {
+            return fail(VM_ERROR_INVALID_LABEL, -1,
+                        "label address outside the program");
+        }
+    }
+
+    VerifyResult shape = verify_operands(program, program_size, num_labels);
+    if (shape.error != VM_SUCCESS) {
+        return shape;
+    }
+
+    for (int ip = 0; ip < program_size; ip++) {
+        const Instruction* instr = &program[ip];
+        const OperandRule* rule = &OPERAND_RULES[instr->opcode];
+        if (instr->num_operands < rule->min_operands ||
+            instr->num_operands > rule->max_operands) {
+            return fail(VM_ERROR_INVALID_OPERAND, ip,
+                        "wrong number of operands");
+        }
+
+        uint32_t limit = memory_limit(instr->opcode, memory_size);
+        for (int i = 0; i < MAX_OPERANDS; i++) {
+            const Operand* operand = &instr->operands[i];
+            if (i < instr->num_operands &&
+                !(rule->allowed[i] & (1 << operand->type))) {
+                return fail(VM_ERROR_INVALID_OPERAND, ip,
+                            "operand type not allowed for opcode");
+            }
+
+            if (operand->type != OPERAND_MEMORY) {
+                continue;
+            }
+            MemoryRef classified = operand->value.mem_ref;
+            memory_ref_classify(&classified);
+            if (classified.mode == ADDR_ABSOLUTE &&
+                (uint32_t)classified.offset >= limit) {
+                return fail(VM_ERROR_MEMORY_ACCESS, ip,
+                            "absolute memory address out of range");
+            }
+        }
+
+        if (instr->opcode == OP_CALL &&
+            label_addresses[instr->operands[0].value.label] >= program_size) {
+            return fail(VM_ERROR_INVALID_LABEL, ip,
+                        "call target past the end of the program");
+        }
+
+        if ((instr->opcode == OP_DIV || instr->opcode == OP_MOD) &&
+            instr->operands[1].type == OPERAND_IMMEDIATE &&
+            instr->operands[1].value.imm == 0) {
+            return fail(VM_ERROR_DIVIDE_BY_ZERO, ip, "division by zero");
+        }
+    }
+
+    return fail(VM_SUCCESS, -1, NULL);
+}
+
+VMError vm_verify(VM* vm) {
+    if (!vm) {
+        return VM_ERROR_INVALID_ARGUMENT;
+    }
+
+    VerifyResult result =
+        verify_program(vm->program, vm->program_size, vm->label_addresses,
+                       vm->num_labels, vm->memory.size);
+    vm->verified = result.error == VM_SUCCESS;
+    return result.error;
+}
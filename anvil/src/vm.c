@@ -1,45 +1,116 @@
 #include "vm.h"
 
-VMError vm_init(VM* vm, Instruction* program, int program_size,
-                int* label_addresses, int num_labels) {
-    VMError err = VM_SUCCESS;
-    if (!vm || !program || program_size <= 0) {
-        err = VM_ERROR_INITIALIZATION;
-    }
+#include "fault.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "trace.h"
+
+VMConfig vm_default_config(void) {
+    VMConfig config = {MEMORY_SIZE, false, MEMORY_SIZE / 4,
+                       CALL_STACK_DEPTH};
+    return config;
+}
 
+// The register and call stack state of a VM that has not run yet
+static void start_program(VM* vm, Instruction* program, int program_size,
+                          int* label_addresses, int num_labels) {
     for (int i = 0; i < R_COUNT; i++) {
         vm->cpu.registers[i] = 0;
     }
 
     vm->cpu.flags = 0;
     vm->cpu.ip = 0;
-    vm->cpu.sp = STACK_START;
+    vm->cpu.registers[R_SP] = vm_stack_start(vm);
+    vm->cpu.registers[R_BP] = vm_stack_start(vm);
+    vm->call_depth = 0;
+
+    vm->program = program;
+    vm->program_size = program_size;
+    vm->label_addresses = label_addresses;
+    vm->num_labels = num_labels;
+    vm->verified = false;
+}
 
-    vm->cpu.registers[R_SP] = vm->cpu.sp;
-    vm->cpu.registers[R_BP] = vm->cpu.sp;
+VMError vm_init_with_config(VM* vm, Instruction* program, int program_size,
+                            int* label_addresses, int num_labels,
+                            const VMConfig* config) {
+    if (!vm || !program || program_size <= 0 || !config) {
+        return VM_ERROR_INITIALIZATION;
+    }
 
-    err = init_memory(&vm->memory);
+    if (config->call_depth == 0 || config->call_depth > INT32_MAX / 4) {
+        fprintf(stderr, "[ANVIL] Error: Invalid call stack depth %u!\n",
+                config->call_depth);
+        return VM_ERROR_INITIALIZATION;
+    }
+    if (config->memory_size < VM_MIN_MEMORY_SIZE ||
+        config->memory_size > MEMORY_MAX_SIZE) {
+        fprintf(stderr,
+                "[ANVIL] Error: Guest memory of %u words is outside "
+                "[%u, %u]!\n",
+                config->memory_size, (unsigned)VM_MIN_MEMORY_SIZE,
+                (unsigned)MEMORY_MAX_SIZE);
+        return VM_ERROR_MEMORY_INIT;
+    }
+    VMError err =
+        init_memory(&vm->memory, config->memory_size, config->huge_pages);
     if (err != VM_SUCCESS) {
         return err;
     }
 
-    vm->program = program;
-    vm->program_size = program_size;
-    vm->label_addresses = label_addresses;
-    vm->num_labels = num_labels;
+    // The heap ends just below the lowest stack word
+    uint32_t heap_end = vm->memory.size - 1 - STACK_SIZE;
+    if (config->heap_size >= heap_end) {
+        fprintf(stderr,
+                "[ANVIL] Error: Heap of %u words does not fit below the "
+                "stack!\n",
+                config->heap_size);
+        free_memory(&vm->memory);
+        return VM_ERROR_MEMORY_INIT;
+    }
+    err = heap_init(&vm->heap, heap_end - config->heap_size,
+                    config->heap_size);
+    if (err != VM_SUCCESS) {
+        free_memory(&vm->memory);
+        return err;
+    }
+
+    vm->call_stack = malloc(sizeof(int) * config->call_depth);
+    if (!vm->call_stack) {
+        heap_destroy(&vm->heap);
+        free_memory(&vm->memory);
+        return VM_ERROR_MEMORY_INIT;
+    }
+    vm->call_capacity = (int)config->call_depth;
+    vm->output = stdout;
+    vm->step_limit = 0;
+    vm->sampler = NULL;
+    vm->trace = NULL;
+#ifdef ANVIL_PROFILE
+    vm->profiler = NULL;
+#endif
 
+    start_program(vm, program, program_size, label_addresses, num_labels);
     return err;
 }
 
-VM* vm_create(Instruction* program, int program_size, int* label_addresses,
-              int num_labels) {
+VMError vm_init(VM* vm, Instruction* program, int program_size,
+                int* label_addresses, int num_labels) {
+    VMConfig config = vm_default_config();
+    return vm_init_with_config(vm, program, program_size, label_addresses,
+                               num_labels, &config);
+}
+
+VM* vm_create_with_config(Instruction* program, int program_size,
+                          int* label_addresses, int num_labels,
+                          const VMConfig* config) {
     VM* vm = (VM*)malloc(sizeof(VM));
     if (!vm) {
         fprintf(stderr, "[ANVIL] Error: Memory allocation failed for VM!\n");
         return NULL;
     }
-    VMError err =
-        vm_init(vm, program, program_size, label_addresses, num_labels);
+    VMError err = vm_init_with_config(vm, program, program_size,
+                                      label_addresses, num_labels, config);
     if (err != VM_SUCCESS) {
         free(vm);
         handle_error(err);
@@ -49,19 +120,194 @@ VM* vm_create(Instruction* program, int program_size, int* label_addresses,
     return vm;
 }
 
+VM* vm_create(Instruction* program, int program_size, int* label_addresses,
+              int num_labels) {
+    VMConfig config = vm_default_config();
+    return vm_create_with_config(program, program_size, label_addresses,
+                                 num_labels, &config);
+}
+
+VMError vm_reset(VM* vm, Instruction* program, int program_size,
+                 int* label_addresses, int num_labels) {
+    if (!vm || !program || program_size <= 0) {
+        return VM_ERROR_INITIALIZATION;
+    }
+
+    uint32_t heap_base = vm->heap.base;
+    uint32_t heap_size = vm->heap.end - vm->heap.base;
+    heap_destroy(&vm->heap);
+    VMError err = heap_init(&vm->heap, heap_base, heap_size);
+    if (err != VM_SUCCESS) {
+        return err;
+    }
+    clear_memory(&vm->memory);
+
+    start_program(vm, program, program_size, label_addresses, num_labels);
+    return VM_SUCCESS;
+}
+
+void vm_release(VM* vm) {
+    if (vm) {
+        free(vm->call_stack);
+        vm->call_stack = NULL;
+        heap_destroy(&vm->heap);
+        free_memory(&vm->memory);
+    }
+}
+
 void vm_destroy(VM* vm) {
     if (vm) {
+        vm_release(vm);
         free(vm);
     }
 }
 
+// Instructions a run may still execute; no limit is one never reached
+static inline uint64_t step_budget(const VM* vm) {
+    return vm->step_limit ? vm->step_limit : UINT64_MAX;
+}
+
+static VMError out_of_steps(VM* vm) {
+    fprintf(stderr,
+            "[ANVIL] Error: Step limit of %llu instructions reached at "
+            "instruction %d!\n",
+            (unsigned long long)vm->step_limit, vm->cpu.ip);
+    return VM_ERROR_STEP_LIMIT;
+}
+
+static inline VMError execute_observed(VM* vm, const Instruction* instr) {
+#ifdef ANVIL_PROFILE
+    if (vm->profiler) {
+        return profiler_execute(vm->profiler, vm, instr);
+    }
+#endif
+    return execute_instruction(vm, *instr);
+}
+
+// Interpreter loop for a VM with a profiler, sampler or trace buffer
+// attached. The others never look at them, so a VM without any pays only
+// the test in vm_run.
+static VMError vm_run_observed(VM* vm) {
+    VMError err = VM_SUCCESS;
+    Sampler* sampler = vm->sampler;
+    TraceBuffer* trace = vm->trace;
+    uint64_t budget = step_budget(vm);
+#ifdef ANVIL_PROFILE
+    if (vm->profiler) {
+        profiler_begin_run(vm->profiler);
+    }
+#endif
+
+    while (vm->cpu.ip >= 0 && vm->cpu.ip < vm->program_size) {
+        if (budget-- == 0) {
+            err = out_of_steps(vm);
+            break;
+        }
+        const Instruction* instr = &vm->program[vm->cpu.ip];
+        TraceEvent event;
+        if (trace) {
+            trace_begin_event(vm, instr, &event);
+        }
+
+        err = execute_observed(vm, instr);
+
+        if (trace) {
+            trace_finish_event(vm, err, &event);
+            trace_record(trace, &event);
+        }
+        if (err != VM_SUCCESS) {
+            break;
+        }
+
+        if (sampler) {
+            sampler_step(sampler, instr);
+        }
+    }
+
+#ifdef ANVIL_PROFILE
+    if (vm->profiler) {
+        profiler_end_run(vm->profiler);
+    }
+#endif
+    return err;
+}
+
+#ifdef ANVIL_GUARD_MEMORY
+// Kept out of line so the hot loop is not compiled under the constraints of
+// a function that calls sigsetjmp
+static __attribute__((noinline)) VMError run_guarded_loop(VM* vm) {
+    VMError err = VM_SUCCESS;
+    uint64_t budget = step_budget(vm);
+    while (vm->cpu.ip >= 0 && vm->cpu.ip < vm->program_size) {
+        if (budget-- == 0) {
+            return out_of_steps(vm);
+        }
+        err = execute_guarded(vm, &vm->program[vm->cpu.ip]);
+        if (err != VM_SUCCESS) {
+            break;
+        }
+    }
+    return err;
+}
+
+static VMError vm_run_guarded(VM* vm) {
+    FaultContext fault;
+    if (sigsetjmp(fault.env, 0)) {
+        fprintf(stderr,
+                "[ANVIL] Error: Memory access violation at address %d "
+                "(instruction %d)!\n",
+                fault.address, vm->cpu.ip);
+        return VM_ERROR_MEMORY_ACCESS;
+    }
+
+    fault_enter(&fault, &vm->memory);
+    VMError err = run_guarded_loop(vm);
+    fault_leave(&fault);
+
+    return err;
+}
+#endif
+
 VMError vm_run(VM* vm) {
     VMError err = VM_SUCCESS;
     if (!vm || !vm->program) {
         err = VM_ERROR_INVALID_ARGUMENT;
     }
 
+    if (vm->sampler || vm->trace) {
+        return vm_run_observed(vm);
+    }
+#ifdef ANVIL_PROFILE
+    if (vm->profiler) {
+        return vm_run_observed(vm);
+    }
+#endif
+
+#ifdef ANVIL_GUARD_MEMORY
+    if (vm->verified && memory_is_guarded(&vm->memory) &&
+        fault_handler_install()) {
+        return vm_run_guarded(vm);
+    }
+#endif
+
+    uint64_t budget = step_budget(vm);
+    if (vm->verified) {
+        while (vm->cpu.ip >= 0 && vm->cpu.ip < vm->program_size) {
+            if (budget-- == 0) {
+                return out_of_steps(vm);
+            }
+            err = execute_verified(vm, &vm->program[vm->cpu.ip]);
+            if (err != VM_SUCCESS) {
+                return err;
+            }
+        }
+        return err;
+    }
+
     while (vm->cpu.ip >= 0 && vm->cpu.ip < vm->program_size) {
+        if (budget-- == 0) {
+            return out_of_steps(vm);
+        }
         Instruction instr = vm->program[vm->cpu.ip];
         err = execute_instruction(vm, instr);
         if (err != VM_SUCCESS) {
@@ -84,6 +330,10 @@ VMError vm_step(VM* vm) {
         return err;
     }
 
+    if (vm->verified) {
+        return execute_verified(vm, &vm->program[vm->cpu.ip]);
+    }
+
     Instruction instr = vm->program[vm->cpu.ip];
     err = execute_instruction(vm, instr);
     return err;
@@ -1,7 +1,17 @@
 #include "vm.h"
 #include "assembler.h"
+#include "cache.h"
+#include "disassembler.h"
 #include "io.h"
+#include "loader.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "trace.h"
+#include "verifier.h"
 #include <assert.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <unistd.h>
 
 void test_arithmetic() {
     printf("\n==========================\n");
@@ -19,14 +29,14 @@ void test_arithmetic() {
         HALT
     */
     Instruction program[] = {
-        {OP_MOV, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 10}}}, 2},
-        {OP_MOV, {{OPERAND_REGISTER, {.reg = R_BX}}, {OPERAND_IMMEDIATE, {.imm = 5}}}, 2},
-        {OP_ADD, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_REGISTER, {.reg = R_BX}}}, 2},
-        {OP_MOV, {{OPERAND_REGISTER, {.reg = R_CX}}, {OPERAND_REGISTER, {.reg = R_AX}}}, 2},
-        {OP_SUB, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 7}}}, 2},
-        {OP_MUL, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_REGISTER, {.reg = R_BX}}}, 2},
-        {OP_DIV, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 2}}}, 2},
-        {OP_HALT, {{0}}, 0}
+        {OP_MOV, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 10}}}, 2, 0},
+        {OP_MOV, {{OPERAND_REGISTER, {.reg = R_BX}}, {OPERAND_IMMEDIATE, {.imm = 5}}}, 2, 0},
+        {OP_ADD, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_REGISTER, {.reg = R_BX}}}, 2, 0},
+        {OP_MOV, {{OPERAND_REGISTER, {.reg = R_CX}}, {OPERAND_REGISTER, {.reg = R_AX}}}, 2, 0},
+        {OP_SUB, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 7}}}, 2, 0},
+        {OP_MUL, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_REGISTER, {.reg = R_BX}}}, 2, 0},
+        {OP_DIV, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 2}}}, 2, 0},
+        {OP_HALT, {{0}}, 0, 0}
     };
     
     VM* vm = vm_create(program, 8, NULL, 0);
@@ -120,7 +130,7 @@ void test_file_parsing() {
     assert(program != NULL);
     printf("[ANVIL] Program assembled successfully.\n");
 
-    VM* vm = vm_create(program->instructions, program->size, program->label_addresses, program->label_size);
+    VM* vm = load_program(program);
     assert(vm != NULL);
     printf("[ANVIL] VM created successfully.\n");
 
@@ -168,6 +178,1400 @@ void test_io_ports() {
     printf("[ANVIL] IO ports test passed!\n");
 }
 
+void test_symbols() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing symbol table...\n");
+
+    const char* source =
+        ".equ COUNT, 5\n"
+        ".equ STEP, COUNT\n"
+        "start:\n"
+        "    mov ax, 0\n"
+        "    mov cx, COUNT\n"
+        "    jmp loop\n"
+        "skip:\n"
+        "    mov ax, 99\n"
+        "loop:\n"
+        "    add ax, STEP\n"
+        "    dec cx\n"
+        "    jnz loop\n"
+        "    mov bx, IO_STDOUT\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    assert(program->label_size == 3);
+    assert(symtab_find(&program->symbols, "loop", 4) >= 0);
+    assert(symtab_find(&program->symbols, "missing", 7) == -1);
+
+    VM* vm = vm_create(program->instructions, program->size, program->label_addresses, program->label_size);
+    assert(vm != NULL);
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 25);
+    assert(vm->cpu.registers[R_BX] == (int)IO_STDOUT);
+
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // Duplicate and undefined symbols are rejected
+    assert(assemble_from_string("a:\n nop\na:\n halt\n") == NULL);
+    assert(assemble_from_string("jmp nowhere\n") == NULL);
+
+    // Many labels, each referenced before it is defined
+    const int num_labels = 20000;
+    size_t capacity = (size_t)num_labels * 32;
+    char* big = malloc(capacity);
+    assert(big != NULL);
+    size_t len = 0;
+    for (int i = 0; i < num_labels; i++) {
+        len += snprintf(big + len, capacity - len, "jmp l%d\nl%d: nop\n", i, i);
+    }
+    program = assemble_from_string(big);
+    assert(program != NULL);
+    assert(program->label_size == num_labels);
+    assert(program->label_addresses[num_labels - 1] == 2 * num_labels - 1);
+    program_destroy(program);
+    free(big);
+
+    printf("[ANVIL] Symbol table test passed!\n");
+}
+
+void test_data_sections() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing data sections...\n");
+
+    const char* source =
+        ".data 0x2000\n"
+        "table:\n"
+        "    .word 10, 20, 30, SIZE\n"
+        "targets:\n"
+        "    .word done\n"
+        "msg: .string \"hi\\n\"\n"
+        "buffer: .space 4\n"
+        ".equ SIZE, 3\n"
+        ".text\n"
+        "start:\n"
+        "    mov bx, table\n"
+        "    mov ax, [bx+2]\n"
+        "    mov cx, msg\n"
+        "    mov dx, buffer\n"
+        "done:\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    assert(program->data_base == 0x2000);
+    assert(program->data_size == 4 + 1 + 1 + 4);
+    assert(program->data[3] == 3);
+    assert(program->data[4] == 4);  // Address of the "done" label
+    assert(memcmp(&program->data[5], "hi\n", 4) == 0);  // Packed string
+    assert(program->data[6] == 0);
+
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 30);
+    assert(vm->cpu.registers[R_CX] == 0x2005);
+    assert(vm->cpu.registers[R_DX] == 0x2006);
+    assert(memory_bytes(&vm->memory)[0x2005 * 4 + 1] == 'i');
+
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // Data directives belong in .data, instructions do not
+    assert(assemble_from_string(".word 1\n") == NULL);
+    assert(assemble_from_string(".data\n mov ax, 1\n") == NULL);
+
+    printf("[ANVIL] Data sections test passed!\n");
+}
+
+void test_verifier() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing bytecode verifier...\n");
+
+    const char* source =
+        "start:\n"
+        "    mov cx, 5\n"
+        "    mov bx, 0x2000\n"
+        "loop:\n"
+        "    add ax, cx\n"
+        "    mov [bx], ax\n"
+        "    call twice\n"
+        "    dec cx\n"
+        "    jnz loop\n"
+        "    halt\n"
+        "twice:\n"
+        "    add ax, ax\n"
+        "    ret\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+    assert(vm->verified);
+
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 258);
+    assert(vm->memory.data[0x2000] == 129);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    int labels[] = {0, 2};
+    Instruction bad_register[] = {
+        {OP_MOV, {{OPERAND_REGISTER, {.reg = 42}}, {OPERAND_IMMEDIATE, {.imm = 1}}}, 2, 0},
+        {OP_HALT, {{0}}, 0, 0}
+    };
+    VerifyResult result = verify_program(bad_register, 2, labels, 2, MEMORY_SIZE);
+    assert(result.error == VM_ERROR_INVALID_REGISTER);
+    assert(result.ip == 0);
+
+    Instruction bad_label[] = {
+        {OP_NOP, {{0}}, 0, 0},
+        {OP_JMP, {{OPERAND_LABEL, {.label = 7}}}, 1, 0}
+    };
+    result = verify_program(bad_label, 2, labels, 2, MEMORY_SIZE);
+    assert(result.error == VM_ERROR_INVALID_LABEL);
+    assert(result.ip == 1);
+
+    Instruction bad_type[] = {
+        {OP_JZ, {{OPERAND_IMMEDIATE, {.imm = 0}}}, 1, 0},
+        {OP_HALT, {{0}}, 0, 0}
+    };
+    result = verify_program(bad_type, 2, labels, 2, MEMORY_SIZE);
+    assert(result.error == VM_ERROR_INVALID_OPERAND);
+
+    Instruction bad_address[] = {
+        {OP_MOV, {{OPERAND_MEMORY, {.mem_ref = {R_NONE, R_NONE, 1, MEMORY_SIZE}}},
+                  {OPERAND_IMMEDIATE, {.imm = 1}}}, 2, 0},
+        {OP_DIV, {{OPERAND_REGISTER, {.reg = R_AX}}, {OPERAND_IMMEDIATE, {.imm = 0}}}, 2, 0}
+    };
+    result = verify_program(bad_address, 2, labels, 2, MEMORY_SIZE);
+    assert(result.error == VM_ERROR_MEMORY_ACCESS);
+    result = verify_program(&bad_address[1], 1, NULL, 0, MEMORY_SIZE);
+    assert(result.error == VM_ERROR_DIVIDE_BY_ZERO);
+
+    // A call must land on an instruction, while a jump may exit the program
+    Instruction call_past_end[] = {
+        {OP_CALL, {{OPERAND_LABEL, {.label = 1}}}, 1, 0},
+        {OP_JMP, {{OPERAND_LABEL, {.label = 1}}}, 1, 0}
+    };
+    int end_labels[] = {0, 2};
+    result = verify_program(call_past_end, 2, end_labels, 2, MEMORY_SIZE);
+    assert(result.error == VM_ERROR_INVALID_LABEL);
+    Instruction exit_jump[] = {
+        {OP_JMP, {{OPERAND_LABEL, {.label = 0}}}, 1, 0}
+    };
+    int exit_label[] = {1};
+    result = verify_program(exit_jump, 1, exit_label, 1, MEMORY_SIZE);
+    assert(result.error == VM_SUCCESS);
+
+    // Unverified programs keep running on the checked interpreter
+    vm = vm_create(bad_type, 2, labels, 2);
+    assert(vm != NULL);
+    assert(vm_verify(vm) == VM_ERROR_INVALID_OPERAND);
+    assert(!vm->verified);
+    vm_destroy(vm);
+
+    printf("[ANVIL] Bytecode verifier test passed!\n");
+}
+
+void test_guard_pages() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing guard page memory...\n");
+
+    const char* sources[] = {
+        "mov bx, 100000\nmov ax, [bx]\nhalt\n",
+        "mov bx, -5\nmov [bx], 7\nhalt\n",
+        "mov bx, 2147483647\nmov ax, [bx+1]\nhalt\n",
+    };
+
+    for (int i = 0; i < 3; i++) {
+        Program* program = assemble_from_string(sources[i]);
+        assert(program != NULL);
+        VM* vm = load_program(program);
+        assert(vm != NULL);
+
+        VMError err = vm_run(vm);
+        if (memory_is_guarded(&vm->memory)) {
+            assert(err == VM_ERROR_MEMORY_ACCESS);
+            assert(vm->cpu.ip == 1);
+        } else if (i == 1) {
+            assert(err == VM_ERROR_MEMORY_ACCESS);
+        }
+
+        vm_destroy(vm);
+        program_destroy(program);
+    }
+
+    // In-range accesses are unaffected, including after a fault
+    Program* program =
+        assemble_from_string("mov bx, 65535\nmov [bx], 9\nmov ax, [bx]\n");
+    assert(program != NULL);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+    assert(vm_run(vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 9);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    printf("[ANVIL] Guard page memory test passed!\n");
+}
+
+void test_addressing_modes() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing addressing modes...\n");
+
+    const char* source =
+        ".data 0x2000\n"
+        "arr: .word 10, 20, 30, 40, 50, 60, 70, 80\n"
+        "out: .space 8\n"
+        ".text\n"
+        "start:\n"
+        "    mov si, 0\n"
+        "    mov ax, 0\n"
+        "sum:\n"
+        "    add ax, [arr + si]\n"
+        "    mov [out + si*1], ax\n"
+        "    inc si\n"
+        "    cmp si, 8\n"
+        "    jl sum\n"
+        "    mov bx, arr\n"
+        "    mov si, 1\n"
+        "    mov cx, [bx + si*2 + 1]\n"
+        "    mov dx, [ 4*si + arr ]\n"
+        "    lea di, [bx + si*4 - 3]\n"
+        "    add [bx + 7], 5\n"
+        "    push 99\n"
+        "    pop [bx + si*8]\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+
+    MemoryRef sum_ref = program->instructions[2].operands[1].value.mem_ref;
+    assert(sum_ref.mode == ADDR_BASE_DISP);
+    assert(sum_ref.base_reg == R_SI && sum_ref.offset == 0x2000);
+    MemoryRef out_ref = program->instructions[3].operands[0].value.mem_ref;
+    assert(out_ref.mode == ADDR_INDEX_DISP);
+    assert(out_ref.index_reg == R_SI && out_ref.scale == 1);
+    MemoryRef full_ref = program->instructions[9].operands[1].value.mem_ref;
+    assert(full_ref.mode == ADDR_BASE_INDEX_DISP);
+    assert(full_ref.base_reg == R_BX && full_ref.index_reg == R_SI);
+    assert(full_ref.scale == 2 && full_ref.offset == 1);
+
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+    assert(vm->verified);
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+
+    assert(vm->cpu.registers[R_AX] == 360);
+    assert(vm->memory.data[0x2008 + 7] == 360);
+    assert(vm->memory.data[0x2008 + 2] == 60);
+    assert(vm->cpu.registers[R_CX] == 40);
+    assert(vm->cpu.registers[R_DX] == 50);
+    assert(vm->cpu.registers[R_DI] == 0x2000 + 4 - 3);
+    assert(vm->memory.data[0x2007] == 85);
+    assert(vm->memory.data[0x2008] == 99);
+
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // Malformed references are rejected by the assembler
+    const char* bad[] = {
+        "mov ax, [bx + cx + dx]\n",
+        "mov ax, [bx*3]\n",
+        "mov ax, [-bx]\n",
+        "mov ax, [bx +]\n",
+        "mov ax, [bx\n",
+    };
+    for (int i = 0; i < 5; i++) {
+        assert(assemble_from_string(bad[i]) == NULL);
+    }
+
+    printf("[ANVIL] Addressing modes test passed!\n");
+}
+
+static bool verifies(const char* source) {
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VerifyResult result =
+        verify_program(program->instructions, program->size,
+                       program->label_addresses, program->label_size,
+                       MEMORY_SIZE);
+    program_destroy(program);
+    return result.error == VM_SUCCESS;
+}
+
+void test_byte_memory() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing byte memory...\n");
+
+    // Upper-case a packed string in place, then print it. The label stands
+    // for its byte address in byte operands and OUT, its word address in MOV
+    const char* source =
+        ".data 0x2000\n"
+        "text: .string \"anvil vm\"\n"
+        ".text\n"
+        "start:\n"
+        "    mov si, text\n"
+        "    mov cx, 0\n"
+        "upper:\n"
+        "    ldb ax, [text + cx]\n"
+        "    cmp ax, 0\n"
+        "    jz done\n"
+        "    cmp ax, 'a'\n"
+        "    jl next\n"
+        "    sub ax, 32\n"
+        "    stb [text + cx], ax\n"
+        "next:\n"
+        "    inc cx\n"
+        "    jmp upper\n"
+        "done:\n"
+        "    out text, cx\n"
+        "    sth [0xC000], 0x1234ABCD\n"
+        "    ldh dx, [0xC000]\n"
+        "    stb [0xC003], 0x17F\n"
+        "    ldb bx, [0xC003]\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    assert(program->data_size == 3);  // Eight characters and a terminator
+
+    VM* vm = load_program(program);
+    assert(vm != NULL && vm->verified);
+    VMError err = vm_run(vm);
+    printf("\n");
+    assert(err == VM_SUCCESS);
+
+    const uint8_t* bytes = memory_bytes(&vm->memory);
+    assert(memcmp(bytes + 0x2000 * 4, "ANVIL VM", 9) == 0);
+    assert(vm->cpu.registers[R_CX] == 8);
+    assert(vm->cpu.registers[R_SI] == 0x2000);
+    assert(vm->cpu.registers[R_DX] == 0xABCD);
+    assert(vm->cpu.registers[R_BX] == 0x7F);
+    assert(bytes[0xC000] == 0xCD && bytes[0xC001] == 0xAB);
+    assert(bytes[0xC002] == 0);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // A halfword must fit entirely inside memory, on the verified and the
+    // checked interpreter alike
+    program = assemble_from_string(
+        "mov bx, 0x3FFFF\nldb ax, [bx]\nldh cx, [bx]\nhalt\n");
+    assert(program != NULL);
+    for (int verified = 1; verified >= 0; verified--) {
+        vm = verified ? load_program(program)
+                      : vm_create(program->instructions, program->size,
+                                  program->label_addresses,
+                                  program->label_size);
+        assert(vm != NULL && vm->verified == verified);
+        assert(vm_run(vm) != VM_SUCCESS);
+        assert(vm->cpu.ip == 2);
+        vm_destroy(vm);
+    }
+    program_destroy(program);
+
+    assert(verifies("ldb ax, [0x3FFFF]\n"));
+    assert(!verifies("ldh ax, [0x3FFFF]\n"));
+    assert(!verifies("stb ax, [0x10]\n"));
+    assert(!verifies("ldb [0x10], ax\n"));
+
+    printf("[ANVIL] Byte memory test passed!\n");
+}
+
+void test_memory_config() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing memory configuration...\n");
+
+    const char* source =
+        "    mov bx, TOP\n"
+        "    mov [bx], 7\n"
+        "    push [bx]\n"
+        "    pop ax\n"
+        "    stb [BYTE_TOP], 9\n"
+        "    halt\n";
+
+    // Sizes are rounded up to whole pages; the stack sits at the top
+    VMConfig config = vm_default_config();
+    config.memory_size = 10000;
+    config.heap_size = 1024;
+    char small[256];
+    snprintf(small, sizeof(small), ".equ TOP, %d\n.equ BYTE_TOP, %d\n%s",
+             10239, 10240 * 4 - 1, source);
+    Program* program = assemble_from_string(small);
+    assert(program != NULL);
+    VM* vm = load_program_with_config(program, &config);
+    assert(vm != NULL && vm->verified);
+    assert(vm->memory.size == 10240);
+    assert(vm->cpu.registers[R_SP] == 10239);
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 7);
+    assert(memory_bytes(&vm->memory)[10240 * 4 - 1] == 9);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // A large memory, on huge pages when the system has them
+    config.memory_size = 1 << 24;
+    config.huge_pages = true;
+    char large[256];
+    snprintf(large, sizeof(large), ".equ TOP, %d\n.equ BYTE_TOP, %d\n%s",
+             (1 << 24) - 1, (1 << 26) - 1, source);
+    program = assemble_from_string(large);
+    assert(program != NULL);
+    vm = load_program_with_config(program, &config);
+    assert(vm != NULL && vm->verified);
+    printf("[ANVIL] %u words, %s\n", vm->memory.size,
+           vm->memory.huge_pages ? "huge pages" : "ordinary pages");
+    err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 7);
+    vm_destroy(vm);
+
+    // The default memory is smaller, so the same program fails to verify
+    vm = load_program(program);
+    assert(vm != NULL && !vm->verified);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    Instruction halt = {OP_HALT, {{0}}, 0, 0};
+    config.memory_size = VM_MIN_MEMORY_SIZE - 1;
+    assert(vm_create_with_config(&halt, 1, NULL, 0, &config) == NULL);
+    config.memory_size = MEMORY_MAX_SIZE + 1;
+    assert(vm_create_with_config(&halt, 1, NULL, 0, &config) == NULL);
+
+    printf("[ANVIL] Memory configuration test passed!\n");
+}
+
+void test_heap() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing guest heap...\n");
+
+    // Build a linked list, sum and free it, then grow a block
+    const char* source =
+        "    mov cx, 100\n"
+        "    mov di, 0\n"
+        "build:\n"
+        "    alloc ax, 2\n"
+        "    mov [ax], cx\n"
+        "    mov [ax + 1], di\n"
+        "    mov di, ax\n"
+        "    dec cx\n"
+        "    jnz build\n"
+        "    mov dx, 0\n"
+        "    mov si, di\n"
+        "sum:\n"
+        "    add dx, [si]\n"
+        "    mov bx, [si + 1]\n"
+        "    free si\n"
+        "    mov si, bx\n"
+        "    cmp si, 0\n"
+        "    jnz sum\n"
+        "    alloc bx, 2\n"
+        "    alloc cx, 100\n"
+        "    mov [cx + 99], 5\n"
+        "    realloc cx, 300\n"
+        "    mov ax, [cx + 99]\n"
+        "    alloc si, 0x7FFFFFFF\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VM* vm = load_program(program);
+    assert(vm != NULL && vm->verified);
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+
+    const Heap* heap = &vm->heap;
+    assert(vm->cpu.registers[R_DX] == 5050);
+    assert(vm->cpu.registers[R_AX] == 5);
+    // The last node freed was the first allocated, at the bottom of the heap
+    assert((uint32_t)vm->cpu.registers[R_BX] == heap->base);
+    assert(heap_block_size(heap, vm->cpu.registers[R_CX]) == 512);
+    assert(vm->cpu.registers[R_SI] == 0);  // Too large to ever fit
+    assert(heap->live_blocks == 2);
+    assert(heap->end == (uint32_t)vm_stack_start(vm) - STACK_SIZE);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // Bad and repeated frees are errors
+    const char* bad[] = {
+        "free 12345\n",
+        "alloc ax, 4\nfree ax\nfree ax\n",
+        "alloc ax, 4\nadd ax, 2\nrealloc ax, 8\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        program = assemble_from_string(bad[i]);
+        assert(program != NULL);
+        vm = load_program(program);
+        assert(vm != NULL);
+        assert(vm_run(vm) == VM_ERROR_INVALID_HEAP_ADDRESS);
+        vm_destroy(vm);
+        program_destroy(program);
+    }
+
+    // A free-list link overwritten by the guest is not followed
+    Memory memory;
+    Heap host_heap;
+    assert(init_memory(&memory, MEMORY_SIZE, false) == VM_SUCCESS);
+    assert(heap_init(&host_heap, 0x100, 64) == VM_SUCCESS);
+    uint32_t a, b, c;
+    heap_alloc(&host_heap, &memory, 3, &a);
+    heap_alloc(&host_heap, &memory, 4, &b);
+    assert(a == 0x100 && b == 0x104);
+    assert(heap_free(&host_heap, &memory, a) == VM_SUCCESS);
+    assert(heap_free(&host_heap, &memory, b) == VM_SUCCESS);
+    memory.data[b] = 0x102;
+    heap_alloc(&host_heap, &memory, 4, &c);
+    assert(c == b);
+    heap_alloc(&host_heap, &memory, 4, &c);
+    assert(c == 0x108);
+    heap_alloc(&host_heap, &memory, 64, &c);
+    assert(c == 0);  // Exhausted
+    heap_destroy(&host_heap);
+    free_memory(&memory);
+
+    // Nor is one the guest points back at its own block, which would hand
+    // that block out twice
+    const char* self_linked =
+        "    alloc ax, 2\n"
+        "    alloc bx, 2\n"
+        "    free ax\n"
+        "    mov [ax], ax\n"
+        "    alloc cx, 2\n"
+        "    alloc dx, 2\n"
+        "    alloc si, 2\n"
+        "    halt\n";
+    program = assemble_from_string(self_linked);
+    assert(program != NULL);
+    vm = load_program(program);
+    assert(vm != NULL);
+    assert(vm_run(vm) == VM_SUCCESS);
+    int* r = vm->cpu.registers;
+    assert(r[R_CX] != r[R_AX] && r[R_DX] != r[R_AX] && r[R_SI] != r[R_AX]);
+    assert(r[R_CX] != r[R_DX] && r[R_DX] != r[R_SI] && r[R_CX] != r[R_SI]);
+    assert(r[R_CX] != r[R_BX] && r[R_DX] != r[R_BX] && r[R_SI] != r[R_BX]);
+    assert(vm->heap.free_lists[0] == 0 && vm->heap.live_blocks == 4);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    // Or at a block it has since taken again
+    const char* taken_again =
+        "    alloc ax, 2\n"
+        "    alloc bx, 2\n"
+        "    free ax\n"
+        "    free bx\n"
+        "    mov [bx], bx\n"
+        "    alloc cx, 2\n"
+        "    alloc dx, 2\n"
+        "    halt\n";
+    program = assemble_from_string(taken_again);
+    assert(program != NULL);
+    vm = load_program(program);
+    assert(vm != NULL);
+    assert(vm_run(vm) == VM_SUCCESS);
+    r = vm->cpu.registers;
+    assert(r[R_CX] != r[R_DX]);
+    assert(vm->heap.live_blocks == 2);
+    vm_destroy(vm);
+    program_destroy(program);
+
+    printf("[ANVIL] Guest heap test passed!\n");
+}
+
+static VMError run_source(const char* source, const VMConfig* config,
+                          VM** out) {
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VM* vm = config ? load_program_with_config(program, config)
+                    : load_program(program);
+    assert(vm != NULL);
+    VMError err = vm_run(vm);
+    if (out) {
+        *out = vm;  // Caller destroys; the program is no longer needed
+        vm->program = NULL;
+        vm->program_size = 0;
+    } else {
+        vm_destroy(vm);
+    }
+    program_destroy(program);
+    return err;
+}
+
+void test_call_stack() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing call stack...\n");
+
+    // Recursive sum with a frame local per call
+    const char* source =
+        "    mov ax, 0\n"
+        "    mov cx, 50\n"
+        "    call sum\n"
+        "    halt\n"
+        "sum:\n"
+        "    enter 1\n"
+        "    mov [bp - 1], cx\n"
+        "    cmp cx, 0\n"
+        "    jz sum_done\n"
+        "    dec cx\n"
+        "    call sum\n"
+        "    add ax, [bp - 1]\n"
+        "sum_done:\n"
+        "    leave\n"
+        "    ret\n";
+    VM* vm;
+    assert(run_source(source, NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 1275);
+    assert(vm->cpu.registers[R_SP] == vm_stack_start(vm));
+    assert(vm->cpu.registers[R_BP] == vm_stack_start(vm));
+    assert(vm->call_depth == 0);
+    vm_destroy(vm);
+
+    // Return addresses are out of reach of guest stores
+    assert(run_source("call f\nmov bx, 1\nhalt\n"
+                      "f:\nmov si, sp\nmov [si], 0\nmov [si - 1], 0\nret\n",
+                      NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_BX] == 1);
+    vm_destroy(vm);
+
+    // The call stack has the configured depth
+    VMConfig config = vm_default_config();
+    config.call_depth = 8;
+    assert(run_source("f:\ncall f\n", &config, &vm) ==
+           VM_ERROR_STACK_OVERFLOW);
+    assert(vm->call_depth == 8);
+    vm_destroy(vm);
+    config.call_depth = 0;
+    Instruction halt = {OP_HALT, {{0}}, 0, 0};
+    assert(vm_create_with_config(&halt, 1, NULL, 0, &config) == NULL);
+
+    assert(run_source("ret\n", NULL, NULL) == VM_ERROR_STACK_UNDERFLOW);
+    assert(run_source("leave\n", NULL, NULL) == VM_ERROR_STACK_UNDERFLOW);
+    assert(run_source("pop ax\n", NULL, NULL) == VM_ERROR_STACK_UNDERFLOW);
+    assert(run_source("mov sp, 5\npush 1\n", NULL, NULL) ==
+           VM_ERROR_STACK_OVERFLOW);
+    assert(run_source("mov sp, 0x7FFFFFFF\npop ax\n", NULL, NULL) ==
+           VM_ERROR_STACK_UNDERFLOW);
+    assert(run_source("enter 5000\n", NULL, NULL) ==
+           VM_ERROR_STACK_OVERFLOW);
+
+    printf("[ANVIL] Call stack test passed!\n");
+}
+
+void test_loop_cjmp() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing LOOP and CJMP...\n");
+
+    // Sum 1..100 with LOOP; the CMP flags survive the whole loop
+    const char* source =
+        "    mov ax, 0\n"
+        "    mov cx, 100\n"
+        "    cmp cx, 100\n"
+        "again:\n"
+        "    add ax, cx\n"
+        "    loop cx, again\n"
+        "    halt\n";
+    VM* vm;
+    assert(run_source(source, NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 5050);
+    assert(vm->cpu.registers[R_CX] == 0);
+    vm_destroy(vm);
+
+    // Count the values in [-3, 3] each condition holds for, against 0
+    static const struct {
+        const char* cond;
+        int expected;
+    } cases[] = {
+        {"eq", 1}, {"ne", 6}, {"lt", 3}, {"le", 4},
+        {"gt", 3}, {"ge", 4}, {"z", 1},  {"nz", 6},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer),
+                 "    mov si, -3\n"
+                 "    mov ax, 0\n"
+                 "next:\n"
+                 "    cjmp %s, si, 0, hit\n"
+                 "    jmp skip\n"
+                 "hit:\n"
+                 "    inc ax\n"
+                 "skip:\n"
+                 "    inc si\n"
+                 "    cjmp le, si, 3, next\n"
+                 "    halt\n",
+                 cases[i].cond);
+        assert(run_source(buffer, NULL, &vm) == VM_SUCCESS);
+        assert(vm->cpu.registers[R_AX] == cases[i].expected);
+        vm_destroy(vm);
+    }
+
+    // CJMP compares memory operands and leaves the flags alone
+    assert(run_source("    mov [0x100], 7\n"
+                      "    mov bx, 1\n"
+                      "    cmp bx, 2\n"
+                      "    cjmp gt, [0x100], 6, out\n"
+                      "    mov bx, 0\n"
+                      "out:\n"
+                      "    halt\n",
+                      NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_BX] == 1);
+    assert(vm->cpu.flags & FL_SF);
+    vm_destroy(vm);
+
+    assert(verifies("l: loop cx, l\n"));
+    assert(!verifies("l: loop 5, l\n"));
+    assert(!verifies("l: loop cx\n"));
+    assert(!verifies("l: cjmp lt, ax, 1\n"));
+    assert(!verifies("l: cjmp lt, ax, bx, cx\n"));
+    assert(assemble_from_string("l: cjmp below, ax, 1, l\n") == NULL);
+
+    Instruction bad[] = {{OP_CJMP,
+                          {{.type = OPERAND_REGISTER, .value.reg = R_AX},
+                           {.type = OPERAND_IMMEDIATE, .value.imm = 0},
+                           {.type = OPERAND_LABEL, .value.label = 0}},
+                          3,
+                          COND_COUNT}};
+    int labels[] = {0};
+    assert(verify_program(bad, 1, labels, 1, MEMORY_SIZE).error ==
+           VM_ERROR_INVALID_INSTRUCTION);
+
+    printf("[ANVIL] LOOP and CJMP test passed!\n");
+}
+
+void test_division() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing signed division...\n");
+
+    VM* vm;
+    assert(run_source("mov ax, -7\ndiv ax, 2\n"
+                      "mov bx, -7\nmod bx, 2\n"
+                      "mov cx, 7\nmod cx, -2\n"
+                      "mov dx, 0x80000000\ndiv dx, -1\n"
+                      "mov si, 0x80000000\nmod si, -1\n"
+                      "mov [0x100], 17\nmod [0x100], 5\n"
+                      "halt\n",
+                      NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == -3);
+    assert(vm->cpu.registers[R_BX] == -1);
+    assert(vm->cpu.registers[R_CX] == 1);
+    assert(vm->cpu.registers[R_DX] == INT32_MIN);
+    assert(vm->cpu.registers[R_SI] == 0);
+    assert(vm->memory.data[0x100] == 2);
+    vm_destroy(vm);
+
+    assert(run_source("mov ax, 0\nmov bx, 5\nmod bx, ax\n", NULL, NULL) ==
+           VM_ERROR_DIVIDE_BY_ZERO);
+    assert(!verifies("mod ax, 0\n"));
+
+    printf("[ANVIL] Signed division test passed!\n");
+}
+
+void test_shifts() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing shifts...\n");
+
+    VM* vm;
+    assert(run_source("mov ax, 3\nshl ax, 4\n"
+                      "mov bx, -16\nshr bx, 28\n"
+                      "mov cx, 1\nmov dx, 33\nshl cx, dx\n"
+                      "mov [0x100], -5\nshl [0x100], 1\n"
+                      "halt\n",
+                      NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 48);
+    assert(vm->cpu.registers[R_BX] == 15);
+    assert(vm->cpu.registers[R_CX] == 2);
+    assert(vm->memory.data[0x100] == (uint32_t)-10);
+    vm_destroy(vm);
+
+    assert(!verifies("shl 1, ax\n"));
+
+    printf("[ANVIL] Shift test passed!\n");
+}
+
+void test_power() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing power...\n");
+
+    VM* vm;
+    assert(run_source("mov ax, -2\npow ax, 3\n"
+                      "mov bx, 2\npow bx, 31\n"
+                      "mov cx, 3\nmov dx, 40\npow cx, dx\n"
+                      "mov dx, 7\npow dx, 0\n"
+                      "mov si, -1\npow si, -3\n"
+                      "mov di, 5\npow di, -1\n"
+                      "mov [0x100], 2\npow [0x100], 10\n"
+                      "halt\n",
+                      NULL, &vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == -8);
+    assert(vm->cpu.registers[R_BX] == INT32_MIN);
+    assert(vm->cpu.registers[R_CX] == 689956897);
+    assert(vm->cpu.registers[R_DX] == 1);
+    assert(vm->cpu.registers[R_SI] == -1);
+    assert(vm->cpu.registers[R_DI] == 0);
+    assert(vm->memory.data[0x100] == 1024);
+    vm_destroy(vm);
+
+    assert(!verifies("pow 2, ax\n"));
+
+    printf("[ANVIL] Power test passed!\n");
+}
+
+static int run_cached(const CacheEntry* entry) {
+    VM* vm = load_program(entry->program);
+    assert(vm != NULL);
+    assert(vm_run(vm) == VM_SUCCESS);
+    int result = vm->cpu.registers[R_AX];
+    vm_destroy(vm);
+    return result;
+}
+
+static CacheEntry* cache_put(ProgramCache* cache, const char* source) {
+    CacheEntry* entry = program_cache_put(cache, "anvil", source,
+                                          strlen(source),
+                                          assemble_from_string(source));
+    assert(entry != NULL);
+    return entry;
+}
+
+static CacheEntry* cache_get(ProgramCache* cache, const char* tag,
+                             const char* source) {
+    return program_cache_get(cache, tag, source, strlen(source));
+}
+
+void test_cache() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing program cache...\n");
+
+    const char* one = "mov ax, 1\nhalt\n";
+    const char* two = "mov ax, 2\nhalt\n";
+    const char* three = "mov ax, 3\nhalt\n";
+    ProgramCache* cache = program_cache_create(2, NULL);
+    assert(cache != NULL);
+    program_cache_release(cache, cache_put(cache, one));
+    program_cache_release(cache, cache_put(cache, two));
+
+    // Using `one` makes `two` the least recently used
+    CacheEntry* entry = cache_get(cache, "anvil", one);
+    assert(entry != NULL && run_cached(entry) == 1);
+    program_cache_release(cache, entry);
+    program_cache_release(cache, cache_put(cache, three));
+    assert(cache_get(cache, "anvil", two) == NULL);
+    assert(cache_get(cache, "other", one) == NULL);
+
+    // Held entries stay past capacity until released
+    CacheEntry* held[3] = {cache_get(cache, "anvil", one),
+                           cache_get(cache, "anvil", three),
+                           cache_put(cache, two)};
+    assert(run_cached(held[0]) == 1);
+    assert(run_cached(held[1]) == 3);
+    assert(run_cached(held[2]) == 2);
+    for (int i = 0; i < 3; i++) {
+        program_cache_release(cache, held[i]);
+    }
+    assert(cache_get(cache, "anvil", one) == NULL);
+
+    CacheStats stats;
+    program_cache_stats(cache, &stats);
+    assert(stats.hits == 3 && stats.disk_hits == 0 && stats.misses == 3);
+    assert(stats.evictions == 2);
+    program_cache_destroy(cache);
+
+    // Images written by one cache are read back by the next
+    const char* source =
+        ".data 0x2000\n"
+        "value: .word 7\n"
+        ".text\n"
+        "    mov ax, [value]\n"
+        "    mul ax, 6\n"
+        "    halt\n";
+    char directory[] = "/tmp/anvil_cache_XXXXXX";
+    assert(mkdtemp(directory) != NULL);
+    cache = program_cache_create(4, directory);
+    assert(cache != NULL);
+    program_cache_release(cache, cache_put(cache, source));
+    program_cache_destroy(cache);
+
+    cache = program_cache_create(4, directory);
+    assert(cache != NULL);
+    assert(cache_get(cache, "anvil 2", source) == NULL);
+    entry = cache_get(cache, "anvil", source);
+    assert(entry != NULL && run_cached(entry) == 42);
+    assert(entry->program->data_base == 0x2000);
+    const Program* read = entry->program;
+    long image_tail = (long)(sizeof(Instruction) * (size_t)read->size +
+                             sizeof(int) * (size_t)read->label_size +
+                             sizeof(uint32_t) * (size_t)read->data_size);
+    program_cache_release(cache, entry);
+    program_cache_stats(cache, &stats);
+    assert(stats.disk_hits == 1 && stats.misses == 1);
+    program_cache_destroy(cache);
+
+    // An image naming a register that does not exist is a miss, not a
+    // program for the checked interpreter to read out of bounds with
+    DIR* dir = opendir(directory);
+    assert(dir != NULL);
+    struct dirent* file;
+    char image[sizeof(directory) + 256] = "";
+    while ((file = readdir(dir)) != NULL) {
+        if (file->d_name[0] != '.') {
+            snprintf(image, sizeof(image), "%s/%s", directory, file->d_name);
+        }
+    }
+    closedir(dir);
+    FILE* tampered = fopen(image, "r+b");
+    assert(tampered != NULL);
+    assert(fseek(tampered, 0, SEEK_END) == 0);
+    long instructions = ftell(tampered) - image_tail;
+    int bad_register = R_COUNT + 1000;
+    assert(fseek(tampered,
+                 instructions + (long)offsetof(Instruction, operands) +
+                     (long)offsetof(Operand, value),
+                 SEEK_SET) == 0);
+    assert(fwrite(&bad_register, sizeof(int), 1, tampered) == 1);
+    assert(fclose(tampered) == 0);
+
+    cache = program_cache_create(4, directory);
+    assert(cache != NULL);
+    assert(cache_get(cache, "anvil", source) == NULL);
+    program_cache_stats(cache, &stats);
+    assert(stats.disk_hits == 0 && stats.misses == 1);
+    program_cache_destroy(cache);
+
+    dir = opendir(directory);
+    assert(dir != NULL);
+    while ((file = readdir(dir)) != NULL) {
+        if (file->d_name[0] != '.') {
+            char path[sizeof(directory) + 256];
+            snprintf(path, sizeof(path), "%s/%s", directory, file->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    assert(rmdir(directory) == 0);
+
+    assert(program_cache_create(4, "/nonexistent/anvil/cache") == NULL);
+
+    printf("[ANVIL] Program cache test passed!\n");
+}
+
+void test_step_limit() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing the step limit...\n");
+
+    Program* endless = assemble_from_string(
+        "    mov ax, 0\n"
+        "again:\n"
+        "    inc ax\n"
+        "    jmp again\n");
+    assert(endless != NULL);
+
+    // Verified, a run stops after exactly the limit
+    VM* vm = load_program(endless);
+    assert(vm != NULL);
+    vm->step_limit = 1001;
+    assert(vm_run(vm) == VM_ERROR_STEP_LIMIT);
+    assert(vm->cpu.registers[R_AX] == 500);
+    assert(vm->cpu.ip == 1);
+
+    // The limit is per run, and kept across a reset
+    assert(reload_program(vm, endless) == VM_SUCCESS);
+    assert(vm_run(vm) == VM_ERROR_STEP_LIMIT);
+    assert(vm->cpu.registers[R_AX] == 500);
+    vm_destroy(vm);
+
+    // And the same without verification
+    vm = vm_create(endless->instructions, endless->size,
+                   endless->label_addresses, endless->label_size);
+    assert(vm != NULL);
+    vm->step_limit = 11;
+    assert(vm_run(vm) == VM_ERROR_STEP_LIMIT);
+    assert(vm->cpu.registers[R_AX] == 5);
+    vm_destroy(vm);
+    program_destroy(endless);
+
+    // A program that halts within the limit is not affected
+    Program* halting = assemble_from_string("mov ax, 3\nhalt\n");
+    assert(halting != NULL);
+    vm = load_program(halting);
+    assert(vm != NULL);
+    vm->step_limit = 2;
+    assert(vm_run(vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 3);
+    vm_destroy(vm);
+    program_destroy(halting);
+
+    printf("[ANVIL] Step limit test passed!\n");
+}
+
+void test_vm_reuse() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing VM reuse...\n");
+
+    Program* first = assemble_from_string(
+        "    mov ax, 5\n"
+        "    mov [0x100], 9\n"
+        "    push ax\n"
+        "    preg ax, 1\n"
+        "    halt\n");
+    Program* second = assemble_from_string(
+        ".data 0x2000\n"
+        "value: .word 4\n"
+        ".text\n"
+        "    mov bx, [0x100]\n"
+        "    mov ax, [value]\n"
+        "    preg ax\n"
+        "    halt\n");
+    assert(first != NULL && second != NULL);
+
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    assert(out != NULL);
+
+    VM* vm = load_program(first);
+    assert(vm != NULL);
+    vm->output = out;
+    assert(vm_run(vm) == VM_SUCCESS);
+
+    // Nothing of the first run is left over but where the output goes
+    assert(reload_program(vm, second) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 0);
+    assert(vm->cpu.registers[R_SP] == vm->cpu.registers[R_BP]);
+    assert(vm_run(vm) == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 4);
+    assert(vm->cpu.registers[R_BX] == 0);
+
+    assert(reload_program(vm, first) == VM_SUCCESS);
+    assert(vm_run(vm) == VM_SUCCESS);
+    assert(vm->memory.data[0x100] == 9);
+    vm_destroy(vm);
+
+    fclose(out);
+    assert(strcmp(text, "0x5\n4\n0x5\n") == 0);
+    free(text);
+    program_destroy(first);
+    program_destroy(second);
+    printf("[ANVIL] VM reuse test passed!\n");
+}
+
+static bool same_operand(const Operand* a, const Operand* b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    switch (a->type) {
+        case OPERAND_REGISTER:
+            return a->value.reg == b->value.reg;
+        case OPERAND_IMMEDIATE:
+            return a->value.imm == b->value.imm;
+        case OPERAND_LABEL:
+            return a->value.label == b->value.label;
+        case OPERAND_MEMORY: {
+            const MemoryRef* x = &a->value.mem_ref;
+            const MemoryRef* y = &b->value.mem_ref;
+            return x->base_reg == y->base_reg &&
+                   x->index_reg == y->index_reg &&
+                   (x->index_reg == R_NONE || x->scale == y->scale) &&
+                   x->offset == y->offset && x->mode == y->mode;
+        }
+        default:
+            return false;
+    }
+}
+
+static void assert_round_trip(const Program* program) {
+    char* text = program_disassemble(program);
+    assert(text != NULL);
+    Program* copy = assemble_from_string(text);
+    assert(copy != NULL);
+
+    assert(copy->size == program->size);
+    for (int i = 0; i < program->size; i++) {
+        const Instruction* a = &program->instructions[i];
+        const Instruction* b = &copy->instructions[i];
+        assert(a->opcode == b->opcode);
+        assert(a->num_operands == b->num_operands);
+        assert(a->opcode != OP_CJMP || a->cond == b->cond);
+        for (int j = 0; j < a->num_operands; j++) {
+            if (a->operands[j].type == OPERAND_LABEL) {
+                // Label indices may differ; their targets may not
+                assert(b->operands[j].type == OPERAND_LABEL);
+                assert(program->label_addresses[a->operands[j].value.label] ==
+                       copy->label_addresses[b->operands[j].value.label]);
+            } else {
+                assert(same_operand(&a->operands[j], &b->operands[j]));
+            }
+        }
+    }
+    assert(copy->data_base == program->data_base);
+    assert(copy->data_size == program->data_size);
+    assert(program->data_size == 0 ||
+           memcmp(copy->data, program->data,
+                  sizeof(uint32_t) * program->data_size) == 0);
+
+    program_destroy(copy);
+    free(text);
+}
+
+void test_disassembler() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing disassembler...\n");
+
+    const char* source =
+        ".data 0x2000\n"
+        "table: .word 1, -2, 3, 4, 5, 6, 7, 8, 9, done\n"
+        "text: .string \"hi\"\n"
+        ".text\n"
+        ".equ K, 12\n"
+        "start:\n"
+        "    mov ax, K\n"
+        "    mov bx, [table + 2]\n"
+        "    mov [bp - 3], ax\n"
+        "    lea si, [bx + di*4 + 8]\n"
+        "    add ax, [si*2 - 1]\n"
+        "    cjmp ge, ax, [0x10], done\n"
+        "again:\n"
+        "    ldb cx, [si]\n"
+        "    loop cx, again\n"
+        "    mod ax, 3\n"
+        "    call done\n"
+        "done:\n"
+        "    ret\n";
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    assert_round_trip(program);
+
+    char line[64];
+    assert(format_instruction(program, &program->instructions[5], line,
+                              sizeof(line)) == 23);
+    assert(strcmp(line, "cjmp ge, ax, [16], done") == 0);
+    char small[8];
+    int full = format_instruction(program, &program->instructions[3], small,
+                                  sizeof(small));
+    assert(full == (int)strlen("lea si, [bx + di*4 + 8]"));
+    assert(strcmp(small, "lea si,") == 0);
+    program_destroy(program);
+
+    // Generated code with anonymous labels, one placed after the end
+    program = program_create();
+    assert(program != NULL);
+    int top = new_label(program);
+    int end = new_label(program);
+    Instruction mov = {OP_MOV,
+                       {{.type = OPERAND_REGISTER, .value.reg = R_CX},
+                        {.type = OPERAND_IMMEDIATE, .value.imm = 3}},
+                       2, 0};
+    Instruction loop = {OP_LOOP,
+                        {{.type = OPERAND_REGISTER, .value.reg = R_CX},
+                         {.type = OPERAND_LABEL, .value.label = top}},
+                        2, 0};
+    Instruction jmp = {OP_JMP, {{.type = OPERAND_LABEL, .value.label = end}},
+                       1, 0};
+    assert(add_instruction(program, mov));
+    place_label(program, top);
+    assert(add_instruction(program, loop));
+    assert(add_instruction(program, jmp));
+    assert(!program_finalize(program));  // `end` is not placed yet
+    place_label(program, end);
+    assert(program_finalize(program));
+
+    char* text = program_disassemble(program);
+    assert(strstr(text, "__L0:\n    loop cx, __L0\n") != NULL);
+    assert(strstr(text, "jmp __L1\n__L1:\n") != NULL);
+    free(text);
+    assert_round_trip(program);
+    program_destroy(program);
+
+    printf("[ANVIL] Disassembler test passed!\n");
+}
+
+#ifdef ANVIL_PROFILE
+void test_profiler() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing profiler...\n");
+
+    const char* source =
+        "start:\n"
+        "    mov cx, 10\n"
+        "loop:\n"
+        "    add ax, cx\n"
+        "    dec cx\n"
+        "    jnz loop\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+
+    Profiler* profiler = profiler_create(program->size);
+    assert(profiler != NULL);
+    assert(vm_attach_profiler(vm, profiler) == VM_SUCCESS);
+
+    // Hardware counters are optional; the run must succeed either way
+    bool perf = profiler_enable_perf(profiler);
+    printf("[ANVIL] Hardware counters %s\n", perf ? "enabled" : "unavailable");
+
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(vm->cpu.registers[R_AX] == 55);
+    if (perf && perf_counter_available(&profiler->perf, PERF_INSTRUCTIONS)) {
+        assert(profiler->perf_totals[PERF_INSTRUCTIONS] > 0);
+    }
+
+    assert(profiler->total_instructions == 1 + 10 * 3 + 1);
+    assert(profiler->opcode_counts[OP_ADD] == 10);
+    assert(profiler->ip_counts[1] == 10);
+    assert(profiler->branch_taken[3] == 9);
+    assert(profiler->branch_not_taken[3] == 1);
+    assert(profiler->class_counts[PROF_CLASS_ARITH] == 20);
+
+    profiler_dump_text(profiler, stdout);
+    profiler_dump_json(profiler, stdout);
+
+    profiler_destroy(profiler);
+    vm_destroy(vm);
+    program_destroy(program);
+    printf("[ANVIL] Profiler test passed!\n");
+}
+#endif
+
+void test_sampler() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing sampling profiler...\n");
+
+    const char* source =
+        "main:\n"
+        "    call outer\n"
+        "    call inner\n"
+        "    halt\n"
+        "outer:\n"
+        "    mov cx, 3\n"
+        "outer_loop:\n"
+        "    call inner\n"
+        "    dec cx\n"
+        "    jnz outer_loop\n"
+        "    ret\n"
+        "inner:\n"
+        "    nop\n"
+        "    ret\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+
+    Sampler* sampler = sampler_create(program, 1);
+    assert(sampler != NULL);
+    assert(vm_attach_sampler(vm, sampler) == VM_SUCCESS);
+
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+    assert(sampler->depth == 0);
+
+    // Every instruction is sampled. A CALL is charged to the callee and a
+    // RET to the caller it returns to.
+    assert(sampler->total_samples == 22);
+
+    FILE* out = tmpfile();
+    assert(out != NULL);
+    sampler_write_collapsed(sampler, out);
+    char collapsed[512];
+    rewind(out);
+    size_t len = fread(collapsed, 1, sizeof(collapsed) - 1, out);
+    collapsed[len] = '\0';
+    fclose(out);
+    printf("%s", collapsed);
+
+    assert(strstr(collapsed, "main;outer;inner 6\n") != NULL);
+    assert(strstr(collapsed, "main;inner 2\n") != NULL);
+    assert(strstr(collapsed, "main;outer 11\n") != NULL);
+    assert(strstr(collapsed, "main 3\n") != NULL);
+
+    sampler_destroy(sampler);
+    vm_destroy(vm);
+    program_destroy(program);
+    printf("[ANVIL] Sampling profiler test passed!\n");
+}
+
+
+void test_trace() {
+    printf("\n==========================\n");
+    printf("[ANVIL] Testing execution trace...\n");
+
+    const char* source =
+        "start:\n"
+        "    mov bx, 0x3000\n"
+        "    mov cx, 3\n"
+        "loop:\n"
+        "    mov [bx+1], cx\n"
+        "    dec cx\n"
+        "    jnz loop\n"
+        "    halt\n";
+
+    Program* program = assemble_from_string(source);
+    assert(program != NULL);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+
+    TraceBuffer* trace = trace_create(60);
+    assert(trace != NULL);
+    assert(trace->mask == 63);
+    assert(vm_attach_trace(vm, trace) == VM_SUCCESS);
+
+    VMError err = vm_run(vm);
+    assert(err == VM_SUCCESS);
+
+    TraceEvent events[64];
+    size_t count = trace_drain(trace, events, 64);
+    assert(count == 2 + 3 * 3 + 1);
+    assert(trace_dropped(trace) == 0);
+    assert(trace_drain(trace, events, 64) == 0);
+
+    // Draining frees the space for the next run
+    vm_destroy(vm);
+    vm = load_program(program);
+    assert(vm_attach_trace(vm, trace) == VM_SUCCESS);
+    assert(vm_run(vm) == VM_SUCCESS);
+    count = trace_drain(trace, events, 64);
+    assert(count == 12);
+
+    assert(events[2].opcode == OP_MOV && events[2].ip == 2);
+    assert((events[2].flags & TRACE_MEMORY) && events[2].address == 0x3001);
+    assert(events[4].opcode == OP_JNZ);
+    assert((events[4].flags & TRACE_BRANCH) && (events[4].flags & TRACE_TAKEN));
+    assert(!(events[10].flags & TRACE_TAKEN));
+
+    // A full ring drops new events instead of blocking the VM
+    TraceBuffer* small = trace_create(4);
+    assert(small != NULL);
+    vm_destroy(vm);
+    vm = load_program(program);
+    assert(vm_attach_trace(vm, small) == VM_SUCCESS);
+    assert(vm_run(vm) == VM_SUCCESS);
+    assert(trace_dropped(small) == 12 - 4);
+
+    FILE* out = tmpfile();
+    assert(out != NULL);
+    assert(trace_write_header(out));
+    assert(trace_drain_to_file(small, out) == 4);
+    rewind(out);
+    assert(trace_read_header(out));
+    assert(fread(events, sizeof(TraceEvent), 64, out) == 4);
+    assert(events[0].ip == 0 && events[3].opcode == OP_DEC);
+    fclose(out);
+
+    trace_destroy(small);
+    trace_destroy(trace);
+    vm_destroy(vm);
+    program_destroy(program);
+    printf("[ANVIL] Execution trace test passed!\n");
+}
+
 int main() {
     printf("[ANVIL] Starting tests...\n");
     test_arithmetic();
@@ -175,6 +1579,28 @@ int main() {
     test_reg_out();
     test_file_parsing();
     test_io_ports();
+    test_symbols();
+    test_data_sections();
+    test_verifier();
+    test_guard_pages();
+    test_addressing_modes();
+    test_byte_memory();
+    test_memory_config();
+    test_heap();
+    test_call_stack();
+    test_loop_cjmp();
+    test_division();
+    test_shifts();
+    test_power();
+    test_cache();
+    test_step_limit();
+    test_vm_reuse();
+    test_disassembler();
+    test_sampler();
+    test_trace();
+#ifdef ANVIL_PROFILE
+    test_profiler();
+#endif
     printf("[ANVIL] All tests passed!\n");
     return 0;
 }
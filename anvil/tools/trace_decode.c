@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "trace.h"
+
+#define TOP_INSTRUCTIONS 10
+#define READ_BATCH 4096
+
+typedef struct {
+    uint64_t events;
+    uint64_t opcode_counts[OP_COUNT];
+    uint64_t branches;
+    uint64_t taken;
+    uint64_t memory_events;
+    uint32_t min_address;
+    uint32_t max_address;
+    uint64_t errors;
+
+    uint64_t* ip_counts;
+    uint32_t ip_capacity;
+} TraceSummary;
+
+static void print_event(uint64_t index, const TraceEvent* event) {
+    printf("%10llu  ip %-6u %-5s", (unsigned long long)index, event->ip,
+           get_opcode_name((OpCode)event->opcode));
+    if (event->flags & TRACE_MEMORY) {
+        printf("  mem 0x%08x", event->address);
+    }
+    if (event->flags & TRACE_BRANCH) {
+        printf("  %s", (event->flags & TRACE_TAKEN) ? "taken" : "not taken");
+    }
+    if (event->flags & TRACE_ERROR) {
+        printf("  ERROR");
+    }
+    printf("\n");
+}
+
+static int summarize_event(TraceSummary* summary, const TraceEvent* event) {
+    summary->events++;
+    if (event->opcode < OP_COUNT) {
+        summary->opcode_counts[event->opcode]++;
+    }
+    if (event->flags & TRACE_BRANCH) {
+        summary->branches++;
+        if (event->flags & TRACE_TAKEN) {
+            summary->taken++;
+        }
+    }
+    if (event->flags & TRACE_MEMORY) {
+        if (summary->memory_events == 0 ||
+            event->address < summary->min_address) {
+            summary->min_address = event->address;
+        }
+        if (summary->memory_events == 0 ||
+            event->address > summary->max_address) {
+            summary->max_address = event->address;
+        }
+        summary->memory_events++;
+    }
+    if (event->flags & TRACE_ERROR) {
+        summary->errors++;
+    }
+
+    if (event->ip >= summary->ip_capacity) {
+        uint32_t new_capacity = summary->ip_capacity ? summary->ip_capacity : 64;
+        while (new_capacity <= event->ip) {
+            new_capacity *= 2;
+        }
+        uint64_t* new_counts =
+            realloc(summary->ip_counts, sizeof(uint64_t) * new_capacity);
+        if (!new_counts) {
+            return -1;
+        }
+        memset(new_counts + summary->ip_capacity, 0,
+               sizeof(uint64_t) * (new_capacity - summary->ip_capacity));
+        summary->ip_counts = new_counts;
+        summary->ip_capacity = new_capacity;
+    }
+    summary->ip_counts[event->ip]++;
+    return 0;
+}
+
+static void print_summary(const TraceSummary* summary) {
+    printf("[ANVIL] Trace: %llu events\n", (unsigned long long)summary->events);
+
+    printf("\nOpcodes:\n");
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (summary->opcode_counts[op] > 0) {
+            printf("  %-6s %12llu\n", get_opcode_name((OpCode)op),
+                   (unsigned long long)summary->opcode_counts[op]);
+        }
+    }
+
+    printf("\nHottest instructions:\n");
+    bool* shown = calloc(summary->ip_capacity + 1, sizeof(bool));
+    for (int n = 0; shown && n < TOP_INSTRUCTIONS; n++) {
+        uint32_t best = 0;
+        uint64_t best_count = 0;
+        for (uint32_t ip = 0; ip < summary->ip_capacity; ip++) {
+            if (!shown[ip] && summary->ip_counts[ip] > best_count) {
+                best = ip;
+                best_count = summary->ip_counts[ip];
+            }
+        }
+        if (best_count == 0) {
+            break;
+        }
+        shown[best] = true;
+        printf("  ip %-6u %12llu\n", best, (unsigned long long)best_count);
+    }
+    free(shown);
+
+    printf("\nBranches: %llu, taken %llu (%.2f%%)\n",
+           (unsigned long long)summary->branches,
+           (unsigned long long)summary->taken,
+           summary->branches
+               ? 100.0 * (double)summary->taken / (double)summary->branches
+               : 0.0);
+
+    printf("Memory accesses: %llu", (unsigned long long)summary->memory_events);
+    if (summary->memory_events > 0) {
+        printf(", addresses 0x%08x - 0x%08x", summary->min_address,
+               summary->max_address);
+    }
+    printf("\nErrors: %llu\n", (unsigned long long)summary->errors);
+}
+
+int main(int argc, char** argv) {
+    bool summary_only = false;
+    const char* filename = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--summary") == 0 || strcmp(argv[i], "-s") == 0) {
+            summary_only = true;
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (!filename) {
+        fprintf(stderr, "Usage: %s [--summary] <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(filename, "rb");
+    if (!in) {
+        fprintf(stderr, "[ANVIL] Error: Cannot open trace file '%s'!\n",
+                filename);
+        return 1;
+    }
+    if (!trace_read_header(in)) {
+        fprintf(stderr, "[ANVIL] Error: '%s' is not an ANVIL trace!\n",
+                filename);
+        fclose(in);
+        return 1;
+    }
+
+    TraceSummary summary;
+    memset(&summary, 0, sizeof(summary));
+
+    TraceEvent batch[READ_BATCH];
+    size_t count;
+    while ((count = fread(batch, sizeof(TraceEvent), READ_BATCH, in)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (!summary_only) {
+                print_event(summary.events, &batch[i]);
+            }
+            if (summarize_event(&summary, &batch[i]) != 0) {
+                fprintf(stderr, "[ANVIL] Error: Out of memory!\n");
+                fclose(in);
+                return 1;
+            }
+        }
+    }
+    fclose(in);
+
+    if (summary_only) {
+        print_summary(&summary);
+    }
+    free(summary.ip_counts);
+    return 0;
+}
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ast.h"
+#include "codegen.h"
+#include "ir.h"
+#include "lexer.h"
+#include "lower.h"
+#include "optimizer.h"
+#include "parser.h"
+
+#define DEFAULT_REPEAT 5
+#define SOURCE_BLOCKS 100000
+
+typedef struct {
+    const char* name;
+    const char* unit;
+    unsigned long long ops;
+    size_t bytes;
+    double min_ns;
+    double median_ns;
+} BenchResult;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void summarize(double* samples, int count, BenchResult* result) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+    result->min_ns = samples[0];
+    result->median_ns = samples[count / 2];
+}
+
+// A program of `blocks` loops, each with its own variable, mixing every
+// statement form and most operators
+static char* build_source(int blocks, size_t* length) {
+    size_t capacity = (size_t)blocks * 256;
+    char* source = malloc(capacity);
+    if (!source) {
+        return NULL;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < blocks; i++) {
+        len += snprintf(
+            source + len, capacity - len,
+            "# block %d\n"
+            "var v%d = %d;\n"
+            "while (v%d > 0 && v%d != 7) {\n"
+            "    if (v%d %% 3 == 0) {\n"
+            "        output v%d * 2 + 1;\n"
+            "    } else {\n"
+            "        v%d = v%d - (4 ^ 2) / 2;\n"
+            "    }\n"
+            "    v%d = v%d - 1;\n"
+            "}\n",
+            i, i, i % 1000, i, i, i, i, i, i, i, i);
+    }
+
+    *length = len;
+    return source;
+}
+
+static int run_lex_bench(const char* source, size_t length, int repeat,
+                         BenchResult* result) {
+    double* samples = malloc(sizeof(double) * repeat);
+    if (!samples) {
+        return -1;
+    }
+
+    int status = 0;
+    for (int r = 0; r < repeat && status == 0; r++) {
+        TokenList tokens;
+        double start = now_ns();
+        bool ok = lex_source(source, length, &tokens);
+        samples[r] = now_ns() - start;
+        if (!ok) {
+            status = -1;
+            break;
+        }
+        result->ops = tokens.count;
+        token_list_destroy(&tokens);
+    }
+
+    if (status == 0) {
+        result->name = "lex";
+        result->unit = "token";
+        result->bytes = length;
+        summarize(samples, repeat, result);
+    }
+    free(samples);
+    return status;
+}
+
+// Parses pre-lexed tokens, so only tree building is timed
+static int run_parse_bench(const char* source, size_t length, int repeat,
+                           BenchResult* result) {
+    double* samples = malloc(sizeof(double) * repeat);
+    TokenList tokens;
+    if (!samples || !lex_source(source, length, &tokens)) {
+        free(samples);
+        return -1;
+    }
+
+    int status = 0;
+    for (int r = 0; r < repeat; r++) {
+        Ast ast;
+        double start = now_ns();
+        bool ok = ast_init(&ast, &tokens, (uint32_t)tokens.count + 1) &&
+                  parse_program(&tokens, &ast);
+        samples[r] = now_ns() - start;
+        ast_destroy(&ast);
+        if (!ok) {
+            status = -1;
+            break;
+        }
+    }
+
+    if (status == 0) {
+        result->name = "parse";
+        result->unit = "token";
+        result->ops = tokens.count;
+        result->bytes = length;
+        summarize(samples, repeat, result);
+    }
+    token_list_destroy(&tokens);
+    free(samples);
+    return status;
+}
+
+typedef enum {
+    STAGE_LOWER,
+    STAGE_OPTIMIZE,
+    STAGE_CODEGEN,
+} Stage;
+
+static const char* const STAGE_NAMES[] = {"lower", "optimize", "codegen"};
+static const char* const STAGE_UNITS[] = {"ir-instr", "ir-instr",
+                                          "instruction"};
+
+// Runs the pipeline after parsing on a pre-parsed tree, timing one stage:
+// lowering to SSA, the optimization passes, or code generation
+static int run_stage_bench(const char* source, size_t length, Stage stage,
+                           int repeat, BenchResult* result) {
+    double* samples = malloc(sizeof(double) * repeat);
+    TokenList tokens;
+    Ast ast;
+    if (!samples || !lex_source(source, length, &tokens)) {
+        free(samples);
+        return -1;
+    }
+    if (!ast_init(&ast, &tokens, (uint32_t)tokens.count + 1) ||
+        !parse_program(&tokens, &ast)) {
+        ast_destroy(&ast);
+        token_list_destroy(&tokens);
+        free(samples);
+        return -1;
+    }
+
+    int status = 0;
+    for (int r = 0; r < repeat && status == 0; r++) {
+        IrFunction ir;
+        ir_init(&ir);
+        double start = now_ns();
+        bool ok = lower_program(&ast, &ir);
+        double lowered = now_ns();
+        ok = ok && ir_optimize(&ir, IR_PASS_ALL);
+        double optimized = now_ns();
+        Program* program = ok ? generate_program(&ir) : NULL;
+        double generated = now_ns();
+
+        if (!program) {
+            status = -1;
+        } else if (stage == STAGE_CODEGEN) {
+            samples[r] = generated - optimized;
+            result->ops = (unsigned long long)program->size;
+        } else {
+            samples[r] = stage == STAGE_LOWER ? lowered - start
+                                              : optimized - lowered;
+            result->ops = ir.count;
+        }
+        program_destroy(program);
+        ir_destroy(&ir);
+    }
+
+    if (status == 0) {
+        result->name = STAGE_NAMES[stage];
+        result->unit = STAGE_UNITS[stage];
+        result->bytes = length;
+        summarize(samples, repeat, result);
+    }
+    ast_destroy(&ast);
+    token_list_destroy(&tokens);
+    free(samples);
+    return status;
+}
+
+static bool selected(const char* name, int argc, char** filters) {
+    if (argc == 0) {
+        return true;
+    }
+    for (int i = 0; i < argc; i++) {
+        if (strstr(name, filters[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_text(const BenchResult* results, int count) {
+    printf("%-12s %12s %14s %12s %10s\n", "benchmark", "ops", "median ns",
+           "ns/op", "MB/s");
+    for (int i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        printf("%-12s %12llu %14.0f %12.2f %10.1f\n", r->name, r->ops,
+               r->median_ns, r->median_ns / (double)r->ops,
+               (double)r->bytes * 1e3 / r->median_ns);
+    }
+}
+
+static void print_json(const BenchResult* results, int count, int repeat) {
+    printf("{\"suite\":\"axiom\",\"repeat\":%d,\"benchmarks\":[", repeat);
+    for (int i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        printf("%s{\"name\":\"%s\",\"unit\":\"%s\",\"ops\":%llu,"
+               "\"bytes\":%zu,\"min_ns\":%.0f,\"median_ns\":%.0f,"
+               "\"ns_per_op\":%.4f}",
+               i ? "," : "", r->name, r->unit, r->ops, r->bytes, r->min_ns,
+               r->median_ns, r->median_ns / (double)r->ops);
+    }
+    printf("]}\n");
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    int repeat = DEFAULT_REPEAT;
+    char** filters = malloc(sizeof(char*) * argc);
+    int num_filters = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1) {
+                repeat = 1;
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [--json] [--repeat N] [name filter...]\n",
+                   argv[0]);
+            free(filters);
+            return 0;
+        } else {
+            filters[num_filters++] = argv[i];
+        }
+    }
+
+    size_t length;
+    char* source = build_source(SOURCE_BLOCKS, &length);
+    if (!source) {
+        free(filters);
+        return 1;
+    }
+
+    BenchResult results[5] = {0};
+    int count = 0;
+    int failures = 0;
+
+    if (selected("lex", num_filters, filters)) {
+        if (run_lex_bench(source, length, repeat, &results[count]) == 0) {
+            count++;
+        } else {
+            failures++;
+        }
+    }
+    if (selected("parse", num_filters, filters)) {
+        if (run_parse_bench(source, length, repeat, &results[count]) == 0) {
+            count++;
+        } else {
+            failures++;
+        }
+    }
+    for (int stage = STAGE_LOWER; stage <= STAGE_CODEGEN; stage++) {
+        if (!selected(STAGE_NAMES[stage], num_filters, filters)) {
+            continue;
+        }
+        if (run_stage_bench(source, length, (Stage)stage, repeat,
+                            &results[count]) == 0) {
+            count++;
+        } else {
+            failures++;
+        }
+    }
+
+    if (json) {
+        print_json(results, count, repeat);
+    } else {
+        print_text(results, count);
+    }
+
+    free(source);
+    free(filters);
+    return failures > 0 ? 1 : 0;
+}
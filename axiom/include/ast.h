@@ -0,0 +1,78 @@
+#ifndef AST_H_
+#define AST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lexer.h"
+
+// Axiom syntax tree. All nodes of a compilation live in one array, the
+// arena, and refer to each other by index, so a tree is a single allocation
+// that is freed at once and stays valid when the array grows.
+
+typedef uint32_t NodeIndex;
+
+#define AST_NONE 0  // Node 0 is reserved, so index 0 means "no node"
+
+typedef enum {
+    NODE_BLOCK,   // { ... }: first statement in lhs, the rest chained by next
+    NODE_VAR,     // var name [= rhs];
+    NODE_ASSIGN,  // name = rhs;
+    NODE_IF,      // if (lhs) rhs [else extra]
+    NODE_WHILE,   // while (lhs) rhs
+    NODE_OUTPUT,  // output lhs;
+    NODE_NUMBER,  // value
+    NODE_NAME,    // A variable, named by token
+    NODE_UNARY,   // op lhs
+    NODE_BINARY,  // lhs op rhs
+    NODE_KIND_COUNT
+} NodeKind;
+
+typedef struct {
+    uint8_t kind;  // NodeKind
+    uint8_t op;    // TokenType of the operator, for NODE_UNARY/NODE_BINARY
+    uint32_t token;  // The name for VAR, ASSIGN and NAME, otherwise the
+                     // token the node starts at
+    union {
+        NodeIndex lhs;
+        int32_t value;  // NODE_NUMBER
+    };
+    NodeIndex rhs;
+    NodeIndex extra;
+    NodeIndex next;  // Following statement of the same block
+} Node;
+
+typedef struct {
+    const TokenList* tokens;
+    Node* nodes;
+    uint32_t count;  // Including the reserved node 0
+    uint32_t capacity;
+    NodeIndex root;  // NODE_BLOCK holding the whole program
+} Ast;
+
+// `capacity` is a hint; the arena grows as needed
+bool ast_init(Ast* ast, const TokenList* tokens, uint32_t capacity);
+void ast_destroy(Ast* ast);
+
+// The new node is zeroed apart from its kind and token. Returns AST_NONE if
+// the arena cannot grow. Adding nodes may move the arena, so Node pointers
+// must not be held across calls.
+NodeIndex ast_add_node(Ast* ast, NodeKind kind, uint32_t token);
+
+static inline Node* ast_node(const Ast* ast, NodeIndex index) {
+    return &ast->nodes[index];
+}
+
+// The source text of a token of the tree
+static inline const char* ast_token_text(const Ast* ast, uint32_t token,
+                                         uint32_t* length) {
+    const TokenSpan* span = &ast->tokens->tokens[token];
+    *length = span->length;
+    return ast->tokens->source + span->start;
+}
+
+// Prints the tree as indented S-expressions
+void ast_dump(const Ast* ast, FILE* out);
+
+#endif  // AST_H_
@@ -0,0 +1,22 @@
+#ifndef CODEGEN_H_
+#define CODEGEN_H_
+
+#include "assembler.h"
+#include "ir.h"
+
+// Compiles an SSA function into ANVIL instructions, with no textual
+// assembly in between; program_disassemble recovers text when a viewer
+// wants it.
+//
+// Values are allocated to BX, CX, DX, SI and DI by linear scan over their
+// live intervals, and the rest spill to stack slots below BP, reserved
+// with ENTER. Values that are never live at the same time share a
+// location, and a phi shares with its operands where it can, so most phis
+// need no copy at all. AX is scratch. Constants are used as immediates.
+// Conditions compile to CJMP, so no flags are used. `output` prints with
+// PREG.
+
+// Returns a finalized Program, or NULL when out of memory
+Program* generate_program(const IrFunction* ir);
+
+#endif  // CODEGEN_H_
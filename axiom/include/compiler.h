@@ -0,0 +1,37 @@
+#ifndef COMPILER_H_
+#define COMPILER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "assembler.h"
+#include "cache.h"
+
+// Part of every cache key, with the passes: bump it whenever the same source
+// and passes may compile to different code
+#define AXIOM_VERSION 1
+
+// What compile_source produces from a source
+typedef enum {
+    COMPILE_PROGRAM,  // An ANVIL program
+    COMPILE_AST,      // A dump of the syntax tree
+    COMPILE_IR,       // A dump of the optimized SSA form
+} CompileTarget;
+
+// The whole front end: lexes, parses, lowers, optimizes and generates code
+// with the given passes, or stops early to write a dump to `out`. Returns
+// the program, or NULL with `*status` set to 0 after a dump and 1 after an
+// error, which has been reported on stderr.
+Program* compile_source(const char* source, size_t length,
+                        CompileTarget target, unsigned passes, FILE* out,
+                        int* status);
+
+// compile_source through `cache`: a source seen before with the same passes
+// skips the front end entirely. The program comes back held in `*entry`
+// until passed to program_cache_release, or owned by the caller if `*entry`
+// is NULL.
+Program* compile_cached(ProgramCache* cache, const char* source,
+                        size_t length, unsigned passes, CacheEntry** entry,
+                        int* status);
+
+#endif  // COMPILER_H_
@@ -0,0 +1,19 @@
+#ifndef EVALUATE_H_
+#define EVALUATE_H_
+
+#include "ir.h"
+
+// Evaluation of the program while compiling. Axiom programs read no input,
+// so running the SSA form from the entry gives exactly the output the VM
+// would, for as long as the fuel lasts. A program that halts on the way
+// becomes a single write of its output. Otherwise the run is cut back to
+// the last time it entered a block outside every loop, or an outermost
+// loop's header, where nothing computed before is computed again: the
+// output up to there is written from the entry, which then jumps straight
+// to that block with its phis' values, and the code before it is gone.
+//
+// A division by zero stops the run the same way, leaving the trap to the
+// VM. Returns 1 if anything changed, 0 if not and -1 when out of memory.
+int ir_evaluate_ahead(IrFunction* func);
+
+#endif  // EVALUATE_H_
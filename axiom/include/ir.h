@@ -0,0 +1,202 @@
+#ifndef IR_H_
+#define IR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "instructions.h"
+
+// Axiom's SSA intermediate representation, between the syntax tree and code
+// generation. A program is one function: a control flow graph of basic
+// blocks over a single instruction array, where every instruction is also
+// the value it defines and is referred to by index.
+//
+// Constants are instructions too but belong to no block; they become
+// immediates. Passes delete an instruction by turning it into IR_NOP and
+// replace a value by turning it into an IR_COPY of another, so indices stay
+// stable until ir_compact renumbers them.
+
+typedef int32_t IrValue;
+
+#define IR_NONE (-1)
+
+typedef enum {
+    IR_NOP,     // Deleted
+    IR_CONST,   // value
+    IR_COPY,    // args[0]
+    IR_PHI,     // One operand per predecessor of its block, in the same order
+    IR_ADD,     // Arithmetic on args[0] and args[1], wrapping like the VM
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_SHL,
+    IR_POW,
+    IR_CMP,     // 1 if args[0] cond args[1], else 0
+    IR_OUTPUT,  // Prints args[0]
+    IR_WRITE,   // Writes args[1] bytes of the function's text from offset
+                // args[0], both constants
+    IR_JUMP,    // Terminators end every block: to succs[0]
+    IR_BRANCH,  // To succs[0] if args[0] cond args[1], else succs[1]
+    IR_HALT,
+    IR_OP_COUNT
+} IrOp;
+
+typedef struct {
+    uint8_t op;     // IrOp
+    uint8_t cond;   // Condition of IR_CMP and IR_BRANCH
+    int32_t block;  // Owning block, -1 for constants
+    union {
+        IrValue args[2];
+        int32_t value;  // IR_CONST
+        struct {
+            uint32_t first;  // Operands in IrFunction.phi_args
+            uint32_t count;
+        } phi;
+    };
+} IrInstr;
+
+// A block's instructions are contiguous: phis first, its terminator last
+typedef struct {
+    uint32_t first;  // Instructions [first, end)
+    uint32_t end;
+    int32_t* preds;  // May repeat a block that branches here twice
+    int32_t pred_count;
+    int32_t pred_capacity;
+    int32_t succs[2];
+    int32_t succ_count;
+    bool dead;  // Removed as unreachable
+} IrBlock;
+
+// An instruction added to a block that was already filled
+typedef struct {
+    IrValue value;
+    IrValue before;
+} IrInsert;
+
+typedef struct {
+    IrInstr* instrs;
+    uint32_t count;
+    uint32_t capacity;
+
+    IrBlock* blocks;  // Block 0 is the entry
+    int32_t block_count;
+    int32_t block_capacity;
+
+    IrValue* phi_args;
+    uint32_t phi_arg_count;
+    uint32_t phi_arg_capacity;
+
+    IrInsert* inserts;  // Waiting for ir_compact, in the order made
+    uint32_t insert_count;
+    uint32_t insert_capacity;
+
+    char* text;  // Output worked out while compiling, for IR_WRITE
+    uint32_t text_length;
+    uint32_t text_capacity;
+} IrFunction;
+
+void ir_init(IrFunction* func);
+void ir_destroy(IrFunction* func);
+
+// Growth helpers shared by lowering and the passes; all return IR_NONE or
+// -1 when out of memory. ir_add_instr appends to `block`, which must be the
+// block currently being filled.
+IrValue ir_add_instr(IrFunction* func, int32_t block, IrOp op);
+IrValue ir_add_const(IrFunction* func, int32_t value);
+int32_t ir_add_block(IrFunction* func);
+bool ir_add_edge(IrFunction* func, int32_t from, int32_t to);
+// Appends a phi's operands in one run; `values` follows the block's preds
+bool ir_set_phi_args(IrFunction* func, IrValue phi, const IrValue* values,
+                     int32_t count);
+// Replaces a block's predecessors; successors are left to the caller
+bool ir_set_preds(IrFunction* func, int32_t block, const int32_t* preds,
+                  int32_t count);
+// Removes one edge from `from` into `to`, with its phi operands: the last
+// one if `last`, for a branch whose two targets are the same block
+void ir_remove_edge(IrFunction* func, int32_t from, int32_t to, bool last);
+// Marks the blocks the entry no longer reaches dead, deleting their
+// instructions and their edges into live blocks
+bool ir_remove_unreachable(IrFunction* func);
+// Appends to the function's text, setting `*offset` to where it starts
+bool ir_add_text(IrFunction* func, const char* text, uint32_t length,
+                 uint32_t* offset);
+
+// Adds an instruction to the block of `before`, to go just ahead of it.
+// Until ir_compact puts it there it lies outside the block's range, where
+// passes iterating over the block do not see it.
+IrValue ir_insert_before(IrFunction* func, IrValue before, IrOp op);
+// Renumbers the instructions so that each live block's are contiguous, with
+// the pending insertions in place, deleted ones and dead blocks gone and
+// the constants after all blocks
+bool ir_compact(IrFunction* func);
+
+static inline IrInstr* ir_instr(const IrFunction* func, IrValue value) {
+    return &func->instrs[value];
+}
+
+static inline IrValue* ir_phi_args(const IrFunction* func,
+                                   const IrInstr* phi) {
+    return &func->phi_args[phi->phi.first];
+}
+
+static inline IrInstr* ir_terminator(const IrFunction* func, int32_t block) {
+    return &func->instrs[func->blocks[block].end - 1];
+}
+
+static inline bool ir_is_const(const IrFunction* func, IrValue value,
+                               int32_t* constant) {
+    const IrInstr* instr = &func->instrs[value];
+    if (instr->op != IR_CONST) {
+        return false;
+    }
+    if (constant) {
+        *constant = instr->value;
+    }
+    return true;
+}
+
+// Follows a chain of copies to the value it stands for
+IrValue ir_resolve(const IrFunction* func, IrValue value);
+
+// The condition that holds exactly when `cond` does not
+Condition ir_negate_condition(Condition cond);
+// The condition for the same comparison with its operands swapped
+Condition ir_swap_condition(Condition cond);
+bool ir_compare(Condition cond, int32_t a, int32_t b);
+
+// Evaluates an arithmetic op the way the VM does. Returns false for a
+// division by zero, which is left for the program to trap on.
+bool ir_evaluate(IrOp op, int32_t a, int32_t b, int32_t* result);
+
+// Reachable blocks in reverse postorder, entry first. Returns the count, or
+// -1 when out of memory; the caller frees *order.
+int32_t ir_reverse_postorder(const IrFunction* func, int32_t** order);
+
+// The dominator tree of the reachable blocks
+typedef struct {
+    int32_t* rpo_index;  // Position in reverse postorder, -1 if unreachable
+    int32_t* idom;
+    int32_t* preorder;   // Dominator tree preorder number
+    int32_t* last;       // Largest preorder number in the subtree
+    int32_t* visit;      // Blocks in dominator tree preorder
+    int32_t count;
+} IrDominators;
+
+// Returns false when out of memory
+bool ir_dominators(const IrFunction* func, IrDominators* dom);
+void ir_dominators_free(IrDominators* dom);
+
+// Whether every path from the entry to `b` passes through `a`; false if
+// either is unreachable
+static inline bool ir_dominates(const IrDominators* dom, int32_t a,
+                                int32_t b) {
+    return dom->preorder[a] <= dom->preorder[b] &&
+           dom->preorder[b] <= dom->last[a];
+}
+
+// Prints the live blocks, with constants shown inline
+void ir_dump(const IrFunction* func, FILE* out);
+
+#endif  // IR_H_
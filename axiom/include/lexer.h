@@ -2,6 +2,7 @@
 #define LEXER_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -52,21 +53,51 @@ typedef struct {
 } Token;
 
 typedef struct {
-    char* source;
+    const char* source;
+    int length;  // Of source, so advancing is O(1)
     int position;
     int line;
     int column;
     char current_char;
 } Lexer;
 
-Lexer* init_lexer(char* source);
-void advance(Lexer* lexer);
-char peek(Lexer* lexer);
+// Character-at-a-time lexer; each token and its text are heap allocated
+Lexer* init_lexer(const char* source);
+void lexer_advance(Lexer* lexer);
+char lexer_peek(Lexer* lexer);
 
-void skip_whitespace(Lexer* lexer);
-void skip_comment(Lexer* lexer);
+void lexer_skip_whitespace(Lexer* lexer);
+void lexer_skip_comment(Lexer* lexer);
 
-Token* number(Lexer* lexer);
-Token* identifier(Lexer* lexer);
+Token* lexer_number(Lexer* lexer);
+Token* lexer_identifier(Lexer* lexer);
+void token_destroy(Token* token);
+
+// A token of a TokenList. Its text is source[start, start + length) and is
+// not copied.
+typedef struct {
+    TokenType type;
+    uint32_t start;
+    uint32_t length;
+    uint32_t line;
+    uint32_t column;
+} TokenSpan;
+
+typedef struct {
+    const char* source;
+    size_t source_length;
+    TokenSpan* tokens;  // The last one is always TOKEN_EOF
+    size_t count;
+    size_t capacity;
+} TokenList;
+
+// Lexes all of `source` in a single pass into one array of tokens. On a
+// character that starts no token, prints where it is and returns false.
+bool lex_source(const char* source, size_t length, TokenList* list);
+void token_list_destroy(TokenList* list);
+
+// TOKEN_IDENTIFIER if `text` is not a keyword
+TokenType keyword_type(const char* text, size_t length);
+const char* token_type_name(TokenType type);
 
 #endif  // LEXER_H_
@@ -0,0 +1,22 @@
+#ifndef LOOPS_H_
+#define LOOPS_H_
+
+#include "ir.h"
+
+// Loop optimizations, on the natural loops found from the back edges of
+// the dominator tree. Innermost loops go first, so code hoisted out of one
+// can be hoisted again out of the loop around it.
+//
+// Invariant code moves to a preheader made on the loop's entry edge. A
+// product of a basic induction variable, one stepping by a constant each
+// iteration, by an invariant becomes a variable of its own stepping by the
+// product of the two. An innermost loop that runs a constant number of
+// times is copied once per iteration when the copies fit the cost budget,
+// otherwise by a factor that divides the count, so the copies need no exit
+// tests of their own. Costs are counted in ANVIL instructions.
+//
+// `passes` selects among IR_PASS_LICM, IR_PASS_STRENGTH and IR_PASS_UNROLL.
+// Returns 1 if anything changed, 0 if not and -1 when out of memory.
+int ir_optimize_loops(IrFunction* func, unsigned passes);
+
+#endif  // LOOPS_H_
@@ -0,0 +1,16 @@
+#ifndef LOWER_H_
+#define LOWER_H_
+
+#include "ast.h"
+#include "ir.h"
+
+// Translates a syntax tree into SSA form in `func`, checking names on the
+// way. Variables become SSA values directly: assignments define new values
+// and phis merge them where control flow joins, so no loads or stores
+// remain. While loops are inverted, testing once before the loop and again
+// at its bottom, so each iteration takes one branch.
+//
+// Returns false after reporting the first undefined or redeclared variable.
+bool lower_program(const Ast* ast, IrFunction* func);
+
+#endif  // LOWER_H_
@@ -0,0 +1,33 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#include "ir.h"
+
+// Optimization passes over the SSA form. Each can be switched off on its
+// own; the enabled scalar ones run together until none of them changes
+// anything, then evaluation and the loop passes once each, with the scalar
+// ones again after each to clean up after them.
+typedef enum {
+    IR_PASS_SIMPLIFY = 1 << 0,  // Algebraic identities; x * 2^k to a shift
+    IR_PASS_FOLD = 1 << 1,      // Constant folding, including branches
+    IR_PASS_COPY = 1 << 2,      // Copy propagation and redundant phis
+    IR_PASS_CSE = 1 << 3,       // Common subexpressions, by dominance
+    IR_PASS_DCE = 1 << 4,       // Instructions whose results go unused
+    IR_PASS_LICM = 1 << 5,      // Loop-invariant code to a preheader
+    IR_PASS_STRENGTH = 1 << 6,  // Induction variable products to additions
+    IR_PASS_UNROLL = 1 << 7,    // Small loops with a known trip count
+    IR_PASS_EVALUATE = 1 << 8,  // Running the program while compiling
+} IrPass;
+
+#define IR_PASS_ALL 0x1ff
+#define IR_PASS_LOOPS (IR_PASS_LICM | IR_PASS_STRENGTH | IR_PASS_UNROLL)
+
+// The pass called `name` ("simplify", "fold", "copy", "cse", "dce",
+// "licm", "strength", "unroll" or "evaluate"), or 0
+unsigned ir_pass_by_name(const char* name);
+
+// Returns false if out of memory, leaving the function correct but possibly
+// less optimized
+bool ir_optimize(IrFunction* func, unsigned passes);
+
+#endif  // OPTIMIZER_H_
@@ -1,15 +1,15 @@
-#ifndef PARSER_H_
-#define PARSER_H_
+#ifndef AXIOM_PARSER_H_
+#define AXIOM_PARSER_H_
 
+#include "ast.h"
 #include "lexer.h"
 
-typedef struct {
-    const char* str;
-    size_t pos;
-} Parser;
+// Nesting deeper than this is rejected rather than risking the C stack
+#define PARSER_MAX_DEPTH 1000
 
-void parser_init(Parser* parser, const char* str);
-bool is_end_of_line(Parser* parser);
-bool parse_keyword(Parser* parser, TokenType expected);
+// Builds the syntax tree of a lexed program into `ast`, which must be
+// initialized over the same tokens. On a syntax error, prints the first
+// one and returns false.
+bool parse_program(const TokenList* tokens, Ast* ast);
 
-#endif  // PARSER_H_
+#endif  // AXIOM_PARSER_H_
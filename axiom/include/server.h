@@ -0,0 +1,73 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "vm.h"
+
+// Compile-and-run server on a Unix domain socket, so that a request costs
+// its compile and run time rather than a process start. Worker threads
+// share one program cache, and each keeps one VM that it resets for every
+// program instead of creating a new one.
+//
+// A client sends batches on a connection, as many as it likes: a uint32_t
+// count, then per program a ServerRequest followed by its source. The
+// server answers each batch with a ServerResult per program, in request
+// order, each followed by the program's output. Everything is in host byte
+// order, as both ends are on the same machine. Diagnostics from the
+// compiler go to the server's stderr.
+
+#define SERVER_MAX_BATCH 1024
+#define SERVER_MAX_SOURCE (1u << 24)  // Bytes
+#define SERVER_MAX_BATCH_SOURCE (1u << 26)  // Bytes of all a batch's sources
+#define SERVER_MAX_STEPS (1ull << 32)  // Instructions a program may run
+#define SERVER_CACHE_CAPACITY 256
+
+typedef struct {
+    uint32_t passes;  // IrPass mask
+    uint32_t length;  // Bytes of source that follow
+} ServerRequest;
+
+typedef enum {
+    SERVER_OK,
+    SERVER_COMPILE_ERROR,
+    // `error` says why, VM_ERROR_STEP_LIMIT if it ran too long; the state
+    // is where it stopped
+    SERVER_RUN_ERROR,
+    SERVER_OUT_OF_MEMORY,
+} ServerStatus;
+
+typedef struct {
+    int32_t status;  // ServerStatus
+    int32_t error;   // VMError of the run
+    int32_t registers[R_COUNT];
+    uint32_t flags;
+    int32_t ip;
+    uint32_t output_length;  // Bytes of output that follow
+} ServerResult;
+
+typedef struct {
+    const char* socket_path;
+    int threads;            // Workers running programs, at least 1
+    const char* cache_dir;  // Also keep programs on disk, or NULL
+    uint64_t max_steps;     // Per program, 0 for SERVER_MAX_STEPS
+} ServerConfig;
+
+// Serves until SIGINT or SIGTERM, then removes the socket. Returns the
+// process exit status.
+int server_run(const ServerConfig* config);
+
+// Client side. Returns a connected socket, or -1.
+int server_connect(const char* socket_path);
+
+// Sends a batch; the sources are read from `sources`, `requests[i].length`
+// bytes each
+bool server_send_batch(int fd, const ServerRequest* requests,
+                       const char* const* sources, uint32_t count);
+
+// Reads the next result of a batch and its output, which the caller frees
+bool server_read_result(int fd, ServerResult* result, char** output);
+
+#endif  // SERVER_H_
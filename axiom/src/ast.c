@@ -0,0 +1,129 @@
+#include "ast.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool ast_init(Ast* ast, const TokenList* tokens, uint32_t capacity) {
+    ast->tokens = tokens;
+    ast->count = 1;
+    ast->capacity = capacity < 16 ? 16 : capacity;
+    ast->root = AST_NONE;
+    ast->nodes = calloc(ast->capacity, sizeof(Node));
+    if (!ast->nodes) {
+        fprintf(stderr, "[AXIOM] Error: Out of memory for the syntax tree!\n");
+        return false;
+    }
+    return true;
+}
+
+void ast_destroy(Ast* ast) {
+    if (ast) {
+        free(ast->nodes);
+        ast->nodes = NULL;
+        ast->count = ast->capacity = 0;
+        ast->root = AST_NONE;
+    }
+}
+
+NodeIndex ast_add_node(Ast* ast, NodeKind kind, uint32_t token) {
+    if (ast->count == ast->capacity) {
+        if (ast->capacity > UINT32_MAX / 2) {
+            return AST_NONE;
+        }
+        uint32_t capacity = ast->capacity * 2;
+        Node* nodes = realloc(ast->nodes, capacity * sizeof(Node));
+        if (!nodes) {
+            return AST_NONE;
+        }
+        ast->nodes = nodes;
+        ast->capacity = capacity;
+    }
+
+    NodeIndex index = ast->count++;
+    Node* node = &ast->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->kind = (uint8_t)kind;
+    node->token = token;
+    return index;
+}
+
+static void dump_node(const Ast* ast, NodeIndex index, int depth, FILE* out);
+
+static void dump_block(const Ast* ast, NodeIndex first, int depth,
+                       FILE* out) {
+    for (NodeIndex s = first; s != AST_NONE; s = ast_node(ast, s)->next) {
+        fprintf(out, "\n");
+        dump_node(ast, s, depth, out);
+    }
+}
+
+static void dump_node(const Ast* ast, NodeIndex index, int depth, FILE* out) {
+    const Node* node = ast_node(ast, index);
+    uint32_t length;
+    const char* text;
+
+    fprintf(out, "%*s", depth * 2, "");
+    switch ((NodeKind)node->kind) {
+        case NODE_BLOCK:
+            fprintf(out, "(block");
+            dump_block(ast, node->lhs, depth + 1, out);
+            fprintf(out, ")");
+            return;
+        case NODE_VAR:
+        case NODE_ASSIGN:
+            text = ast_token_text(ast, node->token, &length);
+            fprintf(out, "(%s %.*s",
+                    node->kind == NODE_VAR ? "var" : "assign", (int)length,
+                    text);
+            if (node->rhs != AST_NONE) {
+                fprintf(out, "\n");
+                dump_node(ast, node->rhs, depth + 1, out);
+            }
+            fprintf(out, ")");
+            return;
+        case NODE_IF:
+        case NODE_WHILE:
+            fprintf(out, "(%s\n", node->kind == NODE_IF ? "if" : "while");
+            dump_node(ast, node->lhs, depth + 1, out);
+            fprintf(out, "\n");
+            dump_node(ast, node->rhs, depth + 1, out);
+            if (node->extra != AST_NONE) {
+                fprintf(out, "\n");
+                dump_node(ast, node->extra, depth + 1, out);
+            }
+            fprintf(out, ")");
+            return;
+        case NODE_OUTPUT:
+            fprintf(out, "(output\n");
+            dump_node(ast, node->lhs, depth + 1, out);
+            fprintf(out, ")");
+            return;
+        case NODE_NUMBER:
+            fprintf(out, "%d", node->value);
+            return;
+        case NODE_NAME:
+            text = ast_token_text(ast, node->token, &length);
+            fprintf(out, "%.*s", (int)length, text);
+            return;
+        case NODE_UNARY:
+        case NODE_BINARY:
+            fprintf(out, "(%s\n", token_type_name((TokenType)node->op));
+            dump_node(ast, node->lhs, depth + 1, out);
+            if (node->kind == NODE_BINARY) {
+                fprintf(out, "\n");
+                dump_node(ast, node->rhs, depth + 1, out);
+            }
+            fprintf(out, ")");
+            return;
+        default:
+            fprintf(out, "(?)");
+            return;
+    }
+}
+
+void ast_dump(const Ast* ast, FILE* out) {
+    if (ast->root != AST_NONE) {
+        dump_node(ast, ast->root, 0, out);
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,1122 @@
+#include "codegen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Positions number the points of the laid out function: each block has one
+// at its start, where its phis are defined, and one at its end, where the
+// copies into its successors' phis read their operands. An instruction
+// reads its operands at its own position and writes its result at the
+// next, so a result can share a location with an operand that dies there.
+typedef struct {
+    int32_t start;
+    int32_t end;
+} Interval;
+
+typedef struct {
+    int32_t block;
+    int32_t position;
+} Use;
+
+typedef struct {
+    Operand dest;
+    Operand source;
+} Copy;
+
+// An edge out of a branch whose phi copies have to run on the edge alone
+typedef struct {
+    int label;
+    int32_t block;
+    int succ;
+} Stub;
+
+typedef struct {
+    const IrFunction* ir;
+    Program* program;
+
+    int32_t* order;  // Reachable blocks in layout order
+    int32_t order_count;
+    int32_t* layout;  // Index of each block in order, -1 if unreachable
+    int32_t* block_start;
+    int32_t* block_end;
+    int* block_label;
+    int32_t max_phis;
+
+    int32_t* def_position;  // Per value
+    int32_t* use_position;
+
+    // Values coalesced into one location form a group, kept as a
+    // union-find forest. The root holds the group's live ranges, sorted and
+    // disjoint, at ranges[range_first .. range_first + range_size), their
+    // hull in live, and the group's home.
+    Interval* ranges;
+    uint32_t range_count;
+    uint32_t range_capacity;
+    uint32_t* range_first;
+    int32_t* range_size;
+    Interval* live;
+    int32_t* group;
+    int32_t* home;
+    int32_t frame_size;  // Stack slots for values that found no register
+
+    Copy* copies;
+    Stub* stubs;
+    int32_t stub_count;
+
+    bool failed;
+} CodeGen;
+
+static Operand reg_operand(Register reg) {
+    Operand operand = {.type = OPERAND_REGISTER, .value.reg = reg};
+    return operand;
+}
+
+static Operand imm_operand(int imm) {
+    Operand operand = {.type = OPERAND_IMMEDIATE, .value.imm = imm};
+    return operand;
+}
+
+static Operand label_operand(int label) {
+    Operand operand = {.type = OPERAND_LABEL, .value.label = label};
+    return operand;
+}
+
+static Operand memory_operand(Register base, int offset) {
+    Operand operand = {.type = OPERAND_MEMORY};
+    operand.value.mem_ref.base_reg = (int8_t)base;
+    operand.value.mem_ref.index_reg = R_NONE;
+    operand.value.mem_ref.offset = offset;
+    operand.value.mem_ref.symbol = -1;
+    memory_ref_classify(&operand.value.mem_ref);
+    return operand;
+}
+
+static bool same_operand(const Operand* a, const Operand* b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    switch (a->type) {
+        case OPERAND_REGISTER:
+            return a->value.reg == b->value.reg;
+        case OPERAND_IMMEDIATE:
+            return a->value.imm == b->value.imm;
+        case OPERAND_MEMORY:
+            return a->value.mem_ref.base_reg == b->value.mem_ref.base_reg &&
+                   a->value.mem_ref.index_reg == R_NONE &&
+                   b->value.mem_ref.index_reg == R_NONE &&
+                   a->value.mem_ref.offset == b->value.mem_ref.offset;
+        default:
+            return false;
+    }
+}
+
+static void out_of_memory(CodeGen* gen) {
+    if (!gen->failed) {
+        fprintf(stderr, "[AXIOM] Error: Out of memory generating code!\n");
+        gen->failed = true;
+    }
+}
+
+static void emit(CodeGen* gen, OpCode opcode, int count, Operand a,
+                 Operand b, Operand c) {
+    Instruction instr = {opcode, {a, b, c}, count, 0};
+    if (!gen->failed && !add_instruction(gen->program, instr)) {
+        out_of_memory(gen);
+    }
+}
+
+static void emit0(CodeGen* gen, OpCode opcode) {
+    Operand none = {0};
+    emit(gen, opcode, 0, none, none, none);
+}
+
+static void emit1(CodeGen* gen, OpCode opcode, Operand a) {
+    Operand none = {0};
+    emit(gen, opcode, 1, a, none, none);
+}
+
+static void emit2(CodeGen* gen, OpCode opcode, Operand a, Operand b) {
+    Operand none = {0};
+    emit(gen, opcode, 2, a, b, none);
+}
+
+static void emit_cjmp(CodeGen* gen, Condition cond, Operand a, Operand b,
+                      int label) {
+    Instruction instr = {OP_CJMP, {a, b, label_operand(label)}, 3,
+                         (uint8_t)cond};
+    if (!gen->failed && !add_instruction(gen->program, instr)) {
+        out_of_memory(gen);
+    }
+}
+
+static int make_label(CodeGen* gen) {
+    int label = new_label(gen->program);
+    if (label < 0) {
+        out_of_memory(gen);
+        return 0;
+    }
+    return label;
+}
+
+static void place(CodeGen* gen, int label) {
+    if (!gen->failed) {
+        place_label(gen->program, label);
+    }
+}
+
+static bool has_result(IrOp op) {
+    return op == IR_PHI || op == IR_COPY || (op >= IR_ADD && op <= IR_CMP);
+}
+
+// Instructions that take code, as opposed to phis and constants
+static bool is_emitted(IrOp op) {
+    return op != IR_NOP && op != IR_CONST && op != IR_PHI;
+}
+
+// Layout
+
+// Blocks go in reverse postorder, which puts most successors right after
+// their block; positions are numbered in the same order
+static bool lay_out(CodeGen* gen) {
+    const IrFunction* ir = gen->ir;
+    gen->order_count = ir_reverse_postorder(ir, &gen->order);
+    if (gen->order_count < 0) {
+        gen->order = NULL;
+        return false;
+    }
+
+    for (int32_t b = 0; b < ir->block_count; b++) {
+        gen->layout[b] = -1;
+    }
+    int32_t position = 0;
+    for (int32_t k = 0; k < gen->order_count; k++) {
+        int32_t b = gen->order[k];
+        const IrBlock* block = &ir->blocks[b];
+        int32_t phis = 0;
+        gen->layout[b] = k;
+        gen->block_start[b] = position++;
+        for (uint32_t i = block->first; i < block->end; i++) {
+            const IrInstr* instr = &ir->instrs[i];
+            if (instr->block != b) {
+                continue;
+            }
+            if (instr->op == IR_PHI) {
+                gen->def_position[i] = gen->block_start[b];
+                phis++;
+            } else if (is_emitted((IrOp)instr->op)) {
+                // A comparison writes its result before reading its
+                // operands, so the result may not share their locations
+                gen->use_position[i] = position;
+                gen->def_position[i] =
+                    instr->op == IR_CMP ? position : position + 1;
+                position += 2;
+            }
+        }
+        gen->block_end[b] = position++;
+        if (phis > gen->max_phis) {
+            gen->max_phis = phis;
+        }
+    }
+    return true;
+}
+
+// Liveness
+
+// Index in the successor's preds of the edge from `block` to its succ-th
+// successor; a branch with both targets the same uses the last for succ 1
+static int32_t pred_index(const IrFunction* ir, int32_t block, int succ) {
+    const IrBlock* b = &ir->blocks[block];
+    const IrBlock* target = &ir->blocks[b->succs[succ]];
+    bool last = succ == 1 && b->succs[0] == b->succs[1];
+    int32_t found = -1;
+    for (int32_t i = 0; i < target->pred_count; i++) {
+        if (target->preds[i] == block) {
+            found = i;
+            if (!last) {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// Counts the uses of each value in reachable code, or with `uses` stores
+// them at the indices in `counts`; phi operands are used at the end of the
+// predecessor they arrive from
+static int32_t collect_uses(CodeGen* gen, int32_t* counts, Use* uses) {
+    const IrFunction* ir = gen->ir;
+    int32_t total = 0;
+
+#define ADD_USE(value, use_block, use_position)              \
+    do {                                                     \
+        if (!ir_is_const(ir, (value), NULL)) {               \
+            if (uses) {                                      \
+                uses[counts[(value)]++] =                    \
+                    (Use){(use_block), (use_position)};      \
+            } else {                                         \
+                counts[(value)]++;                           \
+            }                                                \
+            total++;                                         \
+        }                                                    \
+    } while (0)
+
+    for (int32_t k = 0; k < gen->order_count; k++) {
+        int32_t b = gen->order[k];
+        const IrBlock* block = &ir->blocks[b];
+        for (uint32_t i = block->first; i < block->end; i++) {
+            const IrInstr* instr = &ir->instrs[i];
+            if (instr->block != b || instr->op == IR_NOP ||
+                instr->op == IR_CONST) {
+                continue;
+            }
+            if (instr->op == IR_PHI) {
+                const IrValue* args = ir_phi_args(ir, instr);
+                for (uint32_t j = 0; j < instr->phi.count; j++) {
+                    int32_t pred = block->preds[j];
+                    if (gen->layout[pred] >= 0) {
+                        ADD_USE(args[j], pred, gen->block_end[pred]);
+                    }
+                }
+                continue;
+            }
+            for (int j = 0; j < 2; j++) {
+                if (instr->args[j] != IR_NONE) {
+                    ADD_USE(instr->args[j], b, gen->use_position[i]);
+                }
+            }
+        }
+    }
+#undef ADD_USE
+    return total;
+}
+
+static void extend(Interval* interval, int32_t position) {
+    if (position < interval->start) {
+        interval->start = position;
+    }
+    if (position > interval->end) {
+        interval->end = position;
+    }
+}
+
+static bool reserve_ranges(CodeGen* gen, uint32_t count) {
+    if (gen->range_count + count <= gen->range_capacity) {
+        return true;
+    }
+    uint32_t capacity = gen->range_capacity ? gen->range_capacity : 1024;
+    while (capacity < gen->range_count + count) {
+        capacity *= 2;
+    }
+    Interval* ranges = realloc(gen->ranges, sizeof(Interval) * capacity);
+    if (!ranges) {
+        return false;
+    }
+    gen->ranges = ranges;
+    gen->range_capacity = capacity;
+    return true;
+}
+
+static bool add_range(CodeGen* gen, int32_t start, int32_t end) {
+    if (!reserve_ranges(gen, 1)) {
+        return false;
+    }
+    gen->ranges[gen->range_count++] = (Interval){start, end};
+    return true;
+}
+
+static int compare_ranges(const void* a, const void* b) {
+    int32_t x = ((const Interval*)a)->start;
+    int32_t y = ((const Interval*)b)->start;
+    return (x > y) - (x < y);
+}
+
+// Sorts the ranges added for `value` since `first` and joins those that
+// overlap or touch
+static void finish_ranges(CodeGen* gen, IrValue value, uint32_t first) {
+    Interval* ranges = &gen->ranges[first];
+    uint32_t count = gen->range_count - first;
+    qsort(ranges, count, sizeof(Interval), compare_ranges);
+
+    uint32_t kept = 0;
+    for (uint32_t i = 1; i < count; i++) {
+        if (ranges[i].start <= ranges[kept].end + 1) {
+            extend(&ranges[kept], ranges[i].end);
+        } else {
+            ranges[++kept] = ranges[i];
+        }
+    }
+    gen->range_count = first + kept + 1;
+    gen->range_first[value] = first;
+    gen->range_size[value] = (int32_t)kept + 1;
+    gen->live[value] = (Interval){ranges[0].start, ranges[kept].end};
+}
+
+// Pushes the reachable predecessors of `block` that have not yet been
+// found live-out for `value`
+static void push_preds(CodeGen* gen, int32_t block, IrValue value,
+                       int32_t* stamp, int32_t* stack, int32_t* depth) {
+    const IrBlock* b = &gen->ir->blocks[block];
+    for (int32_t p = 0; p < b->pred_count; p++) {
+        int32_t pred = b->preds[p];
+        if (gen->layout[pred] >= 0 && stamp[pred] != value) {
+            stamp[pred] = value;
+            stack[(*depth)++] = pred;
+        }
+    }
+}
+
+// Finds the ranges of positions each value is live at by walking
+// backwards from its uses to its definition. The ranges leave holes where
+// a value is dead, such as the arm of an if that does not use it, so
+// values can share a location across them.
+static bool compute_liveness(CodeGen* gen) {
+    const IrFunction* ir = gen->ir;
+    int32_t* counts = calloc(ir->count + 1, sizeof(int32_t));
+    int32_t* stamp = malloc(sizeof(int32_t) * ((size_t)ir->block_count + 1));
+    int32_t* stack = malloc(sizeof(int32_t) * ((size_t)ir->block_count + 1));
+    Use* uses = NULL;
+    if (counts && stamp && stack) {
+        uses = malloc(sizeof(Use) * ((size_t)collect_uses(gen, counts, NULL) +
+                                     1));
+    }
+    if (!uses) {
+        free(counts);
+        free(stamp);
+        free(stack);
+        return false;
+    }
+
+    // Counts become each value's first index, then collect_uses advances
+    // them to the next value's
+    int32_t offset = 0;
+    for (uint32_t v = 0; v < ir->count; v++) {
+        int32_t count = counts[v];
+        counts[v] = offset;
+        offset += count;
+    }
+    collect_uses(gen, counts, uses);
+    for (int32_t b = 0; b < ir->block_count; b++) {
+        stamp[b] = -1;
+    }
+
+    bool ok = true;
+    int32_t first = 0;
+    for (uint32_t v = 0; v < ir->count && ok; v++) {
+        const IrInstr* instr = &ir->instrs[v];
+        int32_t last = counts[v];
+        if (!has_result((IrOp)instr->op) || instr->block < 0 ||
+            gen->layout[instr->block] < 0) {
+            first = last;
+            continue;
+        }
+
+        // Within the defining block a value is live from its definition,
+        // elsewhere from the start of the block
+        int32_t def = gen->def_position[v];
+        uint32_t range_first = gen->range_count;
+        int32_t depth = 0;
+        ok = add_range(gen, def, def);
+        for (int32_t u = first; u < last && ok; u++) {
+            int32_t block = uses[u].block;
+            if (block == instr->block) {
+                ok = add_range(gen, def, uses[u].position);
+            } else {
+                ok = add_range(gen, gen->block_start[block],
+                               uses[u].position);
+                push_preds(gen, block, (IrValue)v, stamp, stack, &depth);
+            }
+        }
+        while (depth > 0 && ok) {
+            int32_t block = stack[--depth];
+            if (block == instr->block) {
+                ok = add_range(gen, def, gen->block_end[block]);
+            } else {
+                ok = add_range(gen, gen->block_start[block],
+                               gen->block_end[block]);
+                push_preds(gen, block, (IrValue)v, stamp, stack, &depth);
+            }
+        }
+        if (ok) {
+            finish_ranges(gen, (IrValue)v, range_first);
+        }
+        first = last;
+    }
+
+    free(counts);
+    free(stamp);
+    free(stack);
+    free(uses);
+    return ok;
+}
+
+// Location assignment
+
+static int32_t find_group(CodeGen* gen, IrValue value) {
+    while (gen->group[value] != value) {
+        gen->group[value] = gen->group[gen->group[value]];
+        value = gen->group[value];
+    }
+    return value;
+}
+
+// Whether two groups are live at some common position
+static bool interferes(const CodeGen* gen, int32_t x, int32_t y) {
+    if (gen->live[x].end < gen->live[y].start ||
+        gen->live[y].end < gen->live[x].start) {
+        return false;
+    }
+    const Interval* a = &gen->ranges[gen->range_first[x]];
+    const Interval* b = &gen->ranges[gen->range_first[y]];
+    int32_t i = 0;
+    int32_t j = 0;
+    while (i < gen->range_size[x] && j < gen->range_size[y]) {
+        if (a[i].end < b[j].start) {
+            i++;
+        } else if (b[j].end < a[i].start) {
+            j++;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Puts two values in one location if their groups are never live
+// together. The merged ranges are appended; the old ones are left unused.
+static bool coalesce(CodeGen* gen, IrValue a, IrValue b) {
+    if (ir_is_const(gen->ir, b, NULL)) {
+        return false;
+    }
+    int32_t x = find_group(gen, a);
+    int32_t y = find_group(gen, b);
+    if (x == y) {
+        return true;
+    }
+    if (interferes(gen, x, y) ||
+        !reserve_ranges(gen, (uint32_t)(gen->range_size[x] +
+                                         gen->range_size[y]))) {
+        return false;
+    }
+
+    const Interval* p = &gen->ranges[gen->range_first[x]];
+    const Interval* q = &gen->ranges[gen->range_first[y]];
+    int32_t i = 0;
+    int32_t j = 0;
+    uint32_t first = gen->range_count;
+    while (i < gen->range_size[x] || j < gen->range_size[y]) {
+        Interval next;
+        if (j == gen->range_size[y] ||
+            (i < gen->range_size[x] && p[i].start < q[j].start)) {
+            next = p[i++];
+        } else {
+            next = q[j++];
+        }
+        Interval* top = &gen->ranges[gen->range_count - 1];
+        if (gen->range_count > first && next.start <= top->end + 1) {
+            extend(top, next.end);
+        } else {
+            gen->ranges[gen->range_count++] = next;
+        }
+    }
+
+    gen->range_first[x] = first;
+    gen->range_size[x] = (int32_t)(gen->range_count - first);
+    extend(&gen->live[x], gen->live[y].start);
+    extend(&gen->live[x], gen->live[y].end);
+    gen->group[y] = x;
+    return true;
+}
+
+// Phis first, since a missed phi costs a copy on every incoming edge;
+// then results with an operand, which turns `mov d, a; op d, b` into
+// `op d, b`
+static void coalesce_values(CodeGen* gen) {
+    const IrFunction* ir = gen->ir;
+    for (uint32_t v = 0; v < ir->count; v++) {
+        gen->group[v] = (int32_t)v;
+    }
+
+    for (int32_t k = 0; k < gen->order_count; k++) {
+        int32_t b = gen->order[k];
+        const IrBlock* block = &ir->blocks[b];
+        for (uint32_t i = block->first; i < block->end; i++) {
+            const IrInstr* instr = &ir->instrs[i];
+            if (instr->block != b || instr->op != IR_PHI) {
+                continue;
+            }
+            const IrValue* args = ir_phi_args(ir, instr);
+            for (uint32_t j = 0; j < instr->phi.count; j++) {
+                if (gen->layout[block->preds[j]] >= 0) {
+                    coalesce(gen, (IrValue)i, args[j]);
+                }
+            }
+        }
+    }
+
+    for (int32_t k = 0; k < gen->order_count; k++) {
+        int32_t b = gen->order[k];
+        const IrBlock* block = &ir->blocks[b];
+        for (uint32_t i = block->first; i < block->end; i++) {
+            const IrInstr* instr = &ir->instrs[i];
+            if (instr->block != b) {
+                continue;
+            }
+            switch ((IrOp)instr->op) {
+                case IR_ADD:
+                case IR_MUL:
+                    if (!coalesce(gen, (IrValue)i, instr->args[0])) {
+                        coalesce(gen, (IrValue)i, instr->args[1]);
+                    }
+                    break;
+                case IR_COPY:
+                case IR_SUB:
+                case IR_DIV:
+                case IR_MOD:
+                case IR_SHL:
+                    coalesce(gen, (IrValue)i, instr->args[0]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+// Registers values can live in. AX is kept out as the scratch register
+// for output, phi copies and results that overwrite an operand still to be
+// read.
+static const Register REGISTERS[] = {R_BX, R_CX, R_DX, R_SI, R_DI};
+#define REGISTER_COUNT ((int32_t)(sizeof(REGISTERS) / sizeof(REGISTERS[0])))
+
+// A group's home is REGISTERS[home] below REGISTER_COUNT; homes from there
+// on number the stack slots [bp - 1], [bp - 2] and so on
+#define SPILLED -1
+
+static void heap_push(const Interval* live, int32_t* heap, int32_t* size,
+                      int32_t value) {
+    int32_t i = (*size)++;
+    while (i > 0 && live[heap[(i - 1) / 2]].end > live[value].end) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = value;
+}
+
+static int32_t heap_pop(const Interval* live, int32_t* heap, int32_t* size) {
+    int32_t top = heap[0];
+    int32_t moved = heap[--(*size)];
+    int32_t i = 0;
+    for (;;) {
+        int32_t child = 2 * i + 1;
+        if (child >= *size) {
+            break;
+        }
+        if (child + 1 < *size &&
+            live[heap[child + 1]].end < live[heap[child]].end) {
+            child++;
+        }
+        if (live[heap[child]].end >= live[moved].end) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = moved;
+    return top;
+}
+
+// With every register taken at the start of `value`, takes one held by a
+// single group that stays live longer, spilling the group that stays live
+// longest; otherwise `value` goes to the stack
+static void spill_at(CodeGen* gen, int32_t* active, int32_t* active_count,
+                     IrValue value) {
+    int32_t holder[REGISTER_COUNT];
+    int32_t holders[REGISTER_COUNT] = {0};
+    for (int32_t i = 0; i < *active_count; i++) {
+        if (interferes(gen, active[i], value)) {
+            int32_t reg = gen->home[active[i]];
+            holder[reg] = i;
+            holders[reg]++;
+        }
+    }
+
+    int32_t victim = -1;
+    for (int32_t reg = 0; reg < REGISTER_COUNT; reg++) {
+        if (holders[reg] != 1) {
+            continue;
+        }
+        int32_t end = gen->live[active[holder[reg]]].end;
+        if (end > gen->live[value].end &&
+            (victim < 0 || end > gen->live[active[victim]].end)) {
+            victim = holder[reg];
+        }
+    }
+    if (victim < 0) {
+        gen->home[value] = SPILLED;
+        return;
+    }
+    gen->home[value] = gen->home[active[victim]];
+    gen->home[active[victim]] = SPILLED;
+    active[victim] = value;
+}
+
+// Linear scan over the groups by start (Poletto and Sarkar), with live
+// ranges in place of single intervals: a register is free for a group if
+// no group holding it is live at the same time, so values can fill one
+// another's holes. Groups that do not fit get stack slots in a second
+// scan, which reuses the slot of any spilled group that ended before; ends
+// wait in a min-heap.
+static bool allocate_homes(CodeGen* gen) {
+    const IrFunction* ir = gen->ir;
+    int32_t positions = gen->order_count > 0
+                            ? gen->block_end[gen->order[gen->order_count - 1]]
+                            : 0;
+    int32_t* bucket = calloc((size_t)positions + 2, sizeof(int32_t));
+    int32_t* sorted = malloc(sizeof(int32_t) * (ir->count + 1));
+    int32_t* active = malloc(sizeof(int32_t) * (ir->count + 1));
+    int32_t* heap = malloc(sizeof(int32_t) * (ir->count + 1));
+    int32_t* free_slots = malloc(sizeof(int32_t) * (ir->count + 1));
+    if (!bucket || !sorted || !active || !heap || !free_slots) {
+        free(bucket);
+        free(sorted);
+        free(active);
+        free(heap);
+        free(free_slots);
+        return false;
+    }
+
+    int32_t groups = 0;
+    for (uint32_t v = 0; v < ir->count; v++) {
+        const IrInstr* instr = &ir->instrs[v];
+        if (has_result((IrOp)instr->op) && instr->block >= 0 &&
+            gen->layout[instr->block] >= 0 && gen->group[v] == (int32_t)v) {
+            bucket[gen->live[v].start + 1]++;
+            groups++;
+        }
+    }
+    for (int32_t p = 0; p <= positions; p++) {
+        bucket[p + 1] += bucket[p];
+    }
+    for (uint32_t v = 0; v < ir->count; v++) {
+        const IrInstr* instr = &ir->instrs[v];
+        if (has_result((IrOp)instr->op) && instr->block >= 0 &&
+            gen->layout[instr->block] >= 0 && gen->group[v] == (int32_t)v) {
+            sorted[bucket[gen->live[v].start]++] = (int32_t)v;
+        }
+    }
+
+    int32_t active_count = 0;
+    for (int32_t g = 0; g < groups; g++) {
+        int32_t value = sorted[g];
+        unsigned taken = 0;
+        for (int32_t i = 0; i < active_count;) {
+            if (gen->live[active[i]].end < gen->live[value].start) {
+                active[i] = active[--active_count];
+                continue;
+            }
+            if (interferes(gen, active[i], value)) {
+                taken |= 1u << gen->home[active[i]];
+            }
+            i++;
+        }
+
+        int32_t reg = 0;
+        while (reg < REGISTER_COUNT && (taken & (1u << reg))) {
+            reg++;
+        }
+        if (reg == REGISTER_COUNT) {
+            spill_at(gen, active, &active_count, value);
+        } else {
+            gen->home[value] = reg;
+            active[active_count++] = value;
+        }
+    }
+
+    int32_t slots = 0;
+    int32_t heap_size = 0;
+    int32_t free_count = 0;
+    for (int32_t g = 0; g < groups; g++) {
+        int32_t value = sorted[g];
+        if (gen->home[value] != SPILLED) {
+            continue;
+        }
+        while (heap_size > 0 &&
+               gen->live[heap[0]].end < gen->live[value].start) {
+            int32_t ended = heap_pop(gen->live, heap, &heap_size);
+            free_slots[free_count++] = gen->home[ended];
+        }
+        gen->home[value] = free_count > 0 ? free_slots[--free_count]
+                                          : REGISTER_COUNT + slots++;
+        heap_push(gen->live, heap, &heap_size, value);
+    }
+    gen->frame_size = slots;
+
+    free(bucket);
+    free(sorted);
+    free(active);
+    free(heap);
+    free(free_slots);
+    return true;
+}
+
+// Emission
+
+static Operand value_operand(CodeGen* gen, IrValue value) {
+    int32_t constant;
+    if (ir_is_const(gen->ir, value, &constant)) {
+        return imm_operand(constant);
+    }
+    int32_t home = gen->home[find_group(gen, value)];
+    if (home < REGISTER_COUNT) {
+        return reg_operand(REGISTERS[home]);
+    }
+    return memory_operand(R_BP, -(home - REGISTER_COUNT + 1));
+}
+
+// Copies into the phis of a successor, leaving out those already in place
+static int32_t edge_copies(CodeGen* gen, int32_t block, int succ) {
+    const IrFunction* ir = gen->ir;
+    int32_t target = ir->blocks[block].succs[succ];
+    int32_t index = pred_index(ir, block, succ);
+    const IrBlock* b = &ir->blocks[target];
+    int32_t count = 0;
+    for (uint32_t i = b->first; i < b->end; i++) {
+        const IrInstr* instr = &ir->instrs[i];
+        if (instr->block != target || instr->op != IR_PHI) {
+            continue;
+        }
+        Copy copy = {value_operand(gen, (IrValue)i),
+                     value_operand(gen, ir_phi_args(ir, instr)[index])};
+        if (!same_operand(&copy.dest, &copy.source)) {
+            gen->copies[count++] = copy;
+        }
+    }
+    return count;
+}
+
+// The copies happen all at once, as phis do: no copy may overwrite a
+// location another still has to read. Cycles are broken through AX.
+static void emit_copies(CodeGen* gen, int32_t count) {
+    Copy* copies = gen->copies;
+    while (count > 0) {
+        int32_t ready = -1;
+        for (int32_t i = 0; i < count && ready < 0; i++) {
+            ready = i;
+            for (int32_t j = 0; j < count; j++) {
+                if (j != i &&
+                    same_operand(&copies[j].source, &copies[i].dest)) {
+                    ready = -1;
+                    break;
+                }
+            }
+        }
+
+        if (ready < 0) {
+            Operand saved = copies[0].dest;
+            emit2(gen, OP_MOV, reg_operand(R_AX), saved);
+            for (int32_t j = 0; j < count; j++) {
+                if (same_operand(&copies[j].source, &saved)) {
+                    copies[j].source = reg_operand(R_AX);
+                }
+            }
+            continue;
+        }
+
+        emit2(gen, OP_MOV, copies[ready].dest, copies[ready].source);
+        copies[ready] = copies[--count];
+    }
+}
+
+// Follows the edge to a successor in line: its copies, then a jump unless
+// the successor is laid out next
+static void emit_edge(CodeGen* gen, int32_t block, int succ, int32_t next) {
+    int32_t target = gen->ir->blocks[block].succs[succ];
+    emit_copies(gen, edge_copies(gen, block, succ));
+    if (target != next) {
+        emit1(gen, OP_JMP, label_operand(gen->block_label[target]));
+    }
+}
+
+// Label for jumping along an edge: the successor itself, or a stub that
+// makes the edge's copies first
+static int edge_label(CodeGen* gen, int32_t block, int succ) {
+    if (edge_copies(gen, block, succ) == 0) {
+        return gen->block_label[gen->ir->blocks[block].succs[succ]];
+    }
+    Stub* stub = &gen->stubs[gen->stub_count++];
+    stub->label = make_label(gen);
+    stub->block = block;
+    stub->succ = succ;
+    return stub->label;
+}
+
+// Jumps on one edge and falls into the other, picking the way round that
+// needs fewer instructions
+static void emit_branch(CodeGen* gen, int32_t block, const IrInstr* instr,
+                        int32_t next) {
+    const IrBlock* b = &gen->ir->blocks[block];
+    int32_t cost[2];
+    for (int succ = 0; succ < 2; succ++) {
+        int32_t taken = edge_copies(gen, block, succ);
+        int32_t other = edge_copies(gen, block, 1 - succ);
+        cost[succ] = (taken > 0 ? taken + 1 : 0) + other +
+                     (b->succs[1 - succ] == next ? 0 : 1);
+    }
+
+    int taken = cost[1] < cost[0] ? 1 : 0;
+    Condition cond = (Condition)instr->cond;
+    if (taken == 1) {
+        cond = ir_negate_condition(cond);
+    }
+    emit_cjmp(gen, cond, value_operand(gen, instr->args[0]),
+              value_operand(gen, instr->args[1]),
+              edge_label(gen, block, taken));
+    emit_edge(gen, block, 1 - taken, next);
+}
+
+// The branch ending `block` when `value`, the last instruction before it,
+// steps a counter held in a register down by one in place and the branch
+// tests the counter for zero. LOOP does both; unlike SUB it leaves the
+// flags alone, but no code generated here reads them.
+static const IrInstr* loop_branch(CodeGen* gen, int32_t block,
+                                  IrValue value) {
+    const IrFunction* ir = gen->ir;
+    const IrInstr* instr = &ir->instrs[value];
+    int32_t step;
+    if ((instr->op != IR_SUB && instr->op != IR_ADD) ||
+        !ir_is_const(ir, instr->args[1], &step) ||
+        step != (instr->op == IR_SUB ? 1 : -1)) {
+        return NULL;
+    }
+
+    uint32_t end = ir->blocks[block].end;
+    uint32_t i = (uint32_t)value + 1;
+    while (i < end && (ir->instrs[i].block != block ||
+                       !is_emitted((IrOp)ir->instrs[i].op))) {
+        i++;
+    }
+    const IrInstr* branch = &ir->instrs[i];
+    int32_t zero;
+    if (i == end || branch->op != IR_BRANCH ||
+        (branch->cond != COND_NE && branch->cond != COND_EQ) ||
+        branch->args[0] != value ||
+        !ir_is_const(ir, branch->args[1], &zero) || zero != 0) {
+        return NULL;
+    }
+    Operand counter = value_operand(gen, value);
+    Operand operand = value_operand(gen, instr->args[0]);
+    return counter.type == OPERAND_REGISTER &&
+                   same_operand(&counter, &operand)
+               ? branch
+               : NULL;
+}
+
+// LOOP jumps along the edge taken while the counter is nonzero
+static void emit_loop(CodeGen* gen, int32_t block, IrValue counter,
+                      const IrInstr* branch, int32_t next) {
+    int nonzero = branch->cond == COND_NE ? 0 : 1;
+    emit2(gen, OP_LOOP, value_operand(gen, counter),
+          label_operand(edge_label(gen, block, nonzero)));
+    emit_edge(gen, block, 1 - nonzero, next);
+}
+
+// d = a op b, in place when d shares a location with an operand
+static void emit_arithmetic(CodeGen* gen, OpCode opcode, Operand dest,
+                            Operand a, Operand b) {
+    bool commutative = opcode == OP_ADD || opcode == OP_MUL;
+    if (same_operand(&dest, &a)) {
+        emit2(gen, opcode, dest, b);
+    } else if (commutative && same_operand(&dest, &b)) {
+        emit2(gen, opcode, dest, a);
+    } else if (same_operand(&dest, &b)) {
+        emit2(gen, OP_MOV, reg_operand(R_AX), a);
+        emit2(gen, opcode, reg_operand(R_AX), b);
+        emit2(gen, OP_MOV, dest, reg_operand(R_AX));
+    } else {
+        emit2(gen, OP_MOV, dest, a);
+        emit2(gen, opcode, dest, b);
+    }
+}
+
+// Puts the text in the data image, packed like .string, and prints it with
+// one OUT
+static void emit_write(CodeGen* gen, const IrInstr* instr) {
+    const IrFunction* ir = gen->ir;
+    int32_t offset = ir_instr(ir, instr->args[0])->value;
+    int32_t length = ir_instr(ir, instr->args[1])->value;
+    int address = add_data(gen->program, NULL, (length + 3) / 4);
+    if (address < 0) {
+        out_of_memory(gen);
+        return;
+    }
+    memcpy(&gen->program->data[address - (int)gen->program->data_base],
+           &ir->text[offset], (size_t)length);
+    emit2(gen, OP_MOV, reg_operand(R_AX), imm_operand(address * 4));
+    emit2(gen, OP_OUT, reg_operand(R_AX), imm_operand(length));
+}
+
+static void emit_instr(CodeGen* gen, IrValue value, int32_t next) {
+    static const OpCode OPCODES[IR_OP_COUNT] = {
+        [IR_ADD] = OP_ADD, [IR_SUB] = OP_SUB, [IR_MUL] = OP_MUL,
+        [IR_DIV] = OP_DIV, [IR_MOD] = OP_MOD, [IR_SHL] = OP_SHL,
+        [IR_POW] = OP_POW,
+    };
+    const IrInstr* instr = ir_instr(gen->ir, value);
+    Operand a = {0};
+    Operand b = {0};
+    if (instr->args[0] != IR_NONE) {
+        a = value_operand(gen, instr->args[0]);
+    }
+    if (instr->args[1] != IR_NONE) {
+        b = value_operand(gen, instr->args[1]);
+    }
+
+    switch ((IrOp)instr->op) {
+        case IR_COPY: {
+            Operand dest = value_operand(gen, value);
+            if (!same_operand(&dest, &a)) {
+                emit2(gen, OP_MOV, dest, a);
+            }
+            break;
+        }
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_SHL:
+        case IR_POW:
+            emit_arithmetic(gen, OPCODES[instr->op], value_operand(gen, value),
+                            a, b);
+            break;
+        case IR_CMP: {
+            Operand dest = value_operand(gen, value);
+            int done = make_label(gen);
+            emit2(gen, OP_MOV, dest, imm_operand(1));
+            emit_cjmp(gen, (Condition)instr->cond, a, b, done);
+            emit2(gen, OP_MOV, dest, imm_operand(0));
+            place(gen, done);
+            break;
+        }
+        case IR_OUTPUT:
+            if (a.type != OPERAND_REGISTER) {
+                emit2(gen, OP_MOV, reg_operand(R_AX), a);
+                a = reg_operand(R_AX);
+            }
+            emit1(gen, OP_PREG, a);
+            break;
+        case IR_WRITE:
+            emit_write(gen, instr);
+            break;
+        case IR_JUMP:
+            emit_edge(gen, instr->block, 0, next);
+            break;
+        case IR_BRANCH:
+            emit_branch(gen, instr->block, instr, next);
+            break;
+        case IR_HALT:
+            emit0(gen, OP_HALT);
+            break;
+        default:
+            break;
+    }
+}
+
+static void emit_function(CodeGen* gen) {
+    const IrFunction* ir = gen->ir;
+    if (gen->frame_size > 0) {
+        emit1(gen, OP_ENTER, imm_operand(gen->frame_size));
+    }
+    for (int32_t k = 0; k < gen->order_count; k++) {
+        gen->block_label[gen->order[k]] = make_label(gen);
+    }
+
+    for (int32_t k = 0; k < gen->order_count && !gen->failed; k++) {
+        int32_t b = gen->order[k];
+        int32_t next = k + 1 < gen->order_count ? gen->order[k + 1] : -1;
+        const IrBlock* block = &ir->blocks[b];
+        place(gen, gen->block_label[b]);
+        for (uint32_t i = block->first; i < block->end; i++) {
+            if (ir->instrs[i].block != b ||
+                !is_emitted((IrOp)ir->instrs[i].op)) {
+                continue;
+            }
+            const IrInstr* branch = loop_branch(gen, b, (IrValue)i);
+            if (branch) {
+                emit_loop(gen, b, (IrValue)i, branch, next);
+                break;
+            }
+            emit_instr(gen, (IrValue)i, next);
+        }
+    }
+
+    for (int32_t s = 0; s < gen->stub_count; s++) {
+        const Stub* stub = &gen->stubs[s];
+        place(gen, stub->label);
+        emit_edge(gen, stub->block, stub->succ, -1);
+    }
+}
+
+static void codegen_free(CodeGen* gen) {
+    free(gen->order);
+    free(gen->layout);
+    free(gen->block_start);
+    free(gen->block_end);
+    free(gen->block_label);
+    free(gen->def_position);
+    free(gen->use_position);
+    free(gen->ranges);
+    free(gen->range_first);
+    free(gen->range_size);
+    free(gen->live);
+    free(gen->group);
+    free(gen->home);
+    free(gen->copies);
+    free(gen->stubs);
+}
+
+Program* generate_program(const IrFunction* ir) {
+    CodeGen gen = {0};
+    gen.ir = ir;
+    gen.program = program_create();
+
+    size_t blocks = (size_t)ir->block_count + 1;
+    size_t values = (size_t)ir->count + 1;
+    gen.layout = malloc(sizeof(int32_t) * blocks);
+    gen.block_start = malloc(sizeof(int32_t) * blocks);
+    gen.block_end = malloc(sizeof(int32_t) * blocks);
+    gen.block_label = malloc(sizeof(int) * blocks);
+    gen.stubs = malloc(sizeof(Stub) * blocks * 2);
+    gen.def_position = malloc(sizeof(int32_t) * values);
+    gen.use_position = malloc(sizeof(int32_t) * values);
+    gen.range_first = malloc(sizeof(uint32_t) * values);
+    gen.range_size = malloc(sizeof(int32_t) * values);
+    gen.live = malloc(sizeof(Interval) * values);
+    gen.group = malloc(sizeof(int32_t) * values);
+    gen.home = malloc(sizeof(int32_t) * values);
+    if (!gen.program || !gen.layout || !gen.block_start || !gen.block_end ||
+        !gen.block_label || !gen.stubs || !gen.def_position ||
+        !gen.use_position || !gen.range_first || !gen.range_size ||
+        !gen.live || !gen.group || !gen.home || !lay_out(&gen) ||
+        !(gen.copies = malloc(sizeof(Copy) * ((size_t)gen.max_phis + 1))) ||
+        !compute_liveness(&gen)) {
+        out_of_memory(&gen);
+    } else {
+        coalesce_values(&gen);
+        if (!allocate_homes(&gen)) {
+            out_of_memory(&gen);
+        }
+    }
+
+    if (!gen.failed) {
+        emit_function(&gen);
+    }
+
+    codegen_free(&gen);
+    if (gen.failed || !program_finalize(gen.program)) {
+        program_destroy(gen.program);
+        return NULL;
+    }
+    return gen.program;
+}
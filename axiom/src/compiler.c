@@ -0,0 +1,74 @@
+#include "compiler.h"
+
+#include "ast.h"
+#include "codegen.h"
+#include "ir.h"
+#include "lexer.h"
+#include "lower.h"
+#include "optimizer.h"
+#include "parser.h"
+
+// Lowers a parsed program to SSA and optimizes it, then dumps the IR or
+// generates code
+static Program* compile_ast(const Ast* ast, CompileTarget target,
+                            unsigned passes, FILE* out, int* status) {
+    IrFunction ir;
+    ir_init(&ir);
+    Program* program = NULL;
+    if (lower_program(ast, &ir)) {
+        if (!ir_optimize(&ir, passes)) {
+            fprintf(stderr, "[AXIOM] Error: Out of memory optimizing!\n");
+        } else if (target == COMPILE_IR) {
+            ir_dump(&ir, out);
+            *status = 0;
+        } else {
+            program = generate_program(&ir);
+        }
+    }
+    ir_destroy(&ir);
+    return program;
+}
+
+Program* compile_source(const char* source, size_t length,
+                        CompileTarget target, unsigned passes, FILE* out,
+                        int* status) {
+    Program* program = NULL;
+    TokenList tokens;
+    Ast ast;
+    *status = 1;
+    if (lex_source(source, length, &tokens)) {
+        if (ast_init(&ast, &tokens, (uint32_t)tokens.count + 1)) {
+            if (parse_program(&tokens, &ast)) {
+                if (target == COMPILE_AST) {
+                    ast_dump(&ast, out);
+                    *status = 0;
+                } else {
+                    program = compile_ast(&ast, target, passes, out, status);
+                }
+            }
+            ast_destroy(&ast);
+        }
+        token_list_destroy(&tokens);
+    }
+    return program;
+}
+
+Program* compile_cached(ProgramCache* cache, const char* source,
+                        size_t length, unsigned passes, CacheEntry** entry,
+                        int* status) {
+    char tag[32];
+    snprintf(tag, sizeof(tag), "axiom %d %x", AXIOM_VERSION, passes);
+    *status = 1;
+    *entry = program_cache_get(cache, tag, source, length);
+    if (*entry) {
+        return (*entry)->program;
+    }
+
+    Program* program =
+        compile_source(source, length, COMPILE_PROGRAM, passes, NULL, status);
+    if (program && (*entry = program_cache_put(cache, tag, source, length,
+                                               program))) {
+        return (*entry)->program;
+    }
+    return program;
+}
@@ -0,0 +1,489 @@
+#include "evaluate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounds on the work done while compiling: instructions run, and bytes of
+// output kept in the program's data
+#define EVAL_FUEL (1 << 20)
+#define EVAL_MAX_TEXT (1 << 16)
+
+// An instruction as run. Phis are not steps but moves on the edges into
+// their block, and a missing operand reads a slot that is always 0.
+typedef struct {
+    uint8_t op;  // IrOp
+    uint8_t cond;
+    IrValue dest;
+    IrValue args[2];
+} Step;
+
+typedef struct {
+    IrValue phi;
+    IrValue value;
+} Move;
+
+// A point the program can go on from: entering `block` after writing
+// `text_length` bytes
+typedef struct {
+    int32_t block;  // -1 after a halt
+    uint32_t text_length;
+    int32_t* phis;  // Values of the block's phis, in order
+} Resume;
+
+typedef struct {
+    IrFunction* func;
+    uint32_t count;   // Instructions before any were added
+    int32_t* values;  // Of each instruction, the last time it ran
+    bool* enclosed;   // In a loop, and not the header of an outermost one
+
+    Step* steps;
+    uint32_t* first_step;  // Per block, and one past the last
+    Move* moves;
+    uint32_t* first_move;  // Per edge, numbered block * 2 + succ
+    int32_t* phis;         // Values of the moves on an edge, in order
+    uint32_t max_phis;
+
+    char* text;
+    uint32_t text_length;
+    Resume resume;
+} Evaluator;
+
+static void evaluator_free(Evaluator* e) {
+    free(e->values);
+    free(e->enclosed);
+    free(e->steps);
+    free(e->first_step);
+    free(e->moves);
+    free(e->first_move);
+    free(e->phis);
+    free(e->text);
+    free(e->resume.phis);
+}
+
+// A block is enclosed if it lies in the natural loop of another block: one
+// that reaches a back edge into that header without passing through it
+static bool find_enclosed(Evaluator* e) {
+    const IrFunction* func = e->func;
+    IrDominators dom;
+    if (!ir_dominators(func, &dom)) {
+        return false;
+    }
+
+    size_t blocks = (size_t)func->block_count + 1;
+    int32_t* stamp = calloc(blocks, sizeof(int32_t));
+    int32_t* stack = malloc(sizeof(int32_t) * blocks);
+    bool ok = stamp && stack;
+    int32_t mark = 0;
+    for (int32_t b = 0; ok && b < func->block_count; b++) {
+        const IrBlock* block = &func->blocks[b];
+        if (dom.rpo_index[b] < 0) {
+            continue;
+        }
+        for (int32_t s = 0; s < block->succ_count; s++) {
+            int32_t header = block->succs[s];
+            if (!ir_dominates(&dom, header, b)) {
+                continue;
+            }
+
+            int32_t depth = 0;
+            stamp[header] = ++mark;
+            if (b != header) {
+                stamp[b] = mark;
+                stack[depth++] = b;
+            }
+            while (depth > 0) {
+                int32_t inside = stack[--depth];
+                const IrBlock* body = &func->blocks[inside];
+                e->enclosed[inside] = true;
+                for (int32_t p = 0; p < body->pred_count; p++) {
+                    int32_t pred = body->preds[p];
+                    if (dom.rpo_index[pred] >= 0 && stamp[pred] != mark) {
+                        stamp[pred] = mark;
+                        stack[depth++] = pred;
+                    }
+                }
+            }
+        }
+    }
+
+    free(stamp);
+    free(stack);
+    ir_dominators_free(&dom);
+    return ok;
+}
+
+// Index in the successor's preds of the edge from `block` to its succ-th
+// successor; a branch with both targets the same uses the last for succ 1
+static int32_t pred_index(const IrFunction* func, int32_t block, int succ) {
+    const IrBlock* b = &func->blocks[block];
+    const IrBlock* target = &func->blocks[b->succs[succ]];
+    bool last = succ == 1 && b->succs[0] == b->succs[1];
+    int32_t found = -1;
+    for (int32_t i = 0; i < target->pred_count; i++) {
+        if (target->preds[i] == block) {
+            found = i;
+            if (!last) {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static bool write_text(Evaluator* e, const char* text, uint32_t length) {
+    if (length > EVAL_MAX_TEXT - e->text_length) {
+        return false;
+    }
+    memcpy(&e->text[e->text_length], text, length);
+    e->text_length += length;
+    return true;
+}
+
+// Lays the live blocks out as steps, and the phis as moves per edge
+static bool decode(Evaluator* e) {
+    const IrFunction* func = e->func;
+    size_t blocks = (size_t)func->block_count;
+    e->steps = malloc(sizeof(Step) * ((size_t)func->count + 1));
+    e->first_step = malloc(sizeof(uint32_t) * (blocks + 1));
+    e->moves = malloc(sizeof(Move) * ((size_t)func->phi_arg_count + 1));
+    e->first_move = malloc(sizeof(uint32_t) * (blocks * 2 + 1));
+    if (!e->steps || !e->first_step || !e->moves || !e->first_move) {
+        return false;
+    }
+
+    uint32_t steps = 0;
+    uint32_t moves = 0;
+    for (int32_t b = 0; b < func->block_count; b++) {
+        const IrBlock* block = &func->blocks[b];
+        e->first_step[b] = steps;
+        for (uint32_t i = block->first; !block->dead && i < block->end; i++) {
+            const IrInstr* instr = &func->instrs[i];
+            if (instr->block != b || instr->op == IR_NOP ||
+                instr->op == IR_CONST || instr->op == IR_PHI) {
+                continue;
+            }
+            Step* step = &e->steps[steps++];
+            step->op = instr->op;
+            step->cond = instr->cond;
+            step->dest = (IrValue)i;
+            for (int j = 0; j < 2; j++) {
+                step->args[j] = instr->args[j] != IR_NONE ? instr->args[j]
+                                                          : (IrValue)e->count;
+            }
+        }
+
+        for (int s = 0; s < 2; s++) {
+            e->first_move[b * 2 + s] = moves;
+            if (block->dead || s >= block->succ_count) {
+                continue;
+            }
+            int32_t target = block->succs[s];
+            const IrBlock* succ = &func->blocks[target];
+            int32_t index = pred_index(func, b, s);
+            uint32_t first = moves;
+            for (uint32_t i = succ->first; i < succ->end; i++) {
+                const IrInstr* instr = &func->instrs[i];
+                if (instr->block == target && instr->op == IR_PHI) {
+                    e->moves[moves++] =
+                        (Move){(IrValue)i, ir_phi_args(func, instr)[index]};
+                }
+            }
+            if (moves - first > e->max_phis) {
+                e->max_phis = moves - first;
+            }
+        }
+    }
+    e->first_step[blocks] = steps;
+    e->first_move[blocks * 2] = moves;
+    return true;
+}
+
+// Runs from the entry until the program halts, or would trap, run out of
+// fuel or write too much, noting each point it could go on from
+static void run(Evaluator* e) {
+    int32_t* values = e->values;
+    uint32_t fuel = EVAL_FUEL;
+    int32_t block = 0;
+    uint32_t phi_count = 0;
+
+    for (;;) {
+        if (!e->enclosed[block]) {
+            e->resume.block = block;
+            e->resume.text_length = e->text_length;
+            memcpy(e->resume.phis, e->phis, sizeof(int32_t) * phi_count);
+        }
+
+        int succ = -1;
+        const Step* end = &e->steps[e->first_step[block + 1]];
+        for (const Step* step = &e->steps[e->first_step[block]]; step < end;
+             step++) {
+            if (fuel-- == 0) {
+                return;
+            }
+
+            int32_t x = values[step->args[0]];
+            int32_t y = values[step->args[1]];
+            switch ((IrOp)step->op) {
+                case IR_COPY:
+                    values[step->dest] = x;
+                    break;
+                // The commonest ops, without going through ir_evaluate
+                case IR_ADD:
+                    values[step->dest] = (int32_t)((uint32_t)x + (uint32_t)y);
+                    break;
+                case IR_SUB:
+                    values[step->dest] = (int32_t)((uint32_t)x - (uint32_t)y);
+                    break;
+                case IR_CMP:
+                    values[step->dest] =
+                        ir_compare((Condition)step->cond, x, y);
+                    break;
+                case IR_OUTPUT: {
+                    char digits[16];
+                    int length = snprintf(digits, sizeof(digits), "%d\n", x);
+                    if (!write_text(e, digits, (uint32_t)length)) {
+                        return;
+                    }
+                    break;
+                }
+                case IR_WRITE:
+                    if (!write_text(e, &e->func->text[x], (uint32_t)y)) {
+                        return;
+                    }
+                    break;
+                case IR_JUMP:
+                    succ = 0;
+                    break;
+                case IR_BRANCH:
+                    succ = ir_compare((Condition)step->cond, x, y) ? 0 : 1;
+                    break;
+                case IR_HALT:
+                    e->resume.block = -1;
+                    e->resume.text_length = e->text_length;
+                    return;
+                default:
+                    // A division by zero is left for the VM to trap on
+                    if (!ir_evaluate((IrOp)step->op, x, y,
+                                     &values[step->dest])) {
+                        return;
+                    }
+                    break;
+            }
+        }
+        if (succ < 0) {
+            return;
+        }
+
+        // Phis read their operands before any of them is set
+        uint32_t first = e->first_move[block * 2 + succ];
+        const Move* moves = &e->moves[first];
+        phi_count = e->first_move[block * 2 + succ + 1] - first;
+        for (uint32_t k = 0; k < phi_count; k++) {
+            e->phis[k] = values[moves[k].value];
+        }
+        for (uint32_t k = 0; k < phi_count; k++) {
+            values[moves[k].phi] = e->phis[k];
+        }
+        block = e->func->blocks[block].succs[succ];
+    }
+}
+
+// The operand to use for `value` from the resume point on: the value
+// itself if its block can still run, otherwise a constant of what it was
+// when it last did. IR_NONE when out of memory.
+static IrValue resumed_value(Evaluator* e, const bool* reached,
+                             IrValue* constants, IrValue value) {
+    int32_t block = e->func->instrs[value].block;
+    if ((uint32_t)value >= e->count || block < 0 || reached[block]) {
+        return value;
+    }
+    if (constants[value] == IR_NONE) {
+        constants[value] = ir_add_const(e->func, e->values[value]);
+    }
+    return constants[value];
+}
+
+// Gives the blocks from the resume point on the values they use from
+// blocks before it as constants, as those blocks are about to go
+static bool resume_operands(Evaluator* e, const bool* reached) {
+    IrFunction* func = e->func;
+    IrValue* constants = malloc(sizeof(IrValue) * ((size_t)e->count + 1));
+    if (!constants) {
+        return false;
+    }
+    for (uint32_t i = 0; i < e->count; i++) {
+        constants[i] = IR_NONE;
+    }
+
+    bool ok = true;
+    for (int32_t b = 0; ok && b < func->block_count; b++) {
+        const IrBlock* block = &func->blocks[b];
+        if (!reached[b]) {
+            continue;
+        }
+        for (uint32_t i = block->first; ok && i < block->end; i++) {
+            IrInstr* instr = &func->instrs[i];
+            if (instr->block != b || instr->op == IR_NOP ||
+                instr->op == IR_CONST) {
+                continue;
+            }
+            if (instr->op == IR_PHI) {
+                IrValue* args = ir_phi_args(func, instr);
+                for (uint32_t j = 0; ok && j < instr->phi.count; j++) {
+                    if (reached[block->preds[j]]) {
+                        args[j] = resumed_value(e, reached, constants, args[j]);
+                        ok = args[j] != IR_NONE;
+                    }
+                }
+                continue;
+            }
+            for (int j = 0; ok && j < 2; j++) {
+                IrValue arg = func->instrs[i].args[j];
+                if (arg != IR_NONE) {
+                    arg = resumed_value(e, reached, constants, arg);
+                    func->instrs[i].args[j] = arg;
+                    ok = arg != IR_NONE;
+                }
+            }
+        }
+    }
+
+    free(constants);
+    return ok;
+}
+
+// Adds the entry's edge into the resume block, giving each phi the value
+// it had there
+static bool enter_resumed(Evaluator* e) {
+    IrFunction* func = e->func;
+    int32_t target = e->resume.block;
+    if (!ir_add_edge(func, 0, target)) {
+        return false;
+    }
+
+    const IrBlock* block = &func->blocks[target];
+    IrValue* args = malloc(sizeof(IrValue) * (size_t)block->pred_count);
+    bool ok = args != NULL;
+    uint32_t phi_count = 0;
+    for (uint32_t i = block->first; ok && i < block->end; i++) {
+        if (func->instrs[i].block != target || func->instrs[i].op != IR_PHI) {
+            continue;
+        }
+        IrValue constant = ir_add_const(func, e->resume.phis[phi_count++]);
+        const IrInstr* phi = &func->instrs[i];
+        ok = constant != IR_NONE;
+        if (ok) {
+            memcpy(args, ir_phi_args(func, phi),
+                   sizeof(IrValue) * phi->phi.count);
+            args[phi->phi.count] = constant;
+            ok = ir_set_phi_args(func, (IrValue)i, args, block->pred_count);
+        }
+    }
+    free(args);
+    return ok;
+}
+
+// Makes the entry write the output up to the resume point and go on from
+// there, or halt
+static bool resume_from_entry(Evaluator* e) {
+    IrFunction* func = e->func;
+    int32_t target = e->resume.block;
+    bool* reached = calloc((size_t)func->block_count + 1, sizeof(bool));
+    int32_t* stack = malloc(sizeof(int32_t) * ((size_t)func->block_count + 1));
+    bool ok = reached && stack;
+
+    int32_t depth = 0;
+    if (ok && target >= 0) {
+        reached[target] = true;
+        stack[depth++] = target;
+    }
+    while (depth > 0) {
+        const IrBlock* block = &func->blocks[stack[--depth]];
+        for (int32_t s = 0; s < block->succ_count; s++) {
+            if (!reached[block->succs[s]]) {
+                reached[block->succs[s]] = true;
+                stack[depth++] = block->succs[s];
+            }
+        }
+    }
+    ok = ok && resume_operands(e, reached);
+    free(reached);
+    free(stack);
+
+    // The entry has no predecessors, so nothing from the resume point on
+    // gets back to it and it can start over
+    IrBlock* entry = &func->blocks[0];
+    while (ok && entry->succ_count > 0) {
+        entry->succ_count--;
+        ir_remove_edge(func, 0, entry->succs[entry->succ_count], false);
+    }
+    for (uint32_t i = entry->first; ok && i < entry->end; i++) {
+        if (func->instrs[i].block == 0) {
+            func->instrs[i].op = IR_NOP;
+        }
+    }
+
+    uint32_t offset = 0;
+    IrValue start = IR_NONE;
+    IrValue length = IR_NONE;
+    if (ok && e->resume.text_length > 0) {
+        ok = ir_add_text(func, e->text, e->resume.text_length, &offset) &&
+             (start = ir_add_const(func, (int32_t)offset)) != IR_NONE &&
+             (length = ir_add_const(func, (int32_t)e->resume.text_length)) !=
+                 IR_NONE;
+    }
+    if (ok) {
+        entry->first = entry->end = func->count;
+    }
+    if (ok && start != IR_NONE) {
+        IrValue write = ir_add_instr(func, 0, IR_WRITE);
+        ok = write != IR_NONE;
+        if (ok) {
+            func->instrs[write].args[0] = start;
+            func->instrs[write].args[1] = length;
+        }
+    }
+    if (ok) {
+        ok = ir_add_instr(func, 0, target >= 0 ? IR_JUMP : IR_HALT) !=
+                 IR_NONE &&
+             (target < 0 || enter_resumed(e));
+    }
+    return ok && ir_remove_unreachable(func) && ir_compact(func);
+}
+
+int ir_evaluate_ahead(IrFunction* func) {
+    if (func->block_count == 0 || func->blocks[0].pred_count > 0) {
+        return 0;
+    }
+
+    Evaluator e = {.func = func, .count = func->count};
+    e.values = malloc(sizeof(int32_t) * ((size_t)func->count + 1));
+    e.enclosed = calloc((size_t)func->block_count + 1, sizeof(bool));
+    e.text = malloc(EVAL_MAX_TEXT);
+    bool ok = e.values && e.enclosed && e.text && find_enclosed(&e) &&
+              decode(&e);
+    if (ok) {
+        e.phis = malloc(sizeof(int32_t) * ((size_t)e.max_phis + 1));
+        e.resume.phis = malloc(sizeof(int32_t) * ((size_t)e.max_phis + 1));
+        ok = e.phis && e.resume.phis;
+    }
+    if (!ok) {
+        evaluator_free(&e);
+        return -1;
+    }
+
+    // The slot past the last instruction is read for missing operands
+    for (uint32_t i = 0; i <= func->count; i++) {
+        bool constant = i < func->count && func->instrs[i].op == IR_CONST;
+        e.values[i] = constant ? func->instrs[i].value : 0;
+    }
+    run(&e);
+
+    int result = 0;
+    if (e.resume.block != 0) {
+        result = resume_from_entry(&e) ? 1 : -1;
+    }
+    evaluator_free(&e);
+    return result;
+}
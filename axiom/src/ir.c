@@ -0,0 +1,753 @@
+#include "ir.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void ir_init(IrFunction* func) { memset(func, 0, sizeof(*func)); }
+
+void ir_destroy(IrFunction* func) {
+    if (!func) {
+        return;
+    }
+    for (int32_t b = 0; b < func->block_count; b++) {
+        free(func->blocks[b].preds);
+    }
+    free(func->blocks);
+    free(func->instrs);
+    free(func->phi_args);
+    free(func->inserts);
+    free(func->text);
+    memset(func, 0, sizeof(*func));
+}
+
+static IrValue append_instr(IrFunction* func, IrOp op, int32_t block) {
+    if (func->count == func->capacity) {
+        uint32_t capacity = func->capacity ? func->capacity * 2 : 256;
+        IrInstr* instrs = realloc(func->instrs, sizeof(IrInstr) * capacity);
+        if (!instrs) {
+            return IR_NONE;
+        }
+        func->instrs = instrs;
+        func->capacity = capacity;
+    }
+
+    IrValue value = (IrValue)func->count++;
+    IrInstr* instr = &func->instrs[value];
+    memset(instr, 0, sizeof(*instr));
+    instr->op = (uint8_t)op;
+    instr->block = block;
+    instr->args[0] = instr->args[1] = IR_NONE;
+    return value;
+}
+
+IrValue ir_add_instr(IrFunction* func, int32_t block, IrOp op) {
+    IrValue value = append_instr(func, op, block);
+    if (value != IR_NONE) {
+        IrBlock* b = &func->blocks[block];
+        if (b->first == b->end) {
+            b->first = (uint32_t)value;
+        }
+        b->end = (uint32_t)value + 1;
+    }
+    return value;
+}
+
+IrValue ir_add_const(IrFunction* func, int32_t value) {
+    IrValue constant = append_instr(func, IR_CONST, -1);
+    if (constant != IR_NONE) {
+        func->instrs[constant].value = value;
+    }
+    return constant;
+}
+
+int32_t ir_add_block(IrFunction* func) {
+    if (func->block_count == func->block_capacity) {
+        int32_t capacity = func->block_capacity ? func->block_capacity * 2 : 64;
+        IrBlock* blocks =
+            realloc(func->blocks, sizeof(IrBlock) * (size_t)capacity);
+        if (!blocks) {
+            return -1;
+        }
+        func->blocks = blocks;
+        func->block_capacity = capacity;
+    }
+
+    int32_t block = func->block_count++;
+    memset(&func->blocks[block], 0, sizeof(IrBlock));
+    return block;
+}
+
+static bool add_pred(IrBlock* target, int32_t from) {
+    if (target->pred_count == target->pred_capacity) {
+        int32_t capacity = target->pred_capacity ? target->pred_capacity * 2
+                                                 : 2;
+        int32_t* preds =
+            realloc(target->preds, sizeof(int32_t) * (size_t)capacity);
+        if (!preds) {
+            return false;
+        }
+        target->preds = preds;
+        target->pred_capacity = capacity;
+    }
+    target->preds[target->pred_count++] = from;
+    return true;
+}
+
+bool ir_add_edge(IrFunction* func, int32_t from, int32_t to) {
+    IrBlock* source = &func->blocks[from];
+    if (!add_pred(&func->blocks[to], from)) {
+        return false;
+    }
+    source->succs[source->succ_count++] = to;
+    return true;
+}
+
+bool ir_set_preds(IrFunction* func, int32_t block, const int32_t* preds,
+                  int32_t count) {
+    IrBlock* target = &func->blocks[block];
+    target->pred_count = 0;
+    for (int32_t i = 0; i < count; i++) {
+        if (!add_pred(target, preds[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ir_set_phi_args(IrFunction* func, IrValue phi, const IrValue* values,
+                     int32_t count) {
+    if (func->phi_arg_count + (uint32_t)count > func->phi_arg_capacity) {
+        uint32_t capacity =
+            func->phi_arg_capacity ? func->phi_arg_capacity : 256;
+        while (capacity < func->phi_arg_count + (uint32_t)count) {
+            capacity *= 2;
+        }
+        IrValue* args = realloc(func->phi_args, sizeof(IrValue) * capacity);
+        if (!args) {
+            return false;
+        }
+        func->phi_args = args;
+        func->phi_arg_capacity = capacity;
+    }
+
+    IrInstr* instr = &func->instrs[phi];
+    instr->phi.first = func->phi_arg_count;
+    instr->phi.count = (uint32_t)count;
+    memcpy(&func->phi_args[func->phi_arg_count], values,
+           sizeof(IrValue) * (size_t)count);
+    func->phi_arg_count += (uint32_t)count;
+    return true;
+}
+
+static void remove_pred(IrFunction* func, int32_t block, int32_t index) {
+    IrBlock* b = &func->blocks[block];
+    for (uint32_t i = b->first; i < b->end; i++) {
+        IrInstr* instr = &func->instrs[i];
+        if (instr->op == IR_PHI && instr->block == block) {
+            IrValue* args = ir_phi_args(func, instr);
+            memmove(&args[index], &args[index + 1],
+                    sizeof(IrValue) * (instr->phi.count - (uint32_t)index - 1));
+            instr->phi.count--;
+        }
+    }
+    memmove(&b->preds[index], &b->preds[index + 1],
+            sizeof(int32_t) * (size_t)(b->pred_count - index - 1));
+    b->pred_count--;
+}
+
+void ir_remove_edge(IrFunction* func, int32_t from, int32_t to, bool last) {
+    const IrBlock* b = &func->blocks[to];
+    int32_t found = -1;
+    for (int32_t i = 0; i < b->pred_count; i++) {
+        if (b->preds[i] == from) {
+            found = i;
+            if (!last) {
+                break;
+            }
+        }
+    }
+    if (found >= 0) {
+        remove_pred(func, to, found);
+    }
+}
+
+bool ir_remove_unreachable(IrFunction* func) {
+    bool* reached = calloc((size_t)func->block_count + 1, sizeof(bool));
+    int32_t* stack = malloc(sizeof(int32_t) * ((size_t)func->block_count + 1));
+    if (!reached || !stack) {
+        free(reached);
+        free(stack);
+        return false;
+    }
+
+    int32_t depth = 0;
+    stack[depth++] = 0;
+    reached[0] = true;
+    while (depth > 0) {
+        const IrBlock* b = &func->blocks[stack[--depth]];
+        for (int32_t s = 0; s < b->succ_count; s++) {
+            if (!reached[b->succs[s]]) {
+                reached[b->succs[s]] = true;
+                stack[depth++] = b->succs[s];
+            }
+        }
+    }
+
+    for (int32_t b = 0; b < func->block_count; b++) {
+        IrBlock* block = &func->blocks[b];
+        if (reached[b] || block->dead) {
+            continue;
+        }
+        for (int32_t s = 0; s < block->succ_count; s++) {
+            if (reached[block->succs[s]]) {
+                ir_remove_edge(func, b, block->succs[s], false);
+            }
+        }
+        for (uint32_t i = block->first; i < block->end; i++) {
+            if (func->instrs[i].block == b) {
+                func->instrs[i].op = IR_NOP;
+            }
+        }
+        block->succ_count = 0;
+        block->dead = true;
+    }
+
+    free(reached);
+    free(stack);
+    return true;
+}
+
+bool ir_add_text(IrFunction* func, const char* text, uint32_t length,
+                 uint32_t* offset) {
+    if (func->text_length + length > func->text_capacity) {
+        uint32_t capacity = func->text_capacity ? func->text_capacity : 256;
+        while (capacity < func->text_length + length) {
+            capacity *= 2;
+        }
+        char* grown = realloc(func->text, capacity);
+        if (!grown) {
+            return false;
+        }
+        func->text = grown;
+        func->text_capacity = capacity;
+    }
+
+    memcpy(&func->text[func->text_length], text, length);
+    *offset = func->text_length;
+    func->text_length += length;
+    return true;
+}
+
+IrValue ir_insert_before(IrFunction* func, IrValue before, IrOp op) {
+    if (func->insert_count == func->insert_capacity) {
+        uint32_t capacity =
+            func->insert_capacity ? func->insert_capacity * 2 : 16;
+        IrInsert* inserts =
+            realloc(func->inserts, sizeof(IrInsert) * capacity);
+        if (!inserts) {
+            return IR_NONE;
+        }
+        func->inserts = inserts;
+        func->insert_capacity = capacity;
+    }
+
+    IrValue value = append_instr(func, op, func->instrs[before].block);
+    if (value != IR_NONE) {
+        func->inserts[func->insert_count++] = (IrInsert){value, before};
+    }
+    return value;
+}
+
+// Instructions waiting to go ahead of each one, as linked lists in the
+// order they were inserted
+typedef struct {
+    IrFunction* func;
+    IrInstr* instrs;  // The new array
+    IrValue* renumber;
+    int32_t* first_insert;
+    int32_t* next_insert;
+    uint32_t count;
+} Compaction;
+
+static void place(Compaction* c, IrValue value) {
+    for (int32_t k = c->first_insert[value]; k >= 0; k = c->next_insert[k]) {
+        place(c, c->func->inserts[k].value);
+    }
+    if (c->func->instrs[value].op != IR_NOP) {
+        c->renumber[value] = (IrValue)c->count;
+        c->instrs[c->count++] = c->func->instrs[value];
+    }
+}
+
+static void renumber_args(const Compaction* c, IrValue* args,
+                          uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (args[i] != IR_NONE) {
+            args[i] = c->renumber[args[i]];
+        }
+    }
+}
+
+bool ir_compact(IrFunction* func) {
+    size_t count = (size_t)func->count + 1;
+    Compaction c = {
+        .func = func,
+        .instrs = malloc(sizeof(IrInstr) * count),
+        .renumber = malloc(sizeof(IrValue) * count),
+        .first_insert = malloc(sizeof(int32_t) * count),
+        .next_insert =
+            malloc(sizeof(int32_t) * ((size_t)func->insert_count + 1)),
+    };
+    int32_t* last_insert = malloc(sizeof(int32_t) * count);
+    if (!c.instrs || !c.renumber || !c.first_insert || !c.next_insert ||
+        !last_insert) {
+        free(c.instrs);
+        free(c.renumber);
+        free(c.first_insert);
+        free(c.next_insert);
+        free(last_insert);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < func->count; i++) {
+        c.renumber[i] = IR_NONE;
+        c.first_insert[i] = last_insert[i] = -1;
+    }
+    for (uint32_t k = 0; k < func->insert_count; k++) {
+        IrValue before = func->inserts[k].before;
+        c.next_insert[k] = -1;
+        if (last_insert[before] < 0) {
+            c.first_insert[before] = (int32_t)k;
+        } else {
+            c.next_insert[last_insert[before]] = (int32_t)k;
+        }
+        last_insert[before] = (int32_t)k;
+    }
+
+    for (int32_t b = 0; b < func->block_count; b++) {
+        IrBlock* block = &func->blocks[b];
+        uint32_t first = c.count;
+        if (!block->dead) {
+            for (uint32_t i = block->first; i < block->end; i++) {
+                if (func->instrs[i].block == b) {
+                    place(&c, (IrValue)i);
+                }
+            }
+        }
+        block->first = first;
+        block->end = c.count;
+    }
+    for (uint32_t i = 0; i < func->count; i++) {
+        if (func->instrs[i].op == IR_CONST && c.renumber[i] == IR_NONE) {
+            c.renumber[i] = (IrValue)c.count;
+            c.instrs[c.count++] = func->instrs[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < c.count; i++) {
+        IrInstr* instr = &c.instrs[i];
+        if (instr->op == IR_PHI) {
+            renumber_args(&c, ir_phi_args(func, instr), instr->phi.count);
+        } else if (instr->op != IR_CONST) {
+            renumber_args(&c, instr->args, 2);
+        }
+    }
+
+    free(func->instrs);
+    func->instrs = c.instrs;
+    func->count = c.count;
+    func->capacity = (uint32_t)count;
+    func->insert_count = 0;
+    free(c.renumber);
+    free(c.first_insert);
+    free(c.next_insert);
+    free(last_insert);
+    return true;
+}
+
+IrValue ir_resolve(const IrFunction* func, IrValue value) {
+    while (value != IR_NONE && func->instrs[value].op == IR_COPY) {
+        value = func->instrs[value].args[0];
+    }
+    return value;
+}
+
+Condition ir_negate_condition(Condition cond) {
+    static const Condition negated[COND_COUNT] = {
+        [COND_EQ] = COND_NE, [COND_NE] = COND_EQ, [COND_LT] = COND_GE,
+        [COND_LE] = COND_GT, [COND_GT] = COND_LE, [COND_GE] = COND_LT,
+    };
+    return negated[cond];
+}
+
+Condition ir_swap_condition(Condition cond) {
+    static const Condition swapped[COND_COUNT] = {
+        [COND_EQ] = COND_EQ, [COND_NE] = COND_NE, [COND_LT] = COND_GT,
+        [COND_LE] = COND_GE, [COND_GT] = COND_LT, [COND_GE] = COND_LE,
+    };
+    return swapped[cond];
+}
+
+bool ir_compare(Condition cond, int32_t a, int32_t b) {
+    switch (cond) {
+        case COND_EQ:
+            return a == b;
+        case COND_NE:
+            return a != b;
+        case COND_LT:
+            return a < b;
+        case COND_LE:
+            return a <= b;
+        case COND_GT:
+            return a > b;
+        case COND_GE:
+            return a >= b;
+        default:
+            return false;
+    }
+}
+
+// Square and multiply; negative exponents truncate like division, so only
+// bases 1 and -1 give a nonzero result
+static int32_t power(int32_t base, int32_t exponent) {
+    if (exponent < 0) {
+        if (base == 1) {
+            return 1;
+        }
+        if (base == -1) {
+            return (exponent & 1) ? -1 : 1;
+        }
+        return 0;
+    }
+
+    uint32_t result = 1;
+    uint32_t factor = (uint32_t)base;
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result *= factor;
+        }
+        factor *= factor;
+        exponent /= 2;
+    }
+    return (int32_t)result;
+}
+
+bool ir_evaluate(IrOp op, int32_t a, int32_t b, int32_t* result) {
+    switch (op) {
+        case IR_ADD:
+            *result = (int32_t)((uint32_t)a + (uint32_t)b);
+            return true;
+        case IR_SUB:
+            *result = (int32_t)((uint32_t)a - (uint32_t)b);
+            return true;
+        case IR_MUL:
+            *result = (int32_t)((uint32_t)a * (uint32_t)b);
+            return true;
+        case IR_DIV:
+        case IR_MOD:
+            if (b == 0) {
+                return false;
+            }
+            if (b == -1) {
+                *result = op == IR_DIV ? (int32_t)(0u - (uint32_t)a) : 0;
+            } else {
+                *result = op == IR_DIV ? a / b : a % b;
+            }
+            return true;
+        case IR_SHL:
+            *result = (int32_t)((uint32_t)a << (b & 31));
+            return true;
+        case IR_POW:
+            *result = power(a, b);
+            return true;
+        default:
+            return false;
+    }
+}
+
+int32_t ir_reverse_postorder(const IrFunction* func, int32_t** order) {
+    int32_t count = func->block_count;
+    int32_t* result = malloc(sizeof(int32_t) * (size_t)(count ? count : 1));
+    int32_t* stack = malloc(sizeof(int32_t) * (size_t)(count ? count : 1));
+    uint8_t* next_succ = calloc((size_t)(count ? count : 1), 1);
+    if (!result || !stack || !next_succ) {
+        free(result);
+        free(stack);
+        free(next_succ);
+        return -1;
+    }
+
+    // Blocks are numbered in postorder from the back of `result`; a block
+    // is finished once all of its successors have been visited
+    int32_t position = count;
+    int32_t depth = 0;
+    if (count > 0) {
+        stack[depth++] = 0;
+        next_succ[0] = 1;
+    }
+    while (depth > 0) {
+        int32_t block = stack[depth - 1];
+        const IrBlock* b = &func->blocks[block];
+        int32_t index = next_succ[block] - 1;
+        if (index < b->succ_count) {
+            next_succ[block]++;
+            int32_t succ = b->succs[index];
+            if (next_succ[succ] == 0) {
+                next_succ[succ] = 1;
+                stack[depth++] = succ;
+            }
+        } else {
+            result[--position] = block;
+            depth--;
+        }
+    }
+
+    int32_t reached = count - position;
+    memmove(result, result + position, sizeof(int32_t) * (size_t)reached);
+    free(stack);
+    free(next_succ);
+    *order = result;
+    return reached;
+}
+
+void ir_dominators_free(IrDominators* dom) {
+    free(dom->rpo_index);
+    free(dom->idom);
+    free(dom->preorder);
+    free(dom->last);
+    free(dom->visit);
+}
+
+static int32_t intersect(const IrDominators* dom, int32_t a, int32_t b) {
+    while (a != b) {
+        while (dom->rpo_index[a] > dom->rpo_index[b]) {
+            a = dom->idom[a];
+        }
+        while (dom->rpo_index[b] > dom->rpo_index[a]) {
+            b = dom->idom[b];
+        }
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm
+bool ir_dominators(const IrFunction* func, IrDominators* dom) {
+    size_t blocks = (size_t)func->block_count + 1;
+    int32_t* order = NULL;
+    memset(dom, 0, sizeof(*dom));
+    dom->count = ir_reverse_postorder(func, &order);
+    dom->rpo_index = malloc(sizeof(int32_t) * blocks);
+    dom->idom = malloc(sizeof(int32_t) * blocks);
+    dom->preorder = malloc(sizeof(int32_t) * blocks);
+    dom->last = malloc(sizeof(int32_t) * blocks);
+    dom->visit = malloc(sizeof(int32_t) * blocks);
+    int32_t* child_start = calloc(blocks + 1, sizeof(int32_t));
+    int32_t* children = malloc(sizeof(int32_t) * blocks);
+    int32_t* stack = malloc(sizeof(int32_t) * blocks);
+    if (dom->count < 0 || !dom->rpo_index || !dom->idom || !dom->preorder ||
+        !dom->last || !dom->visit || !child_start || !children || !stack) {
+        free(order);
+        free(child_start);
+        free(children);
+        free(stack);
+        ir_dominators_free(dom);
+        return false;
+    }
+
+    for (int32_t b = 0; b < func->block_count; b++) {
+        dom->rpo_index[b] = -1;
+        dom->idom[b] = -1;
+        dom->preorder[b] = -1;  // An empty subtree dominates nothing
+        dom->last[b] = -2;
+    }
+    for (int32_t i = 0; i < dom->count; i++) {
+        dom->rpo_index[order[i]] = i;
+    }
+    dom->idom[0] = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int32_t i = 1; i < dom->count; i++) {
+            const IrBlock* block = &func->blocks[order[i]];
+            int32_t idom = -1;
+            for (int32_t p = 0; p < block->pred_count; p++) {
+                int32_t pred = block->preds[p];
+                if (dom->idom[pred] < 0) {
+                    continue;
+                }
+                idom = idom < 0 ? pred : intersect(dom, pred, idom);
+            }
+            if (idom != dom->idom[order[i]]) {
+                dom->idom[order[i]] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    // Children lists, then an iterative preorder walk numbering subtrees
+    for (int32_t i = 1; i < dom->count; i++) {
+        child_start[dom->idom[order[i]] + 1]++;
+    }
+    for (int32_t b = 0; b < func->block_count; b++) {
+        child_start[b + 1] += child_start[b];
+    }
+    for (int32_t i = 1; i < dom->count; i++) {
+        children[child_start[dom->idom[order[i]]]++] = order[i];
+    }
+    for (int32_t b = func->block_count; b > 0; b--) {
+        child_start[b] = child_start[b - 1];
+    }
+    child_start[0] = 0;
+
+    int32_t visited = 0;
+    int32_t depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int32_t block = stack[--depth];
+        dom->preorder[block] = visited;
+        dom->visit[visited++] = block;
+        for (int32_t c = child_start[block + 1] - 1; c >= child_start[block];
+             c--) {
+            stack[depth++] = children[c];
+        }
+    }
+    // A subtree ends where the next block that is not inside it begins
+    for (int32_t i = dom->count - 1; i >= 0; i--) {
+        int32_t block = dom->visit[i];
+        dom->last[block] = i;
+    }
+    for (int32_t i = dom->count - 1; i > 0; i--) {
+        int32_t block = dom->visit[i];
+        int32_t parent = dom->idom[block];
+        if (dom->last[block] > dom->last[parent]) {
+            dom->last[parent] = dom->last[block];
+        }
+    }
+
+    free(order);
+    free(child_start);
+    free(children);
+    free(stack);
+    return true;
+}
+
+static const char* const OP_NAMES[IR_OP_COUNT] = {
+    [IR_NOP] = "nop",       [IR_CONST] = "const", [IR_COPY] = "copy",
+    [IR_PHI] = "phi",       [IR_ADD] = "add",     [IR_SUB] = "sub",
+    [IR_MUL] = "mul",       [IR_DIV] = "div",     [IR_MOD] = "mod",
+    [IR_SHL] = "shl",       [IR_POW] = "pow",     [IR_CMP] = "cmp",
+    [IR_OUTPUT] = "output", [IR_WRITE] = "write", [IR_JUMP] = "jump",
+    [IR_BRANCH] = "branch", [IR_HALT] = "halt",
+};
+
+static const char* const CONDITION_NAMES[COND_COUNT] = {
+    [COND_EQ] = "eq", [COND_NE] = "ne", [COND_LT] = "lt",
+    [COND_LE] = "le", [COND_GT] = "gt", [COND_GE] = "ge",
+};
+
+static void dump_value(const IrFunction* func, IrValue value, FILE* out) {
+    int32_t constant;
+    if (ir_is_const(func, value, &constant)) {
+        fprintf(out, "%d", constant);
+    } else {
+        fprintf(out, "v%d", value);
+    }
+}
+
+// The text of an IR_WRITE, which is all printed numbers and newlines
+static void dump_text(const IrFunction* func, const IrInstr* instr,
+                      FILE* out) {
+    int32_t offset = 0;
+    int32_t length = 0;
+    ir_is_const(func, instr->args[0], &offset);
+    ir_is_const(func, instr->args[1], &length);
+    fprintf(out, " \"");
+    for (int32_t i = 0; i < length; i++) {
+        char c = func->text[offset + i];
+        if (c == '\n') {
+            fprintf(out, "\\n");
+        } else {
+            fputc(c, out);
+        }
+    }
+    fprintf(out, "\"");
+}
+
+static void dump_instr(const IrFunction* func, IrValue value, FILE* out) {
+    const IrInstr* instr = &func->instrs[value];
+    const IrBlock* block = &func->blocks[instr->block];
+
+    fprintf(out, "    ");
+    switch ((IrOp)instr->op) {
+        case IR_OUTPUT:
+        case IR_WRITE:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_HALT:
+            fprintf(out, "%s", OP_NAMES[instr->op]);
+            break;
+        default:
+            fprintf(out, "v%d = %s", value, OP_NAMES[instr->op]);
+            break;
+    }
+    if (instr->op == IR_CMP || instr->op == IR_BRANCH) {
+        fprintf(out, " %s", CONDITION_NAMES[instr->cond]);
+    }
+
+    switch ((IrOp)instr->op) {
+        case IR_PHI:
+            for (uint32_t i = 0; i < instr->phi.count; i++) {
+                fprintf(out, "%s [", i ? "," : "");
+                dump_value(func, ir_phi_args(func, instr)[i], out);
+                fprintf(out, ", b%d]", block->preds[i]);
+            }
+            break;
+        case IR_COPY:
+        case IR_OUTPUT:
+            fprintf(out, " ");
+            dump_value(func, instr->args[0], out);
+            break;
+        case IR_WRITE:
+            dump_text(func, instr, out);
+            break;
+        case IR_JUMP:
+            fprintf(out, " b%d", block->succs[0]);
+            break;
+        case IR_HALT:
+            break;
+        case IR_BRANCH:
+        default:
+            fprintf(out, " ");
+            dump_value(func, instr->args[0], out);
+            fprintf(out, ", ");
+            dump_value(func, instr->args[1], out);
+            if (instr->op == IR_BRANCH) {
+                fprintf(out, ", b%d, b%d", block->succs[0], block->succs[1]);
+            }
+            break;
+    }
+    fprintf(out, "\n");
+}
+
+void ir_dump(const IrFunction* func, FILE* out) {
+    for (int32_t b = 0; b < func->block_count; b++) {
+        const IrBlock* block = &func->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+
+        fprintf(out, "b%d:", b);
+        for (int32_t i = 0; i < block->pred_count; i++) {
+            fprintf(out, "%s b%d", i ? "," : "  ; preds", block->preds[i]);
+        }
+        fprintf(out, "\n");
+
+        for (uint32_t i = block->first; i < block->end; i++) {
+            IrOp op = (IrOp)func->instrs[i].op;
+            if (op != IR_NOP && op != IR_CONST) {
+                dump_instr(func, (IrValue)i, out);
+            }
+        }
+    }
+}
@@ -4,13 +4,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-Lexer* init_lexer(char* source) {
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static bool is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+static bool is_identifier_start(char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 || c == '_';
+}
+
+static bool is_identifier_char(char c) {
+    return is_identifier_start(c) || is_digit(c);
+}
+
+static bool is_space(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+Lexer* init_lexer(const char* source) {
     Lexer* lexer = (Lexer*)malloc(sizeof(Lexer));
     if (!lexer) {
         fprintf(stderr, "Memory allocation failed\n");
         return NULL;
     }
     lexer->source = source;
+    lexer->length = (int)strlen(source);
     lexer->position = 0;
     lexer->line = 1;
     lexer->column = 1;
@@ -18,9 +37,9 @@ Lexer* init_lexer(char* source) {
     return lexer;
 }
 
-void advance(Lexer* lexer) {
+void lexer_advance(Lexer* lexer) {
     lexer->position++;
-    if (lexer->position >= (int)strlen(lexer->source))
+    if (lexer->position >= lexer->length)
         lexer->current_char = '\0';
     else {
         lexer->current_char = lexer->source[lexer->position];
@@ -32,72 +51,382 @@ void advance(Lexer* lexer) {
     }
 }
 
-char peek(Lexer* lexer) {
+char lexer_peek(Lexer* lexer) {
     int peek_pos = lexer->position + 1;
-    if (peek_pos >= (int)strlen(lexer->source)) return '\0';
+    if (peek_pos >= lexer->length) return '\0';
     return lexer->source[peek_pos];
 }
 
-void skip_whitespace(Lexer* lexer) {
+void lexer_skip_whitespace(Lexer* lexer) {
     while (lexer->current_char != '\0' && isspace(lexer->current_char))
-        advance(lexer);
+        lexer_advance(lexer);
 }
 
-void skip_comment(Lexer* lexer) {
+void lexer_skip_comment(Lexer* lexer) {
     if (lexer->current_char == '#') {
         while (lexer->current_char != '\0' && lexer->current_char != '\n')
-            advance(lexer);
+            lexer_advance(lexer);
         if (lexer->current_char == '\n') {
-            advance(lexer);
+            lexer_advance(lexer);
         }
     }
 }
 
-Token* number(Lexer* lexer) {
-    char* buffer = (char*)malloc(32 * sizeof(char));
-    int index = 0;
-    while (lexer->current_char != '\0' && isdigit(lexer->current_char)) {
-        buffer[index++] = lexer->current_char;
-        advance(lexer);
-    }
-    buffer[index] = '\0';
-
+// Copies the text from `start` to the current position into a new token
+static Token* make_token(Lexer* lexer, TokenType type, int start, int column) {
+    int length = lexer->position - start;
+    char* buffer = (char*)malloc((size_t)length + 1);
     Token* token = (Token*)malloc(sizeof(Token));
-    if (!token) {
+    if (!buffer || !token) {
         fprintf(stderr, "Memory allocation failed\n");
         free(buffer);
+        free(token);
         return NULL;
     }
+    memcpy(buffer, lexer->source + start, (size_t)length);
+    buffer[length] = '\0';
 
-    token->type = TOKEN_NUMBER;
+    token->type = type;
     token->value = buffer;
     token->line = lexer->line;
-    token->column = lexer->column - index;
-
+    token->column = column;
     return token;
 }
 
-Token* identifier(Lexer* lexer) {
-    char* buffer = (char*)malloc(32 * sizeof(char));
-    int index = 0;
+Token* lexer_number(Lexer* lexer) {
+    int start = lexer->position;
+    int column = lexer->column;
+    while (lexer->current_char != '\0' && is_digit(lexer->current_char)) {
+        lexer_advance(lexer);
+    }
+    return make_token(lexer, TOKEN_NUMBER, start, column);
+}
+
+Token* lexer_identifier(Lexer* lexer) {
+    int start = lexer->position;
+    int column = lexer->column;
     while (lexer->current_char != '\0' &&
-           (isalnum(lexer->current_char) || lexer->current_char == '_')) {
-        buffer[index++] = lexer->current_char;
-        advance(lexer);
+           is_identifier_char(lexer->current_char)) {
+        lexer_advance(lexer);
     }
-    buffer[index] = '\0';
+    return make_token(
+        lexer, keyword_type(lexer->source + start, lexer->position - start),
+        start, column);
+}
 
-    Token* token = (Token*)malloc(sizeof(Token));
-    if (!token) {
-        fprintf(stderr, "Memory allocation failed\n");
-        free(buffer);
-        return NULL;
+void token_destroy(Token* token) {
+    if (token) {
+        free(token->value);
+        free(token);
     }
+}
 
-    token->type = TOKEN_IDENTIFIER;
-    token->value = buffer;
-    token->line = lexer->line;
-    token->column = lexer->column - index;
+// The keywords all have different lengths, so the length is a perfect hash
+// and one comparison decides
+static const struct {
+    const char* text;
+    TokenType type;
+} KEYWORDS[] = {
+    [2] = {"if", TOKEN_IF},       [3] = {"var", TOKEN_VAR},
+    [4] = {"else", TOKEN_ELSE},   [5] = {"while", TOKEN_WHILE},
+    [6] = {"output", TOKEN_POUT},
+};
 
-    return token;
+TokenType keyword_type(const char* text, size_t length) {
+    if (length < sizeof(KEYWORDS) / sizeof(KEYWORDS[0]) &&
+        KEYWORDS[length].text &&
+        memcmp(text, KEYWORDS[length].text, length) == 0) {
+        return KEYWORDS[length].type;
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+const char* token_type_name(TokenType type) {
+    static const char* names[] = {
+        [TOKEN_IF] = "'if'",
+        [TOKEN_ELSE] = "'else'",
+        [TOKEN_WHILE] = "'while'",
+        [TOKEN_VAR] = "'var'",
+        [TOKEN_POUT] = "'output'",
+        [TOKEN_LPAREN] = "'('",
+        [TOKEN_RPAREN] = "')'",
+        [TOKEN_LBRACE] = "'{'",
+        [TOKEN_RBRACE] = "'}'",
+        [TOKEN_SEMICOLON] = "';'",
+        [TOKEN_PLUS] = "'+'",
+        [TOKEN_MINUS] = "'-'",
+        [TOKEN_MULTIPLY] = "'*'",
+        [TOKEN_DIVIDE] = "'/'",
+        [TOKEN_MODULUS] = "'%'",
+        [TOKEN_EXPONENT] = "'^'",
+        [TOKEN_NOT] = "'!'",
+        [TOKEN_AND] = "'&&'",
+        [TOKEN_OR] = "'||'",
+        [TOKEN_GREATER] = "'>'",
+        [TOKEN_LESS] = "'<'",
+        [TOKEN_GREATER_EQUAL] = "'>='",
+        [TOKEN_LESS_EQUAL] = "'<='",
+        [TOKEN_EQUAL] = "'=='",
+        [TOKEN_NOT_EQUAL] = "'!='",
+        [TOKEN_ASSIGN] = "'='",
+        [TOKEN_IDENTIFIER] = "identifier",
+        [TOKEN_NUMBER] = "number",
+        [TOKEN_EOF] = "end of input",
+    };
+    if ((int)type < 0 || type > TOKEN_EOF) {
+        return "???";
+    }
+    return names[type];
+}
+
+// Length of the run of identifier characters at the start of `text`. Runs
+// are scanned 16 bytes at a time where SSE2 is available.
+static size_t identifier_run(const char* text, size_t length) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i before_0 = _mm_set1_epi8('0' - 1);
+    const __m128i after_9 = _mm_set1_epi8('9' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i underscore = _mm_set1_epi8('_');
+    while (i + 16 <= length) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i folded = _mm_or_si128(c, case_bit);
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, before_a),
+                                      _mm_cmplt_epi8(folded, after_z));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, before_0),
+                                      _mm_cmplt_epi8(c, after_9));
+        __m128i ident = _mm_or_si128(_mm_or_si128(alpha, digit),
+                                     _mm_cmpeq_epi8(c, underscore));
+        unsigned mask = (unsigned)_mm_movemask_epi8(ident);
+        if (mask != 0xFFFF) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+        i += 16;
+    }
+#endif
+    while (i < length && is_identifier_char(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+// Skips the whitespace at `pos`, keeping the line count and the offset of
+// the current line's first byte up to date
+static size_t skip_space_run(const char* source, size_t length, size_t pos,
+                             uint32_t* line, size_t* line_start) {
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i before_tab = _mm_set1_epi8('\t' - 1);
+    const __m128i after_cr = _mm_set1_epi8('\r' + 1);
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (pos + 16 <= length) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(source + pos));
+        __m128i control = _mm_and_si128(_mm_cmpgt_epi8(c, before_tab),
+                                        _mm_cmplt_epi8(c, after_cr));
+        unsigned spaces = (unsigned)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(c, space), control));
+        unsigned newlines =
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(c, newline));
+
+        // Only the newlines before the first non-space count
+        unsigned run =
+            spaces == 0xFFFF ? 16 : (unsigned)__builtin_ctz(~spaces);
+        newlines &= (1u << run) - 1;
+        if (newlines) {
+            *line += (uint32_t)__builtin_popcount(newlines);
+            *line_start = pos + (size_t)(31 - __builtin_clz(newlines)) + 1;
+        }
+        pos += run;
+        if (run < 16) {
+            return pos;
+        }
+    }
+#endif
+    while (pos < length && is_space(source[pos])) {
+        if (source[pos] == '\n') {
+            (*line)++;
+            *line_start = pos + 1;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+// The operator or punctuation at `*pos`, advancing past it, or TOKEN_EOF if
+// there is none
+static TokenType operator_type(const char* source, size_t length,
+                               size_t* pos) {
+    char c = source[*pos];
+    char next = *pos + 1 < length ? source[*pos + 1] : '\0';
+    TokenType type;
+    size_t width = 1;
+
+    switch (c) {
+        case '(':
+            type = TOKEN_LPAREN;
+            break;
+        case ')':
+            type = TOKEN_RPAREN;
+            break;
+        case '{':
+            type = TOKEN_LBRACE;
+            break;
+        case '}':
+            type = TOKEN_RBRACE;
+            break;
+        case ';':
+            type = TOKEN_SEMICOLON;
+            break;
+        case '+':
+            type = TOKEN_PLUS;
+            break;
+        case '-':
+            type = TOKEN_MINUS;
+            break;
+        case '*':
+            type = TOKEN_MULTIPLY;
+            break;
+        case '/':
+            type = TOKEN_DIVIDE;
+            break;
+        case '%':
+            type = TOKEN_MODULUS;
+            break;
+        case '^':
+            type = TOKEN_EXPONENT;
+            break;
+        case '!':
+            type = next == '=' ? TOKEN_NOT_EQUAL : TOKEN_NOT;
+            break;
+        case '=':
+            type = next == '=' ? TOKEN_EQUAL : TOKEN_ASSIGN;
+            break;
+        case '>':
+            type = next == '=' ? TOKEN_GREATER_EQUAL : TOKEN_GREATER;
+            break;
+        case '<':
+            type = next == '=' ? TOKEN_LESS_EQUAL : TOKEN_LESS;
+            break;
+        case '&':
+            type = next == '&' ? TOKEN_AND : TOKEN_EOF;
+            break;
+        case '|':
+            type = next == '|' ? TOKEN_OR : TOKEN_EOF;
+            break;
+        default:
+            return TOKEN_EOF;
+    }
+
+    if (type == TOKEN_EOF) {
+        return type;
+    }
+    if (type == TOKEN_NOT_EQUAL || type == TOKEN_EQUAL ||
+        type == TOKEN_GREATER_EQUAL || type == TOKEN_LESS_EQUAL ||
+        type == TOKEN_AND || type == TOKEN_OR) {
+        width = 2;
+    }
+    *pos += width;
+    return type;
+}
+
+static bool push_token(TokenList* list, TokenType type, size_t start,
+                       size_t end, uint32_t line, size_t line_start) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity * 2;
+        TokenSpan* tokens =
+            realloc(list->tokens, capacity * sizeof(TokenSpan));
+        if (!tokens) {
+            fprintf(stderr, "[AXIOM] Error: Out of memory while lexing!\n");
+            return false;
+        }
+        list->tokens = tokens;
+        list->capacity = capacity;
+    }
+
+    TokenSpan* token = &list->tokens[list->count++];
+    token->type = type;
+    token->start = (uint32_t)start;
+    token->length = (uint32_t)(end - start);
+    token->line = line;
+    token->column = (uint32_t)(start - line_start + 1);
+    return true;
+}
+
+bool lex_source(const char* source, size_t length, TokenList* list) {
+    list->source = source;
+    list->source_length = length;
+    list->count = 0;
+    // Sources average several bytes per token; growing past this is rare
+    list->capacity = length / 4 + 16;
+    list->tokens = malloc(list->capacity * sizeof(TokenSpan));
+    if (!list->tokens) {
+        fprintf(stderr, "[AXIOM] Error: Out of memory while lexing!\n");
+        return false;
+    }
+    if (length >= UINT32_MAX) {
+        fprintf(stderr, "[AXIOM] Error: Source of %zu bytes is too large!\n",
+                length);
+        token_list_destroy(list);
+        return false;
+    }
+
+    uint32_t line = 1;
+    size_t line_start = 0;
+    size_t pos = 0;
+    while (true) {
+        pos = skip_space_run(source, length, pos, &line, &line_start);
+        if (pos >= length) {
+            break;
+        }
+
+        char c = source[pos];
+        if (c == '#') {
+            const char* end = memchr(source + pos, '\n', length - pos);
+            pos = end ? (size_t)(end - source) : length;
+            continue;
+        }
+
+        size_t start = pos;
+        TokenType type;
+        if (is_identifier_start(c)) {
+            pos += identifier_run(source + pos, length - pos);
+            type = keyword_type(source + start, pos - start);
+        } else if (is_digit(c)) {
+            while (pos < length && is_digit(source[pos])) {
+                pos++;
+            }
+            type = TOKEN_NUMBER;
+        } else {
+            type = operator_type(source, length, &pos);
+            if (type == TOKEN_EOF) {
+                fprintf(stderr,
+                        "[AXIOM] Error: Unexpected character '%c' at "
+                        "%u:%zu!\n",
+                        c, line, start - line_start + 1);
+                token_list_destroy(list);
+                return false;
+            }
+        }
+
+        if (!push_token(list, type, start, pos, line, line_start)) {
+            token_list_destroy(list);
+            return false;
+        }
+    }
+
+    if (!push_token(list, TOKEN_EOF, length, length, line, line_start)) {
+        token_list_destroy(list);
+        return false;
+    }
+    return true;
+}
+
+void token_list_destroy(TokenList* list) {
+    if (list) {
+        free(list->tokens);
+        list->tokens = NULL;
+        list->count = list->capacity = 0;
+    }
 }
@@ -0,0 +1,1116 @@
+#include "loops.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "optimizer.h"
+
+// Each reduced product keeps a variable of its own live across the loop,
+// and there are only five registers to go round
+#define MAX_REDUCED 2
+
+// Budgets, in ANVIL instructions, for the code an unrolled loop becomes
+#define FULL_UNROLL_COST 128
+#define PARTIAL_UNROLL_COST 64
+#define MAX_UNROLL_FACTOR 8
+
+// Roughly what codegen emits for each op: a two-address operation needs a
+// move into its destination and a comparison two moves around a CJMP
+static const uint8_t ANVIL_COST[IR_OP_COUNT] = {
+    [IR_COPY] = 1, [IR_PHI] = 1,  [IR_ADD] = 2,    [IR_SUB] = 2,
+    [IR_MUL] = 2,  [IR_DIV] = 2,  [IR_MOD] = 2,    [IR_SHL] = 2,
+    [IR_POW] = 2,  [IR_CMP] = 3,  [IR_OUTPUT] = 2, [IR_WRITE] = 2,
+    [IR_JUMP] = 1, [IR_BRANCH] = 1,
+};
+
+typedef struct {
+    int32_t header;
+    int32_t latch;   // The only block with a back edge, or -1
+    int32_t parent;  // Innermost loop around this one, or -1
+    bool innermost;
+    int32_t* blocks;  // In reverse postorder, so the header first, but for
+                      // preheaders added just ahead of inner loops' headers
+    int32_t size;
+    int32_t capacity;
+} Loop;
+
+typedef struct {
+    IrFunction* func;
+    Loop* loops;  // Innermost first
+    int32_t count;
+    int32_t capacity;
+    int32_t* stamp;  // The blocks of the current loop hold `mark`
+    int32_t stamp_size;
+    int32_t mark;
+} LoopNest;
+
+static void make_copy(IrInstr* instr, IrValue value) {
+    instr->op = IR_COPY;
+    instr->args[0] = value;
+    instr->args[1] = IR_NONE;
+}
+
+// Loop analysis
+
+static void nest_free(LoopNest* nest) {
+    for (int32_t l = 0; l < nest->count; l++) {
+        free(nest->loops[l].blocks);
+    }
+    free(nest->loops);
+    free(nest->stamp);
+}
+
+static bool insert_block(Loop* loop, int32_t at, int32_t block) {
+    if (loop->size == loop->capacity) {
+        int32_t capacity = loop->capacity ? loop->capacity * 2 : 8;
+        int32_t* blocks =
+            realloc(loop->blocks, sizeof(int32_t) * (size_t)capacity);
+        if (!blocks) {
+            return false;
+        }
+        loop->blocks = blocks;
+        loop->capacity = capacity;
+    }
+    memmove(&loop->blocks[at + 1], &loop->blocks[at],
+            sizeof(int32_t) * (size_t)(loop->size - at));
+    loop->blocks[at] = block;
+    loop->size++;
+    return true;
+}
+
+static Loop* add_loop(LoopNest* nest, int32_t header, int32_t latch) {
+    if (nest->count == nest->capacity) {
+        int32_t capacity = nest->capacity ? nest->capacity * 2 : 8;
+        Loop* loops = realloc(nest->loops, sizeof(Loop) * (size_t)capacity);
+        if (!loops) {
+            return NULL;
+        }
+        nest->loops = loops;
+        nest->capacity = capacity;
+    }
+    Loop* loop = &nest->loops[nest->count++];
+    memset(loop, 0, sizeof(*loop));
+    loop->header = header;
+    loop->latch = latch;
+    loop->parent = -1;
+    loop->innermost = true;
+    return loop;
+}
+
+static int compare_size(const void* a, const void* b) {
+    const Loop* x = a;
+    const Loop* y = b;
+    if (x->size != y->size) {
+        return x->size < y->size ? -1 : 1;
+    }
+    return (x->header > y->header) - (x->header < y->header);
+}
+
+// A loop is a header with the blocks that reach one of its back edges, the
+// edges into it from blocks it dominates, without passing through it
+static bool find_loops(IrFunction* func, LoopNest* nest) {
+    memset(nest, 0, sizeof(*nest));
+    nest->func = func;
+    IrDominators dom;
+    if (!ir_dominators(func, &dom)) {
+        return false;
+    }
+
+    size_t blocks = (size_t)func->block_count + 1;
+    int32_t* loop_of = malloc(sizeof(int32_t) * blocks);
+    int32_t* order = malloc(sizeof(int32_t) * blocks);
+    int32_t* stack = malloc(sizeof(int32_t) * blocks);
+    nest->stamp = calloc(blocks, sizeof(int32_t));
+    nest->stamp_size = func->block_count;
+    bool ok = loop_of && order && stack && nest->stamp;
+
+    for (int32_t b = 0; ok && b < func->block_count; b++) {
+        loop_of[b] = -1;
+        if (dom.rpo_index[b] >= 0) {
+            order[dom.rpo_index[b]] = b;
+        }
+    }
+    for (int32_t i = 0; ok && i < dom.count; i++) {
+        const IrBlock* block = &func->blocks[order[i]];
+        for (int32_t s = 0; ok && s < block->succ_count; s++) {
+            int32_t header = block->succs[s];
+            if (!ir_dominates(&dom, header, order[i])) {
+                continue;
+            }
+            if (loop_of[header] >= 0) {
+                Loop* loop = &nest->loops[loop_of[header]];
+                if (loop->latch != order[i]) {
+                    loop->latch = -1;
+                }
+                continue;
+            }
+            loop_of[header] = nest->count;
+            ok = add_loop(nest, header, order[i]) != NULL;
+        }
+    }
+
+    for (int32_t l = 0; ok && l < nest->count; l++) {
+        Loop* loop = &nest->loops[l];
+        const IrBlock* header = &func->blocks[loop->header];
+        int32_t mark = l + 1;
+        int32_t last = dom.rpo_index[loop->header];
+        int32_t depth = 0;
+        nest->stamp[loop->header] = mark;
+        for (int32_t p = 0; p < header->pred_count; p++) {
+            int32_t pred = header->preds[p];
+            if (ir_dominates(&dom, loop->header, pred) &&
+                nest->stamp[pred] != mark) {
+                nest->stamp[pred] = mark;
+                stack[depth++] = pred;
+            }
+        }
+        while (depth > 0) {
+            int32_t b = stack[--depth];
+            const IrBlock* block = &func->blocks[b];
+            if (dom.rpo_index[b] > last) {
+                last = dom.rpo_index[b];
+            }
+            for (int32_t p = 0; p < block->pred_count; p++) {
+                int32_t pred = block->preds[p];
+                if (dom.rpo_index[pred] >= 0 && nest->stamp[pred] != mark) {
+                    nest->stamp[pred] = mark;
+                    stack[depth++] = pred;
+                }
+            }
+        }
+        for (int32_t i = dom.rpo_index[loop->header]; ok && i <= last; i++) {
+            if (nest->stamp[order[i]] == mark) {
+                ok = insert_block(loop, loop->size, order[i]);
+            }
+        }
+    }
+
+    // A loop's blocks are a strict subset of those of any loop around it,
+    // so going from the largest down, the last loop to claim a header is
+    // the one just around it
+    if (ok && nest->count > 0) {
+        qsort(nest->loops, (size_t)nest->count, sizeof(Loop), compare_size);
+        for (int32_t b = 0; b < func->block_count; b++) {
+            loop_of[b] = -1;
+        }
+        for (int32_t l = nest->count - 1; l >= 0; l--) {
+            Loop* loop = &nest->loops[l];
+            loop->parent = loop_of[loop->header];
+            if (loop->parent >= 0) {
+                nest->loops[loop->parent].innermost = false;
+            }
+            for (int32_t i = 0; i < loop->size; i++) {
+                loop_of[loop->blocks[i]] = l;
+            }
+        }
+    }
+    nest->mark = nest->count;
+
+    free(loop_of);
+    free(order);
+    free(stack);
+    ir_dominators_free(&dom);
+    return ok;
+}
+
+// Makes `loop` the current one, for in_loop
+static bool enter_loop(LoopNest* nest, const Loop* loop) {
+    int32_t blocks = nest->func->block_count;
+    if (blocks > nest->stamp_size) {
+        int32_t* stamp =
+            realloc(nest->stamp, sizeof(int32_t) * (size_t)blocks);
+        if (!stamp) {
+            return false;
+        }
+        memset(&stamp[nest->stamp_size], 0,
+               sizeof(int32_t) * (size_t)(blocks - nest->stamp_size));
+        nest->stamp = stamp;
+        nest->stamp_size = blocks;
+    }
+    nest->mark++;
+    for (int32_t i = 0; i < loop->size; i++) {
+        nest->stamp[loop->blocks[i]] = nest->mark;
+    }
+    return true;
+}
+
+// Blocks made since entering the loop, such as its preheader, are outside
+static bool in_loop(const LoopNest* nest, int32_t block) {
+    return block >= 0 && block < nest->stamp_size &&
+           nest->stamp[block] == nest->mark;
+}
+
+// Index in the header's preds of the only edge into the current loop, or -1
+// if there is more than one
+static int32_t entry_index(const LoopNest* nest, const Loop* loop) {
+    const IrBlock* header = &nest->func->blocks[loop->header];
+    int32_t entry = -1;
+    for (int32_t p = 0; p < header->pred_count; p++) {
+        if (!in_loop(nest, header->preds[p])) {
+            if (entry >= 0) {
+                return -1;
+            }
+            entry = p;
+        }
+    }
+    return entry;
+}
+
+// Puts an empty block on the entry edge of a loop, which also joins every
+// loop around it. The caller fills it, ending with a jump.
+static int32_t add_preheader(LoopNest* nest, int32_t index, int32_t entry) {
+    IrFunction* func = nest->func;
+    const Loop* loop = &nest->loops[index];
+    int32_t header = loop->header;
+    int32_t outside = func->blocks[header].preds[entry];
+    int32_t block = ir_add_block(func);
+    if (block < 0) {
+        return -1;
+    }
+
+    bool ok = ir_set_preds(func, block, &outside, 1);
+    for (int32_t l = loop->parent; ok && l >= 0; l = nest->loops[l].parent) {
+        Loop* around = &nest->loops[l];
+        int32_t at = 0;
+        while (around->blocks[at] != header) {
+            at++;
+        }
+        ok = insert_block(around, at, block);
+    }
+    if (!ok) {
+        func->blocks[block].dead = true;
+        return -1;
+    }
+
+    IrBlock* source = &func->blocks[outside];
+    for (int32_t s = 0; s < source->succ_count; s++) {
+        if (source->succs[s] == header) {
+            source->succs[s] = block;
+            break;
+        }
+    }
+    func->blocks[header].preds[entry] = block;
+    func->blocks[block].succs[0] = header;
+    func->blocks[block].succ_count = 1;
+    return block;
+}
+
+// Induction variables
+//
+// A basic induction variable is a header phi that comes back around the
+// loop as itself plus or minus a constant. When one starts at a constant
+// and the latch tests it against another, the values it takes, and how
+// many times the loop runs, are known here.
+
+typedef struct {
+    IrValue phi;
+    IrValue next;   // phi + step, its operand from the latch
+    IrValue entry;  // Its operand from outside
+    int32_t step;
+} Induction;
+
+static bool basic_induction(const IrFunction* func, IrValue phi,
+                            int32_t entry, Induction* iv) {
+    const IrInstr* instr = ir_instr(func, phi);
+    if (instr->op != IR_PHI || instr->phi.count != 2) {
+        return false;
+    }
+    const IrValue* args = ir_phi_args(func, instr);
+    IrValue next = ir_resolve(func, args[1 - entry]);
+    const IrInstr* add = ir_instr(func, next);
+    if (add->op != IR_ADD && add->op != IR_SUB) {
+        return false;
+    }
+    IrValue x = ir_resolve(func, add->args[0]);
+    IrValue y = ir_resolve(func, add->args[1]);
+    if (x != phi && add->op == IR_ADD) {
+        IrValue swap = x;
+        x = y;
+        y = swap;
+    }
+    if (x != phi || !ir_is_const(func, y, &iv->step) || iv->step == 0 ||
+        iv->step == INT32_MIN) {
+        return false;
+    }
+    if (add->op == IR_SUB) {
+        iv->step = -iv->step;
+    }
+    iv->phi = phi;
+    iv->next = next;
+    iv->entry = ir_resolve(func, args[entry]);
+    return true;
+}
+
+// Whether `value` is a basic induction variable of the loop with the given
+// header, or that variable's next value
+static bool induction_of(const IrFunction* func, int32_t header,
+                         int32_t entry, IrValue value, Induction* iv) {
+    const IrInstr* instr = ir_instr(func, value);
+    IrValue phi = value;
+    if (instr->op == IR_ADD || instr->op == IR_SUB) {
+        phi = ir_resolve(func, instr->args[0]);
+        if (ir_instr(func, phi)->op != IR_PHI) {
+            phi = ir_resolve(func, instr->args[1]);
+        }
+    }
+    const IrInstr* candidate = ir_instr(func, phi);
+    return candidate->op == IR_PHI && candidate->block == header &&
+           basic_induction(func, phi, entry, iv) &&
+           (value == phi || value == iv->next);
+}
+
+// Iterations until the tested value, base + n * step after the n-th,
+// fails `cond` against the bound, counting the one where it does; 0 if
+// that never happens or only after the value wraps
+static int64_t count_trips(Condition cond, int64_t base, int64_t step,
+                           int64_t bound) {
+    int64_t first = base + step;
+    if (first < INT32_MIN || first > INT32_MAX) {
+        return 0;
+    }
+    if (!ir_compare(cond, (int32_t)first, (int32_t)bound)) {
+        return 1;
+    }
+
+    // The rest run while the value stays below a limit, negated if it falls
+    int64_t sign = 1;
+    int64_t limit;
+    switch (cond) {
+        case COND_EQ:
+            return 2;
+        case COND_NE:
+            if ((bound - base) % step != 0) {
+                return 0;
+            }
+            return (bound - base) / step >= 1 ? (bound - base) / step : 0;
+        case COND_LT:
+            limit = bound;
+            break;
+        case COND_LE:
+            limit = bound + 1;
+            break;
+        case COND_GT:
+            sign = -1;
+            limit = -bound;
+            break;
+        case COND_GE:
+            sign = -1;
+            limit = 1 - bound;
+            break;
+        default:
+            return 0;
+    }
+    base *= sign;
+    step *= sign;
+    if (step < 0) {
+        return 0;
+    }
+    int64_t trips = (limit - base + step - 1) / step;
+    int64_t last = (base + trips * step) * sign;
+    return last >= INT32_MIN && last <= INT32_MAX ? trips : 0;
+}
+
+// The latch's test of a basic induction variable against a constant
+typedef struct {
+    Induction iv;
+    IrValue tested;  // iv.phi or iv.next
+    Condition cond;  // To go round again, with `tested` on the left
+    int32_t bound;
+    int64_t trips;  // Iterations each time the loop is entered
+    int64_t first;  // Values tested after the first and the last of them
+    int64_t last;
+} ExitTest;
+
+static bool exit_test(const IrFunction* func, int32_t header, int32_t entry,
+                      const IrInstr* branch, bool back_first,
+                      ExitTest* test) {
+    test->cond = (Condition)branch->cond;
+    if (!back_first) {
+        test->cond = ir_negate_condition(test->cond);
+    }
+    test->tested = ir_resolve(func, branch->args[0]);
+    IrValue other = ir_resolve(func, branch->args[1]);
+    if (!ir_is_const(func, other, &test->bound)) {
+        if (!ir_is_const(func, test->tested, &test->bound)) {
+            return false;
+        }
+        test->tested = other;
+        test->cond = ir_swap_condition(test->cond);
+    }
+
+    Induction* iv = &test->iv;
+    int32_t start;
+    if (!induction_of(func, header, entry, test->tested, iv) ||
+        !ir_is_const(func, iv->entry, &start)) {
+        return false;
+    }
+    int64_t base = test->tested == iv->phi ? (int64_t)start - iv->step
+                                           : start;
+    test->trips = count_trips(test->cond, base, iv->step, test->bound);
+    test->first = base + iv->step;
+    test->last = base + test->trips * iv->step;
+    return test->trips > 0;
+}
+
+// Loop-invariant code motion
+//
+// A pure instruction whose operands are all defined outside the loop
+// computes the same value on every iteration, so it can run once before
+// the loop instead. Only the header's preds outside the loop lead in, and
+// the preheader takes the place of the one there is; the loop's blocks are
+// visited in reverse postorder, so what uses a hoisted value is seen after
+// it and may follow it out. Division stays unless the divisor is a nonzero
+// constant, since the loop may never have reached it.
+
+// Returns 1 if anything moved, 0 if not and -1 when out of memory
+static int hoist_invariants(LoopNest* nest, int32_t index, int32_t entry,
+                            int32_t* preheader) {
+    IrFunction* func = nest->func;
+    const Loop* loop = &nest->loops[index];
+    int changed = 0;
+    for (int32_t k = 0; k < loop->size; k++) {
+        int32_t b = loop->blocks[k];
+        uint32_t end = func->blocks[b].end;
+        for (uint32_t i = func->blocks[b].first; i < end; i++) {
+            const IrInstr* instr = &func->instrs[i];
+            IrOp op = (IrOp)instr->op;
+            if (instr->block != b || op < IR_ADD || op > IR_CMP) {
+                continue;
+            }
+
+            IrValue a = ir_resolve(func, instr->args[0]);
+            IrValue c = ir_resolve(func, instr->args[1]);
+            int32_t divisor;
+            if (in_loop(nest, ir_instr(func, a)->block) ||
+                in_loop(nest, ir_instr(func, c)->block) ||
+                ((op == IR_DIV || op == IR_MOD) &&
+                 (!ir_is_const(func, c, &divisor) || divisor == 0))) {
+                continue;
+            }
+
+            if (*preheader < 0 &&
+                (*preheader = add_preheader(nest, index, entry)) < 0) {
+                return -1;
+            }
+            IrValue hoisted = ir_add_instr(func, *preheader, op);
+            if (hoisted == IR_NONE) {
+                return -1;
+            }
+            IrInstr* moved = ir_instr(func, hoisted);
+            moved->cond = func->instrs[i].cond;
+            moved->args[0] = a;
+            moved->args[1] = c;
+            make_copy(&func->instrs[i], hoisted);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+// Strength reduction
+//
+// The product of a basic induction variable and an invariant factor starts
+// at the product of the entry value and steps by that of the step, so a
+// phi of its own can carry it with one addition per iteration. That
+// addition overwrites its operand in place, where the multiplication
+// needed a move first to keep the variable itself. A latch test of the
+// variable against a constant can then test the product instead, which
+// often leaves the variable itself with nothing to do.
+
+typedef struct {
+    IrValue phi;
+    IrValue factor;
+    IrValue scaled;  // phi * factor
+    IrValue scaled_next;
+} Reduced;
+
+// The instruction after `value` in its block, or IR_NONE if it was inserted
+// and has no place yet
+static IrValue following(const IrFunction* func, IrValue value) {
+    int32_t b = ir_instr(func, value)->block;
+    const IrBlock* block = &func->blocks[b];
+    if ((uint32_t)value < block->first || (uint32_t)value >= block->end) {
+        return IR_NONE;
+    }
+    for (uint32_t i = (uint32_t)value + 1; i < block->end; i++) {
+        if (func->instrs[i].block == b) {
+            return (IrValue)i;
+        }
+    }
+    return IR_NONE;
+}
+
+// a * b, folded if both are constants and otherwise computed in the
+// preheader, which is made if the loop has none yet
+static IrValue product(LoopNest* nest, int32_t index, int32_t entry,
+                       int32_t* preheader, IrValue a, IrValue b) {
+    IrFunction* func = nest->func;
+    int32_t x, y;
+    if (ir_is_const(func, a, &x) && ir_is_const(func, b, &y)) {
+        return ir_add_const(func, (int32_t)((uint32_t)x * (uint32_t)y));
+    }
+    if (*preheader < 0) {
+        *preheader = add_preheader(nest, index, entry);
+        if (*preheader < 0 ||
+            ir_add_instr(func, *preheader, IR_JUMP) == IR_NONE) {
+            return IR_NONE;
+        }
+    }
+    IrValue value = ir_insert_before(
+        func, (IrValue)func->blocks[*preheader].end - 1, IR_MUL);
+    if (value != IR_NONE) {
+        ir_instr(func, value)->args[0] = a;
+        ir_instr(func, value)->args[1] = b;
+    }
+    return value;
+}
+
+static bool same_factor(const IrFunction* func, IrValue a, IrValue b) {
+    int32_t x, y;
+    if (ir_is_const(func, a, &x) && ir_is_const(func, b, &y)) {
+        return x == y;
+    }
+    return a == b;
+}
+
+// Starts a variable for iv.phi * factor. Returns 1 if it did, 0 if there
+// is no place yet for its step and -1 when out of memory.
+static int reduce(LoopNest* nest, int32_t index, int32_t entry,
+                  int32_t* preheader, const Induction* iv, IrValue factor,
+                  Reduced* reduced) {
+    IrFunction* func = nest->func;
+    int32_t header = nest->loops[index].header;
+    IrValue anchor = following(func, iv->next);
+    if (anchor == IR_NONE) {
+        return 0;
+    }
+    IrValue step = ir_add_const(func, iv->step);
+    IrValue start = step == IR_NONE ? IR_NONE
+                                    : product(nest, index, entry, preheader,
+                                              iv->entry, factor);
+    if (start == IR_NONE ||
+        (step = product(nest, index, entry, preheader, step, factor)) ==
+            IR_NONE) {
+        return -1;
+    }
+
+    IrValue scaled = ir_insert_before(
+        func, (IrValue)func->blocks[header].first, IR_PHI);
+    IrValue next = scaled == IR_NONE
+                       ? IR_NONE
+                       : ir_insert_before(func, anchor, IR_ADD);
+    if (next == IR_NONE) {
+        return -1;
+    }
+    ir_instr(func, next)->args[0] = scaled;
+    ir_instr(func, next)->args[1] = step;
+    IrValue args[2];
+    args[entry] = start;
+    args[1 - entry] = next;
+    if (!ir_set_phi_args(func, scaled, args, 2)) {
+        return -1;
+    }
+
+    reduced->phi = iv->phi;
+    reduced->factor = factor;
+    reduced->scaled = scaled;
+    reduced->scaled_next = next;
+    return 1;
+}
+
+static bool fits(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Moves the latch's exit test onto a product by a positive constant, where
+// no product it sees overflows. Returns 1 if it did, 0 if not and -1 when
+// out of memory.
+static int replace_test(LoopNest* nest, int32_t index, int32_t entry,
+                        const Reduced* reduced) {
+    IrFunction* func = nest->func;
+    const Loop* loop = &nest->loops[index];
+    const IrBlock* latch = &func->blocks[loop->latch];
+    IrInstr* branch = ir_terminator(func, loop->latch);
+    bool back_first = latch->succs[0] == loop->header;
+    ExitTest test;
+    int32_t factor;
+    if (branch->op != IR_BRANCH ||
+        in_loop(nest, latch->succs[back_first ? 1 : 0]) ||
+        !exit_test(func, loop->header, entry, branch, back_first, &test) ||
+        test.iv.phi != reduced->phi ||
+        !ir_is_const(func, reduced->factor, &factor) || factor <= 0 ||
+        !fits(test.first * factor) || !fits(test.last * factor) ||
+        !fits((int64_t)test.bound * factor)) {
+        return 0;
+    }
+
+    IrValue bound = ir_add_const(func, test.bound * factor);
+    if (bound == IR_NONE) {
+        return -1;
+    }
+    branch = ir_terminator(func, loop->latch);
+    branch->cond = (uint8_t)(back_first ? test.cond
+                                        : ir_negate_condition(test.cond));
+    branch->args[0] = test.tested == test.iv.phi ? reduced->scaled
+                                                 : reduced->scaled_next;
+    branch->args[1] = bound;
+    return 1;
+}
+
+// Returns 1 if anything changed, 0 if not and -1 when out of memory
+static int reduce_strength(LoopNest* nest, int32_t index, int32_t entry,
+                           int32_t* preheader) {
+    IrFunction* func = nest->func;
+    const Loop* loop = &nest->loops[index];
+    if (loop->latch < 0 || func->blocks[loop->header].pred_count != 2) {
+        return 0;
+    }
+
+    Reduced reduced[MAX_REDUCED];
+    int32_t count = 0;
+    int changed = 0;
+    for (int32_t k = 0; k < loop->size; k++) {
+        int32_t b = loop->blocks[k];
+        uint32_t end = func->blocks[b].end;
+        for (uint32_t i = func->blocks[b].first; i < end; i++) {
+            const IrInstr* instr = &func->instrs[i];
+            IrOp op = (IrOp)instr->op;
+            if (instr->block != b || (op != IR_MUL && op != IR_SHL)) {
+                continue;
+            }
+
+            IrValue x = ir_resolve(func, instr->args[0]);
+            IrValue factor = ir_resolve(func, instr->args[1]);
+            Induction iv;
+            if (!induction_of(func, loop->header, entry, x, &iv)) {
+                if (op == IR_SHL) {
+                    continue;
+                }
+                IrValue swap = x;
+                x = factor;
+                factor = swap;
+                if (!induction_of(func, loop->header, entry, x, &iv)) {
+                    continue;
+                }
+            }
+            int32_t shift;
+            if (op == IR_SHL) {
+                if (!ir_is_const(func, factor, &shift)) {
+                    continue;
+                }
+                factor = ir_add_const(func, (int32_t)(1u << (shift & 31)));
+                if (factor == IR_NONE) {
+                    return -1;
+                }
+            } else if (in_loop(nest, ir_instr(func, factor)->block)) {
+                continue;
+            }
+
+            int32_t r = 0;
+            while (r < count && (reduced[r].phi != iv.phi ||
+                                 !same_factor(func, reduced[r].factor,
+                                              factor))) {
+                r++;
+            }
+            if (r == count) {
+                if (count == MAX_REDUCED) {
+                    continue;
+                }
+                int made = reduce(nest, index, entry, preheader, &iv, factor,
+                                  &reduced[count]);
+                if (made <= 0) {
+                    if (made < 0) {
+                        return -1;
+                    }
+                    continue;
+                }
+                count++;
+            }
+            make_copy(&func->instrs[i], x == iv.phi ? reduced[r].scaled
+                                                    : reduced[r].scaled_next);
+            changed = 1;
+        }
+    }
+
+    for (int32_t r = 0; r < count; r++) {
+        int result = replace_test(nest, index, entry, &reduced[r]);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return changed;
+}
+
+// A counter stepping down by one to zero takes no other values that fail
+// the latch's test, so testing it for zero instead keeps the trip count,
+// and codegen turns the decrement and the test into one LOOP. Returns 1 if
+// it did, 0 if not and -1 when out of memory.
+static int count_to_zero(LoopNest* nest, int32_t index, int32_t entry) {
+    IrFunction* func = nest->func;
+    const Loop* loop = &nest->loops[index];
+    if (loop->latch < 0) {
+        return 0;
+    }
+    const IrBlock* latch = &func->blocks[loop->latch];
+    IrInstr* branch = ir_terminator(func, loop->latch);
+    bool back_first = latch->succs[0] == loop->header;
+    ExitTest test;
+    if (branch->op != IR_BRANCH ||
+        in_loop(nest, latch->succs[back_first ? 1 : 0]) ||
+        !exit_test(func, loop->header, entry, branch, back_first, &test) ||
+        test.tested != test.iv.next || test.iv.step != -1 ||
+        test.last != 0 || test.cond == COND_NE) {
+        return 0;
+    }
+
+    IrValue zero = ir_add_const(func, 0);
+    if (zero == IR_NONE) {
+        return -1;
+    }
+    branch = ir_terminator(func, loop->latch);
+    branch->cond = (uint8_t)(back_first ? COND_NE : COND_EQ);
+    branch->args[0] = test.tested;
+    branch->args[1] = zero;
+    return 1;
+}
+
+// Returns 1 if anything changed, 0 if not and -1 when out of memory
+static int optimize_loop(LoopNest* nest, int32_t index, unsigned passes) {
+    IrFunction* func = nest->func;
+    if (!enter_loop(nest, &nest->loops[index])) {
+        return -1;
+    }
+    int32_t entry = entry_index(nest, &nest->loops[index]);
+    if (entry < 0) {
+        return 0;
+    }
+
+    int32_t preheader = -1;
+    int hoisted = 0;
+    int reduced = 0;
+    if (passes & IR_PASS_LICM) {
+        hoisted = hoist_invariants(nest, index, entry, &preheader);
+    }
+    if (preheader >= 0 &&
+        ir_add_instr(func, preheader, IR_JUMP) == IR_NONE) {
+        return -1;
+    }
+    if (hoisted >= 0 && (passes & IR_PASS_STRENGTH)) {
+        reduced = reduce_strength(nest, index, entry, &preheader);
+        if (reduced >= 0) {
+            int counted = count_to_zero(nest, index, entry);
+            reduced = counted < 0 ? -1 : reduced | counted;
+        }
+    }
+    return hoisted < 0 || reduced < 0 ? -1 : hoisted | reduced;
+}
+
+// Unrolling
+//
+// An innermost loop whose only exit is the test in its latch, of a basic
+// induction variable with a constant start against a constant bound, runs
+// a number of times known here. Copies of its blocks go in front of the
+// original, each falling into the next, and the original is kept as the
+// last one: its values are the ones seen after the loop, and its latch
+// holds the only test left. Each copy's header phis become copies of what
+// the one before carried around the back edge. Unrolled fully the loop is
+// gone; by a factor dividing the count, the back edge goes to the first
+// copy, whose header keeps the phis.
+
+typedef struct {
+    IrFunction* func;
+    const Loop* loop;
+    const LoopNest* nest;
+    uint32_t count;    // Values before unrolling
+    IrValue* map;      // Each value of the loop to its latest copy
+    int32_t* position;  // Each block of the loop to its index in it
+    IrValue* phis;     // The header's
+    IrValue* carried;  // What each phi takes for the next copy
+    int32_t phi_count;
+    IrValue* values;   // Scratch for phi operands
+} Unroller;
+
+static IrValue mapped(const Unroller* u, IrValue value) {
+    if (value != IR_NONE && (uint32_t)value < u->count &&
+        in_loop(u->nest, u->func->instrs[value].block)) {
+        return u->map[value];
+    }
+    return value;
+}
+
+// Appends a copy of every block of the loop, the first time from the
+// loop's entry and after that from the latch of the copy before
+static bool copy_iteration(Unroller* u, int32_t entry, bool first,
+                           bool full, bool last) {
+    IrFunction* func = u->func;
+    const Loop* loop = u->loop;
+    int32_t header = loop->header;
+    int32_t base = func->block_count;
+    for (int32_t k = 0; k < loop->size; k++) {
+        if (ir_add_block(func) < 0) {
+            return false;
+        }
+    }
+
+    for (int32_t k = 0; k < loop->size; k++) {
+        int32_t b = loop->blocks[k];
+        int32_t copy = base + k;
+        const IrBlock* block = &func->blocks[b];
+        if (b != header) {
+            if (!ir_set_preds(func, copy, block->preds, block->pred_count)) {
+                return false;
+            }
+            IrBlock* target = &func->blocks[copy];
+            for (int32_t p = 0; p < target->pred_count; p++) {
+                target->preds[p] = base + u->position[target->preds[p]];
+            }
+        } else if (first && !full) {
+            if (!ir_set_preds(func, copy, block->preds, block->pred_count)) {
+                return false;
+            }
+        } else {
+            int32_t pred =
+                first ? block->preds[entry]
+                      : base - loop->size + u->position[loop->latch];
+            if (!ir_set_preds(func, copy, &pred, 1)) {
+                return false;
+            }
+        }
+
+        block = &func->blocks[b];
+        IrBlock* target = &func->blocks[copy];
+        target->succ_count = 0;
+        for (int32_t s = 0; s < block->succ_count; s++) {
+            int32_t succ = block->succs[s];
+            if (succ == header) {
+                target->succs[target->succ_count++] =
+                    last ? header : base + loop->size;
+            } else if (in_loop(u->nest, succ)) {
+                target->succs[target->succ_count++] =
+                    base + u->position[succ];
+            }
+        }
+
+        int32_t phi = 0;
+        uint32_t end = block->end;
+        for (uint32_t i = block->first; i < end; i++) {
+            IrInstr instr = func->instrs[i];
+            if (instr.block != b || instr.op == IR_NOP) {
+                continue;
+            }
+            IrOp op = (IrOp)instr.op;
+            if (b == header && op == IR_PHI && (!first || full)) {
+                op = IR_COPY;
+            } else if (b == loop->latch && i == end - 1) {
+                op = IR_JUMP;
+            }
+
+            IrValue value = ir_add_instr(func, copy, op);
+            if (value == IR_NONE) {
+                return false;
+            }
+            u->map[i] = value;
+            IrInstr* made = ir_instr(func, value);
+            made->cond = instr.cond;
+            if (op == IR_COPY && instr.op == IR_PHI) {
+                made->args[0] = u->carried[phi++];
+            } else if (op == IR_PHI) {
+                const IrValue* args = ir_phi_args(func, &instr);
+                for (uint32_t j = 0; j < instr.phi.count; j++) {
+                    u->values[j] = b == header ? args[j] : mapped(u, args[j]);
+                }
+                if (!ir_set_phi_args(func, value, u->values,
+                                     (int32_t)instr.phi.count)) {
+                    return false;
+                }
+                phi += b == header;
+            } else if (op == IR_CONST) {
+                made->value = instr.value;
+            } else if (op != IR_JUMP) {
+                made->args[0] = mapped(u, instr.args[0]);
+                made->args[1] = mapped(u, instr.args[1]);
+            }
+        }
+    }
+
+    for (int32_t p = 0; p < u->phi_count; p++) {
+        const IrInstr* instr = ir_instr(func, u->phis[p]);
+        u->carried[p] = mapped(u, ir_phi_args(func, instr)[1 - entry]);
+    }
+    return true;
+}
+
+static bool unroll(LoopNest* nest, const Loop* loop, int32_t entry,
+                   int32_t copies, bool full) {
+    IrFunction* func = nest->func;
+    int32_t header = loop->header;
+    const IrBlock* head = &func->blocks[header];
+    int32_t max_preds = 2;
+    for (int32_t k = 0; k < loop->size; k++) {
+        if (func->blocks[loop->blocks[k]].pred_count > max_preds) {
+            max_preds = func->blocks[loop->blocks[k]].pred_count;
+        }
+    }
+
+    Unroller u = {
+        .func = func,
+        .loop = loop,
+        .nest = nest,
+        .count = func->count,
+        .map = malloc(sizeof(IrValue) * func->count),
+        .position = malloc(sizeof(int32_t) * (size_t)func->block_count),
+        .phis = malloc(sizeof(IrValue) * (head->end - head->first + 1)),
+        .carried = malloc(sizeof(IrValue) * (head->end - head->first + 1)),
+        .values = malloc(sizeof(IrValue) * (size_t)max_preds),
+    };
+    bool ok = u.map && u.position && u.phis && u.carried && u.values;
+    for (int32_t k = 0; ok && k < loop->size; k++) {
+        u.position[loop->blocks[k]] = k;
+    }
+    for (uint32_t i = head->first; ok && i < head->end; i++) {
+        const IrInstr* instr = &func->instrs[i];
+        if (instr->block == header && instr->op == IR_PHI) {
+            u.phis[u.phi_count] = (IrValue)i;
+            u.carried[u.phi_count++] = ir_phi_args(func, instr)[entry];
+        }
+    }
+
+    int32_t latch = loop->latch;
+    int32_t outside = head->preds[entry];
+    int32_t first_copy = func->block_count;
+    for (int32_t c = 0; ok && c < copies; c++) {
+        ok = copy_iteration(&u, entry, c == 0, full, c == copies - 1);
+    }
+
+    if (ok) {
+        int32_t pred = copies > 0 ? func->block_count - loop->size +
+                                        u.position[latch]
+                                  : outside;
+        ok = ir_set_preds(func, header, &pred, 1);
+    }
+    if (ok) {
+        for (int32_t p = 0; p < u.phi_count; p++) {
+            make_copy(ir_instr(func, u.phis[p]), u.carried[p]);
+        }
+        IrBlock* source = &func->blocks[outside];
+        for (int32_t s = 0; copies > 0 && s < source->succ_count; s++) {
+            if (source->succs[s] == header) {
+                source->succs[s] = first_copy;
+                break;
+            }
+        }
+
+        IrBlock* bottom = &func->blocks[latch];
+        int back = bottom->succs[0] == header ? 0 : 1;
+        if (full) {
+            IrInstr* branch = ir_terminator(func, latch);
+            branch->op = IR_JUMP;
+            branch->args[0] = branch->args[1] = IR_NONE;
+            bottom->succs[0] = bottom->succs[1 - back];
+            bottom->succ_count = 1;
+        } else {
+            bottom->succs[back] = first_copy;
+        }
+    }
+
+    free(u.map);
+    free(u.position);
+    free(u.phis);
+    free(u.carried);
+    free(u.values);
+    return ok;
+}
+
+// Returns 1 if the loop was unrolled, 0 if not and -1 when out of memory
+static int unroll_loop(LoopNest* nest, int32_t index) {
+    IrFunction* func = nest->func;
+    const Loop* loop = &nest->loops[index];
+    if (!loop->innermost || loop->latch < 0) {
+        return 0;
+    }
+    if (!enter_loop(nest, loop)) {
+        return -1;
+    }
+    int32_t entry = entry_index(nest, loop);
+    if (entry < 0 || func->blocks[loop->header].pred_count != 2) {
+        return 0;
+    }
+
+    int64_t cost = 0;
+    for (int32_t k = 0; k < loop->size; k++) {
+        int32_t b = loop->blocks[k];
+        const IrBlock* block = &func->blocks[b];
+        if (block->succ_count == 2 && block->succs[0] == block->succs[1]) {
+            return 0;
+        }
+        for (int32_t s = 0; s < block->succ_count; s++) {
+            if (b != loop->latch && !in_loop(nest, block->succs[s])) {
+                return 0;
+            }
+        }
+        for (int32_t p = 0; p < block->pred_count; p++) {
+            if (b != loop->header && !in_loop(nest, block->preds[p])) {
+                return 0;  // From an unreachable block not yet removed
+            }
+        }
+        for (uint32_t i = block->first; i < block->end; i++) {
+            if (func->instrs[i].block == b) {
+                cost += ANVIL_COST[func->instrs[i].op];
+            }
+        }
+    }
+
+    const IrBlock* latch = &func->blocks[loop->latch];
+    const IrInstr* branch = ir_terminator(func, loop->latch);
+    bool back_first = latch->succs[0] == loop->header;
+    if (branch->op != IR_BRANCH ||
+        in_loop(nest, latch->succs[back_first ? 1 : 0])) {
+        return 0;
+    }
+    ExitTest test;
+    if (!exit_test(func, loop->header, entry, branch, back_first, &test)) {
+        return 0;
+    }
+    int64_t trips = test.trips;
+
+    if (trips * cost <= FULL_UNROLL_COST) {
+        return unroll(nest, loop, entry, (int32_t)trips - 1, true) ? 1 : -1;
+    }
+    for (int32_t factor = MAX_UNROLL_FACTOR; factor > 1; factor /= 2) {
+        if (trips % factor == 0 && factor * cost <= PARTIAL_UNROLL_COST) {
+            return unroll(nest, loop, entry, factor - 1, false) ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+int ir_optimize_loops(IrFunction* func, unsigned passes) {
+    LoopNest nest;
+    int changed = 0;
+    if (passes & (IR_PASS_LICM | IR_PASS_STRENGTH)) {
+        if (!find_loops(func, &nest)) {
+            nest_free(&nest);
+            return -1;
+        }
+        for (int32_t l = 0; changed >= 0 && l < nest.count; l++) {
+            int result = optimize_loop(&nest, l, passes);
+            changed = result < 0 ? -1 : changed | result;
+        }
+        nest_free(&nest);
+        if (changed < 0 || (changed && !ir_compact(func))) {
+            return -1;
+        }
+    }
+    if (passes & IR_PASS_UNROLL) {
+        if (!find_loops(func, &nest)) {
+            nest_free(&nest);
+            return -1;
+        }
+        for (int32_t l = 0; changed >= 0 && l < nest.count; l++) {
+            int result = unroll_loop(&nest, l);
+            changed = result < 0 ? -1 : changed | result;
+        }
+        nest_free(&nest);
+    }
+    return changed;
+}
@@ -0,0 +1,699 @@
+#include "lower.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+
+typedef struct {
+    int name;       // Symbol id in Lowerer.names
+    int depth;      // Scope depth of the declaration
+    int shadowed;   // Variable this one hides, or -1
+    int level;      // Nesting of ifs and loops at the declaration
+    IrValue value;  // Current SSA value
+    uint32_t mark;  // Scratch for deduplicating sets of variables
+    IrValue saved;  // Scratch value that goes with mark
+} Variable;
+
+// A variable with its value before and after some region of code
+typedef struct {
+    int var;
+    IrValue before;
+    IrValue after;
+} VarChange;
+
+typedef struct {
+    VarChange* items;
+    int count;
+    int capacity;
+} VarChanges;
+
+typedef struct {
+    const Ast* ast;
+    IrFunction* func;
+
+    // Variable names. A bound name is SYM_DATA with the index of its
+    // innermost Variable as value.
+    SymbolTable names;
+    Variable* vars;  // Scope stack
+    int var_count;
+    int var_capacity;
+    int scope_depth;
+
+    int level;      // Nesting of ifs and loops being lowered
+    int32_t block;  // Block being filled
+
+    VarChanges log;       // Assignments to variables from outside `level`
+    VarChanges captured;  // Variable values at the end of branches
+    uint32_t mark;
+    bool failed;
+} Lowerer;
+
+static void out_of_memory(Lowerer* lw) {
+    if (!lw->failed) {
+        fprintf(stderr, "[AXIOM] Error: Out of memory lowering the program!\n");
+        lw->failed = true;
+    }
+}
+
+static void error_at_token(Lowerer* lw, uint32_t token, const char* message) {
+    if (lw->failed) {
+        return;
+    }
+    lw->failed = true;
+
+    const TokenSpan* span = &lw->ast->tokens->tokens[token];
+    fprintf(stderr, "[AXIOM] Error: %s '%.*s' at %u:%u!\n", message,
+            (int)span->length, lw->ast->tokens->source + span->start,
+            span->line, span->column);
+}
+
+static void push_change(Lowerer* lw, VarChanges* changes, int var,
+                        IrValue before, IrValue after) {
+    if (changes->count == changes->capacity) {
+        int capacity = changes->capacity ? changes->capacity * 2 : 64;
+        VarChange* items =
+            realloc(changes->items, sizeof(VarChange) * (size_t)capacity);
+        if (!items) {
+            out_of_memory(lw);
+            return;
+        }
+        changes->items = items;
+        changes->capacity = capacity;
+    }
+    changes->items[changes->count++] = (VarChange){var, before, after};
+}
+
+// Instructions and blocks
+
+static IrValue constant(Lowerer* lw, int32_t value) {
+    IrValue result = ir_add_const(lw->func, value);
+    if (result == IR_NONE) {
+        out_of_memory(lw);
+    }
+    return result;
+}
+
+static IrValue emit(Lowerer* lw, IrOp op, IrValue a, IrValue b) {
+    if (lw->failed) {
+        return IR_NONE;
+    }
+    IrValue result = ir_add_instr(lw->func, lw->block, op);
+    if (result == IR_NONE) {
+        out_of_memory(lw);
+        return IR_NONE;
+    }
+    ir_instr(lw->func, result)->args[0] = a;
+    ir_instr(lw->func, result)->args[1] = b;
+    return result;
+}
+
+static int32_t new_block(Lowerer* lw) {
+    int32_t block = lw->failed ? -1 : ir_add_block(lw->func);
+    if (block < 0) {
+        out_of_memory(lw);
+        return 0;
+    }
+    return block;
+}
+
+static void edge(Lowerer* lw, int32_t to) {
+    if (!lw->failed && !ir_add_edge(lw->func, lw->block, to)) {
+        out_of_memory(lw);
+    }
+}
+
+static void jump(Lowerer* lw, int32_t target) {
+    emit(lw, IR_JUMP, IR_NONE, IR_NONE);
+    edge(lw, target);
+}
+
+static void branch(Lowerer* lw, Condition cond, IrValue a, IrValue b,
+                   int32_t if_true, int32_t if_false) {
+    IrValue instr = emit(lw, IR_BRANCH, a, b);
+    if (instr != IR_NONE) {
+        ir_instr(lw->func, instr)->cond = (uint8_t)cond;
+    }
+    edge(lw, if_true);
+    edge(lw, if_false);
+}
+
+// A phi at the head of the current block, taking `first` from the first
+// `split` predecessors and `rest` from the others
+static IrValue phi(Lowerer* lw, int32_t split, IrValue first, IrValue rest) {
+    IrValue result = emit(lw, IR_PHI, IR_NONE, IR_NONE);
+    if (result == IR_NONE) {
+        return IR_NONE;
+    }
+
+    const IrBlock* block = &lw->func->blocks[lw->block];
+    IrValue* values =
+        malloc(sizeof(IrValue) * (size_t)(block->pred_count + 1));
+    if (!values) {
+        out_of_memory(lw);
+        return IR_NONE;
+    }
+    for (int32_t i = 0; i < block->pred_count; i++) {
+        values[i] = i < split ? first : rest;
+    }
+    if (!ir_set_phi_args(lw->func, result, values, block->pred_count)) {
+        out_of_memory(lw);
+    }
+    free(values);
+    return result;
+}
+
+// Scopes and variables
+
+static void enter_scope(Lowerer* lw) { lw->scope_depth++; }
+
+static void exit_scope(Lowerer* lw) {
+    while (lw->var_count > 0 &&
+           lw->vars[lw->var_count - 1].depth == lw->scope_depth) {
+        const Variable* var = &lw->vars[--lw->var_count];
+        Symbol* symbol = &lw->names.symbols[var->name];
+        symbol->kind = var->shadowed >= 0 ? SYM_DATA : SYM_UNDEFINED;
+        symbol->value = var->shadowed;
+    }
+    lw->scope_depth--;
+}
+
+static void declare(Lowerer* lw, uint32_t token, IrValue value) {
+    uint32_t length;
+    const char* name = ast_token_text(lw->ast, token, &length);
+    int id = symtab_intern(&lw->names, name, length);
+    if (id < 0) {
+        out_of_memory(lw);
+        return;
+    }
+
+    Symbol* symbol = &lw->names.symbols[id];
+    int shadowed = symbol->kind == SYM_DATA ? symbol->value : -1;
+    if (shadowed >= 0 && lw->vars[shadowed].depth == lw->scope_depth) {
+        error_at_token(lw, token, "Redeclared variable");
+        return;
+    }
+
+    if (lw->var_count == lw->var_capacity) {
+        int capacity = lw->var_capacity ? lw->var_capacity * 2 : 16;
+        Variable* vars = realloc(lw->vars, sizeof(Variable) * (size_t)capacity);
+        if (!vars) {
+            out_of_memory(lw);
+            return;
+        }
+        lw->vars = vars;
+        lw->var_capacity = capacity;
+    }
+
+    lw->vars[lw->var_count] = (Variable){
+        id, lw->scope_depth, shadowed, lw->level, value, 0, IR_NONE};
+    symbol->kind = SYM_DATA;
+    symbol->value = lw->var_count++;
+}
+
+// The variable named at `token`, or -1
+static int find(const Lowerer* lw, uint32_t token) {
+    uint32_t length;
+    const char* name = ast_token_text(lw->ast, token, &length);
+    int id = symtab_find(&lw->names, name, length);
+    if (id < 0 || lw->names.symbols[id].kind != SYM_DATA) {
+        return -1;
+    }
+    return lw->names.symbols[id].value;
+}
+
+static int lookup(Lowerer* lw, uint32_t token) {
+    int var = find(lw, token);
+    if (var < 0) {
+        error_at_token(lw, token, "Undefined variable");
+    }
+    return var;
+}
+
+// Assignments to variables from outside the current if or loop are logged,
+// so the construct can restore and merge them when it ends
+static void assign(Lowerer* lw, int var, IrValue value) {
+    Variable* v = &lw->vars[var];
+    if (v->level < lw->level) {
+        push_change(lw, &lw->log, var, v->value, IR_NONE);
+    }
+    v->value = value;
+}
+
+// Expressions
+
+static IrValue lower_value(Lowerer* lw, NodeIndex index);
+
+static bool arithmetic_op(TokenType op, IrOp* ir_op) {
+    switch (op) {
+        case TOKEN_PLUS:
+            *ir_op = IR_ADD;
+            return true;
+        case TOKEN_MINUS:
+            *ir_op = IR_SUB;
+            return true;
+        case TOKEN_MULTIPLY:
+            *ir_op = IR_MUL;
+            return true;
+        case TOKEN_DIVIDE:
+            *ir_op = IR_DIV;
+            return true;
+        case TOKEN_MODULUS:
+            *ir_op = IR_MOD;
+            return true;
+        case TOKEN_EXPONENT:
+            *ir_op = IR_POW;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool comparison_condition(TokenType op, Condition* cond) {
+    switch (op) {
+        case TOKEN_EQUAL:
+            *cond = COND_EQ;
+            return true;
+        case TOKEN_NOT_EQUAL:
+            *cond = COND_NE;
+            return true;
+        case TOKEN_LESS:
+            *cond = COND_LT;
+            return true;
+        case TOKEN_LESS_EQUAL:
+            *cond = COND_LE;
+            return true;
+        case TOKEN_GREATER:
+            *cond = COND_GT;
+            return true;
+        case TOKEN_GREATER_EQUAL:
+            *cond = COND_GE;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Ends the current block with a branch to `if_true` or `if_false` on the
+// truth of an expression; && and || short-circuit through new blocks
+static void lower_condition(Lowerer* lw, NodeIndex index, int32_t if_true,
+                            int32_t if_false) {
+    const Node* node = ast_node(lw->ast, index);
+    Condition cond;
+
+    if (node->kind == NODE_NUMBER) {
+        jump(lw, node->value != 0 ? if_true : if_false);
+        return;
+    }
+    if (node->kind == NODE_UNARY && node->op == TOKEN_NOT) {
+        lower_condition(lw, node->lhs, if_false, if_true);
+        return;
+    }
+    if (node->kind == NODE_BINARY &&
+        comparison_condition((TokenType)node->op, &cond)) {
+        IrValue a = lower_value(lw, node->lhs);
+        IrValue b = lower_value(lw, node->rhs);
+        branch(lw, cond, a, b, if_true, if_false);
+        return;
+    }
+    if (node->kind == NODE_BINARY &&
+        (node->op == TOKEN_AND || node->op == TOKEN_OR)) {
+        int32_t rest = new_block(lw);
+        if (node->op == TOKEN_AND) {
+            lower_condition(lw, node->lhs, rest, if_false);
+        } else {
+            lower_condition(lw, node->lhs, if_true, rest);
+        }
+        lw->block = rest;
+        lower_condition(lw, node->rhs, if_true, if_false);
+        return;
+    }
+
+    IrValue value = lower_value(lw, index);
+    branch(lw, COND_NE, value, constant(lw, 0), if_true, if_false);
+}
+
+// && and || as values: 1 or 0 merged by a phi
+static IrValue lower_logic(Lowerer* lw, NodeIndex index) {
+    int32_t if_true = new_block(lw);
+    int32_t if_false = new_block(lw);
+    int32_t join = new_block(lw);
+    lower_condition(lw, index, if_true, if_false);
+    lw->block = if_true;
+    jump(lw, join);
+    lw->block = if_false;
+    jump(lw, join);
+    lw->block = join;
+    return phi(lw, 1, constant(lw, 1), constant(lw, 0));
+}
+
+static IrValue lower_value(Lowerer* lw, NodeIndex index) {
+    if (lw->failed) {
+        return IR_NONE;
+    }
+
+    const Node* node = ast_node(lw->ast, index);
+    Condition cond;
+    IrOp op;
+
+    switch ((NodeKind)node->kind) {
+        case NODE_NUMBER:
+            return constant(lw, node->value);
+        case NODE_NAME: {
+            int var = lookup(lw, node->token);
+            return var < 0 ? IR_NONE : lw->vars[var].value;
+        }
+        case NODE_UNARY:
+            if (node->op == TOKEN_NOT) {
+                IrValue value = lower_value(lw, node->lhs);
+                IrValue result = emit(lw, IR_CMP, value, constant(lw, 0));
+                if (result != IR_NONE) {
+                    ir_instr(lw->func, result)->cond = COND_EQ;
+                }
+                return result;
+            }
+            if (ast_node(lw->ast, node->lhs)->kind == NODE_NUMBER) {
+                return constant(lw, -ast_node(lw->ast, node->lhs)->value);
+            }
+            return emit(lw, IR_MUL, lower_value(lw, node->lhs),
+                        constant(lw, -1));
+        case NODE_BINARY:
+            if (arithmetic_op((TokenType)node->op, &op)) {
+                IrValue a = lower_value(lw, node->lhs);
+                IrValue b = lower_value(lw, node->rhs);
+                return emit(lw, op, a, b);
+            }
+            if (comparison_condition((TokenType)node->op, &cond)) {
+                IrValue a = lower_value(lw, node->lhs);
+                IrValue b = lower_value(lw, node->rhs);
+                IrValue result = emit(lw, IR_CMP, a, b);
+                if (result != IR_NONE) {
+                    ir_instr(lw->func, result)->cond = (uint8_t)cond;
+                }
+                return result;
+            }
+            return lower_logic(lw, index);
+        default:
+            return IR_NONE;
+    }
+}
+
+// Statements
+
+static void lower_statement(Lowerer* lw, NodeIndex index);
+
+// A statement nested in if or while gets its own scope
+static void lower_nested(Lowerer* lw, NodeIndex index) {
+    enter_scope(lw);
+    lower_statement(lw, index);
+    exit_scope(lw);
+}
+
+// Records the final value of each variable assigned since log entry
+// `start`, then rolls the variables back to their values from before
+static void capture_branch(Lowerer* lw, int start) {
+    uint32_t mark = ++lw->mark;
+    for (int i = lw->log.count - 1; i >= start; i--) {
+        Variable* var = &lw->vars[lw->log.items[i].var];
+        if (var->mark != mark) {
+            var->mark = mark;
+            push_change(lw, &lw->captured, lw->log.items[i].var, IR_NONE,
+                        var->value);
+        }
+        var->value = lw->log.items[i].before;
+    }
+    lw->log.count = start;
+}
+
+// Merges a variable's values from the two sides of an if in the join block;
+// the then side arrives from `then_pred`
+static void merge_variable(Lowerer* lw, int var, IrValue then_value,
+                           IrValue else_value, int32_t then_pred) {
+    if (then_value == else_value) {
+        assign(lw, var, then_value);
+        return;
+    }
+
+    // The then side is a single jump; all other predecessors are the else
+    // side, so the phi is built in predecessor order
+    IrValue result = emit(lw, IR_PHI, IR_NONE, IR_NONE);
+    if (result == IR_NONE) {
+        return;
+    }
+    const IrBlock* join = &lw->func->blocks[lw->block];
+    IrValue* values =
+        malloc(sizeof(IrValue) * (size_t)(join->pred_count + 1));
+    if (!values) {
+        out_of_memory(lw);
+        return;
+    }
+    for (int32_t i = 0; i < join->pred_count; i++) {
+        values[i] = join->preds[i] == then_pred ? then_value : else_value;
+    }
+    if (!ir_set_phi_args(lw->func, result, values, join->pred_count)) {
+        out_of_memory(lw);
+    }
+    free(values);
+    assign(lw, var, result);
+}
+
+static void lower_if(Lowerer* lw, const Node* node) {
+    int32_t then_block = new_block(lw);
+    int32_t else_block = node->extra != AST_NONE ? new_block(lw) : -1;
+    int32_t join = new_block(lw);
+    lower_condition(lw, node->lhs, then_block,
+                    else_block >= 0 ? else_block : join);
+
+    int log_start = lw->log.count;
+    int then_start = lw->captured.count;
+    lw->level++;
+    lw->block = then_block;
+    lower_nested(lw, node->rhs);
+    int32_t then_pred = lw->block;
+    jump(lw, join);
+    capture_branch(lw, log_start);
+
+    int else_start = lw->captured.count;
+    if (else_block >= 0) {
+        lw->block = else_block;
+        lower_nested(lw, node->extra);
+        jump(lw, join);
+    }
+    capture_branch(lw, log_start);
+    lw->level--;
+    lw->block = join;
+    if (lw->failed) {
+        return;
+    }
+
+    // Every variable is back at its value from before the if; merge each
+    // one either side assigned
+    const VarChange* changes = lw->captured.items;
+    uint32_t then_mark = ++lw->mark;
+    uint32_t merged_mark = ++lw->mark;
+    for (int i = then_start; i < else_start; i++) {
+        Variable* var = &lw->vars[changes[i].var];
+        var->mark = then_mark;
+        var->saved = changes[i].after;
+    }
+    for (int i = else_start; i < lw->captured.count; i++) {
+        Variable* var = &lw->vars[changes[i].var];
+        IrValue then_value = var->mark == then_mark ? var->saved : var->value;
+        var->mark = merged_mark;
+        merge_variable(lw, changes[i].var, then_value, changes[i].after,
+                       then_pred);
+    }
+    for (int i = then_start; i < else_start; i++) {
+        Variable* var = &lw->vars[changes[i].var];
+        if (var->mark == then_mark) {
+            merge_variable(lw, changes[i].var, var->saved, var->value,
+                           then_pred);
+        }
+    }
+    lw->captured.count = then_start;
+}
+
+// Records each outer variable a loop body may assign, with its value before
+// the loop. Names are resolved in the scope around the loop, so a body
+// variable that shadows an outer one only costs a phi that folds away.
+static void collect_assigned(Lowerer* lw, NodeIndex index, uint32_t mark) {
+    const Node* node = ast_node(lw->ast, index);
+    switch ((NodeKind)node->kind) {
+        case NODE_BLOCK:
+            for (NodeIndex s = node->lhs; s != AST_NONE;
+                 s = ast_node(lw->ast, s)->next) {
+                collect_assigned(lw, s, mark);
+            }
+            break;
+        case NODE_IF:
+            collect_assigned(lw, node->rhs, mark);
+            if (node->extra != AST_NONE) {
+                collect_assigned(lw, node->extra, mark);
+            }
+            break;
+        case NODE_WHILE:
+            collect_assigned(lw, node->rhs, mark);
+            break;
+        case NODE_ASSIGN: {
+            int var = find(lw, node->token);
+            if (var >= 0 && lw->vars[var].mark != mark) {
+                lw->vars[var].mark = mark;
+                push_change(lw, &lw->captured, var, lw->vars[var].value,
+                            IR_NONE);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// while (c) body becomes: if (c) { do body while (c) }. The body block is
+// the loop header, with a phi for each assigned variable.
+static void lower_while(Lowerer* lw, const Node* node) {
+    int changes_start = lw->captured.count;
+    collect_assigned(lw, node->rhs, ++lw->mark);
+    int changes_end = lw->captured.count;
+
+    int32_t body = new_block(lw);
+    int32_t exit = new_block(lw);
+    lower_condition(lw, node->lhs, body, exit);
+    if (lw->failed) {
+        return;
+    }
+    int32_t body_entries = lw->func->blocks[body].pred_count;
+    int32_t exit_entries = lw->func->blocks[exit].pred_count;
+
+    // Header phis get their operands once the back edges exist
+    int log_start = lw->log.count;
+    lw->level++;
+    lw->block = body;
+    for (int i = changes_start; i < changes_end; i++) {
+        VarChange* change = &lw->captured.items[i];
+        change->after = emit(lw, IR_PHI, IR_NONE, IR_NONE);
+        lw->vars[change->var].value = change->after;
+    }
+    lower_nested(lw, node->rhs);
+    lower_condition(lw, node->lhs, body, exit);
+    lw->level--;
+    lw->log.count = log_start;
+    if (lw->failed) {
+        return;
+    }
+
+    const IrBlock* header = &lw->func->blocks[body];
+    IrValue* values =
+        malloc(sizeof(IrValue) * (size_t)(header->pred_count + 1));
+    if (!values) {
+        out_of_memory(lw);
+        return;
+    }
+    for (int i = changes_start; i < changes_end; i++) {
+        VarChange* change = &lw->captured.items[i];
+        Variable* var = &lw->vars[change->var];
+        IrValue header_phi = change->after;
+        IrValue latch = ir_resolve(lw->func, var->value);
+
+        // A variable the loop never actually changes needs no phi
+        if (latch == header_phi || latch == change->before) {
+            IrInstr* instr = ir_instr(lw->func, header_phi);
+            instr->op = IR_COPY;
+            instr->args[0] = change->before;
+            instr->args[1] = IR_NONE;
+            latch = change->before;
+        } else {
+            for (int32_t p = 0; p < header->pred_count; p++) {
+                values[p] = p < body_entries ? change->before : latch;
+            }
+            if (!ir_set_phi_args(lw->func, header_phi, values,
+                                 header->pred_count)) {
+                out_of_memory(lw);
+            }
+        }
+
+        // Roll back so the exit value is logged against the value from
+        // before the loop
+        var->value = change->before;
+        change->after = latch;
+    }
+    free(values);
+
+    lw->block = exit;
+    for (int i = changes_start; i < changes_end && !lw->failed; i++) {
+        const VarChange* change = &lw->captured.items[i];
+        if (change->after != change->before) {
+            assign(lw, change->var,
+                   phi(lw, exit_entries, change->before, change->after));
+        }
+    }
+    lw->captured.count = changes_start;
+}
+
+static void lower_statement(Lowerer* lw, NodeIndex index) {
+    if (lw->failed) {
+        return;
+    }
+
+    const Node* node = ast_node(lw->ast, index);
+    switch ((NodeKind)node->kind) {
+        case NODE_BLOCK:
+            enter_scope(lw);
+            for (NodeIndex s = node->lhs; s != AST_NONE && !lw->failed;
+                 s = ast_node(lw->ast, s)->next) {
+                lower_statement(lw, s);
+            }
+            exit_scope(lw);
+            break;
+        case NODE_VAR: {
+            // The initializer still sees an outer variable of the same name
+            IrValue value = node->rhs != AST_NONE ? lower_value(lw, node->rhs)
+                                                  : constant(lw, 0);
+            declare(lw, node->token, value);
+            break;
+        }
+        case NODE_ASSIGN: {
+            int var = lookup(lw, node->token);
+            IrValue value = lower_value(lw, node->rhs);
+            if (var >= 0) {
+                assign(lw, var, value);
+            }
+            break;
+        }
+        case NODE_IF:
+            lower_if(lw, node);
+            break;
+        case NODE_WHILE:
+            lower_while(lw, node);
+            break;
+        case NODE_OUTPUT:
+            emit(lw, IR_OUTPUT, lower_value(lw, node->lhs), IR_NONE);
+            break;
+        default:
+            break;
+    }
+}
+
+bool lower_program(const Ast* ast, IrFunction* func) {
+    Lowerer lw = {0};
+    lw.ast = ast;
+    lw.func = func;
+    ir_init(func);
+    if (!symtab_init(&lw.names)) {
+        fprintf(stderr, "[AXIOM] Error: Out of memory lowering the program!\n");
+        return false;
+    }
+
+    lw.block = new_block(&lw);
+    lower_statement(&lw, ast->root);
+    emit(&lw, IR_HALT, IR_NONE, IR_NONE);
+
+    symtab_free(&lw.names);
+    free(lw.vars);
+    free(lw.log.items);
+    free(lw.captured.items);
+    if (lw.failed) {
+        ir_destroy(func);
+        return false;
+    }
+    return true;
+}
@@ -1,3 +1,257 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int main() { printf("Hello, World!\n"); }
+#include "cache.h"
+#include "compiler.h"
+#include "disassembler.h"
+#include "loader.h"
+#include "optimizer.h"
+#include "server.h"
+
+static char* read_file(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "[AXIOM] Error: Could not open file %s!\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (!source || fread(source, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, "[AXIOM] Error: Could not read file %s!\n", path);
+        free(source);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    source[size] = '\0';
+    *length = (size_t)size;
+    return source;
+}
+
+// Prints the generated assembly with --asm, otherwise runs the program
+static int run_program(Program* program, bool dump_asm) {
+    if (dump_asm) {
+        char* text = program_disassemble(program);
+        if (!text) {
+            return 1;
+        }
+        fputs(text, stdout);
+        free(text);
+        return 0;
+    }
+
+    VM* vm = load_program(program);
+    if (!vm) {
+        return 1;
+    }
+    VMError err = vm_run(vm);
+    vm_destroy(vm);
+    return err == VM_SUCCESS ? 0 : 1;
+}
+
+typedef enum {
+    OUTPUT_RUN,
+    OUTPUT_AST,
+    OUTPUT_IR,
+    OUTPUT_ASM,
+} OutputMode;
+
+// Compiles and runs, or dumps, one file in this process
+static int run_file(const char* path, OutputMode mode, unsigned passes,
+                    const char* cache_dir) {
+    // Only generated programs are cached; dumps always run the front end
+    ProgramCache* cache = NULL;
+    if (cache_dir && (mode == OUTPUT_RUN || mode == OUTPUT_ASM) &&
+        !(cache = program_cache_create(1, cache_dir))) {
+        fprintf(stderr, "[AXIOM] Error: Could not use cache directory %s!\n",
+                cache_dir);
+        return 1;
+    }
+
+    size_t length;
+    char* source = read_file(path, &length);
+    if (!source) {
+        program_cache_destroy(cache);
+        return 1;
+    }
+
+    static const CompileTarget TARGETS[] = {
+        [OUTPUT_RUN] = COMPILE_PROGRAM,
+        [OUTPUT_AST] = COMPILE_AST,
+        [OUTPUT_IR] = COMPILE_IR,
+        [OUTPUT_ASM] = COMPILE_PROGRAM,
+    };
+    int status;
+    CacheEntry* entry = NULL;
+    Program* program =
+        cache ? compile_cached(cache, source, length, passes, &entry, &status)
+              : compile_source(source, length, TARGETS[mode], passes, stdout,
+                               &status);
+    if (program) {
+        status = run_program(program, mode == OUTPUT_ASM);
+        if (entry) {
+            program_cache_release(cache, entry);
+        } else {
+            program_destroy(program);
+        }
+    }
+
+    program_cache_destroy(cache);
+    free(source);
+    return status;
+}
+
+// Sends the files to a server as one batch and prints their outputs in order
+static int run_client(const char* socket_path, const char** paths,
+                      uint32_t count, unsigned passes) {
+    ServerRequest* requests = calloc(count, sizeof(ServerRequest));
+    char** sources = calloc(count, sizeof(char*));
+    int status = requests && sources ? 0 : 1;
+    size_t total = 0;
+    for (uint32_t i = 0; i < count && status == 0; i++) {
+        size_t length = 0;
+        if (!(sources[i] = read_file(paths[i], &length))) {
+            status = 1;
+        } else if (length > SERVER_MAX_SOURCE) {
+            fprintf(stderr, "[AXIOM] Error: %s is too large to send!\n",
+                    paths[i]);
+            status = 1;
+        } else if ((total += length) > SERVER_MAX_BATCH_SOURCE) {
+            fprintf(stderr,
+                    "[AXIOM] Error: The files are too large to send in one "
+                    "batch!\n");
+            status = 1;
+        }
+        requests[i].passes = passes;
+        requests[i].length = (uint32_t)length;
+    }
+
+    int fd = status == 0 ? server_connect(socket_path) : -1;
+    if (status == 0 && fd < 0) {
+        fprintf(stderr, "[AXIOM] Error: Could not connect to %s!\n",
+                socket_path);
+        status = 1;
+    }
+    bool connected =
+        fd >= 0 &&
+        server_send_batch(fd, requests, (const char* const*)sources, count);
+
+    for (uint32_t i = 0; i < count && connected; i++) {
+        ServerResult result;
+        char* output;
+        if (!server_read_result(fd, &result, &output)) {
+            connected = false;
+            break;
+        }
+        fwrite(output, 1, result.output_length, stdout);
+        free(output);
+        if (result.status == SERVER_COMPILE_ERROR) {
+            fprintf(stderr, "[AXIOM] Error: %s did not compile!\n",
+                    paths[i]);
+        } else if (result.status == SERVER_RUN_ERROR &&
+                   result.error == VM_ERROR_STEP_LIMIT) {
+            fprintf(stderr,
+                    "[AXIOM] Error: %s ran past the server's step limit!\n",
+                    paths[i]);
+        } else if (result.status == SERVER_RUN_ERROR) {
+            fprintf(stderr,
+                    "[AXIOM] Error: %s stopped with VM error %d at "
+                    "instruction %d!\n",
+                    paths[i], result.error, result.ip);
+        } else if (result.status != SERVER_OK) {
+            fprintf(stderr,
+                    "[AXIOM] Error: The server ran out of memory for %s!\n",
+                    paths[i]);
+        }
+        if (result.status != SERVER_OK) {
+            status = 1;
+        }
+    }
+    if (fd >= 0 && !connected) {
+        fprintf(stderr, "[AXIOM] Error: Lost the connection to %s!\n",
+                socket_path);
+        status = 1;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    for (uint32_t i = 0; sources && i < count; i++) {
+        free(sources[i]);
+    }
+    free(sources);
+    free(requests);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    OutputMode mode = OUTPUT_RUN;
+    unsigned passes = IR_PASS_ALL;
+    const char** paths = malloc(sizeof(char*) * (size_t)argc);
+    uint32_t path_count = 0;
+    const char* cache_dir = NULL;
+    const char* serve = NULL;
+    const char* connect_to = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!paths) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ast") == 0) {
+            mode = OUTPUT_AST;
+        } else if (strcmp(argv[i], "--ir") == 0) {
+            mode = OUTPUT_IR;
+        } else if (strcmp(argv[i], "--asm") == 0) {
+            mode = OUTPUT_ASM;
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            passes = 0;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_to = argv[++i];
+        } else if (strncmp(argv[i], "--no-", 5) == 0 &&
+                   ir_pass_by_name(argv[i] + 5) != 0) {
+            passes &= ~ir_pass_by_name(argv[i] + 5);
+        } else {
+            paths[path_count++] = argv[i];
+        }
+    }
+
+    int status;
+    if (serve && path_count == 0 && threads > 0 && threads <= 1024) {
+        ServerConfig config = {.socket_path = serve,
+                               .threads = (int)threads,
+                               .cache_dir = cache_dir};
+        status = server_run(&config);
+    } else if (connect_to && path_count > 0 &&
+               path_count <= SERVER_MAX_BATCH) {
+        status = run_client(connect_to, paths, path_count, passes);
+    } else if (!serve && !connect_to && path_count == 1) {
+        status = run_file(paths[0], mode, passes, cache_dir);
+    } else {
+        fprintf(stderr,
+                "Usage: %s [--ast | --ir | --asm] [-O0] [--no-<pass>] "
+                "[--cache <dir>] <file>\n"
+                "       %s --serve <socket> [--threads <n>] "
+                "[--cache <dir>]\n"
+                "       %s --connect <socket> [-O0] [--no-<pass>] "
+                "<file>...\n"
+                "Passes: simplify, fold, copy, cse, dce, licm, strength, "
+                "unroll, evaluate\n",
+                argv[0], argv[0], argv[0]);
+        status = 1;
+    }
+
+    free(paths);
+    return status;
+}
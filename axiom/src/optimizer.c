@@ -0,0 +1,581 @@
+#include "optimizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "evaluate.h"
+#include "loops.h"
+
+// Passes feed each other (folding exposes copies, copies expose common
+// subexpressions), but each round must change something, so this bound is
+// only reached on pathological input
+#define MAX_ROUNDS 16
+
+static const struct {
+    const char* name;
+    IrPass pass;
+} PASS_NAMES[] = {
+    {"simplify", IR_PASS_SIMPLIFY}, {"fold", IR_PASS_FOLD},
+    {"copy", IR_PASS_COPY},         {"cse", IR_PASS_CSE},
+    {"dce", IR_PASS_DCE},           {"licm", IR_PASS_LICM},
+    {"strength", IR_PASS_STRENGTH}, {"unroll", IR_PASS_UNROLL},
+    {"evaluate", IR_PASS_EVALUATE},
+};
+
+unsigned ir_pass_by_name(const char* name) {
+    for (size_t i = 0; i < sizeof(PASS_NAMES) / sizeof(PASS_NAMES[0]); i++) {
+        if (strcmp(name, PASS_NAMES[i].name) == 0) {
+            return PASS_NAMES[i].pass;
+        }
+    }
+    return 0;
+}
+
+// Instructions of live blocks, skipping constants that were created while
+// the block was being filled
+#define FOR_EACH_INSTR(func, b, i)                                   \
+    for (int32_t b = 0; b < (func)->block_count; b++)                \
+        if (!(func)->blocks[b].dead)                                 \
+            for (uint32_t i = (func)->blocks[b].first;               \
+                 i < (func)->blocks[b].end; i++)                     \
+                if ((func)->instrs[i].block == b &&                  \
+                    (func)->instrs[i].op != IR_NOP)
+
+static bool is_pure(IrOp op) { return op >= IR_ADD && op <= IR_CMP; }
+
+static void make_copy(IrInstr* instr, IrValue value) {
+    instr->op = IR_COPY;
+    instr->args[0] = value;
+    instr->args[1] = IR_NONE;
+}
+
+static void make_const(IrInstr* instr, int32_t value) {
+    instr->op = IR_CONST;
+    instr->value = value;
+}
+
+// Algebraic simplification
+
+static bool power_of_two(int32_t value, int32_t* shift) {
+    if (value < 2 || (value & (value - 1)) != 0) {
+        return false;
+    }
+    *shift = 0;
+    while ((1 << *shift) != value) {
+        (*shift)++;
+    }
+    return true;
+}
+
+static bool simplify_instr(IrFunction* func, IrValue value) {
+    IrInstr* instr = ir_instr(func, value);
+    IrValue a = instr->args[0];
+    IrValue b = instr->args[1];
+    int32_t x, y;
+    bool a_const, b_const;
+
+    switch ((IrOp)instr->op) {
+        case IR_ADD:
+        case IR_MUL:
+        case IR_CMP:
+        case IR_BRANCH:
+            a_const = ir_is_const(func, a, &x);
+            b_const = ir_is_const(func, b, &y);
+            break;
+        case IR_SUB:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_SHL:
+        case IR_POW:
+            a_const = false;
+            b_const = ir_is_const(func, b, &y);
+            break;
+        default:
+            return false;
+    }
+
+    // Constants go on the right, so the rules below need only match there
+    // and equal expressions look alike to CSE
+    if (a_const && !b_const) {
+        instr->args[0] = b;
+        instr->args[1] = a;
+        if (instr->op == IR_CMP || instr->op == IR_BRANCH) {
+            instr->cond = (uint8_t)ir_swap_condition((Condition)instr->cond);
+        }
+        return true;
+    }
+
+    switch ((IrOp)instr->op) {
+        case IR_ADD:
+            if (b_const && y == 0) {
+                make_copy(instr, a);
+                return true;
+            }
+            return false;
+        case IR_SUB:
+            if (b_const && y == 0) {
+                make_copy(instr, a);
+                return true;
+            }
+            if (a == b) {
+                make_const(instr, 0);
+                return true;
+            }
+            return false;
+        case IR_MUL: {
+            int32_t shift;
+            if (b_const && y == 0) {
+                make_const(instr, 0);
+                return true;
+            }
+            if (b_const && y == 1) {
+                make_copy(instr, a);
+                return true;
+            }
+            if (b_const && power_of_two(y, &shift)) {
+                IrValue count = ir_add_const(func, shift);
+                if (count == IR_NONE) {
+                    return false;
+                }
+                instr = ir_instr(func, value);
+                instr->op = IR_SHL;
+                instr->args[1] = count;
+                return true;
+            }
+            return false;
+        }
+        case IR_DIV:
+            if (b_const && y == 1) {
+                make_copy(instr, a);
+                return true;
+            }
+            if (b_const && y == -1) {
+                instr->op = IR_MUL;
+                return true;
+            }
+            return false;
+        case IR_MOD:
+            if (b_const && (y == 1 || y == -1)) {
+                make_const(instr, 0);
+                return true;
+            }
+            return false;
+        case IR_SHL:
+            if (b_const && (y & 31) == 0) {
+                make_copy(instr, a);
+                return true;
+            }
+            return false;
+        case IR_POW:
+            if ((b_const && y == 0) || (ir_is_const(func, a, &x) && x == 1)) {
+                make_const(instr, 1);
+                return true;
+            }
+            if (b_const && y == 1) {
+                make_copy(instr, a);
+                return true;
+            }
+            if (b_const && y == 2) {
+                instr->op = IR_MUL;
+                instr->args[1] = a;
+                return true;
+            }
+            return false;
+        case IR_CMP:
+            if (a == b) {
+                Condition cond = (Condition)instr->cond;
+                make_const(instr, ir_compare(cond, 0, 0));
+                return true;
+            }
+            return false;
+        case IR_BRANCH: {
+            // Branching on a comparison against 0 tests the comparison
+            const IrInstr* compare = ir_instr(func, a);
+            if (b_const && y == 0 && compare->op == IR_CMP &&
+                (instr->cond == COND_NE || instr->cond == COND_EQ)) {
+                Condition cond = (Condition)compare->cond;
+                instr->cond = (uint8_t)(instr->cond == COND_NE
+                                            ? cond
+                                            : ir_negate_condition(cond));
+                instr->args[0] = compare->args[0];
+                instr->args[1] = compare->args[1];
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+static bool simplify(IrFunction* func) {
+    bool changed = false;
+    FOR_EACH_INSTR(func, b, i) {
+        if (simplify_instr(func, (IrValue)i)) {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Constant folding
+
+static bool fold_instr(IrFunction* func, IrValue value, bool* cfg_changed) {
+    IrInstr* instr = ir_instr(func, value);
+    IrOp op = (IrOp)instr->op;
+    int32_t x = 0;
+    int32_t y, result;
+
+    if (is_pure(op)) {
+        if (!ir_is_const(func, instr->args[0], &x) ||
+            !ir_is_const(func, instr->args[1], &y)) {
+            return false;
+        }
+        if (op == IR_CMP) {
+            make_const(instr, ir_compare((Condition)instr->cond, x, y));
+            return true;
+        }
+        if (!ir_evaluate(op, x, y, &result)) {
+            return false;  // Division by zero traps at run time
+        }
+        make_const(instr, result);
+        return true;
+    }
+
+    switch (op) {
+        case IR_COPY:
+            if (!ir_is_const(func, instr->args[0], &x)) {
+                return false;
+            }
+            make_const(instr, x);
+            return true;
+        case IR_PHI: {
+            // Every operand the same constant, apart from the phi itself
+            bool found = false;
+            const IrValue* args = ir_phi_args(func, instr);
+            for (uint32_t i = 0; i < instr->phi.count; i++) {
+                if (args[i] == value) {
+                    continue;
+                }
+                if (!ir_is_const(func, args[i], &y) || (found && y != x)) {
+                    return false;
+                }
+                x = y;
+                found = true;
+            }
+            if (!found) {
+                return false;
+            }
+            make_const(instr, x);
+            return true;
+        }
+        case IR_BRANCH: {
+            if (!ir_is_const(func, instr->args[0], &x) ||
+                !ir_is_const(func, instr->args[1], &y)) {
+                return false;
+            }
+            IrBlock* block = &func->blocks[instr->block];
+            int taken = ir_compare((Condition)instr->cond, x, y) ? 0 : 1;
+            ir_remove_edge(func, instr->block, block->succs[1 - taken],
+                           taken == 0);
+            block->succs[0] = block->succs[taken];
+            block->succ_count = 1;
+            instr->op = IR_JUMP;
+            instr->args[0] = instr->args[1] = IR_NONE;
+            *cfg_changed = true;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static bool fold(IrFunction* func, bool* ok) {
+    bool changed = false;
+    bool cfg_changed = false;
+    FOR_EACH_INSTR(func, b, i) {
+        if (fold_instr(func, (IrValue)i, &cfg_changed)) {
+            changed = true;
+        }
+    }
+    if (cfg_changed && !ir_remove_unreachable(func)) {
+        *ok = false;
+    }
+    return changed;
+}
+
+// Copy propagation
+
+static bool resolve_arg(const IrFunction* func, IrValue* arg) {
+    IrValue resolved = ir_resolve(func, *arg);
+    if (resolved == *arg) {
+        return false;
+    }
+    *arg = resolved;
+    return true;
+}
+
+// A phi whose operands are all one value or the phi itself is a copy
+static bool trivial_phi(IrFunction* func, IrValue value) {
+    IrInstr* instr = ir_instr(func, value);
+    const IrValue* args = ir_phi_args(func, instr);
+    IrValue unique = IR_NONE;
+    for (uint32_t i = 0; i < instr->phi.count; i++) {
+        if (args[i] == value || args[i] == unique) {
+            continue;
+        }
+        if (unique != IR_NONE) {
+            return false;
+        }
+        unique = args[i];
+    }
+    if (unique == IR_NONE) {
+        return false;
+    }
+    make_copy(instr, unique);
+    return true;
+}
+
+// Points every use past copies, then deletes the copies, which nothing
+// refers to any more
+static bool propagate_copies(IrFunction* func) {
+    bool changed = false;
+    bool again = true;
+    while (again) {
+        again = false;
+        FOR_EACH_INSTR(func, b, i) {
+            IrInstr* instr = &func->instrs[i];
+            if (instr->op == IR_PHI) {
+                IrValue* args = ir_phi_args(func, instr);
+                for (uint32_t j = 0; j < instr->phi.count; j++) {
+                    again |= resolve_arg(func, &args[j]);
+                }
+                again |= trivial_phi(func, (IrValue)i);
+            } else if (instr->op != IR_CONST) {
+                for (int j = 0; j < 2; j++) {
+                    if (instr->args[j] != IR_NONE &&
+                        instr->op != IR_COPY) {
+                        again |= resolve_arg(func, &instr->args[j]);
+                    }
+                }
+            }
+        }
+        changed |= again;
+    }
+
+    FOR_EACH_INSTR(func, b, i) {
+        if (func->instrs[i].op == IR_COPY) {
+            func->instrs[i].op = IR_NOP;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Common subexpression elimination
+//
+// Blocks are visited in preorder of the dominator tree. An earlier
+// instruction can stand in for a later equal one if its block dominates
+// the later one's; once preorder leaves a block's subtree, the block
+// dominates nothing after it, so its table entries can be overwritten.
+
+// Constants compare by value, so `x + 1` matches however each 1 was made
+static uint64_t operand_key(const IrFunction* func, IrValue value) {
+    int32_t constant;
+    if (ir_is_const(func, value, &constant)) {
+        return (1ull << 32) | (uint32_t)constant;
+    }
+    return (uint32_t)value;
+}
+
+static void expression_key(const IrFunction* func, const IrInstr* instr,
+                           uint64_t key[2]) {
+    key[0] = operand_key(func, instr->args[0]);
+    key[1] = operand_key(func, instr->args[1]);
+    if ((instr->op == IR_ADD || instr->op == IR_MUL) && key[0] > key[1]) {
+        uint64_t swap = key[0];
+        key[0] = key[1];
+        key[1] = swap;
+    }
+}
+
+static bool same_expression(const IrFunction* func, const IrInstr* a,
+                            const IrInstr* b) {
+    uint64_t key_a[2], key_b[2];
+    if (a->op != b->op || a->cond != b->cond) {
+        return false;
+    }
+    expression_key(func, a, key_a);
+    expression_key(func, b, key_b);
+    return key_a[0] == key_b[0] && key_a[1] == key_b[1];
+}
+
+static uint32_t hash_expression(const IrFunction* func, const IrInstr* instr) {
+    uint64_t key[2];
+    expression_key(func, instr, key);
+    uint64_t hash = ((uint64_t)instr->op << 8 | instr->cond) *
+                    0x9e3779b97f4a7c15ull;
+    hash = (hash ^ key[0]) * 0xff51afd7ed558ccdull;
+    hash = (hash ^ key[1]) * 0xc4ceb9fe1a85ec53ull;
+    return (uint32_t)(hash >> 32);
+}
+
+// Returns 1 if anything changed, 0 if not and -1 when out of memory
+static int eliminate_common(IrFunction* func) {
+    IrDominators dom;
+    if (!ir_dominators(func, &dom)) {
+        return -1;
+    }
+
+    uint32_t capacity = 16;
+    while (capacity < func->count * 2) {
+        capacity *= 2;
+    }
+    IrValue* table = malloc(sizeof(IrValue) * capacity);
+    if (!table) {
+        ir_dominators_free(&dom);
+        return -1;
+    }
+    memset(table, 0xff, sizeof(IrValue) * capacity);  // IR_NONE
+
+    int changed = 0;
+    for (int32_t v = 0; v < dom.count; v++) {
+        int32_t b = dom.visit[v];
+        const IrBlock* block = &func->blocks[b];
+        for (uint32_t i = block->first; i < block->end; i++) {
+            IrInstr* instr = &func->instrs[i];
+            if (instr->block != b || !is_pure((IrOp)instr->op)) {
+                continue;
+            }
+
+            uint32_t slot = hash_expression(func, instr) & (capacity - 1);
+            while (table[slot] != IR_NONE &&
+                   !same_expression(func, ir_instr(func, table[slot]),
+                                    instr)) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            IrValue found = table[slot];
+            if (found != IR_NONE &&
+                ir_dominates(&dom, ir_instr(func, found)->block, b)) {
+                make_copy(instr, found);
+                changed = 1;
+            } else {
+                table[slot] = (IrValue)i;
+            }
+        }
+    }
+
+    free(table);
+    ir_dominators_free(&dom);
+    return changed;
+}
+
+// Dead code elimination
+
+// Division can trap, so it stays unless the divisor is a nonzero constant
+static bool has_effect(const IrFunction* func, const IrInstr* instr) {
+    int32_t divisor;
+    switch ((IrOp)instr->op) {
+        case IR_OUTPUT:
+        case IR_WRITE:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_HALT:
+            return true;
+        case IR_DIV:
+        case IR_MOD:
+            return !ir_is_const(func, instr->args[1], &divisor) ||
+                   divisor == 0;
+        default:
+            return false;
+    }
+}
+
+static int eliminate_dead(IrFunction* func) {
+    bool* live = calloc(func->count + 1, sizeof(bool));
+    IrValue* worklist = malloc(sizeof(IrValue) * (func->count + 1));
+    if (!live || !worklist) {
+        free(live);
+        free(worklist);
+        return -1;
+    }
+
+    uint32_t pending = 0;
+    FOR_EACH_INSTR(func, b, i) {
+        if (has_effect(func, &func->instrs[i])) {
+            live[i] = true;
+            worklist[pending++] = (IrValue)i;
+        }
+    }
+    while (pending > 0) {
+        const IrInstr* instr = &func->instrs[worklist[--pending]];
+        const IrValue* args = instr->args;
+        uint32_t count = 2;
+        if (instr->op == IR_PHI) {
+            args = ir_phi_args(func, instr);
+            count = instr->phi.count;
+        } else if (instr->op == IR_CONST) {
+            count = 0;
+        }
+        for (uint32_t j = 0; j < count; j++) {
+            if (args[j] != IR_NONE && !live[args[j]]) {
+                live[args[j]] = true;
+                worklist[pending++] = args[j];
+            }
+        }
+    }
+
+    int changed = 0;
+    FOR_EACH_INSTR(func, b, i) {
+        if (!live[i] && func->instrs[i].op != IR_CONST) {
+            func->instrs[i].op = IR_NOP;
+            changed = 1;
+        }
+    }
+
+    free(live);
+    free(worklist);
+    return changed;
+}
+
+static bool optimize_scalars(IrFunction* func, unsigned passes) {
+    bool ok = true;
+    for (int round = 0; round < MAX_ROUNDS && ok; round++) {
+        bool changed = false;
+        if (passes & IR_PASS_COPY) {
+            changed |= propagate_copies(func);
+        }
+        if (passes & IR_PASS_SIMPLIFY) {
+            changed |= simplify(func);
+        }
+        if (passes & IR_PASS_FOLD) {
+            changed |= fold(func, &ok);
+        }
+        if (passes & IR_PASS_CSE) {
+            int result = eliminate_common(func);
+            ok &= result >= 0;
+            changed |= result > 0;
+        }
+        if (!changed) {
+            break;
+        }
+    }
+    return ok;
+}
+
+bool ir_optimize(IrFunction* func, unsigned passes) {
+    bool ok = optimize_scalars(func, passes);
+    if (ok && (passes & IR_PASS_EVALUATE)) {
+        int result = ir_evaluate_ahead(func);
+        ok = result >= 0 && (result == 0 || optimize_scalars(func, passes));
+    }
+    if (ok && (passes & IR_PASS_LOOPS)) {
+        int result = ir_optimize_loops(func, passes);
+        ok = result >= 0 && (result == 0 || optimize_scalars(func, passes));
+    }
+
+    if (ok && (passes & IR_PASS_DCE) && eliminate_dead(func) < 0) {
+        ok = false;
+    }
+    return ok;
+}
@@ -1,13 +1,393 @@
 #include "parser.h"
 
-void parser_init(Parser* parser, const char* str) {
-    parser->str = str;
-    parser->pos = 0;
+#include <limits.h>
+
+// Recursive descent over the token array; binary operators by precedence
+// climbing. Errors set `failed` and unwind; only the first is reported.
+typedef struct {
+    const TokenList* tokens;
+    Ast* ast;
+    uint32_t pos;
+    int depth;
+    bool failed;
+} Parser;
+
+static const TokenSpan* current(const Parser* parser) {
+    return &parser->tokens->tokens[parser->pos];
+}
+
+static TokenType current_type(const Parser* parser) {
+    return current(parser)->type;
+}
+
+// Never moves past the final TOKEN_EOF
+static uint32_t advance(Parser* parser) {
+    uint32_t token = parser->pos;
+    if (current_type(parser) != TOKEN_EOF) {
+        parser->pos++;
+    }
+    return token;
+}
+
+static void error_at(Parser* parser, const TokenSpan* token,
+                     const char* message) {
+    if (parser->failed) {
+        return;
+    }
+    parser->failed = true;
+
+    if (token->type == TOKEN_EOF) {
+        fprintf(stderr, "[AXIOM] Error: %s, but found the end of input!\n",
+                message);
+    } else {
+        fprintf(stderr, "[AXIOM] Error: %s, but found '%.*s' at %u:%u!\n",
+                message, (int)token->length,
+                parser->tokens->source + token->start, token->line,
+                token->column);
+    }
+}
+
+static bool expect(Parser* parser, TokenType type) {
+    if (current_type(parser) != type) {
+        char message[64];
+        snprintf(message, sizeof(message), "Expected %s",
+                 token_type_name(type));
+        error_at(parser, current(parser), message);
+        return false;
+    }
+    advance(parser);
+    return true;
+}
+
+static NodeIndex add_node(Parser* parser, NodeKind kind, uint32_t token) {
+    if (parser->failed) {
+        return AST_NONE;
+    }
+    NodeIndex index = ast_add_node(parser->ast, kind, token);
+    if (index == AST_NONE) {
+        fprintf(stderr, "[AXIOM] Error: Out of memory for the syntax tree!\n");
+        parser->failed = true;
+    }
+    return index;
+}
+
+// Called on the way into each nesting level; false once parsing has failed
+static bool enter(Parser* parser) {
+    if (parser->failed) {
+        return false;
+    }
+    if (++parser->depth > PARSER_MAX_DEPTH) {
+        error_at(parser, current(parser), "Nesting is too deep");
+        return false;
+    }
+    return true;
+}
+
+static NodeIndex parse_expression(Parser* parser);
+static NodeIndex parse_statement(Parser* parser);
+
+// Binding strength of a binary operator, 0 if the token is not one. `^`
+// is handled with the unary operators.
+static int binary_precedence(TokenType type) {
+    switch (type) {
+        case TOKEN_OR:
+            return 1;
+        case TOKEN_AND:
+            return 2;
+        case TOKEN_EQUAL:
+        case TOKEN_NOT_EQUAL:
+            return 3;
+        case TOKEN_GREATER:
+        case TOKEN_LESS:
+        case TOKEN_GREATER_EQUAL:
+        case TOKEN_LESS_EQUAL:
+            return 4;
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+            return 5;
+        case TOKEN_MULTIPLY:
+        case TOKEN_DIVIDE:
+        case TOKEN_MODULUS:
+            return 6;
+        default:
+            return 0;
+    }
+}
+
+static NodeIndex parse_number(Parser* parser) {
+    const TokenSpan* token = current(parser);
+    const char* text = parser->tokens->source + token->start;
+    int64_t value = 0;
+    for (uint32_t i = 0; i < token->length; i++) {
+        value = value * 10 + (text[i] - '0');
+        if (value > INT32_MAX) {
+            error_at(parser, token, "Expected a number below 2^31");
+            return AST_NONE;
+        }
+    }
+
+    NodeIndex node = add_node(parser, NODE_NUMBER, advance(parser));
+    if (node != AST_NONE) {
+        ast_node(parser->ast, node)->value = (int32_t)value;
+    }
+    return node;
+}
+
+// primary := number | name | '(' expression ')'
+static NodeIndex parse_primary(Parser* parser) {
+    switch (current_type(parser)) {
+        case TOKEN_NUMBER:
+            return parse_number(parser);
+        case TOKEN_IDENTIFIER:
+            return add_node(parser, NODE_NAME, advance(parser));
+        case TOKEN_LPAREN: {
+            advance(parser);
+            NodeIndex inner = parse_expression(parser);
+            if (!expect(parser, TOKEN_RPAREN)) {
+                return AST_NONE;
+            }
+            return inner;
+        }
+        default:
+            error_at(parser, current(parser), "Expected an expression");
+            return AST_NONE;
+    }
+}
+
+// unary := ('-' | '!') unary | primary ['^' unary]
+//
+// `^` is right associative and binds tighter than negation, so -2^2 is -4
+// and 2^3^2 is 2^9.
+static NodeIndex parse_unary(Parser* parser) {
+    if (!enter(parser)) {
+        return AST_NONE;
+    }
+
+    NodeIndex node;
+    TokenType type = current_type(parser);
+    if (type == TOKEN_MINUS || type == TOKEN_NOT) {
+        uint32_t token = advance(parser);
+        NodeIndex operand = parse_unary(parser);
+        node = add_node(parser, NODE_UNARY, token);
+        if (node != AST_NONE) {
+            ast_node(parser->ast, node)->op = (uint8_t)type;
+            ast_node(parser->ast, node)->lhs = operand;
+        }
+    } else {
+        node = parse_primary(parser);
+        if (current_type(parser) == TOKEN_EXPONENT) {
+            uint32_t token = advance(parser);
+            NodeIndex exponent = parse_unary(parser);
+            NodeIndex base = node;
+            node = add_node(parser, NODE_BINARY, token);
+            if (node != AST_NONE) {
+                ast_node(parser->ast, node)->op = TOKEN_EXPONENT;
+                ast_node(parser->ast, node)->lhs = base;
+                ast_node(parser->ast, node)->rhs = exponent;
+            }
+        }
+    }
+
+    parser->depth--;
+    return node;
 }
 
-bool is_end_of_line(Parser* parser) {
-    return parser->str[parser->pos] == '\0' ||
-           parser->str[parser->pos] == '\n' || parser->str[parser->pos] == ';';
+// Operators of the same precedence associate to the left
+static NodeIndex parse_binary(Parser* parser, int min_precedence) {
+    NodeIndex lhs = parse_unary(parser);
+    while (!parser->failed) {
+        TokenType type = current_type(parser);
+        int precedence = binary_precedence(type);
+        if (precedence < min_precedence || precedence == 0) {
+            break;
+        }
+
+        uint32_t token = advance(parser);
+        NodeIndex rhs = parse_binary(parser, precedence + 1);
+        NodeIndex node = add_node(parser, NODE_BINARY, token);
+        if (node == AST_NONE) {
+            break;
+        }
+        ast_node(parser->ast, node)->op = (uint8_t)type;
+        ast_node(parser->ast, node)->lhs = lhs;
+        ast_node(parser->ast, node)->rhs = rhs;
+        lhs = node;
+    }
+    return parser->failed ? AST_NONE : lhs;
+}
+
+static NodeIndex parse_expression(Parser* parser) {
+    if (!enter(parser)) {
+        return AST_NONE;
+    }
+    NodeIndex node = parse_binary(parser, 1);
+    parser->depth--;
+    return node;
+}
+
+// Statements up to `end`, linked through `next`; returns the first
+static NodeIndex parse_statements(Parser* parser, TokenType end) {
+    NodeIndex first = AST_NONE;
+    NodeIndex last = AST_NONE;
+    while (!parser->failed && current_type(parser) != end &&
+           current_type(parser) != TOKEN_EOF) {
+        NodeIndex statement = parse_statement(parser);
+        if (statement == AST_NONE) {
+            break;
+        }
+        if (last == AST_NONE) {
+            first = statement;
+        } else {
+            ast_node(parser->ast, last)->next = statement;
+        }
+        last = statement;
+    }
+    return first;
+}
+
+// '(' expression ')' after if and while
+static NodeIndex parse_parenthesized(Parser* parser) {
+    if (!expect(parser, TOKEN_LPAREN)) {
+        return AST_NONE;
+    }
+    NodeIndex condition = parse_expression(parser);
+    if (!expect(parser, TOKEN_RPAREN)) {
+        return AST_NONE;
+    }
+    return condition;
 }
 
-bool parse_keyword(Parser* parser, TokenType expected) {}
+static NodeIndex parse_if(Parser* parser) {
+    uint32_t token = advance(parser);
+    NodeIndex condition = parse_parenthesized(parser);
+    NodeIndex then_branch = parse_statement(parser);
+    NodeIndex else_branch = AST_NONE;
+    if (!parser->failed && current_type(parser) == TOKEN_ELSE) {
+        advance(parser);
+        else_branch = parse_statement(parser);
+    }
+
+    NodeIndex node = add_node(parser, NODE_IF, token);
+    if (node != AST_NONE) {
+        Node* n = ast_node(parser->ast, node);
+        n->lhs = condition;
+        n->rhs = then_branch;
+        n->extra = else_branch;
+    }
+    return node;
+}
+
+static NodeIndex parse_while(Parser* parser) {
+    uint32_t token = advance(parser);
+    NodeIndex condition = parse_parenthesized(parser);
+    NodeIndex body = parse_statement(parser);
+
+    NodeIndex node = add_node(parser, NODE_WHILE, token);
+    if (node != AST_NONE) {
+        ast_node(parser->ast, node)->lhs = condition;
+        ast_node(parser->ast, node)->rhs = body;
+    }
+    return node;
+}
+
+// var name [= expression] ; and name = expression ;
+static NodeIndex parse_binding(Parser* parser, NodeKind kind) {
+    if (kind == NODE_VAR) {
+        advance(parser);
+    }
+    uint32_t name = parser->pos;
+    if (!expect(parser, TOKEN_IDENTIFIER)) {
+        return AST_NONE;
+    }
+
+    NodeIndex value = AST_NONE;
+    if (kind == NODE_ASSIGN || current_type(parser) != TOKEN_SEMICOLON) {
+        if (!expect(parser, TOKEN_ASSIGN)) {
+            return AST_NONE;
+        }
+        value = parse_expression(parser);
+    }
+    if (!expect(parser, TOKEN_SEMICOLON)) {
+        return AST_NONE;
+    }
+
+    NodeIndex node = add_node(parser, kind, name);
+    if (node != AST_NONE) {
+        ast_node(parser->ast, node)->rhs = value;
+    }
+    return node;
+}
+
+static NodeIndex parse_block(Parser* parser) {
+    uint32_t token = advance(parser);
+    NodeIndex first = parse_statements(parser, TOKEN_RBRACE);
+    if (!expect(parser, TOKEN_RBRACE)) {
+        return AST_NONE;
+    }
+
+    NodeIndex node = add_node(parser, NODE_BLOCK, token);
+    if (node != AST_NONE) {
+        ast_node(parser->ast, node)->lhs = first;
+    }
+    return node;
+}
+
+static NodeIndex parse_statement(Parser* parser) {
+    if (!enter(parser)) {
+        return AST_NONE;
+    }
+
+    NodeIndex node = AST_NONE;
+    switch (current_type(parser)) {
+        case TOKEN_VAR:
+            node = parse_binding(parser, NODE_VAR);
+            break;
+        case TOKEN_IDENTIFIER:
+            node = parse_binding(parser, NODE_ASSIGN);
+            break;
+        case TOKEN_IF:
+            node = parse_if(parser);
+            break;
+        case TOKEN_WHILE:
+            node = parse_while(parser);
+            break;
+        case TOKEN_LBRACE:
+            node = parse_block(parser);
+            break;
+        case TOKEN_POUT: {
+            uint32_t token = advance(parser);
+            NodeIndex value = parse_expression(parser);
+            if (!expect(parser, TOKEN_SEMICOLON)) {
+                break;
+            }
+            node = add_node(parser, NODE_OUTPUT, token);
+            if (node != AST_NONE) {
+                ast_node(parser->ast, node)->lhs = value;
+            }
+            break;
+        }
+        default:
+            error_at(parser, current(parser), "Expected a statement");
+            break;
+    }
+
+    parser->depth--;
+    return parser->failed ? AST_NONE : node;
+}
+
+bool parse_program(const TokenList* tokens, Ast* ast) {
+    Parser parser = {tokens, ast, 0, 0, false};
+
+    NodeIndex first = parse_statements(&parser, TOKEN_EOF);
+    if (!parser.failed) {
+        expect(&parser, TOKEN_EOF);
+    }
+    NodeIndex root = add_node(&parser, NODE_BLOCK, 0);
+    if (parser.failed) {
+        return false;
+    }
+
+    ast_node(ast, root)->lhs = first;
+    ast->root = root;
+    return true;
+}
@@ -0,0 +1,495 @@
+#include "server.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "loader.h"
+
+typedef struct Batch Batch;
+
+typedef struct Job {
+    ServerRequest request;
+    char* source;
+    ServerResult result;
+    char* output;
+    size_t output_size;
+    Batch* batch;
+    struct Job* next;
+} Job;
+
+// The jobs of one batch, which its connection waits on
+struct Batch {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    uint32_t pending;
+};
+
+typedef struct Connection {
+    struct Server* server;
+    int fd;
+    struct Connection* next;
+} Connection;
+
+typedef struct Server {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;  // A job was queued, or the workers should stop
+    pthread_cond_t idle;   // The last connection closed
+    Job* head;             // Queued jobs, oldest first
+    Job* tail;
+    bool stopping;
+    Connection* connections;
+    ProgramCache* cache;
+    uint64_t max_steps;
+} Server;
+
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static bool read_all(int fd, void* buffer, size_t size) {
+    char* bytes = buffer;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+// A client that hangs up early must not kill the server with SIGPIPE
+static bool write_all(int fd, const void* buffer, size_t size) {
+    const char* bytes = buffer;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// Workers
+
+static Job* next_job(Server* server) {
+    pthread_mutex_lock(&server->lock);
+    while (!server->head && !server->stopping) {
+        pthread_cond_wait(&server->ready, &server->lock);
+    }
+    Job* job = server->head;
+    if (job) {
+        server->head = job->next;
+        if (!server->head) {
+            server->tail = NULL;
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+    return job;
+}
+
+// Runs a compiled program on the worker's VM, which is created for its
+// first program and reset for every later one. A program that does not
+// halt in time is stopped, so that its batch is answered and the server
+// can shut down.
+static void run_program(Job* job, Program* program, VM** vm,
+                        uint64_t max_steps) {
+    ServerResult* result = &job->result;
+    FILE* output = open_memstream(&job->output, &job->output_size);
+    if (!output) {
+        result->status = SERVER_OUT_OF_MEMORY;
+        return;
+    }
+
+    VMError err = VM_SUCCESS;
+    if (*vm) {
+        err = reload_program(*vm, program);
+    } else if (!(*vm = load_program(program))) {
+        result->status = SERVER_OUT_OF_MEMORY;
+        fclose(output);
+        return;
+    }
+
+    if (err == VM_SUCCESS) {
+        (*vm)->output = output;
+        (*vm)->step_limit = max_steps;
+        err = vm_run(*vm);
+        (*vm)->output = stdout;
+    }
+    fclose(output);
+
+    result->status = err == VM_SUCCESS ? SERVER_OK : SERVER_RUN_ERROR;
+    result->error = err;
+    memcpy(result->registers, (*vm)->cpu.registers,
+           sizeof(result->registers));
+    result->flags = (*vm)->cpu.flags;
+    result->ip = (*vm)->cpu.ip;
+    result->output_length = (uint32_t)job->output_size;
+}
+
+static void run_job(Server* server, Job* job, VM** vm) {
+    CacheEntry* entry;
+    int status;
+    Program* program =
+        compile_cached(server->cache, job->source, job->request.length,
+                       job->request.passes, &entry, &status);
+    if (!program) {
+        job->result.status = SERVER_COMPILE_ERROR;
+        return;
+    }
+
+    run_program(job, program, vm, server->max_steps);
+    if (entry) {
+        program_cache_release(server->cache, entry);
+    } else {
+        program_destroy(program);
+    }
+}
+
+static void* worker_main(void* arg) {
+    Server* server = arg;
+    VM* vm = NULL;
+    Job* job;
+    while ((job = next_job(server)) != NULL) {
+        run_job(server, job, &vm);
+
+        Batch* batch = job->batch;
+        pthread_mutex_lock(&batch->lock);
+        if (--batch->pending == 0) {
+            pthread_cond_signal(&batch->done);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+    vm_destroy(vm);
+    return NULL;
+}
+
+// Connections
+
+static void free_jobs(Job* jobs, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        free(jobs[i].source);
+        free(jobs[i].output);
+    }
+    free(jobs);
+}
+
+// Reads the programs of a batch. Returns false, having freed them, if the
+// client hung up or broke the protocol.
+static bool read_jobs(int fd, Job* jobs, uint32_t count, Batch* batch) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        Job* job = &jobs[i];
+        job->batch = batch;
+        if (!read_all(fd, &job->request, sizeof(job->request)) ||
+            job->request.length > SERVER_MAX_SOURCE ||
+            job->request.length > SERVER_MAX_BATCH_SOURCE - total ||
+            !(job->source = malloc(job->request.length + 1)) ||
+            !read_all(fd, job->source, job->request.length)) {
+            return false;
+        }
+        job->source[job->request.length] = '\0';
+        total += job->request.length;
+    }
+    return true;
+}
+
+// Serves one batch: queues its programs for the workers, waits for all of
+// them and writes back the results in order. Returns false once the client
+// is done or broke the protocol.
+static bool serve_batch(Server* server, int fd) {
+    uint32_t count;
+    if (!read_all(fd, &count, sizeof(count)) || count == 0 ||
+        count > SERVER_MAX_BATCH) {
+        return false;
+    }
+
+    Batch batch;
+    Job* jobs = calloc(count, sizeof(Job));
+    if (!jobs || !read_jobs(fd, jobs, count, &batch)) {
+        free_jobs(jobs, jobs ? count : 0);
+        return false;
+    }
+
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.done, NULL);
+    batch.pending = count;
+    pthread_mutex_lock(&server->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        if (server->tail) {
+            server->tail->next = &jobs[i];
+        } else {
+            server->head = &jobs[i];
+        }
+        server->tail = &jobs[i];
+    }
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_mutex_lock(&batch.lock);
+    while (batch.pending > 0) {
+        pthread_cond_wait(&batch.done, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+    pthread_cond_destroy(&batch.done);
+    pthread_mutex_destroy(&batch.lock);
+
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        ok = write_all(fd, &jobs[i].result, sizeof(ServerResult)) &&
+             write_all(fd, jobs[i].output, jobs[i].result.output_length);
+    }
+    free_jobs(jobs, count);
+    return ok;
+}
+
+static void* connection_main(void* arg) {
+    Connection* connection = arg;
+    Server* server = connection->server;
+    while (serve_batch(server, connection->fd)) {
+    }
+
+    pthread_mutex_lock(&server->lock);
+    Connection** link = &server->connections;
+    while (*link != connection) {
+        link = &(*link)->next;
+    }
+    *link = connection->next;
+    if (!server->connections) {
+        pthread_cond_signal(&server->idle);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
+
+static void accept_connection(Server* server, int fd) {
+    Connection* connection = malloc(sizeof(Connection));
+    pthread_t thread;
+    pthread_attr_t attributes;
+    if (!connection || pthread_attr_init(&attributes) != 0) {
+        free(connection);
+        close(fd);
+        return;
+    }
+    connection->server = server;
+    connection->fd = fd;
+
+    pthread_mutex_lock(&server->lock);
+    connection->next = server->connections;
+    server->connections = connection;
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attributes, connection_main, connection) !=
+        0) {
+        server->connections = connection->next;
+        close(fd);
+        free(connection);
+    }
+    pthread_mutex_unlock(&server->lock);
+    pthread_attr_destroy(&attributes);
+}
+
+// Lets batches in flight finish: connections stop reading, answer what they
+// already have and close, then the workers drain the queue and exit
+static void shut_down(Server* server, pthread_t* workers, int count) {
+    pthread_mutex_lock(&server->lock);
+    for (Connection* c = server->connections; c; c = c->next) {
+        shutdown(c->fd, SHUT_RD);
+    }
+    while (server->connections) {
+        pthread_cond_wait(&server->idle, &server->lock);
+    }
+    server->stopping = true;
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+static int listen_on(const char* path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "[AXIOM] Error: Socket path %s is too long!\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    // A socket left behind by an earlier server is replaced; anything else
+    // at the path is not touched
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 ||
+        bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "[AXIOM] Error: Could not listen on %s: %s!\n", path,
+                strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int server_run(const ServerConfig* config) {
+    Server server = {0};
+    server.max_steps = config->max_steps ? config->max_steps
+                                         : SERVER_MAX_STEPS;
+    server.cache =
+        program_cache_create(SERVER_CACHE_CAPACITY, config->cache_dir);
+    if (!server.cache) {
+        fprintf(stderr, "[AXIOM] Error: Could not create the program cache!\n");
+        return 1;
+    }
+    int listener = listen_on(config->socket_path);
+    pthread_t* workers = malloc(sizeof(pthread_t) * (size_t)config->threads);
+    if (listener < 0 || !workers) {
+        if (listener >= 0) {
+            close(listener);
+            unlink(config->socket_path);
+        }
+        free(workers);
+        program_cache_destroy(server.cache);
+        return 1;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+    pthread_cond_init(&server.idle, NULL);
+
+    // Only the accepting thread takes the stop signals, and only while it
+    // waits in pselect, so they cannot be lost between checks
+    sigset_t stop_signals;
+    sigset_t waiting;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &waiting);
+    sigdelset(&waiting, SIGINT);
+    sigdelset(&waiting, SIGTERM);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int started = 0;
+    while (started < config->threads &&
+           pthread_create(&workers[started], NULL, worker_main, &server) ==
+               0) {
+        started++;
+    }
+    int status = 0;
+    if (started == 0) {
+        fprintf(stderr, "[AXIOM] Error: Could not start any workers!\n");
+        status = 1;
+    } else {
+        fprintf(stderr, "[AXIOM] Serving on %s with %d workers\n",
+                config->socket_path, started);
+    }
+
+    while (status == 0 && !stop_requested) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listener, &readable);
+        if (pselect(listener + 1, &readable, NULL, NULL, NULL, &waiting) <=
+            0) {
+            continue;
+        }
+        int fd = accept(listener, NULL, NULL);
+        if (fd >= 0) {
+            accept_connection(&server, fd);
+        }
+    }
+
+    close(listener);
+    unlink(config->socket_path);
+    shut_down(&server, workers, started);
+    free(workers);
+    pthread_cond_destroy(&server.idle);
+    pthread_cond_destroy(&server.ready);
+    pthread_mutex_destroy(&server.lock);
+    program_cache_destroy(server.cache);
+    return status;
+}
+
+// Client
+
+int server_connect(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 &&
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+bool server_send_batch(int fd, const ServerRequest* requests,
+                       const char* const* sources, uint32_t count) {
+    if (!write_all(fd, &count, sizeof(count))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!write_all(fd, &requests[i], sizeof(ServerRequest)) ||
+            !write_all(fd, sources[i], requests[i].length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool server_read_result(int fd, ServerResult* result, char** output) {
+    *output = NULL;
+    if (!read_all(fd, result, sizeof(ServerResult)) ||
+        !(*output = malloc((size_t)result->output_length + 1))) {
+        return false;
+    }
+    (*output)[result->output_length] = '\0';
+    if (!read_all(fd, *output, result->output_length)) {
+        free(*output);
+        *output = NULL;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,1143 @@
+#include <assert.h>
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "disassembler.h"
+#include "loader.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "server.h"
+
+// The scalar passes alone, for checking the IR they leave
+#define SCALAR_PASSES (IR_PASS_ALL & ~(IR_PASS_LOOPS | IR_PASS_EVALUATE))
+
+typedef struct {
+    char* output;
+    VMError error;
+} RunResult;
+
+static Program* compile(const char* source, unsigned passes) {
+    int status;
+    Program* program = compile_source(source, strlen(source),
+                                      COMPILE_PROGRAM, passes, NULL, &status);
+    assert(program != NULL);
+    return program;
+}
+
+static RunResult run_source(const char* source, unsigned passes) {
+    Program* program = compile(source, passes);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+
+    RunResult result = {NULL, VM_SUCCESS};
+    size_t length;
+    FILE* out = open_memstream(&result.output, &length);
+    assert(out != NULL);
+    vm->output = out;
+    result.error = vm_run(vm);
+    fclose(out);
+
+    vm_destroy(vm);
+    program_destroy(program);
+    return result;
+}
+
+// The optimized IR as --ir prints it
+static char* dump_ir(const char* source, unsigned passes) {
+    char* text = NULL;
+    size_t length;
+    FILE* out = open_memstream(&text, &length);
+    assert(out != NULL);
+    int status;
+    assert(compile_source(source, strlen(source), COMPILE_IR, passes, out,
+                          &status) == NULL);
+    assert(status == 0);
+    fclose(out);
+    return text;
+}
+
+// The syntax tree as --ast prints it
+static char* dump_ast(const char* source) {
+    char* text = NULL;
+    size_t length;
+    FILE* out = open_memstream(&text, &length);
+    assert(out != NULL);
+    int status;
+    assert(compile_source(source, strlen(source), COMPILE_AST, 0, out,
+                          &status) == NULL);
+    assert(status == 0);
+    fclose(out);
+    return text;
+}
+
+// What compiling `source` reports on stderr, expecting it to fail
+static char* compile_error(const char* source) {
+    FILE* captured = tmpfile();
+    assert(captured != NULL);
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    assert(saved >= 0);
+    dup2(fileno(captured), STDERR_FILENO);
+
+    int status;
+    Program* program = compile_source(source, strlen(source),
+                                      COMPILE_PROGRAM, IR_PASS_ALL, NULL,
+                                      &status);
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    assert(program == NULL && status == 1);
+
+    long length = ftell(captured);
+    assert(length >= 0);
+    char* text = malloc((size_t)length + 1);
+    assert(text != NULL);
+    rewind(captured);
+    assert(fread(text, 1, (size_t)length, captured) == (size_t)length);
+    text[length] = '\0';
+    fclose(captured);
+    return text;
+}
+
+static void check_error(const char* source, const char* expected) {
+    char* error = compile_error(source);
+    if (strcmp(error, expected) != 0) {
+        printf("[AXIOM] Expected \"%s\" but got \"%s\" for:\n%s", expected,
+               error, source);
+    }
+    assert(strcmp(error, expected) == 0);
+    free(error);
+}
+
+// The generated program as --asm prints it
+static char* dump_asm(const char* source, unsigned passes) {
+    Program* program = compile(source, passes);
+    char* text = program_disassemble(program);
+    assert(text != NULL);
+    program_destroy(program);
+    return text;
+}
+
+// Instructions the VM executes to run `source` to the end
+static long count_steps(const char* source, unsigned passes) {
+    Program* program = compile(source, passes);
+    VM* vm = load_program(program);
+    assert(vm != NULL);
+
+    char* output = NULL;
+    size_t length;
+    FILE* out = open_memstream(&output, &length);
+    assert(out != NULL);
+    vm->output = out;
+    long steps = 0;
+    while (vm->cpu.ip >= 0 && vm->cpu.ip < vm->program_size) {
+        assert(vm_step(vm) == VM_SUCCESS);
+        steps++;
+    }
+    fclose(out);
+    free(output);
+
+    vm_destroy(vm);
+    program_destroy(program);
+    return steps;
+}
+
+static int count(const char* text, const char* needle) {
+    int found = 0;
+    for (const char* at = strstr(text, needle); at;
+         at = strstr(at + 1, needle)) {
+        found++;
+    }
+    return found;
+}
+
+// Runs `source` unoptimized, fully optimized and with each pass switched
+// off in turn, expecting `expected` and the same error every time
+static void check_program(const char* source, const char* expected,
+                          VMError error) {
+    RunResult reference = run_source(source, 0);
+    if (strcmp(reference.output, expected) != 0 ||
+        reference.error != error) {
+        printf("[AXIOM] -O0 gave \"%s\" (error %d) for:\n%s", reference.output,
+               reference.error, source);
+    }
+    assert(strcmp(reference.output, expected) == 0);
+    assert(reference.error == error);
+    free(reference.output);
+
+    for (unsigned pass = 0; pass <= IR_PASS_ALL; pass = pass ? pass << 1 : 1) {
+        RunResult result = run_source(source, IR_PASS_ALL & ~pass);
+        if (strcmp(result.output, expected) != 0 || result.error != error) {
+            printf("[AXIOM] Passes %#x gave \"%s\" (error %d) for:\n%s",
+                   IR_PASS_ALL & ~pass, result.output, result.error, source);
+        }
+        assert(strcmp(result.output, expected) == 0);
+        assert(result.error == error);
+        free(result.output);
+    }
+}
+
+// check_program, then every combination of the loop passes with the
+// evaluator off, since it would otherwise run the loops away first
+static void check_loops(const char* source, const char* expected) {
+    check_program(source, expected, VM_SUCCESS);
+    unsigned rest = IR_PASS_ALL & ~(IR_PASS_LOOPS | IR_PASS_EVALUATE);
+    unsigned loops = IR_PASS_LOOPS;
+    do {
+        RunResult result = run_source(source, rest | loops);
+        if (strcmp(result.output, expected) != 0 ||
+            result.error != VM_SUCCESS) {
+            printf("[AXIOM] Passes %#x gave \"%s\" (error %d) for:\n%s",
+                   rest | loops, result.output, result.error, source);
+        }
+        assert(strcmp(result.output, expected) == 0);
+        assert(result.error == VM_SUCCESS);
+        free(result.output);
+        loops = (loops - 1) & IR_PASS_LOOPS;  // The next subset down
+    } while (loops != IR_PASS_LOOPS);
+}
+
+// check_program for what the evaluator leaves: the same run with it and
+// without it as unoptimized, however long the output
+static void check_evaluated(const char* source, VMError error) {
+    RunResult reference = run_source(source, 0);
+    assert(reference.error == error);
+    const unsigned passes[] = {IR_PASS_ALL, IR_PASS_ALL & ~IR_PASS_EVALUATE};
+    for (int i = 0; i < 2; i++) {
+        RunResult result = run_source(source, passes[i]);
+        if (strcmp(result.output, reference.output) != 0 ||
+            result.error != error) {
+            printf("[AXIOM] Passes %#x differ from -O0 (error %d) for:\n%s",
+                   passes[i], result.error, source);
+        }
+        assert(strcmp(result.output, reference.output) == 0);
+        assert(result.error == error);
+        free(result.output);
+    }
+    free(reference.output);
+}
+
+// Lexes `source` a byte at a time, the way lex_source does without SSE2,
+// and checks that lex_source finds the same tokens at the same places.
+// Covers the names, numbers, spaces, comments and single-character
+// punctuation the generated sources below are made of.
+static void check_lexer_matches(const char* source, size_t length) {
+    TokenList list;
+    assert(lex_source(source, length, &list));
+
+    size_t next = 0;
+    uint32_t line = 1;
+    size_t line_start = 0;
+    size_t pos = 0;
+    while (true) {
+        while (pos < length && (source[pos] == ' ' ||
+                                (source[pos] >= '\t' && source[pos] <= '\r'))) {
+            if (source[pos] == '\n') {
+                line++;
+                line_start = pos + 1;
+            }
+            pos++;
+        }
+        if (pos < length && source[pos] == '#') {
+            while (pos < length && source[pos] != '\n') {
+                pos++;
+            }
+            continue;
+        }
+
+        size_t start = pos;
+        TokenType type = TOKEN_EOF;
+        if (pos == length) {
+            // The end of input token
+        } else if (isalpha((unsigned char)source[pos]) || source[pos] == '_') {
+            while (pos < length && (isalnum((unsigned char)source[pos]) ||
+                                    source[pos] == '_')) {
+                pos++;
+            }
+            type = keyword_type(source + start, pos - start);
+        } else if (isdigit((unsigned char)source[pos])) {
+            while (pos < length && isdigit((unsigned char)source[pos])) {
+                pos++;
+            }
+            type = TOKEN_NUMBER;
+        } else {
+            pos++;
+        }
+
+        assert(next < list.count);
+        const TokenSpan* token = &list.tokens[next++];
+        if (token->start != start || token->length != pos - start ||
+            token->line != line || token->column != start - line_start + 1) {
+            printf("[AXIOM] Token %zu is at %u:%u, expected %u:%zu\n",
+                   next - 1, token->line, token->column, line,
+                   start - line_start + 1);
+        }
+        assert(token->start == start);
+        assert(token->length == pos - start);
+        assert(token->line == line);
+        assert(token->column == start - line_start + 1);
+        if (type != TOKEN_EOF || start == length) {
+            assert(token->type == type);
+        }
+        if (start == length) {
+            break;
+        }
+    }
+    assert(next == list.count);
+    token_list_destroy(&list);
+}
+
+static uint32_t next_random(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Appends a run of `length` characters drawn from `chars`
+static size_t random_run(char* at, const char* chars, size_t length,
+                         uint32_t* state) {
+    size_t count = strlen(chars);
+    for (size_t i = 0; i < length; i++) {
+        at[i] = chars[next_random(state) % count];
+    }
+    return length;
+}
+
+void test_lexer() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing lexer...\n");
+
+    // Runs either side of 16 bytes, in and out of step with the source,
+    // so the vector loop stops in every lane and hands over to the tail
+    static const char NAME[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    static const char SPACE[] = "      \t\t\n\r\v\f";
+    static const char PUNCT[] = "(){};+-*/%^";
+    enum { SOURCES = 2000, MAX_SOURCE = 600 };
+    char* source = malloc(MAX_SOURCE + 80);
+    assert(source != NULL);
+    uint32_t state = 0x2545F491;
+    for (int n = 0; n < SOURCES; n++) {
+        size_t length = 0;
+        while (length < (size_t)(n % MAX_SOURCE)) {
+            char* at = source + length;
+            uint32_t run = next_random(&state) % 40 + 1;
+            switch (next_random(&state) % 5) {
+                case 0:
+                    *at = NAME[next_random(&state) % 53];
+                    length += 1 + random_run(at + 1, NAME, run - 1, &state);
+                    break;
+                case 1:
+                    length += random_run(at, "0123456789", run % 10 + 1,
+                                         &state);
+                    break;
+                case 2:
+                    length += random_run(at, SPACE, run, &state);
+                    break;
+                case 3:
+                    *at = '#';
+                    length += 1 + random_run(at + 1, " x#(", run, &state);
+                    if (next_random(&state) % 4) {
+                        source[length++] = '\n';
+                    }
+                    break;
+                default:
+                    length += random_run(at, PUNCT, run % 3 + 1, &state);
+                    break;
+            }
+        }
+        check_lexer_matches(source, length);
+    }
+    free(source);
+
+    // Lines and columns count from 1 after whitespace spanning lines,
+    // including a newline in each half of a 16-byte chunk
+    const char* spaced =
+        "var a = 1;\n"
+        "                    \n"
+        "\n"
+        "\t     \n       \r\n                 b = a;  \n"
+        "abcdefghijklmnopqrstuvwxyzabcdefghijk_0123 = b;";
+    TokenList list;
+    assert(lex_source(spaced, strlen(spaced), &list));
+    assert(list.count == 14);
+    assert(list.tokens[5].type == TOKEN_IDENTIFIER);
+    assert(list.tokens[5].line == 6 && list.tokens[5].column == 18);
+    assert(list.tokens[9].type == TOKEN_IDENTIFIER);
+    assert(list.tokens[9].length == 42);
+    assert(list.tokens[9].line == 7 && list.tokens[9].column == 1);
+    assert(list.tokens[10].type == TOKEN_ASSIGN);
+    assert(list.tokens[10].column == 44);
+    assert(list.tokens[13].type == TOKEN_EOF && list.tokens[13].line == 7);
+    token_list_destroy(&list);
+    check_lexer_matches(spaced, strlen(spaced));
+
+    // Comments run to the end of the line or the input, whatever is in them
+    const char* commented =
+        "# var x = $;\n"
+        "output 1; #                      ( $ @\n"
+        "#\n"
+        "  output 2; # no newline";
+    assert(lex_source(commented, strlen(commented), &list));
+    assert(list.count == 7);
+    assert(list.tokens[0].type == TOKEN_POUT);
+    assert(list.tokens[0].line == 2 && list.tokens[0].column == 1);
+    assert(list.tokens[3].type == TOKEN_POUT);
+    assert(list.tokens[3].line == 4 && list.tokens[3].column == 3);
+    assert(list.tokens[6].type == TOKEN_EOF && list.tokens[6].line == 4);
+    token_list_destroy(&list);
+    check_program(commented, "1\n2\n", VM_SUCCESS);
+
+    // A character that starts no token is reported where it is
+    check_error("var a = 1;\n  $",
+                "[AXIOM] Error: Unexpected character '$' at 2:3!\n");
+    check_error("output 1 & 2;\n",
+                "[AXIOM] Error: Unexpected character '&' at 1:10!\n");
+    check_error("output 1;\n                        \n                 @;",
+                "[AXIOM] Error: Unexpected character '@' at 3:18!\n");
+
+    printf("[AXIOM] Lexer test passed!\n");
+}
+
+// `output` wrapped in `depth` pairs of parentheses
+static char* nested_source(int depth) {
+    size_t length = strlen("output 1;\n") + 2 * (size_t)depth;
+    char* source = malloc(length + 1);
+    assert(source != NULL);
+    char* at = source + sprintf(source, "output ");
+    memset(at, '(', (size_t)depth);
+    at += depth;
+    *at++ = '1';
+    memset(at, ')', (size_t)depth);
+    strcpy(at + depth, ";\n");
+    return source;
+}
+
+void test_parser() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing parser...\n");
+
+    // Negation binds looser than `^`, which is right associative; the
+    // other binary operators associate to the left
+    char* tree = dump_ast(
+        "output -2 ^ 2;\n"
+        "output 2 ^ 3 ^ 2;\n"
+        "output 10 - 4 - 3;\n"
+        "output 64 / 4 / 2;\n"
+        "output 1 + 2 * 3 < 8 && !0;\n");
+    const char* expected =
+        "(block\n"
+        "  (output\n"
+        "    ('-'\n"
+        "      ('^'\n"
+        "        2\n"
+        "        2)))\n"
+        "  (output\n"
+        "    ('^'\n"
+        "      2\n"
+        "      ('^'\n"
+        "        3\n"
+        "        2)))\n"
+        "  (output\n"
+        "    ('-'\n"
+        "      ('-'\n"
+        "        10\n"
+        "        4)\n"
+        "      3))\n"
+        "  (output\n"
+        "    ('/'\n"
+        "      ('/'\n"
+        "        64\n"
+        "        4)\n"
+        "      2))\n"
+        "  (output\n"
+        "    ('&&'\n"
+        "      ('<'\n"
+        "        ('+'\n"
+        "          1\n"
+        "          ('*'\n"
+        "            2\n"
+        "            3))\n"
+        "        8)\n"
+        "      ('!'\n"
+        "        0))))\n";
+    if (strcmp(tree, expected) != 0) {
+        printf("[AXIOM] Unexpected tree:\n%s", tree);
+    }
+    assert(strcmp(tree, expected) == 0);
+    free(tree);
+    check_program(
+        "output -2 ^ 2;\n"
+        "output 2 ^ 3 ^ 2;\n"
+        "output 10 - 4 - 3;\n"
+        "output 64 / 4 / 2;\n",
+        "-4\n512\n3\n8\n", VM_SUCCESS);
+
+    // Nesting up to the limit parses, past it is an error, not a crash
+    char* source = nested_source(PARSER_MAX_DEPTH / 4);
+    check_program(source, "1\n", VM_SUCCESS);
+    free(source);
+    source = nested_source(PARSER_MAX_DEPTH);
+    char* error = compile_error(source);
+    assert(strstr(error, "[AXIOM] Error: Nesting is too deep, but found '(' "
+                         "at 1:") == error);
+    free(error);
+    free(source);
+
+    // The largest literal, then ones past it, however long
+    check_program("output 2147483647;\n", "2147483647\n", VM_SUCCESS);
+    check_error("output 2147483648;\n",
+                "[AXIOM] Error: Expected a number below 2^31, but found "
+                "'2147483648' at 1:8!\n");
+    check_error("var a = 1;\nvar b = 99999999999999999999999;\n",
+                "[AXIOM] Error: Expected a number below 2^31, but found "
+                "'99999999999999999999999' at 2:9!\n");
+
+    // Errors point at the offending token, lines and columns from 1
+    check_error("var a = 1;\n\n  var b = ;\n",
+                "[AXIOM] Error: Expected an expression, but found ';' at "
+                "3:11!\n");
+    check_error("if (1) {\n    output 1\n}\n",
+                "[AXIOM] Error: Expected ';', but found '}' at 3:1!\n");
+    check_error("while (1 {\n",
+                "[AXIOM] Error: Expected ')', but found '{' at 1:10!\n");
+    check_error("output (1 + 2",
+                "[AXIOM] Error: Expected ')', but found the end of input!\n");
+
+    printf("[AXIOM] Parser test passed!\n");
+}
+
+void test_scalar_passes() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing scalar passes...\n");
+
+    // Identities, constant expressions and branches, copies, repeated and
+    // unused subexpressions, each inside a loop so not everything folds
+    check_program(
+        "var i = 0;\n"
+        "while (i < 5) {\n"
+        "    var a = i * 3;\n"
+        "    var b = i * 3;\n"
+        "    var unused = i * 7;\n"
+        "    var c = a + 0;\n"
+        "    var d = c;\n"
+        "    output d + b * 1 - (i - i) + i * 4;\n"
+        "    i = i + 1;\n"
+        "}\n",
+        "0\n10\n20\n30\n40\n", VM_SUCCESS);
+    check_program(
+        "var x = (2 + 3) * 4 - 20 / 3 % 4;\n"
+        "if (x > 17) { output x; } else { output 0 - x; }\n"
+        "if (!(1 < 2) || 0) { output 1; }\n"
+        "output (7 == 7) + (7 != 7) * 10 + (3 >= 4) + (-5 <= -5);\n"
+        "output 2 ^ 10;\n"
+        "output -7 / 2;\n"
+        "output -7 % 2;\n",
+        "18\n2\n1024\n-3\n-1\n", VM_SUCCESS);
+    check_program(
+        "var a = 1;\n"
+        "var b = 2;\n"
+        "var n = 0;\n"
+        "while (n < 6) {\n"
+        "    var t = a;\n"
+        "    a = b;\n"
+        "    b = t + b;\n"
+        "    if (n % 2 == 0 && a > 2) { output a; } else { output b; }\n"
+        "    n = n + 1;\n"
+        "}\n",
+        "3\n5\n5\n13\n13\n34\n", VM_SUCCESS);
+
+    // Wrapping arithmetic is the VM's, whatever folds it
+    check_program(
+        "var big = 2147483647;\n"
+        "output big + 1;\n"
+        "output big * 2;\n",
+        "-2147483648\n-2\n", VM_SUCCESS);
+
+    // A division by zero traps at run time, after the output before it
+    check_program(
+        "var i = 3;\n"
+        "output i;\n"
+        "output 10 / (i - 3);\n"
+        "output 4;\n",
+        "3\n", VM_ERROR_DIVIDE_BY_ZERO);
+
+    printf("[AXIOM] Scalar passes test passed!\n");
+}
+
+void test_scalar_ir() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing scalar pass IR...\n");
+
+    // A constant expression folds into the one mov that OUT needs
+    const char* constant = "var x = 2 * 3 + 4;\noutput x;\n";
+    char* text = dump_asm(constant, IR_PASS_ALL & ~IR_PASS_EVALUATE);
+    assert(count(text, "mov ") == 1);
+    assert(strstr(text, "mov ax, 10\n") != NULL);
+    assert(count(text, "mul ") == 0 && count(text, "add ") == 0);
+    free(text);
+    text = dump_asm(constant, 0);
+    assert(count(text, "mul ") == 1 && count(text, "add ") == 1);
+    free(text);
+
+    const char* loop =
+        "var i = 0;\n"
+        "while (i < 10) {\n"
+        "    var a = i * 3;\n"
+        "    var b = i * 3;\n"
+        "    var unused = i * 7;\n"
+        "    var c = a + 0;\n"
+        "    output c + b * 1;\n"
+        "    output i * 8;\n"
+        "    i = i + 1;\n"
+        "}\n";
+    text = dump_ir(loop, SCALAR_PASSES);
+    assert(count(text, " = mul ") == 1);  // CSE, identities and DCE
+    assert(count(text, ", 0\n") == 0 && count(text, ", 1\n") == 1);
+    assert(count(text, " = shl ") == 1);  // i * 8
+    free(text);
+
+    text = dump_ir(loop, SCALAR_PASSES & ~IR_PASS_CSE);
+    assert(count(text, " = mul v") == 2);
+    free(text);
+    text = dump_ir(loop, SCALAR_PASSES & ~IR_PASS_DCE);
+    assert(count(text, " = mul ") >= 2);
+    free(text);
+    text = dump_ir(loop, SCALAR_PASSES & ~IR_PASS_SIMPLIFY);
+    assert(count(text, " = shl ") == 0);
+    free(text);
+
+    // A branch on a constant goes, and its dead side with it
+    text = dump_ir("if (1 < 2) { output 1; } else { output 2; }\n",
+                   SCALAR_PASSES);
+    assert(count(text, "branch") == 0 && count(text, "output 2") == 0);
+    free(text);
+    text = dump_ir("if (1 < 2) { output 1; } else { output 2; }\n",
+                   SCALAR_PASSES & ~IR_PASS_FOLD);
+    assert(count(text, "branch") == 1);
+    free(text);
+
+    printf("[AXIOM] Scalar pass IR test passed!\n");
+}
+
+// A loop whose value comes out after 101 trips, too many to unroll, so the
+// loop after it has an invariant that is not a constant
+static const char* INVARIANT_LOOP =
+    "var k = 0;\n"
+    "var x = 1;\n"
+    "while (k < 101) {\n"
+    "    x = x * 3 + k;\n"
+    "    k = k + 1;\n"
+    "}\n"
+    "var i = 0;\n"
+    "var s = 0;\n"
+    "while (i < 50) {\n"
+    "    s = s + i + x * x - x / 7;\n"
+    "    i = i + 1;\n"
+    "}\n"
+    "output s;\n";
+
+// Products of induction variables, counting up, down and around the test
+static const char* INDUCTION_LOOPS =
+    "var i = 2;\n"
+    "var s = 0;\n"
+    "while (i < 300) {\n"
+    "    s = s * 3 + i * 7;\n"
+    "    i = i + 3;\n"
+    "}\n"
+    "output s;\n"
+    "var j = 41;\n"
+    "while (j > -41) {\n"
+    "    s = s + j * -5;\n"
+    "    j = j - 2;\n"
+    "}\n"
+    "output s;\n"
+    "var k = 0;\n"
+    "while (k < 9) {\n"
+    "    output k * 6;\n"
+    "    k = k + 1;\n"
+    "}\n";
+
+// Trip counts of zero, one, a few, a prime, and ones unrolling divides by
+// 2, 4 or more, nested or not
+static const char* TRIP_COUNTS =
+    "var s = 0;\n"
+    "var i = 0;\n"
+    "while (i < 0) { s = s * 31 + i; i = i + 1; }\n"
+    "output s;\n"
+    "i = 5;\n"
+    "while (i < 6) { s = s * 31 + i; i = i + 1; }\n"
+    "output s;\n"
+    "i = 0;\n"
+    "while (i < 7) { s = s * 31 + i; i = i + 1; }\n"
+    "output s;\n"
+    "i = 0;\n"
+    "while (i < 97) { s = s * 31 + i; i = i + 1; }\n"
+    "output s;\n"
+    "i = 0;\n"
+    "while (i < 98) { s = s * 31 + i; i = i + 1; }\n"
+    "output s;\n"
+    "i = 3;\n"
+    "while (i <= 100) { s = s * 31 + i; i = i + 1; }\n"
+    "output s;\n"
+    "i = 60;\n"
+    "while (i != 0) { s = s * 31 + i; i = i - 5; }\n"
+    "output s;\n"
+    "var n = 0;\n"
+    "while (n < 5) {\n"
+    "    var m = 0;\n"
+    "    while (m < 6) { s = s * 31 + m * n; m = m + 1; }\n"
+    "    n = n + 1;\n"
+    "}\n"
+    "output s;\n";
+
+// Counters stepping down by one to zero, tested two ways
+static const char* COUNT_DOWN =
+    "var i = 1001;\n"
+    "var s = 0;\n"
+    "while (i > 0) {\n"
+    "    s = s + i * i;\n"
+    "    i = i - 1;\n"
+    "}\n"
+    "output s;\n"
+    "var j = 999;\n"
+    "while (j != 0) {\n"
+    "    s = s + j * j;\n"
+    "    j = j - 1;\n"
+    "}\n"
+    "output s;\n";
+
+void test_loop_passes() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing loop passes...\n");
+
+    check_loops(INVARIANT_LOOP, "-921715959\n");
+    check_loops(INDUCTION_LOOPS,
+                "711913114\n711912909\n0\n6\n12\n18\n24\n30\n36\n42\n48\n");
+    check_loops(TRIP_COUNTS,
+                "0\n5\n154686654\n227479858\n276567267\n1406580404\n"
+                "1509894550\n66885812\n");
+    check_loops(COUNT_DOWN, "334835501\n667669001\n");
+
+    // A division that would trap stays in a loop that never runs, whose
+    // divisor is invariant; one by a nonzero constant may leave
+    check_loops(
+        "var k = 0;\n"
+        "var z = 5;\n"
+        "while (k < 101) {\n"
+        "    z = z - k % 2;\n"
+        "    k = k + 1;\n"
+        "}\n"
+        "output z;\n"
+        "var i = 0;\n"
+        "while (i < z + 5) {\n"
+        "    output 100 / (z + 45);\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "var j = 0;\n"
+        "while (j < 3) {\n"
+        "    output 100 / z;\n"
+        "    j = j + 1;\n"
+        "}\n",
+        "-45\n-2\n-2\n-2\n");
+
+    printf("[AXIOM] Loop passes test passed!\n");
+}
+
+void test_loop_ir() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing loop pass IR...\n");
+
+    // Hoisted, the invariant is computed once instead of every trip
+    unsigned passes = IR_PASS_ALL & ~(IR_PASS_EVALUATE | IR_PASS_UNROLL);
+    assert(count_steps(INVARIANT_LOOP, passes) + 49 * 2 <=
+           count_steps(INVARIANT_LOOP, passes & ~IR_PASS_LICM));
+
+    // Only s * 3 is left to multiply; the rest step by additions
+    char* text = dump_ir(INDUCTION_LOOPS, passes);
+    assert(count(text, " = mul ") == 1);
+    free(text);
+    text = dump_ir(INDUCTION_LOOPS, passes & ~IR_PASS_STRENGTH);
+    assert(count(text, " = mul ") == 4);
+    free(text);
+    // The last loop's test moves onto k * 6, and k itself goes
+    text = dump_ir(INDUCTION_LOOPS, passes);
+    assert(strstr(text, ", 54, b") != NULL);
+    free(text);
+
+    // Unrolled copies repeat the body's multiplication
+    passes = IR_PASS_ALL & ~IR_PASS_EVALUATE;
+    char* unrolled = dump_ir(TRIP_COUNTS, passes);
+    char* rolled = dump_ir(TRIP_COUNTS, passes & ~IR_PASS_UNROLL);
+    assert(count(unrolled, " = mul ") > count(rolled, " = mul "));
+    assert(count(unrolled, "branch") <= count(rolled, "branch"));
+    free(unrolled);
+    free(rolled);
+    assert(count_steps(TRIP_COUNTS, passes) <
+           count_steps(TRIP_COUNTS, passes & ~IR_PASS_UNROLL));
+
+    // Stepped down to zero and tested for it, a counter takes one LOOP
+    text = dump_asm(COUNT_DOWN, passes);
+    assert(count(text, "loop ") == 2 && count(text, "cjmp ") == 0);
+    free(text);
+    text = dump_asm(COUNT_DOWN, passes & ~IR_PASS_STRENGTH);
+    assert(count(text, "loop ") == 1 && count(text, "cjmp gt") == 1);
+    free(text);
+
+    printf("[AXIOM] Loop pass IR test passed!\n");
+}
+
+void test_evaluator() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing the evaluator...\n");
+
+    // A program that halts is left as one write of everything it printed
+    const char* halting =
+        "var n = 0;\n"
+        "while (n < 20) {\n"
+        "    var m = n;\n"
+        "    while (m > 0) {\n"
+        "        if (m % 3 == 0) { output m * n; }\n"
+        "        m = m - 1;\n"
+        "    }\n"
+        "    n = n + 1;\n"
+        "}\n"
+        "output n;\n";
+    check_evaluated(halting, VM_SUCCESS);
+    char* text = dump_ir(halting, IR_PASS_ALL);
+    assert(count(text, "write ") == 1 && count(text, "halt") == 1);
+    assert(count(text, "branch") == 0 && count(text, "phi") == 0);
+    free(text);
+    text = dump_asm(halting, IR_PASS_ALL);
+    assert(count(text, "out ") == 1 && count(text, "preg ") == 0);
+    free(text);
+
+    // Out of fuel, it goes back to the last outer loop header it entered
+    // and the program goes on from there, with the values the header's
+    // phis had; the inner loop's start again from its own header
+    const char* endless =
+        "var n = 0;\n"
+        "var s = 0;\n"
+        "while (n < 1000) {\n"
+        "    var m = 0;\n"
+        "    while (m < 1000) {\n"
+        "        s = s + m * n;\n"
+        "        m = m + 1;\n"
+        "    }\n"
+        "    output s;\n"
+        "    n = n + 1;\n"
+        "}\n";
+    check_evaluated(endless, VM_SUCCESS);
+    text = dump_ir(endless, IR_PASS_ALL);
+    assert(count(text, "write ") == 1 && count(text, "branch") == 2);
+    assert(count(text, ", b0]") == 2 && count(text, "[0, b0]") == 0);
+    free(text);
+
+    // A division by zero is left to trap in the VM, after the output
+    // before it
+    const char* trap =
+        "var i = 0;\n"
+        "var d = 5;\n"
+        "while (i < 10) {\n"
+        "    output 100 / d;\n"
+        "    d = d - 1;\n"
+        "    i = i + 1;\n"
+        "}\n";
+    check_evaluated(trap, VM_ERROR_DIVIDE_BY_ZERO);
+    text = dump_ir(trap, IR_PASS_ALL);
+    assert(strstr(text, "write \"20\\n25\\n33\\n50\\n100\\n\"") != NULL);
+    assert(strstr(text, "div 100, 0") != NULL);
+    free(text);
+
+    // No more than 64 KiB of output goes in the program's data
+    const char* verbose =
+        "var i = 0;\n"
+        "while (i < 20000) {\n"
+        "    output i * 7;\n"
+        "    i = i + 1;\n"
+        "}\n";
+    check_evaluated(verbose, VM_SUCCESS);
+    text = dump_asm(verbose, IR_PASS_ALL);
+    const char* out = strstr(text, "out ax, ");
+    assert(out != NULL && count(text, "out ") == 1);
+    long written = strtol(out + strlen("out ax, "), NULL, 10);
+    assert(written > 60000 && written <= 65536);
+    assert(count(text, "preg ") == 1 && count(text, "cjmp ") == 1);
+    free(text);
+
+    printf("[AXIOM] Evaluator test passed!\n");
+}
+
+void test_register_spills() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing register spills...\n");
+
+    // Eight values live around the loop, and only five registers
+    const char* spills =
+        "var a = 1;\n"
+        "var b = 2;\n"
+        "var c = 3;\n"
+        "var d = 4;\n"
+        "var e = 5;\n"
+        "var f = 6;\n"
+        "var g = 7;\n"
+        "var h = 8;\n"
+        "var i = 0;\n"
+        "while (i < 40) {\n"
+        "    a = a + b;\n"
+        "    b = b + c;\n"
+        "    c = c + d;\n"
+        "    d = d + e;\n"
+        "    e = e + f;\n"
+        "    f = f + g;\n"
+        "    g = g + h;\n"
+        "    h = h + a;\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "output a;\n"
+        "output b;\n"
+        "output c;\n"
+        "output d;\n"
+        "output e;\n"
+        "output f;\n"
+        "output g;\n"
+        "output h;\n";
+    check_program(spills,
+                  "752359602\n-1764585947\n2049598808\n-1222725399\n"
+                  "37728733\n-762090641\n-910128635\n-1343321837\n",
+                  VM_SUCCESS);
+    char* text = dump_asm(spills, IR_PASS_ALL & ~IR_PASS_EVALUATE);
+    assert(strstr(text, "enter ") != NULL);
+    assert(strstr(text, "[bp - ") != NULL);
+    free(text);
+
+    // Spilled values swapped around a loop and held across a branch
+    check_program(
+        "var a = 1;\n"
+        "var b = 2;\n"
+        "var c = 3;\n"
+        "var d = 4;\n"
+        "var e = 5;\n"
+        "var f = 6;\n"
+        "var n = 0;\n"
+        "while (n < 9) {\n"
+        "    var t = a;\n"
+        "    a = f;\n"
+        "    f = e;\n"
+        "    e = d;\n"
+        "    d = c;\n"
+        "    c = b;\n"
+        "    b = t;\n"
+        "    if (n % 3 == 0) { output a * b + c; } else { output d - e; }\n"
+        "    n = n + 1;\n"
+        "}\n"
+        "output a + b + c + d + e + f;\n",
+        "8\n-1\n-1\n17\n-1\n-1\n8\n-1\n-1\n21\n", VM_SUCCESS);
+
+    printf("[AXIOM] Register spills test passed!\n");
+}
+
+// Sources for the server test: one that runs, one that does not compile,
+// one that traps after printing and one that never halts
+static const char* SERVER_SOURCES[] = {
+    "var i = 0;\nwhile (i < 3) { output i * 5; i = i + 1; }\n",
+    "var x = ;\n",
+    "var i = 3;\noutput i;\noutput 10 / (i - 3);\n",
+    "var i = 0;\nwhile (1) { i = i + 1; }\n",
+};
+
+static char* join_path(const char* dir, const char* name) {
+    char* path = malloc(strlen(dir) + strlen(name) + 2);
+    assert(path != NULL);
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static void write_file(const char* path, const char* text) {
+    FILE* file = fopen(path, "w");
+    assert(file != NULL);
+    fputs(text, file);
+    fclose(file);
+}
+
+// Runs the compiler as a client of the server, leaving what it prints in
+// `output`, and returns its exit status
+static int run_client(const char* socket_path, const char* files,
+                      char* output, size_t size) {
+    char command[1024];
+    snprintf(command, sizeof(command), "'%s' --connect '%s' %s 2>/dev/null",
+             AXIOM_BINARY, socket_path, files);
+    FILE* pipe = popen(command, "r");
+    assert(pipe != NULL);
+    size_t length = fread(output, 1, size - 1, pipe);
+    output[length] = '\0';
+    int status = pclose(pipe);
+    assert(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+void test_server() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing the server...\n");
+
+    char dir[] = "/tmp/axiom_test_XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    char* socket_path = join_path(dir, "server.sock");
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t server = fork();
+    assert(server >= 0);
+    if (server == 0) {
+        ServerConfig config = {.socket_path = socket_path,
+                               .threads = 2,
+                               .max_steps = 1 << 20};
+        _exit(server_run(&config));
+    }
+
+    int fd = -1;
+    for (int attempt = 0; attempt < 500 && fd < 0; attempt++) {
+        if ((fd = server_connect(socket_path)) < 0) {
+            nanosleep(&(struct timespec){0, 10 * 1000 * 1000}, NULL);
+        }
+    }
+    assert(fd >= 0);
+
+    // The first program again at the end, from the cache this time; the
+    // one that never halts is stopped at the step limit
+    const char* sources[] = {SERVER_SOURCES[0], SERVER_SOURCES[1],
+                             SERVER_SOURCES[2], SERVER_SOURCES[3],
+                             SERVER_SOURCES[0]};
+    ServerRequest requests[5];
+    for (int i = 0; i < 5; i++) {
+        requests[i].passes = i == 4 ? 0 : IR_PASS_ALL;
+        requests[i].length = (uint32_t)strlen(sources[i]);
+    }
+    assert(server_send_batch(fd, requests, sources, 5));
+
+    const ServerStatus statuses[] = {SERVER_OK, SERVER_COMPILE_ERROR,
+                                     SERVER_RUN_ERROR, SERVER_RUN_ERROR,
+                                     SERVER_OK};
+    const VMError errors[] = {VM_SUCCESS, VM_SUCCESS,
+                              VM_ERROR_DIVIDE_BY_ZERO, VM_ERROR_STEP_LIMIT,
+                              VM_SUCCESS};
+    const char* outputs[] = {"0\n5\n10\n", "", "3\n", "", "0\n5\n10\n"};
+    for (int i = 0; i < 5; i++) {
+        ServerResult result;
+        char* output;
+        assert(server_read_result(fd, &result, &output));
+        assert(result.status == (int32_t)statuses[i]);
+        assert(result.output_length == strlen(outputs[i]));
+        assert(memcmp(output, outputs[i], result.output_length) == 0);
+        if (statuses[i] != SERVER_COMPILE_ERROR) {
+            assert(result.error == (int32_t)errors[i]);
+        }
+        free(output);
+    }
+    close(fd);
+
+    // A batch whose sources add up to more than the limit is refused once
+    // the request that goes over arrives
+    fd = server_connect(socket_path);
+    assert(fd >= 0);
+    const uint32_t per_source = SERVER_MAX_SOURCE;
+    const uint32_t over = SERVER_MAX_BATCH_SOURCE / per_source + 1;
+    char* spaces = malloc(per_source);
+    assert(spaces != NULL);
+    memset(spaces, ' ', per_source);
+    const char** big = malloc(sizeof(char*) * over);
+    ServerRequest* big_requests = malloc(sizeof(ServerRequest) * over);
+    assert(big != NULL && big_requests != NULL);
+    for (uint32_t i = 0; i < over; i++) {
+        big[i] = spaces;
+        big_requests[i].passes = IR_PASS_ALL;
+        big_requests[i].length = per_source;
+    }
+    server_send_batch(fd, big_requests, big, over);
+    ServerResult refused;
+    char* refused_output;
+    assert(!server_read_result(fd, &refused, &refused_output));
+    close(fd);
+    free(big_requests);
+    free(big);
+    free(spaces);
+
+    // The compiler's own client fails the batch if any program does
+    char* paths[3];
+    const char* names[] = {"good.ax", "broken.ax", "trap.ax"};
+    for (int i = 0; i < 3; i++) {
+        paths[i] = join_path(dir, names[i]);
+        write_file(paths[i], SERVER_SOURCES[i]);
+    }
+    char files[512];
+    char output[256];
+    snprintf(files, sizeof(files), "'%s' '%s'", paths[0], paths[0]);
+    assert(run_client(socket_path, files, output, sizeof(output)) == 0);
+    assert(strcmp(output, "0\n5\n10\n0\n5\n10\n") == 0);
+    snprintf(files, sizeof(files), "'%s' '%s' '%s'", paths[0], paths[1],
+             paths[2]);
+    assert(run_client(socket_path, files, output, sizeof(output)) == 1);
+    assert(strcmp(output, "0\n5\n10\n3\n") == 0);
+    snprintf(files, sizeof(files), "'%s'", paths[2]);
+    assert(run_client(socket_path, files, output, sizeof(output)) == 1);
+
+    // Stopped, the server exits cleanly and takes its socket with it
+    assert(kill(server, SIGTERM) == 0);
+    int status;
+    assert(waitpid(server, &status, 0) == server);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(access(socket_path, F_OK) != 0);
+
+    for (int i = 0; i < 3; i++) {
+        assert(unlink(paths[i]) == 0);
+        free(paths[i]);
+    }
+    assert(rmdir(dir) == 0);
+    free(socket_path);
+
+    printf("[AXIOM] Server test passed!\n");
+}
+
+void test_pass_names() {
+    printf("\n==========================\n");
+    printf("[AXIOM] Testing pass names...\n");
+
+    const char* names[] = {"simplify", "fold",     "copy",
+                           "cse",      "dce",      "licm",
+                           "strength", "unroll",   "evaluate"};
+    unsigned all = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        unsigned pass = ir_pass_by_name(names[i]);
+        assert(pass != 0 && (pass & all) == 0);
+        all |= pass;
+    }
+    assert(all == IR_PASS_ALL);
+    assert(ir_pass_by_name("inline") == 0);
+    assert(ir_pass_by_name("") == 0);
+
+    printf("[AXIOM] Pass names test passed!\n");
+}
+
+int main() {
+    printf("[AXIOM] Starting tests...\n");
+    test_pass_names();
+    test_lexer();
+    test_parser();
+    test_scalar_passes();
+    test_scalar_ir();
+    test_loop_passes();
+    test_loop_ir();
+    test_evaluator();
+    test_register_spills();
+    test_server();
+    printf("[AXIOM] All tests passed!\n");
+    return 0;
+}